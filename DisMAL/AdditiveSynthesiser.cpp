@@ -0,0 +1,282 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "AdditiveSynthesiser.h"
+
+AdditiveSynthesiser::AdditiveSynthesiser()   : pendingChanges (false)
+{
+    sampleRate = 0;
+    maxBlockSize = 0;
+    maxNumPartials = 0;
+    paddedNumPartials = 0;
+    gain = 1;
+    numActive = 0;
+    numRendered = 0;
+    numPending = 0;
+}
+
+AdditiveSynthesiser::~AdditiveSynthesiser()
+{
+}
+
+//==============================================================================
+
+
+void AdditiveSynthesiser::prepare (double newSampleRate, int maximumBlockSize, int maximumNumPartials)
+{
+    jassert (newSampleRate > 0);            // Sample rate must be positive
+    jassert (maximumBlockSize > 0);         // Block size must be positive
+    jassert (maximumNumPartials > 0);       // The bank must hold at least one oscillator
+
+    const int laneWidth = (int) SIMDFloat::size();
+
+    sampleRate = newSampleRate;
+    maxBlockSize = jmax (1, maximumBlockSize);
+    maxNumPartials = jmax (1, maximumNumPartials);
+    paddedNumPartials = ((maxNumPartials + laneWidth - 1) / laneWidth) * laneWidth;
+
+    const int paddedBlockSize = ((maxBlockSize + laneWidth - 1) / laneWidth) * laneWidth;
+
+    // Nine oscillator arrays, the per-lane scratch buffer, the mono output buffer and room for alignment
+    storage.calloc ((size_t) (9 * paddedNumPartials + maxBlockSize * laneWidth + paddedBlockSize + laneWidth));
+
+    float* data = SIMDFloat::getNextSIMDAlignedPtr (storage.get());
+
+    bank.real = data;
+    bank.imag = bank.real + paddedNumPartials;
+    bank.cosine = bank.imag + paddedNumPartials;
+    bank.sine = bank.cosine + paddedNumPartials;
+    bank.amp = bank.sine + paddedNumPartials;
+    bank.targetAmp = bank.amp + paddedNumPartials;
+    pendingCosine = bank.targetAmp + paddedNumPartials;
+    pendingSine = pendingCosine + paddedNumPartials;
+    pendingAmp = pendingSine + paddedNumPartials;
+    laneScratch = pendingAmp + paddedNumPartials;
+    monoScratch = laneScratch + maxBlockSize * laneWidth;
+
+    // Idle oscillators have a unit phasor that doesn't rotate and zero amplitude
+    FloatVectorOperations::fill (bank.real, 1, paddedNumPartials);
+    FloatVectorOperations::fill (bank.cosine, 1, paddedNumPartials);
+
+    partialList.ensureStorageAllocated (maxNumPartials);
+
+    numActive = 0;
+    numRendered = 0;
+    numPending = 0;
+    pendingChanges = false;
+}
+
+double AdditiveSynthesiser::getSampleRate() const noexcept
+{
+    return sampleRate;
+}
+
+int AdditiveSynthesiser::getMaxNumPartials() const noexcept
+{
+    return maxNumPartials;
+}
+
+//==============================================================================
+
+
+void AdditiveSynthesiser::setDistributions (const OwnedArray<OvertoneDistribution>& distributions)
+{
+    jassert (sampleRate > 0);               // prepare must be called first
+
+    if (sampleRate <= 0)
+        return;
+
+    partialList.setDistributions (distributions);
+
+    const double nyquist = sampleRate / 2;
+    const SpinLock::ScopedLockType lock (pendingLock);
+
+    numPending = 0;
+
+    for (int i = 0; i < partialList.size() && numPending < maxNumPartials; ++i)
+    {
+        const double freq = partialList.getFreq (i);
+
+        if (freq <= 0 || freq >= nyquist)
+            continue;
+
+        const double increment = MathConstants<double>::twoPi * freq / sampleRate;
+
+        pendingCosine[numPending] = (float) std::cos (increment);
+        pendingSine[numPending] = (float) std::sin (increment);
+        pendingAmp[numPending] = partialList.getAmp (i);
+        ++numPending;
+    }
+
+    // More audible partials than the bank can hold. Call prepare with a larger maximumNumPartials.
+    jassert (partialList.size() <= maxNumPartials);
+
+    pendingChanges = true;
+}
+
+void AdditiveSynthesiser::clearDistributions()
+{
+    const SpinLock::ScopedLockType lock (pendingLock);
+
+    numPending = 0;
+    pendingChanges = true;
+}
+
+void AdditiveSynthesiser::setGain (float newGain)
+{
+    jassert (newGain >= 0);                 // Gain must not be negative
+
+    gain = jmax (0.0f, newGain);
+}
+
+float AdditiveSynthesiser::getGain() const noexcept
+{
+    return gain;
+}
+
+int AdditiveSynthesiser::getNumActiveOscillators() const noexcept
+{
+    return numActive;
+}
+
+void AdditiveSynthesiser::reset()
+{
+    if (paddedNumPartials > 0)
+    {
+        FloatVectorOperations::fill (bank.real, 1, paddedNumPartials);
+        FloatVectorOperations::clear (bank.imag, paddedNumPartials);
+    }
+}
+
+//==============================================================================
+
+
+void AdditiveSynthesiser::renderNextBlock (AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
+{
+    if (maxBlockSize == 0)
+        return;
+
+    while (numSamples > 0)
+    {
+        const int chunkSize = jmin (numSamples, maxBlockSize);
+
+        applyPendingChanges();
+        renderChunk (monoScratch, chunkSize);
+
+        for (int channel = 0; channel < outputBuffer.getNumChannels(); ++channel)
+            outputBuffer.addFrom (channel, startSample, monoScratch, chunkSize, gain);
+
+        startSample += chunkSize;
+        numSamples -= chunkSize;
+    }
+}
+
+//==============================================================================
+
+
+void AdditiveSynthesiser::applyPendingChanges() noexcept
+{
+    if (! pendingChanges)
+        return;
+
+    const SpinLock::ScopedTryLockType lock (pendingLock);
+
+    // Another thread is writing new settings. Keep playing the old ones and try again next block.
+    if (! lock.isLocked())
+        return;
+
+    if (numPending > 0)
+    {
+        FloatVectorOperations::copy (bank.cosine, pendingCosine, numPending);
+        FloatVectorOperations::copy (bank.sine, pendingSine, numPending);
+        FloatVectorOperations::copy (bank.targetAmp, pendingAmp, numPending);
+    }
+
+    // Oscillators that are no longer needed fade out over the next chunk
+    for (int i = numPending; i < numRendered; ++i)
+        bank.targetAmp[i] = 0;
+
+    numRendered = jmax (numRendered, numPending);
+    numActive = numPending;
+    pendingChanges = false;
+}
+
+void AdditiveSynthesiser::renderChunk (float* output, int numSamples) noexcept
+{
+    const int laneWidth = (int) SIMDFloat::size();
+    const int numLanes = ((numRendered + laneWidth - 1) / laneWidth) * laneWidth;
+    const float rampScale = 1.0f / (float) numSamples;
+
+    FloatVectorOperations::clear (laneScratch, numSamples * laneWidth);
+
+    // Each group of oscillators is kept in registers for the whole chunk, accumulating into one
+    // scratch lane per oscillator slot. This avoids a horizontal sum for every group and sample.
+    for (int i = 0; i < numLanes; i += laneWidth)
+    {
+        SIMDFloat real = SIMDFloat::fromRawArray (bank.real + i);
+        SIMDFloat imag = SIMDFloat::fromRawArray (bank.imag + i);
+        SIMDFloat amp = SIMDFloat::fromRawArray (bank.amp + i);
+        const SIMDFloat cosine = SIMDFloat::fromRawArray (bank.cosine + i);
+        const SIMDFloat sine = SIMDFloat::fromRawArray (bank.sine + i);
+        const SIMDFloat targetAmp = SIMDFloat::fromRawArray (bank.targetAmp + i);
+        const SIMDFloat ampIncrement = (targetAmp - amp) * rampScale;
+
+        for (int s = 0; s < numSamples; ++s)
+        {
+            const SIMDFloat rotatedReal = real * cosine - imag * sine;
+            imag = real * sine + imag * cosine;
+            real = rotatedReal;
+            amp += ampIncrement;
+
+            float* lane = laneScratch + s * laneWidth;
+            (SIMDFloat::fromRawArray (lane) + amp * imag).copyToRawArray (lane);
+        }
+
+        real.copyToRawArray (bank.real + i);
+        imag.copyToRawArray (bank.imag + i);
+        targetAmp.copyToRawArray (bank.amp + i);
+    }
+
+    for (int s = 0; s < numSamples; ++s)
+        output[s] = SIMDFloat::fromRawArray (laneScratch + s * laneWidth).sum();
+
+    normalisePhasors();
+
+    // Oscillators that have faded out are returned to their idle state
+    for (int i = numActive; i < numRendered; ++i)
+    {
+        bank.real[i] = 1;
+        bank.imag[i] = 0;
+        bank.cosine[i] = 1;
+        bank.sine[i] = 0;
+    }
+
+    numRendered = numActive;
+}
+
+void AdditiveSynthesiser::normalisePhasors() noexcept
+{
+    const int laneWidth = (int) SIMDFloat::size();
+    const int numLanes = ((numRendered + laneWidth - 1) / laneWidth) * laneWidth;
+
+    // First-order approximation of 1 / sqrt (re^2 + im^2), which is accurate for magnitudes close to 1
+    for (int i = 0; i < numLanes; i += laneWidth)
+    {
+        SIMDFloat real = SIMDFloat::fromRawArray (bank.real + i);
+        SIMDFloat imag = SIMDFloat::fromRawArray (bank.imag + i);
+        const SIMDFloat correction = SIMDFloat::expand (1.5f) - (real * real + imag * imag) * 0.5f;
+
+        (real * correction).copyToRawArray (bank.real + i);
+        (imag * correction).copyToRawArray (bank.imag + i);
+    }
+}
@@ -0,0 +1,135 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "OvertoneDistribution.h"
+#include "PartialList.h"
+
+/** An additive synthesiser for auditioning sets of overtone distributions.
+
+    Every audible partial of the distributions (including fundamentals) is rendered by one sinusoidal oscillator in a bank. Muted distributions and partials are skipped in the same way that the dissonance models skip them, so what you hear is what DisMAL analyses. Partials at or above the Nyquist frequency are also left out to prevent aliasing.
+
+    The oscillators are recursive (each one rotates a phasor by a fixed angle every sample) and are stored in SIMD-aligned arrays so that several oscillators are advanced per instruction using juce::dsp::SIMDRegister. This requires the juce_dsp module.
+
+    All memory is allocated in prepare(). setDistributions can be called from another thread while audio is being rendered: new oscillator settings are handed over to renderNextBlock without blocking or allocating on the audio thread, and amplitude changes are ramped over a block to avoid clicks.
+*/
+class AdditiveSynthesiser
+{
+public:
+    //==============================================================================
+    /** Creates an AdditiveSynthesiser object. prepare must be called before rendering. */
+    AdditiveSynthesiser();
+
+    /** Destructor. */
+    ~AdditiveSynthesiser();
+
+    //==============================================================================
+    /** Allocates the oscillator bank and scratch buffers.
+
+        This must not be called while another thread is rendering.
+
+        @param sampleRate The sample rate of the buffers that will be rendered.
+        @param maximumBlockSize The largest number of samples that will be rendered at once. Larger blocks are rendered in multiple passes.
+        @param maximumNumPartials The largest number of audible partials (including fundamentals) that can be played at once. Any further partials are ignored.
+    */
+    void prepare (double sampleRate, int maximumBlockSize, int maximumNumPartials);
+
+    /** Returns the sample rate passed to prepare. */
+    double getSampleRate() const noexcept;
+
+    /** Returns the number of oscillators the bank can hold. */
+    int getMaxNumPartials() const noexcept;
+
+    //==============================================================================
+    /** Sets the overtone distributions to be played.
+
+        The real frequencies and amplitudes of the distributions' partials are copied, so later changes to the distributions are not heard until this is called again. This allocates, so it should not be called from the audio thread.
+    */
+    void setDistributions (const OwnedArray<OvertoneDistribution>& distributions);
+
+    /** Silences all oscillators. */
+    void clearDistributions();
+
+    /** Sets a gain that is applied to the amplitudes of all partials.
+
+        Real amplitudes are used as they are, so chords with many loud partials will likely need a gain below 1 to avoid clipping.
+    */
+    void setGain (float newGain);
+
+    /** Returns the gain applied to the amplitudes of all partials. */
+    float getGain() const noexcept;
+
+    /** Returns the number of oscillators that are currently playing. */
+    int getNumActiveOscillators() const noexcept;
+
+    /** Resets the phase of every oscillator. This must not be called while another thread is rendering. */
+    void reset();
+
+    //==============================================================================
+    /** Renders the oscillator bank and adds the result to every channel of a buffer.
+
+        This does not allocate or block, so it is safe to call from the audio thread.
+
+        @param outputBuffer The buffer to add the rendered audio to.
+        @param startSample The first sample of the buffer to render into.
+        @param numSamples The number of samples to render.
+    */
+    void renderNextBlock (AudioBuffer<float>& outputBuffer, int startSample, int numSamples);
+
+private:
+    //==============================================================================
+    typedef dsp::SIMDRegister<float> SIMDFloat;
+
+    /** Pointers into the aligned bank storage, one array per oscillator property. */
+    struct OscillatorBank
+    {
+        float* real = nullptr;          /**< The real part of each oscillator's phasor. */
+        float* imag = nullptr;          /**< The imaginary part of each oscillator's phasor, which is the output sample. */
+        float* cosine = nullptr;        /**< The cosine of each oscillator's phase increment. */
+        float* sine = nullptr;          /**< The sine of each oscillator's phase increment. */
+        float* amp = nullptr;           /**< Each oscillator's current amplitude. */
+        float* targetAmp = nullptr;     /**< The amplitude that each oscillator is ramping towards. */
+    };
+
+    double sampleRate;
+    int maxBlockSize, maxNumPartials, paddedNumPartials;
+    float gain;
+
+    HeapBlock<float> storage;
+    OscillatorBank bank;
+    float* pendingCosine = nullptr;
+    float* pendingSine = nullptr;
+    float* pendingAmp = nullptr;
+    float* laneScratch = nullptr;
+    float* monoScratch = nullptr;
+
+    int numActive, numRendered, numPending;
+    std::atomic<bool> pendingChanges;
+    SpinLock pendingLock;
+
+    PartialList partialList;
+
+    //==============================================================================
+    /** Copies pending oscillator settings into the bank, if there are any and the lock can be taken. */
+    void applyPendingChanges() noexcept;
+
+    /** Renders up to maxBlockSize samples into a mono scratch buffer. */
+    void renderChunk (float* output, int numSamples) noexcept;
+
+    /** Corrects the magnitude of each phasor, which slowly drifts from 1 due to rounding errors. */
+    void normalisePhasors() noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AdditiveSynthesiser)
+};
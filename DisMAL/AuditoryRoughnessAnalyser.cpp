@@ -0,0 +1,406 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "AuditoryRoughnessAnalyser.h"
+#include "AuditoryScales.h"
+
+AuditoryRoughnessAnalyser::AuditoryRoughnessAnalyser()
+{
+    sampleRate = 0;
+    numBands = 0;
+    paddedNumBands = 0;
+    frameLength = 0;
+    frameSamples = 0;
+    frameIndex = 0;
+    calibration = 0.25f;
+    modB0 = 0;
+    modA1 = 0;
+    modA2 = 0;
+}
+
+AuditoryRoughnessAnalyser::~AuditoryRoughnessAnalyser()
+{
+}
+
+//==============================================================================
+
+
+void AuditoryRoughnessAnalyser::prepare (double newSampleRate, int newNumBands, float lowestFreq, float highestFreq, float frameSeconds)
+{
+    jassert (newSampleRate > 0 && newNumBands > 0 && lowestFreq > 0 && frameSeconds > 0);
+
+    sampleRate = newSampleRate;
+    numBands = jmax (1, newNumBands);
+    frameLength = jmax (1, roundToInt (frameSeconds * sampleRate));
+
+    const int laneWidth = (int) SIMDFloat::size();
+    paddedNumBands = ((numBands + laneWidth - 1) / laneWidth) * laneWidth;
+
+    // Every band property and the chunk of fluctuations share one aligned allocation
+    const int numArrays = 3 + 2 * numFilterStages + 2 * numModulationStages + 5;
+    storage.calloc ((size_t) (numArrays * paddedNumBands + chunkSize * paddedNumBands + laneWidth));
+
+    float* data = SIMDFloat::getNextSIMDAlignedPtr (storage.get());
+
+    auto nextArray = [&data, this]
+    {
+        float* array = data;
+        data += paddedNumBands;
+        return array;
+    };
+
+    bands.b0 = nextArray();
+    bands.a1 = nextArray();
+    bands.a2 = nextArray();
+
+    for (int stage = 0; stage < numFilterStages; ++stage)
+    {
+        bands.z1[stage] = nextArray();
+        bands.z2[stage] = nextArray();
+    }
+
+    for (int stage = 0; stage < numModulationStages; ++stage)
+    {
+        bands.modZ1[stage] = nextArray();
+        bands.modZ2[stage] = nextArray();
+    }
+
+    bands.envelopeSum = nextArray();
+    bands.fluctuationSum = nextArray();
+    bands.crossSum = nextArray();
+    bands.weight = nextArray();
+    bands.specific = nextArray();
+    fluctuations = data;
+
+    // The bands are spaced evenly on the ERB-rate scale, below the Nyquist frequency
+    const float lowestRate = AuditoryScales::hzToErbRate (lowestFreq);
+    const float highestRate = AuditoryScales::hzToErbRate (jlimit (lowestFreq, (float) (0.45 * sampleRate), highestFreq));
+
+    // The -3 dB bandwidth of a fourth-order gammatone is 0.887 ERB, and a cascade of four identical biquads is narrower than one by a factor of sqrt (2^(1/4) - 1)
+    const double cascadeNarrowing = std::sqrt (std::pow (2.0, 1.0 / numFilterStages) - 1.0);
+
+    bandFrequencies.clearQuick();
+
+    for (int b = 0; b < numBands; ++b)
+    {
+        const float rate = numBands > 1 ? lowestRate + (highestRate - lowestRate) * b / (numBands - 1) : lowestRate;
+        const float freq = AuditoryScales::erbRateToHz (rate);
+        const double stageBandwidth = 0.887 * AuditoryScales::getErb (freq) / cascadeNarrowing;
+
+        bandFrequencies.add (freq);
+        calculateBandPass (sampleRate, freq, freq / stageBandwidth, bands.b0[b], bands.a1[b], bands.a2[b]);
+
+        // Roughness is weighted most heavily between 2.5 and 12 Bark, and less towards both ends of the scale
+        const float bark = AuditoryScales::hzToBark (freq);
+
+        if (bark < 2.5f)
+            bands.weight[b] = jmax (0.0f, 0.6f + 0.4f * (bark - 0.5f) / 2.0f);
+        else if (bark <= 12.0f)
+            bands.weight[b] = 1.0f;
+        else
+            bands.weight[b] = jmax (0.6f, 1.0f - 0.4f * (bark - 12.0f) / 12.0f);
+    }
+
+    // Envelope fluctuations are weighted around 70 Hz, the modulation frequency that sounds roughest
+    calculateBandPass (sampleRate, 70.0, 0.5, modB0, modA1, modA2);
+
+    reset();
+}
+
+void AuditoryRoughnessAnalyser::reset()
+{
+    if (storage == nullptr)
+        return;
+
+    for (int stage = 0; stage < numFilterStages; ++stage)
+    {
+        FloatVectorOperations::clear (bands.z1[stage], paddedNumBands);
+        FloatVectorOperations::clear (bands.z2[stage], paddedNumBands);
+    }
+
+    for (int stage = 0; stage < numModulationStages; ++stage)
+    {
+        FloatVectorOperations::clear (bands.modZ1[stage], paddedNumBands);
+        FloatVectorOperations::clear (bands.modZ2[stage], paddedNumBands);
+    }
+
+    FloatVectorOperations::clear (bands.envelopeSum, paddedNumBands);
+    FloatVectorOperations::clear (bands.fluctuationSum, paddedNumBands);
+    FloatVectorOperations::clear (bands.crossSum, paddedNumBands);
+    FloatVectorOperations::clear (bands.specific, paddedNumBands);
+
+    frameSamples = 0;
+    frameIndex = 0;
+}
+
+int AuditoryRoughnessAnalyser::getNumBands() const noexcept
+{
+    return numBands;
+}
+
+float AuditoryRoughnessAnalyser::getBandFrequency (int band) const
+{
+    jassert (isPositiveAndBelow (band, numBands));      // The band doesn't exist
+
+    return bandFrequencies[band];
+}
+
+int AuditoryRoughnessAnalyser::getFrameLength() const noexcept
+{
+    return frameLength;
+}
+
+//==============================================================================
+
+
+void AuditoryRoughnessAnalyser::process (const float* samples, int numSamples, const FrameCallback& frameCallback)
+{
+    jassert (storage != nullptr);       // prepare must be called before processing
+
+    if (storage == nullptr)
+        return;
+
+    int position = 0;
+
+    // Chunks never cross the end of a frame, so each frame's sums only hold its own samples
+    while (position < numSamples)
+    {
+        const int numToProcess = jmin ((int) chunkSize, numSamples - position, frameLength - frameSamples);
+
+        processChunk (samples + position, numToProcess);
+        position += numToProcess;
+        frameSamples += numToProcess;
+
+        if (frameSamples == frameLength)
+        {
+            const float roughness = finishFrame();
+
+            if (frameCallback != nullptr)
+                frameCallback (frameIndex, roughness);
+
+            ++frameIndex;
+        }
+    }
+}
+
+Array<float> AuditoryRoughnessAnalyser::analyse (const float* samples, int numSamples)
+{
+    Array<float> roughness;
+
+    if (frameLength > 0)
+        roughness.ensureStorageAllocated (numSamples / frameLength);
+
+    reset();
+    process (samples, numSamples, [&roughness] (int64, float frameRoughness) { roughness.add (frameRoughness); });
+
+    return roughness;
+}
+
+float AuditoryRoughnessAnalyser::getSpecificRoughness (int band) const
+{
+    jassert (isPositiveAndBelow (band, numBands));      // The band doesn't exist
+
+    return isPositiveAndBelow (band, numBands) ? bands.specific[band] : 0.0f;
+}
+
+//==============================================================================
+
+
+void AuditoryRoughnessAnalyser::setCalibration (float newCalibration)
+{
+    jassert (newCalibration > 0);
+
+    calibration = newCalibration;
+}
+
+float AuditoryRoughnessAnalyser::getCalibration() const noexcept
+{
+    return calibration;
+}
+
+void AuditoryRoughnessAnalyser::calibrate (SpectralInterferenceModel& model)
+{
+    jassert (storage != nullptr);       // prepare must be called before calibrating
+
+    if (storage == nullptr)
+        return;
+
+    const float freqs[] = { 930.0f, 1000.0f, 1070.0f };
+    const float amps[] = { 0.5f, 1.0f, 0.5f };
+    float modelRoughness = 0;
+
+    for (int i = 0; i < 3; ++i)
+        for (int j = i + 1; j < 3; ++j)
+            modelRoughness += model.calculateRoughness (freqs[i], amps[i], freqs[j], amps[j]);
+
+    // The tone lasts for ten frames after the first, which is skipped while the filters settle
+    const int numSamples = 11 * frameLength;
+    HeapBlock<float> tone ((size_t) numSamples);
+
+    for (int s = 0; s < numSamples; ++s)
+    {
+        const double time = s / sampleRate;
+        tone[s] = (float) ((1.0 + std::cos (MathConstants<double>::twoPi * 70.0 * time)) * std::cos (MathConstants<double>::twoPi * 1000.0 * time));
+    }
+
+    const float previousCalibration = calibration;
+    calibration = 1.0f;
+
+    const Array<float> roughness = analyse (tone, numSamples);
+    float analysedRoughness = 0;
+
+    for (int frame = 1; frame < roughness.size(); ++frame)
+        analysedRoughness += roughness[frame];
+
+    analysedRoughness /= jmax (1, roughness.size() - 1);
+
+    // The filterbank doesn't reach 1 kHz, so the tone can't be analysed
+    jassert (analysedRoughness > 0);
+
+    calibration = analysedRoughness > 0 ? modelRoughness / analysedRoughness : previousCalibration;
+    reset();
+}
+
+//==============================================================================
+
+
+void AuditoryRoughnessAnalyser::processChunk (const float* samples, int numSamples) noexcept
+{
+    const int laneWidth = (int) SIMDFloat::size();
+    const SIMDFloat modB0s = SIMDFloat::expand (modB0);
+    const SIMDFloat modA1s = SIMDFloat::expand (modA1);
+    const SIMDFloat modA2s = SIMDFloat::expand (modA2);
+    const SIMDFloat zero = SIMDFloat::expand (0.0f);
+
+    // Each register holds one state of several bands, which are filtered side by side in transposed direct form II
+    for (int i = 0; i < paddedNumBands; i += laneWidth)
+    {
+        const SIMDFloat b0 = SIMDFloat::fromRawArray (bands.b0 + i);
+        const SIMDFloat a1 = SIMDFloat::fromRawArray (bands.a1 + i);
+        const SIMDFloat a2 = SIMDFloat::fromRawArray (bands.a2 + i);
+        SIMDFloat z1[numFilterStages], z2[numFilterStages], modZ1[numModulationStages], modZ2[numModulationStages];
+
+        for (int stage = 0; stage < numFilterStages; ++stage)
+        {
+            z1[stage] = SIMDFloat::fromRawArray (bands.z1[stage] + i);
+            z2[stage] = SIMDFloat::fromRawArray (bands.z2[stage] + i);
+        }
+
+        for (int stage = 0; stage < numModulationStages; ++stage)
+        {
+            modZ1[stage] = SIMDFloat::fromRawArray (bands.modZ1[stage] + i);
+            modZ2[stage] = SIMDFloat::fromRawArray (bands.modZ2[stage] + i);
+        }
+
+        SIMDFloat envelopeSum = SIMDFloat::fromRawArray (bands.envelopeSum + i);
+        SIMDFloat fluctuationSum = SIMDFloat::fromRawArray (bands.fluctuationSum + i);
+
+        for (int s = 0; s < numSamples; ++s)
+        {
+            SIMDFloat signal = SIMDFloat::expand (samples[s]);
+
+            // The band-pass biquads have no b1 coefficient, and b2 is -b0
+            for (int stage = 0; stage < numFilterStages; ++stage)
+            {
+                const SIMDFloat input = signal * b0;
+                signal = input + z1[stage];
+                z1[stage] = z2[stage] - a1 * signal;
+                z2[stage] = zero - input - a2 * signal;
+            }
+
+            signal = SIMDFloat::abs (signal);
+            envelopeSum += signal;
+
+            for (int stage = 0; stage < numModulationStages; ++stage)
+            {
+                const SIMDFloat input = signal * modB0s;
+                signal = input + modZ1[stage];
+                modZ1[stage] = modZ2[stage] - modA1s * signal;
+                modZ2[stage] = zero - input - modA2s * signal;
+            }
+
+            fluctuationSum += signal * signal;
+            signal.copyToRawArray (fluctuations + s * paddedNumBands + i);
+        }
+
+        for (int stage = 0; stage < numFilterStages; ++stage)
+        {
+            z1[stage].copyToRawArray (bands.z1[stage] + i);
+            z2[stage].copyToRawArray (bands.z2[stage] + i);
+        }
+
+        for (int stage = 0; stage < numModulationStages; ++stage)
+        {
+            modZ1[stage].copyToRawArray (bands.modZ1[stage] + i);
+            modZ2[stage].copyToRawArray (bands.modZ2[stage] + i);
+        }
+
+        envelopeSum.copyToRawArray (bands.envelopeSum + i);
+        fluctuationSum.copyToRawArray (bands.fluctuationSum + i);
+    }
+
+    // The fluctuations of each band are correlated with those of the band two above it
+    if (numBands > 2)
+        for (int s = 0; s < numSamples; ++s)
+            FloatVectorOperations::addWithMultiply (bands.crossSum, fluctuations + s * paddedNumBands, fluctuations + s * paddedNumBands + 2, numBands - 2);
+}
+
+float AuditoryRoughnessAnalyser::finishFrame() noexcept
+{
+    auto getCorrelation = [this] (int lower)
+    {
+        const float power = bands.fluctuationSum[lower] * bands.fluctuationSum[lower + 2];
+
+        return power > 0 ? jmax (0.0f, bands.crossSum[lower] / std::sqrt (power)) : 0.0f;
+    };
+
+    float roughness = 0;
+
+    for (int b = 0; b < numBands; ++b)
+    {
+        const float meanEnvelope = bands.envelopeSum[b] / frameLength;
+
+        // The modulation depth of a sinusoidally modulated envelope is its peak fluctuation over its mean
+        const float modulationDepth = meanEnvelope > 1.0e-6f ? jmin (1.0f, std::sqrt (2.0f * bands.fluctuationSum[b] / frameLength) / meanEnvelope)
+                                                             : 0.0f;
+
+        // Bands at the ends of the filterbank only have one neighbour, whose correlation is used twice
+        const bool hasLower = b >= 2;
+        const bool hasUpper = b + 2 < numBands;
+        const float lowerCorrelation = hasLower ? getCorrelation (b - 2) : (hasUpper ? getCorrelation (b) : 1.0f);
+        const float upperCorrelation = hasUpper ? getCorrelation (b) : lowerCorrelation;
+
+        const float specific = bands.weight[b] * modulationDepth * lowerCorrelation * upperCorrelation;
+        bands.specific[b] = specific * specific;
+        roughness += bands.specific[b];
+    }
+
+    FloatVectorOperations::clear (bands.envelopeSum, paddedNumBands);
+    FloatVectorOperations::clear (bands.fluctuationSum, paddedNumBands);
+    FloatVectorOperations::clear (bands.crossSum, paddedNumBands);
+    frameSamples = 0;
+
+    return calibration * roughness;
+}
+
+void AuditoryRoughnessAnalyser::calculateBandPass (double rate, double centreFreq, double q, float& b0, float& a1, float& a2) noexcept
+{
+    // Robert Bristow-Johnson's band-pass biquad, normalised so that a0 is 1
+    const double w0 = MathConstants<double>::twoPi * centreFreq / rate;
+    const double alpha = std::sin (w0) / (2.0 * q);
+    const double a0 = 1.0 + alpha;
+
+    b0 = (float) (alpha / a0);
+    a1 = (float) (-2.0 * std::cos (w0) / a0);
+    a2 = (float) ((1.0 - alpha) / a0);
+}
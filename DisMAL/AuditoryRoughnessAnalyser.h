@@ -0,0 +1,149 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceModel.h"
+
+/** Estimates the roughness of an audio signal over time, with an auditory filterbank in the style of Daniel & Weber (1997).
+
+    Unlike the spectral models, which only see the partials found by peak picking, this analyses the signal itself, so it also measures the roughness of noise and transients. The analysis has four steps:
+
+    - The signal is split into bands spaced evenly on the ERB-rate scale. Each band is a cascade of four identical band-pass biquads, which approximates a fourth-order gammatone filter with a bandwidth of one ERB.
+    - The envelope of each band is found by full-wave rectification.
+    - The envelope's fluctuations are band-pass filtered around 70 Hz, where roughness is strongest, and the modulation depth of each band is the RMS of the fluctuations relative to the mean of the envelope.
+    - The specific roughness of each band is its modulation depth weighted by its centre frequency, and by how well its fluctuations correlate with those two bands above and below it, squared. The roughness of a frame is the sum of the specific roughnesses, multiplied by a calibration factor.
+
+    The filters of several bands are processed at once with juce::dsp::SIMDRegister, and the signal is processed in short chunks, so any amount of audio can be streamed through the analyser with the memory allocated by prepare. This requires the juce_dsp module.
+
+    calibrate scales the results to match a spectral model, so that the roughness of a signal is comparable to the dissonance of its partials.
+*/
+class AuditoryRoughnessAnalyser
+{
+public:
+    //==============================================================================
+    /** Called with the roughness of each frame as it's completed. */
+    using FrameCallback = std::function<void (int64 frameIndex, float roughness)>;
+
+    //==============================================================================
+    /** Creates an AuditoryRoughnessAnalyser object. prepare must be called before processing. */
+    AuditoryRoughnessAnalyser();
+
+    /** Destructor. */
+    ~AuditoryRoughnessAnalyser();
+
+    //==============================================================================
+    /** Designs the filterbank and allocates all of the memory used for analysis.
+
+        @param sampleRate The sample rate of the signals that will be analysed.
+        @param numBands The number of auditory filters.
+        @param lowestFreq The centre frequency of the lowest filter, in Hz.
+        @param highestFreq The centre frequency of the highest filter, in Hz. This is limited to just below the Nyquist frequency.
+        @param frameSeconds The length of each frame of the roughness time series.
+    */
+    void prepare (double sampleRate, int numBands = 47, float lowestFreq = 50.0f, float highestFreq = 12000.0f, float frameSeconds = 0.1f);
+
+    /** Clears the filters and the current frame. */
+    void reset();
+
+    /** Returns the number of auditory filters. */
+    int getNumBands() const noexcept;
+
+    /** Returns the centre frequency of an auditory filter, in Hz. */
+    float getBandFrequency (int band) const;
+
+    /** Returns the number of samples in each frame. */
+    int getFrameLength() const noexcept;
+
+    //==============================================================================
+    /** Analyses a block of a signal. Blocks can be of any length, and frames can span several blocks.
+
+        This doesn't allocate, so it can be called from an audio thread.
+
+        @param samples The block's samples.
+        @param numSamples The number of samples.
+        @param frameCallback Called with the roughness of each frame completed by this block.
+    */
+    void process (const float* samples, int numSamples, const FrameCallback& frameCallback);
+
+    /** Resets the analyser and returns the roughness of every complete frame of a signal. */
+    Array<float> analyse (const float* samples, int numSamples);
+
+    /** Returns the specific roughness of a band in the last completed frame, before calibration. */
+    float getSpecificRoughness (int band) const;
+
+    //==============================================================================
+    /** Sets the factor that converts the summed specific roughnesses to roughness. The default is 0.25, as used by Daniel & Weber. */
+    void setCalibration (float newCalibration);
+
+    /** Returns the factor that converts the summed specific roughnesses to roughness. */
+    float getCalibration() const noexcept;
+
+    /** Sets the calibration so that the analyser's roughness matches a spectral model's.
+
+        The reference is Daniel & Weber's: a 1 kHz tone, fully amplitude modulated at 70 Hz, whose spectrum is three partials at 930, 1000 and 1070 Hz. The model's dissonance of these partials is matched to the analyser's roughness of the tone. This resets the analyser.
+    */
+    void calibrate (SpectralInterferenceModel& model);
+
+private:
+    //==============================================================================
+    typedef dsp::SIMDRegister<float> SIMDFloat;
+
+    enum
+    {
+        numFilterStages = 4,
+        numModulationStages = 2,
+        chunkSize = 64
+    };
+
+    /** Pointers into the aligned storage, one array per band property. */
+    struct BandArrays
+    {
+        float* b0 = nullptr;                /**< The feed-forward coefficient of each band's filter stages. The other is -b0. */
+        float* a1 = nullptr;                /**< The first feedback coefficient of each band's filter stages. */
+        float* a2 = nullptr;                /**< The second feedback coefficient of each band's filter stages. */
+        float* z1[numFilterStages] = {};
+        float* z2[numFilterStages] = {};
+        float* modZ1[numModulationStages] = {};
+        float* modZ2[numModulationStages] = {};
+        float* envelopeSum = nullptr;       /**< The sum of each band's envelope over the current frame. */
+        float* fluctuationSum = nullptr;    /**< The sum of the squared fluctuations of each band's envelope over the current frame. */
+        float* crossSum = nullptr;          /**< The sum of the products of each band's fluctuations with those of the band two above it. */
+        float* weight = nullptr;            /**< The weighting of each band by its centre frequency. */
+        float* specific = nullptr;          /**< The specific roughness of each band in the last frame. */
+    };
+
+    double sampleRate;
+    int numBands, paddedNumBands, frameLength, frameSamples;
+    int64 frameIndex;
+    float calibration;
+    float modB0, modA1, modA2;
+
+    HeapBlock<float> storage;
+    BandArrays bands;
+    float* fluctuations = nullptr;      /**< The fluctuations of every band for each sample of a chunk. */
+    Array<float> bandFrequencies;
+
+    //==============================================================================
+    /** Filters a chunk of samples through every band and adds the results to the current frame. */
+    void processChunk (const float* samples, int numSamples) noexcept;
+
+    /** Calculates the roughness of the current frame and starts a new one. */
+    float finishFrame() noexcept;
+
+    /** Calculates the coefficients of a band-pass biquad with a peak gain of 1. */
+    static void calculateBandPass (double rate, double centreFreq, double q, float& b0, float& a1, float& a2) noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AuditoryRoughnessAnalyser)
+};
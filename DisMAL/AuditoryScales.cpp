@@ -0,0 +1,42 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "AuditoryScales.h"
+
+float AuditoryScales::hzToErbRate (float freq) noexcept
+{
+    return 21.4f * std::log10 (1 + 0.00437f * freq);
+}
+
+float AuditoryScales::erbRateToHz (float erbRate) noexcept
+{
+    return (std::pow (10.0f, erbRate / 21.4f) - 1) / 0.00437f;
+}
+
+float AuditoryScales::getErb (float freq) noexcept
+{
+    return 24.7f * (0.00437f * freq + 1);
+}
+
+float AuditoryScales::hzToBark (float freq) noexcept
+{
+    return 26.81f * freq / (1960 + freq) - 0.53f;
+}
+
+float AuditoryScales::barkToHz (float bark) noexcept
+{
+    // The Bark scale approaches 26.28 as frequencies approach infinity
+    jassert (bark < 26.28f);
+
+    return 1960 * (bark + 0.53f) / (26.28f - bark);
+}
@@ -0,0 +1,40 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Conversions between frequencies in Hz and psychoacoustic frequency scales.
+
+    The ERB-rate scale counts the number of equivalent rectangular bandwidths of the auditory filters below a frequency (Glasberg & Moore, 1990). The Bark scale counts critical bands, using Traunmüller's (1990) approximation without its corrections at the ends of the scale, so that it can be inverted exactly.
+
+    Both scales space frequencies roughly linearly below 500 Hz and logarithmically above it, matching the resolution of the ear more closely than a purely logarithmic scale.
+*/
+struct AuditoryScales
+{
+    /** Returns the ERB-rate (in Cams) of a frequency in Hz. */
+    static float hzToErbRate (float freq) noexcept;
+
+    /** Returns the frequency in Hz at an ERB-rate (in Cams). */
+    static float erbRateToHz (float erbRate) noexcept;
+
+    /** Returns the equivalent rectangular bandwidth (in Hz) of the auditory filter centred on a frequency. */
+    static float getErb (float freq) noexcept;
+
+    /** Returns the critical band rate (in Bark) of a frequency in Hz. */
+    static float hzToBark (float freq) noexcept;
+
+    /** Returns the frequency in Hz at a critical band rate (in Bark). */
+    static float barkToHz (float bark) noexcept;
+};
@@ -0,0 +1,250 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "BatchEvaluator.h"
+#include "PartialList.h"
+
+BatchEvaluator::BatchEvaluator()
+{
+    spectrumOffsets.add (0);
+}
+
+BatchEvaluator::~BatchEvaluator()
+{
+}
+
+//==============================================================================
+
+
+int BatchEvaluator::addSpectrum (const OvertoneDistribution& distribution)
+{
+    auto* spectrum = spectra.add (new OvertoneDistribution (distribution));
+
+    // With a fundamental of 1 Hz at an amplitude of 1, the real frequencies and amplitudes of the partials are their ratios
+    spectrum->setFundamental (1, 1);
+
+    PartialList partials;
+    partials.addDistribution (*spectrum, spectra.size() - 1);
+
+    for (int p = 0; p < partials.size(); ++p)
+    {
+        freqRatios.add (partials.getFreq (p));
+        ampRatios.add (partials.getAmp (p));
+    }
+
+    spectrumOffsets.add (freqRatios.size());
+
+    return spectra.size() - 1;
+}
+
+int BatchEvaluator::getNumSpectra() const noexcept
+{
+    return spectra.size();
+}
+
+int BatchEvaluator::addModel (const DissonanceModel& model)
+{
+    models.add (model.cloneModel().release());
+
+    return models.size() - 1;
+}
+
+int BatchEvaluator::getNumModels() const noexcept
+{
+    return models.size();
+}
+
+void BatchEvaluator::clear()
+{
+    spectra.clear();
+    models.clear();
+    freqRatios.clear();
+    ampRatios.clear();
+    spectrumOffsets.clear();
+    spectrumOffsets.add (0);
+    workers.clear();
+}
+
+//==============================================================================
+
+
+void BatchEvaluator::evaluate (const Query* queries, int numQueries, const Voice* voices, float* results, WorkerPool* pool)
+{
+    evaluateQueries (nullptr, queries, numQueries, voices, results, pool);
+}
+
+void BatchEvaluator::evaluate (const SpectrumStore& store, const Query* queries, int numQueries, const Voice* voices, float* results, WorkerPool* pool)
+{
+    jassert (store.isAttached());
+
+    evaluateQueries (&store, queries, numQueries, voices, results, pool);
+}
+
+//==============================================================================
+
+
+void BatchEvaluator::evaluateQueries (const SpectrumStore* store, const Query* queries, int numQueries, const Voice* voices, float* results, WorkerPool* pool)
+{
+    if (numQueries <= 0)
+        return;
+
+    // Queries are grouped by model, so that each chunk of queries mostly uses a single model
+    std::vector<int> order ((size_t) numQueries);
+
+    for (int q = 0; q < numQueries; ++q)
+        order[(size_t) q] = q;
+
+    std::stable_sort (order.begin(), order.end(),
+                      [queries] (int a, int b) { return queries[a].model < queries[b].model; });
+
+    const int numWorkers = pool != nullptr ? pool->getNumWorkers() : 1;
+    workers.resize ((size_t) jmax ((int) workers.size(), numWorkers));
+
+    const int chunkSize = 32;
+    const int numChunks = (numQueries + chunkSize - 1) / chunkSize;
+
+    auto evaluateChunk = [&] (int chunk, int workerIndex)
+    {
+        WorkerState& worker = workers[(size_t) workerIndex];
+        worker.models.resize ((size_t) models.size());
+
+        const int end = jmin (numQueries, (chunk + 1) * chunkSize);
+
+        for (int i = chunk * chunkSize; i < end; ++i)
+        {
+            const int q = order[(size_t) i];
+            const Query& query = queries[q];
+
+            // This query refers to a model or spectrum that hasn't been added
+            if (! isValid (store, query, voices))
+            {
+                jassertfalse;
+                results[q] = std::numeric_limits<float>::quiet_NaN();
+                continue;
+            }
+
+            auto& model = worker.models[(size_t) query.model];
+
+            if (model == nullptr)
+                model = models[query.model]->cloneModel();
+
+            if (auto* pairwiseModel = dynamic_cast<SpectralInterferenceModel*> (model.get()))
+                results[q] = evaluatePairwise (*pairwiseModel, store, query, voices, worker);
+            else
+                results[q] = evaluateFull (*model, store, query, voices, worker);
+        }
+    };
+
+    if (pool != nullptr)
+    {
+        pool->parallelFor (numChunks, evaluateChunk);
+    }
+    else
+    {
+        for (int chunk = 0; chunk < numChunks; ++chunk)
+            evaluateChunk (chunk, 0);
+    }
+}
+
+//==============================================================================
+
+
+bool BatchEvaluator::isValid (const SpectrumStore* store, const Query& query, const Voice* voices) const
+{
+    if (! isPositiveAndBelow (query.model, models.size()) || query.numVoices < 0)
+        return false;
+
+    const int numSpectra = store != nullptr ? store->size() : spectra.size();
+
+    for (int v = query.firstVoice; v < query.firstVoice + query.numVoices; ++v)
+        if (! isPositiveAndBelow (voices[v].spectrum, numSpectra))
+            return false;
+
+    return true;
+}
+
+float BatchEvaluator::evaluatePairwise (SpectralInterferenceModel& model, const SpectrumStore* store, const Query& query, const Voice* voices, WorkerState& worker) const
+{
+    int maxNumPartials = 0;
+
+    for (int v = query.firstVoice; v < query.firstVoice + query.numVoices; ++v)
+    {
+        const int spectrum = voices[v].spectrum;
+        maxNumPartials += store != nullptr ? store->getNumPartials (spectrum) + 1
+                                           : spectrumOffsets[spectrum + 1] - spectrumOffsets[spectrum];
+    }
+
+    worker.freqs.resize (maxNumPartials);
+    worker.amps.resize (maxNumPartials);
+
+    float* freqs = worker.freqs.getRawDataPointer();
+    float* amps = worker.amps.getRawDataPointer();
+    int numPartials = 0;
+
+    // Each voice's partials are its spectrum's ratios scaled by its fundamental
+    for (int v = query.firstVoice; v < query.firstVoice + query.numVoices; ++v)
+    {
+        const Voice& voice = voices[v];
+
+        if (store == nullptr)
+        {
+            const int offset = spectrumOffsets[voice.spectrum];
+            const int size = spectrumOffsets[voice.spectrum + 1] - offset;
+
+            FloatVectorOperations::copyWithMultiply (freqs + numPartials, freqRatios.getRawDataPointer() + offset, voice.fundamentalFreq, size);
+            FloatVectorOperations::copyWithMultiply (amps + numPartials, ampRatios.getRawDataPointer() + offset, voice.fundamentalAmp, size);
+            numPartials += size;
+            continue;
+        }
+
+        // The store keeps muted partials, so they are left out here in the same way as PartialList
+        if (store->isMuted (voice.spectrum))
+            continue;
+
+        if (! store->isFundamentalMuted (voice.spectrum))
+        {
+            freqs[numPartials] = voice.fundamentalFreq;
+            amps[numPartials] = voice.fundamentalAmp;
+            ++numPartials;
+        }
+
+        const float* storeFreqRatios = store->getFreqRatios (voice.spectrum);
+        const float* storeAmpRatios = store->getAmpRatios (voice.spectrum);
+
+        for (int p = 0; p < store->getNumPartials (voice.spectrum); ++p)
+        {
+            if (store->isPartialMuted (voice.spectrum, p))
+                continue;
+
+            freqs[numPartials] = storeFreqRatios[p] * voice.fundamentalFreq;
+            amps[numPartials] = storeAmpRatios[p] * voice.fundamentalAmp;
+            ++numPartials;
+        }
+    }
+
+    return model.calculatePairwiseDissonance (freqs, amps, numPartials);
+}
+
+float BatchEvaluator::evaluateFull (DissonanceModel& model, const SpectrumStore* store, const Query& query, const Voice* voices, WorkerState& worker) const
+{
+    worker.distributions.clear();
+
+    for (int v = query.firstVoice; v < query.firstVoice + query.numVoices; ++v)
+    {
+        auto* distribution = worker.distributions.add (store != nullptr ? store->createDistribution (voices[v].spectrum)
+                                                                        : new OvertoneDistribution (*spectra[voices[v].spectrum]));
+        distribution->setFundamental (voices[v].fundamentalFreq, voices[v].fundamentalAmp);
+    }
+
+    return model.calculateDissonance (worker.distributions, false);
+}
@@ -0,0 +1,136 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceModel.h"
+#include "OvertoneDistribution.h"
+#include "SpectrumStore.h"
+#include "WorkerPool.h"
+
+/** Evaluates the dissonance of many small, unrelated chords in one call.
+
+    Setting up a DissonanceCalc for every chord copies its distributions and clones its model, which can cost more than the calculation itself. Instead, a BatchEvaluator holds a set of spectra and models that are added once and shared by every query. Each query only names a model and a range of voices, and each voice only names a spectrum and its fundamental.
+
+    Spectra are stored as flat arrays of the frequency and amplitude ratios of their audible partials, so the partials of a voice are scaled to its fundamental with vector operations. Queries are grouped by model and split between the workers of a WorkerPool, and each worker clones each model the first time it's used, rather than once per query.
+
+    SpectralInterferenceModel queries sum the roughness of every pair of partials directly from the flat arrays. Queries using other models are evaluated with copies of the spectra. Preprocessors aren't applied.
+
+    The spectra of a SpectrumStore can also be evaluated without adding them, as its arrays are already flat.
+*/
+class BatchEvaluator
+{
+public:
+    //==============================================================================
+    /** A note in a query: a spectrum at a fundamental frequency and amplitude. */
+    struct Voice
+    {
+        int spectrum;               /**< The index of the spectrum, as returned by addSpectrum. */
+        float fundamentalFreq;      /**< The frequency of the voice's fundamental, in Hz. */
+        float fundamentalAmp;       /**< The amplitude of the voice's fundamental. */
+    };
+
+    /** A chord whose dissonance is evaluated, made of consecutive voices in the array passed to evaluate. */
+    struct Query
+    {
+        int model;                  /**< The index of the model, as returned by addModel. */
+        int firstVoice;             /**< The index of the chord's first voice. */
+        int numVoices;              /**< The number of voices in the chord. */
+    };
+
+    //==============================================================================
+    /** Creates an empty BatchEvaluator object. */
+    BatchEvaluator();
+
+    /** Destructor. */
+    ~BatchEvaluator();
+
+    //==============================================================================
+    /** Adds a spectrum that queries can refer to. The distribution's fundamental is ignored, as each voice sets its own.
+
+        @return The index of the spectrum.
+    */
+    int addSpectrum (const OvertoneDistribution& distribution);
+
+    /** Returns the number of spectra. */
+    int getNumSpectra() const noexcept;
+
+    /** Adds a model that queries can refer to. The model is cloned.
+
+        @return The index of the model.
+    */
+    int addModel (const DissonanceModel& model);
+
+    /** Returns the number of models. */
+    int getNumModels() const noexcept;
+
+    /** Removes all spectra and models. */
+    void clear();
+
+    //==============================================================================
+    /** Evaluates a batch of queries.
+
+        This must not be called from more than one thread at a time.
+
+        @param queries The queries to evaluate.
+        @param numQueries The number of queries.
+        @param voices The voices that the queries refer to.
+        @param results An array of numQueries values, which is filled with the dissonance of each query in order. Queries that refer to a missing model or spectrum are given NaN.
+        @param pool If not nullptr, queries are evaluated in parallel by the pool's workers.
+    */
+    void evaluate (const Query* queries, int numQueries, const Voice* voices, float* results, WorkerPool* pool = nullptr);
+
+    /** Evaluates a batch of queries whose voices refer to the spectra of a SpectrumStore, rather than to spectra added with addSpectrum.
+
+        The partials of each voice are read directly from the store's mapped arrays, so a library of any size can be queried without copying it. Queries using models other than SpectralInterferenceModel create a distribution for each voice with SpectrumStore::createDistribution.
+
+        @param store The store that each Voice::spectrum indexes. It must stay attached until this returns.
+        @see evaluate
+    */
+    void evaluate (const SpectrumStore& store, const Query* queries, int numQueries, const Voice* voices, float* results, WorkerPool* pool = nullptr);
+
+private:
+    //==============================================================================
+    /** The models and scratch memory used by one worker. */
+    struct WorkerState
+    {
+        std::vector<std::unique_ptr<DissonanceModel>> models;
+        Array<float> freqs, amps;
+        OwnedArray<OvertoneDistribution> distributions;
+    };
+
+    OwnedArray<OvertoneDistribution> spectra;
+    OwnedArray<DissonanceModel> models;
+
+    // The ratios of every spectrum's audible partials, with spectrum s at [spectrumOffsets[s], spectrumOffsets[s + 1])
+    Array<float> freqRatios, ampRatios;
+    Array<int> spectrumOffsets;
+
+    std::vector<WorkerState> workers;
+
+    //==============================================================================
+    /** Evaluates a batch of queries, whose voices refer to the spectra of a store if it isn't nullptr, or to the added spectra otherwise. */
+    void evaluateQueries (const SpectrumStore* store, const Query* queries, int numQueries, const Voice* voices, float* results, WorkerPool* pool);
+
+    /** Returns true if every model and spectrum that a query refers to exists. */
+    bool isValid (const SpectrumStore* store, const Query& query, const Voice* voices) const;
+
+    /** Evaluates a query with a SpectralInterferenceModel, from the flat arrays of partial ratios. */
+    float evaluatePairwise (SpectralInterferenceModel& model, const SpectrumStore* store, const Query& query, const Voice* voices, WorkerState& worker) const;
+
+    /** Evaluates a query with any model, from copies of the spectra. */
+    float evaluateFull (DissonanceModel& model, const SpectrumStore* store, const Query& query, const Voice* voices, WorkerState& worker) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchEvaluator)
+};
@@ -0,0 +1,408 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "ConsonanceIndex.h"
+
+namespace
+{
+    const int consonanceIndexMagic = 0x49434d44;     // "DMCI"
+    const int consonanceIndexVersion = 1;
+}
+
+ConsonanceIndex::ConsonanceIndex()   : model (std::make_unique<SetharesModel>())
+{
+    modelName = model->getName();
+    referenceFreq = 261.63f;
+    ratioRange = Range<float> (1, 2.1f);
+    numSteps = 1200;
+}
+
+ConsonanceIndex::~ConsonanceIndex()
+{
+}
+
+//==============================================================================
+
+
+void ConsonanceIndex::setModel (DissonanceModel* newModel)
+{
+    model = newModel->cloneModel();
+    modelName = model->getName();
+}
+
+String ConsonanceIndex::getModelName() const
+{
+    return modelName;
+}
+
+void ConsonanceIndex::setReferenceFrequency (float newReferenceFreq)
+{
+    jassert (newReferenceFreq > 0);                 // Frequencies must be positive
+
+    if (newReferenceFreq > 0)
+        referenceFreq = newReferenceFreq;
+}
+
+float ConsonanceIndex::getReferenceFrequency() const noexcept
+{
+    return referenceFreq;
+}
+
+void ConsonanceIndex::setRatioRange (float lowestRatio, float highestRatio)
+{
+    jassert (lowestRatio > 0);                      // Ratios must be positive
+    jassert (highestRatio > lowestRatio);           // highestRatio must be greater than lowestRatio
+
+    if (lowestRatio > 0 && highestRatio > lowestRatio)
+        ratioRange = Range<float> (lowestRatio, highestRatio);
+}
+
+Range<float> ConsonanceIndex::getRatioRange() const noexcept
+{
+    return ratioRange;
+}
+
+void ConsonanceIndex::setNumSteps (int newNumSteps)
+{
+    jassert (newNumSteps > 2);                      // Curves need at least three points to have a minimum
+
+    numSteps = jmax (3, newNumSteps);
+}
+
+int ConsonanceIndex::getNumSteps() const noexcept
+{
+    return numSteps;
+}
+
+//==============================================================================
+
+
+void ConsonanceIndex::build (const OwnedArray<OvertoneDistribution>& timbres, WorkerPool& pool)
+{
+    clear();
+
+    modelName = model->getName();
+
+    for (auto* timbre : timbres)
+        names.add (timbre->getName());
+
+    curves.resize (timbres.size() * numSteps);
+
+    Array<Array<Minimum>> minimaOfTimbres;
+    minimaOfTimbres.resize (timbres.size());
+
+    pool.parallelFor (timbres.size(), [&] (int item, int)
+    {
+        float* curve = curves.getRawDataPointer() + item * numSteps;
+
+        calculateCurve (*timbres[item], curve);
+        findMinima (curve, item, minimaOfTimbres.getReference (item));
+    });
+
+    for (auto& minima : minimaOfTimbres)
+    {
+        firstMinimumOfTimbre.add (minimaByTimbre.size());
+        minimaByTimbre.addArray (minima);
+    }
+
+    firstMinimumOfTimbre.add (minimaByTimbre.size());
+
+    sortMinima();
+}
+
+void ConsonanceIndex::clear()
+{
+    names.clear();
+    curves.clear();
+    minimaByTimbre.clear();
+    minimaByRatio.clear();
+    firstMinimumOfTimbre.clear();
+}
+
+int ConsonanceIndex::numTimbres() const noexcept
+{
+    return names.size();
+}
+
+String ConsonanceIndex::getName (int timbreIndex) const
+{
+    return names[timbreIndex];
+}
+
+const float* ConsonanceIndex::getCurve (int timbreIndex) const
+{
+    if (curves.isEmpty() || ! isPositiveAndBelow (timbreIndex, numTimbres()))
+        return nullptr;
+
+    return curves.getRawDataPointer() + timbreIndex * numSteps;
+}
+
+float ConsonanceIndex::getRatioAtStep (float step) const
+{
+    // Matches the logarithmic steps of DissonanceCalc
+    return ratioRange.getStart() * std::pow (ratioRange.getEnd() / ratioRange.getStart(), step / numSteps);
+}
+
+Array<ConsonanceIndex::Minimum> ConsonanceIndex::getMinima (int timbreIndex) const
+{
+    Array<Minimum> minima;
+
+    if (isPositiveAndBelow (timbreIndex, numTimbres()))
+    {
+        for (int i = firstMinimumOfTimbre[timbreIndex]; i < firstMinimumOfTimbre[timbreIndex + 1]; ++i)
+            minima.add (minimaByTimbre[i]);
+    }
+
+    return minima;
+}
+
+//==============================================================================
+
+
+Array<ConsonanceIndex::Minimum> ConsonanceIndex::findMinimaNear (float ratio, float toleranceCents, float minRelativeDepth) const
+{
+    jassert (ratio > 0);                            // Ratios must be positive
+
+    Array<Minimum> matches;
+
+    if (ratio <= 0)
+        return matches;
+
+    const float lowestRatio = ratio * std::pow (2.0f, -std::abs (toleranceCents) / 1200);
+    const float highestRatio = ratio * std::pow (2.0f, std::abs (toleranceCents) / 1200);
+
+    auto* minimum = std::lower_bound (minimaByRatio.begin(), minimaByRatio.end(), lowestRatio,
+                                      [] (const Minimum& m, float r) { return m.ratio < r; });
+
+    for (; minimum != minimaByRatio.end() && minimum->ratio <= highestRatio; ++minimum)
+    {
+        if (minimum->relativeDepth >= minRelativeDepth)
+            matches.add (*minimum);
+    }
+
+    std::sort (matches.begin(), matches.end(),
+               [] (const Minimum& a, const Minimum& b) { return a.relativeDepth > b.relativeDepth; });
+
+    return matches;
+}
+
+//==============================================================================
+
+
+File ConsonanceIndex::getDefaultFileForLibrary (const File& libraryFolder)
+{
+    return libraryFolder.getChildFile ("consonance.dismalindex");
+}
+
+bool ConsonanceIndex::saveToFile (const File& file, bool includeCurves) const
+{
+    file.deleteFile();
+
+    FileOutputStream os (file);
+
+    if (! os.openedOk())
+    {
+        jassertfalse;       // Failed to create file
+        return false;
+    }
+
+    includeCurves = includeCurves && ! curves.isEmpty();
+
+    os.writeInt (consonanceIndexMagic);
+    os.writeInt (consonanceIndexVersion);
+    os.writeString (modelName);
+    os.writeFloat (referenceFreq);
+    os.writeFloat (ratioRange.getStart());
+    os.writeFloat (ratioRange.getEnd());
+    os.writeInt (numSteps);
+    os.writeInt (numTimbres());
+    os.writeBool (includeCurves);
+
+    for (int t = 0; t < numTimbres(); ++t)
+    {
+        os.writeString (names[t]);
+        os.writeInt (firstMinimumOfTimbre[t + 1] - firstMinimumOfTimbre[t]);
+
+        for (int i = firstMinimumOfTimbre[t]; i < firstMinimumOfTimbre[t + 1]; ++i)
+        {
+            os.writeFloat (minimaByTimbre[i].ratio);
+            os.writeFloat (minimaByTimbre[i].dissonance);
+            os.writeFloat (minimaByTimbre[i].depth);
+            os.writeFloat (minimaByTimbre[i].relativeDepth);
+        }
+    }
+
+    if (includeCurves)
+        os.write (curves.getRawDataPointer(), sizeof (float) * (size_t) curves.size());
+
+    os.flush();
+
+    return true;
+}
+
+bool ConsonanceIndex::loadFromFile (const File& file)
+{
+    clear();
+
+    FileInputStream is (file);
+
+    if (! is.openedOk()
+        || is.readInt() != consonanceIndexMagic
+        || is.readInt() != consonanceIndexVersion)
+    {
+        jassertfalse;       // Not a consonance index, or written by an incompatible version
+        return false;
+    }
+
+    modelName = is.readString();
+    referenceFreq = is.readFloat();
+
+    const float lowestRatio = is.readFloat();
+    const float highestRatio = is.readFloat();
+    const int stepsInFile = is.readInt();
+    const int timbresInFile = is.readInt();
+    const bool hasCurves = is.readBool();
+
+    if (lowestRatio <= 0 || highestRatio <= lowestRatio || stepsInFile < 3 || timbresInFile < 0)
+        return false;
+
+    ratioRange = Range<float> (lowestRatio, highestRatio);
+    numSteps = stepsInFile;
+
+    for (int t = 0; t < timbresInFile; ++t)
+    {
+        names.add (is.readString());
+        firstMinimumOfTimbre.add (minimaByTimbre.size());
+
+        const int numMinima = is.readInt();
+
+        for (int i = 0; i < numMinima && ! is.isExhausted(); ++i)
+        {
+            Minimum minimum;
+            minimum.timbreIndex = t;
+            minimum.ratio = is.readFloat();
+            minimum.dissonance = is.readFloat();
+            minimum.depth = is.readFloat();
+            minimum.relativeDepth = is.readFloat();
+
+            minimaByTimbre.add (minimum);
+        }
+    }
+
+    firstMinimumOfTimbre.add (minimaByTimbre.size());
+
+    if (hasCurves)
+    {
+        curves.resize (timbresInFile * numSteps);
+
+        const int numBytes = (int) sizeof (float) * curves.size();
+
+        if (is.read (curves.getRawDataPointer(), numBytes) != numBytes)
+        {
+            clear();
+            return false;
+        }
+    }
+
+    sortMinima();
+
+    return true;
+}
+
+//==============================================================================
+
+
+void ConsonanceIndex::calculateCurve (const OvertoneDistribution& timbre, float* curve) const
+{
+    // Each call uses its own calculator (and its own clone of the model), so curves can be calculated in parallel
+    DissonanceCalc calc;
+    calc.setModel (model.get());
+    calc.setSumPartialDissonances (false);
+
+    calc.addOvertoneDistribution (new OvertoneDistribution (timbre));
+    calc.addOvertoneDistribution (new OvertoneDistribution (timbre));
+    calc.getDistributionReference (0)->setFundamental (referenceFreq, 1);
+    calc.getDistributionReference (1)->setFundamental (referenceFreq * ratioRange.getStart(), 1);
+
+    calc.set2dVariableDistribution (1);
+    calc.setNumSteps (numSteps);
+    calc.useLogarithmicSteps (true);
+    calc.setRange (referenceFreq * ratioRange.getStart(), referenceFreq * ratioRange.getEnd());
+
+    calc.calculateDissonanceMap();
+
+    FloatVectorOperations::copy (curve, calc.get2dRawDissonanceData(), numSteps);
+}
+
+void ConsonanceIndex::findMinima (const float* curve, int timbreIndex, Array<Minimum>& result) const
+{
+    const Range<float> curveRange = FloatVectorOperations::findMinAndMax (curve, numSteps);
+
+    if (curveRange.getLength() <= 0)
+        return;
+
+    for (int i = 0; i < numSteps; ++i)
+    {
+        const bool lowerThanPrevious = i == 0 || curve[i] < curve[i - 1];
+        const bool lowerThanNext = i == numSteps - 1 || curve[i] <= curve[i + 1];
+
+        if (! lowerThanPrevious || ! lowerThanNext)
+            continue;
+
+        // The prominence is the smaller of the highest points on each side before the curve drops below the minimum.
+        // Minima at the ends of the curve only have one side.
+        float leftPeak = curve[i];
+        float rightPeak = curve[i];
+
+        for (int j = i - 1; j >= 0 && curve[j] >= curve[i]; --j)
+            leftPeak = jmax (leftPeak, curve[j]);
+
+        for (int j = i + 1; j < numSteps && curve[j] >= curve[i]; ++j)
+            rightPeak = jmax (rightPeak, curve[j]);
+
+        const float peak = i == 0 ? rightPeak
+                                  : (i == numSteps - 1 ? leftPeak : jmin (leftPeak, rightPeak));
+
+        Minimum minimum;
+        minimum.timbreIndex = timbreIndex;
+        minimum.ratio = getRatioAtStep ((float) i);
+        minimum.dissonance = curve[i];
+        minimum.depth = peak - curve[i];
+        minimum.relativeDepth = minimum.depth / curveRange.getLength();
+
+        // Refine interior minima by fitting a parabola through the neighbouring steps
+        if (i > 0 && i < numSteps - 1)
+        {
+            const float curvature = curve[i - 1] - 2 * curve[i] + curve[i + 1];
+
+            if (curvature > 0)
+            {
+                const float offset = 0.5f * (curve[i - 1] - curve[i + 1]) / curvature;
+
+                minimum.ratio = getRatioAtStep (i + offset);
+                minimum.dissonance = curve[i] - 0.25f * (curve[i - 1] - curve[i + 1]) * offset;
+            }
+        }
+
+        if (minimum.depth > 0)
+            result.add (minimum);
+    }
+}
+
+void ConsonanceIndex::sortMinima()
+{
+    minimaByRatio = minimaByTimbre;
+
+    std::sort (minimaByRatio.begin(), minimaByRatio.end(),
+               [] (const Minimum& a, const Minimum& b) { return a.ratio < b.ratio; });
+}
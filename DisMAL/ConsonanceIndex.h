@@ -0,0 +1,156 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceCalc.h"
+#include "DissonanceModel.h"
+#include "OvertoneDistribution.h"
+#include "WorkerPool.h"
+
+/** An index of the consonant intervals of every timbre in a library.
+
+    For each timbre, the index precomputes a self-dyad dissonance curve (two notes with the same overtone distribution, one fixed at a reference frequency and the other sweeping a range of frequency ratios above it) and locates the curve's local minima. This answers questions like "which timbres are consonant near 11/8?" without computing a dissonance map for every timbre at query time.
+
+    Each minimum is given a depth: its prominence, measured as how far the curve rises on both sides before it falls below the minimum again. Because the overall level of a dissonance curve depends on the number and loudness of a timbre's partials, queries use the relative depth, which is the prominence divided by the range of the timbre's curve. This makes depths comparable across timbres.
+
+    Curves are calculated in parallel with a WorkerPool, and the curves and minima can be saved to a file kept alongside the timbre library.
+*/
+class ConsonanceIndex
+{
+public:
+    //==============================================================================
+    /** A dissonance minimum in a timbre's self-dyad curve. */
+    struct Minimum
+    {
+        int timbreIndex;        /**< The index of the timbre in the ConsonanceIndex. */
+        float ratio;            /**< The frequency ratio at which the minimum lies. */
+        float dissonance;       /**< The dissonance at the minimum. */
+        float depth;            /**< The prominence of the minimum, in units of dissonance. */
+        float relativeDepth;    /**< The prominence of the minimum divided by the range of the timbre's curve, between 0 and 1. */
+    };
+
+    //==============================================================================
+    /** Creates an empty ConsonanceIndex object that uses a SetharesModel. */
+    ConsonanceIndex();
+
+    /** Destructor. */
+    ~ConsonanceIndex();
+
+    //==============================================================================
+    /** Sets the dissonance model used to calculate curves. The model is cloned. */
+    void setModel (DissonanceModel* newModel);
+
+    /** Returns the name of the model used to calculate the curves in the index.
+
+        After loadFromFile, this is the name of the model stored in the file.
+    */
+    String getModelName() const;
+
+    /** Sets the frequency (in Hz) of the lower, fixed note of each dyad. The default is middle C. */
+    void setReferenceFrequency (float newReferenceFreq);
+
+    /** Returns the frequency of the lower note of each dyad. */
+    float getReferenceFrequency() const noexcept;
+
+    /** Sets the range of frequency ratios covered by each curve. The default is from 1 to 2.1, just beyond an octave. */
+    void setRatioRange (float lowestRatio, float highestRatio);
+
+    /** Returns the range of frequency ratios covered by each curve. */
+    Range<float> getRatioRange() const noexcept;
+
+    /** Sets the number of logarithmically spaced steps in each curve. */
+    void setNumSteps (int newNumSteps);
+
+    /** Returns the number of steps in each curve. */
+    int getNumSteps() const noexcept;
+
+    //==============================================================================
+    /** Calculates the curves and minima of a library of timbres, replacing the current contents of the index.
+
+        The curve settings and model must be set before calling this.
+    */
+    void build (const OwnedArray<OvertoneDistribution>& timbres, WorkerPool& pool);
+
+    /** Removes all timbres from the index. */
+    void clear();
+
+    /** Returns the number of indexed timbres. */
+    int numTimbres() const noexcept;
+
+    /** Returns the name of an indexed timbre. */
+    String getName (int timbreIndex) const;
+
+    /** Returns a pointer to the getNumSteps() dissonance values of a timbre's curve. */
+    const float* getCurve (int timbreIndex) const;
+
+    /** Returns the frequency ratio of a step in the curves. */
+    float getRatioAtStep (float step) const;
+
+    /** Returns the minima of a single timbre, in order of ascending ratio. */
+    Array<Minimum> getMinima (int timbreIndex) const;
+
+    //==============================================================================
+    /** Finds the timbres with a dissonance minimum near a frequency ratio.
+
+        @param ratio The target frequency ratio, such as 11/8.
+        @param toleranceCents How far a minimum can lie from the target ratio, in cents.
+        @param minRelativeDepth Minima with a smaller relative depth are ignored.
+        @return The matching minima, ranked from deepest to shallowest relative depth.
+    */
+    Array<Minimum> findMinimaNear (float ratio, float toleranceCents, float minRelativeDepth = 0) const;
+
+    //==============================================================================
+    /** Returns the default location of a consonance index for a library folder. */
+    static File getDefaultFileForLibrary (const File& libraryFolder);
+
+    /** Saves the index to a file.
+
+        @param file The file to write.
+        @param includeCurves Set to false to save only the minima, which makes the file much smaller. getCurve will return nullptr after loading such a file.
+        @return True if the file was written.
+    */
+    bool saveToFile (const File& file, bool includeCurves = true) const;
+
+    /** Replaces the contents of the index with a file written by saveToFile.
+
+        @return True if the file was read successfully. Otherwise, the index is left empty.
+    */
+    bool loadFromFile (const File& file);
+
+private:
+    //==============================================================================
+    std::unique_ptr<DissonanceModel> model;
+    String modelName;
+    float referenceFreq;
+    Range<float> ratioRange;
+    int numSteps;
+
+    StringArray names;
+    Array<float> curves;
+    Array<Minimum> minimaByTimbre, minimaByRatio;
+    Array<int> firstMinimumOfTimbre;
+
+    //==============================================================================
+    /** Calculates the self-dyad curve of a timbre into an array of numSteps values. */
+    void calculateCurve (const OvertoneDistribution& timbre, float* curve) const;
+
+    /** Finds the minima of a curve and adds them to an array. */
+    void findMinima (const float* curve, int timbreIndex, Array<Minimum>& result) const;
+
+    /** Rebuilds minimaByRatio from minimaByTimbre. */
+    void sortMinima();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ConsonanceIndex)
+};
@@ -17,10 +17,35 @@
 #include "DissonanceModel.h"
 #include "OvertoneDistribution.h"
 #include "TuningSystem.h"
+#include "AuditoryScales.h"
+#include "MapStorage.h"
+#include "SparseMapStorage.h"
+#include "LibraryLoader.h"
+#include "SessionSnapshot.h"
+#include "ResultCache.h"
+#include "SpectrumStore.h"
+#include "MinimaTracker.h"
+#include "RegisterSweep.h"
+#include "DissonanceEstimator.h"
+#include "MapRenderer.h"
+#include "ShadowVerifier.h"
+#include "BatchEvaluator.h"
+#include "AuditoryRoughnessAnalyser.h"
+#include "RoughnessSpectrogram.h"
+#include "ScaleAnalyser.h"
+#include "ScaleSearch.h"
 #include "Preprocessor.h"
 #include "FileIO.h"
+#include "PartialList.h"
+#include "AdditiveSynthesiser.h"
+#include "WorkerPool.h"
+#include "SpectrumAnalyser.h"
+#include "TimbreExtractor.h"
+#include "TimbreIndex.h"
+#include "ConsonanceIndex.h"
+#include "TuningMatcher.h"
 
 namespace DisMAL {
     const OwnedArray<Preprocessor> Preprocessors (std::initializer_list<Preprocessor*> {new HearingRangePreprocessor()});
-    const OwnedArray<DissonanceModel> DissonanceModels (std::initializer_list<DissonanceModel*> {new SetharesModel(), new VassilakisModel()});
+    const OwnedArray<DissonanceModel> DissonanceModels (std::initializer_list<DissonanceModel*> {new SetharesModel(), new VassilakisModel(), new KameokaKuriyagawaModel()});
 }
@@ -12,17 +12,24 @@
 */
 
 #include "DissonanceCalc.h"
+#include "ShadowVerifier.h"
 
 DissonanceCalc::DissonanceCalc()   : model (nullptr)
 {
     sumPartialDissonances = true;
     
     // Dissonance maps
-    logSteps = false;
+    stepType = StepType::linearSteps;
+    stepSize = 0;
+    numSteps = 0;
     varDist = 0;
     xDist = 0;
     yDist = 0;
     dimensionality = Dimensionality::twoDimensional;
+    shadowVerifier = nullptr;
+    numCompressedRepairs = 0;
+    softMemoryLimit = 0;
+    hardMemoryLimit = 0;
     
     // Optimization
     optimMinInterval = 1.001;
@@ -30,7 +37,11 @@ DissonanceCalc::DissonanceCalc()   : model (nullptr)
     optimTolerance = 0.0001;
 }
 
-DissonanceCalc::DissonanceCalc (const DissonanceCalc& otherCalc)   : model (otherCalc.model->cloneModel())
+DissonanceCalc::DissonanceCalc (const DissonanceCalc& otherCalc)   : DissonanceCalc (otherCalc, true)
+{
+}
+
+DissonanceCalc::DissonanceCalc (const DissonanceCalc& otherCalc, bool copyChords)   : model (otherCalc.model->cloneModel())
 {
     for (auto pre : otherCalc.preprocessors)
     {
@@ -44,13 +55,20 @@ DissonanceCalc::DissonanceCalc (const DissonanceCalc& otherCalc)   : model (othe
     varDist = otherCalc.varDist;
     xDist = otherCalc.xDist;
     yDist = otherCalc.yDist;
-    logSteps = otherCalc.logSteps;
+    stepType = otherCalc.stepType;
+    compressedMap3D.setPrecision (otherCalc.getMapPrecision());
+    cellMask = otherCalc.cellMask;
+    shadowVerifier = nullptr;
+    numCompressedRepairs = 0;
+    softMemoryLimit = otherCalc.softMemoryLimit;
+    hardMemoryLimit = otherCalc.hardMemoryLimit;
     
     optimMinInterval = otherCalc.optimMinInterval;
     optimStepSize = otherCalc.optimStepSize;
     optimTolerance = otherCalc.optimTolerance;
 
-    chords = otherCalc.chords;
+    if (copyChords)
+        chords = otherCalc.chords;
 }
 
 DissonanceCalc::~DissonanceCalc()
@@ -184,9 +202,20 @@ float DissonanceCalc::calculateDissonance() const
 //                  Calculations of multiple specific intervals
 //==============================================================================
 
-void DissonanceCalc::addChord()
+Result DissonanceCalc::addChord()
 {
+    const String error = getChordMemoryError (chords.size() + 1);
+    
+    // Adding this chord would take the chords over the hard memory limit
+    if (error.isNotEmpty())
+    {
+        jassertfalse;
+        return Result::fail (error);
+    }
+    
     chords.resize (chords.size() + 1);
+    
+    return Result::ok();
 }
 
 void DissonanceCalc::setFreqInChord (int chordIndex, int distributionIndex, float newFreq)
@@ -227,6 +256,15 @@ int DissonanceCalc::numChords() const noexcept
 
 void DissonanceCalc::calculateDissonances()
 {
+    lastError = getChordMemoryError (chords.size());
+    
+    // The chords are over the hard memory limit. See checkMemoryBudget.
+    if (lastError.isNotEmpty())
+    {
+        jassertfalse;
+        return;
+    }
+    
     OwnedArray<OvertoneDistribution> tempDistributions;
 
     for (int i = 0; i < chords.size(); ++i)
@@ -269,6 +307,97 @@ DissonanceCalc::Dimensionality DissonanceCalc::getNumDimensions() const noexcept
     return dimensionality;
 }
 
+void DissonanceCalc::setMapPrecision (MapStorage::Precision newPrecision)
+{
+    compressedMap3D.setPrecision (newPrecision);
+    
+    if (numSteps > 0)
+        resizeMap();
+}
+
+MapStorage::Precision DissonanceCalc::getMapPrecision() const noexcept
+{
+    return compressedMap3D.getPrecision();
+}
+
+const MapStorage& DissonanceCalc::getMapStorage() const noexcept
+{
+    return compressedMap3D;
+}
+
+void DissonanceCalc::setCellMask (CellMask newMask)
+{
+    cellMask = newMask;
+}
+
+void DissonanceCalc::clearCellMask()
+{
+    cellMask = nullptr;
+    sparseMap3D.clear();
+}
+
+bool DissonanceCalc::hasCellMask() const noexcept
+{
+    return cellMask != nullptr;
+}
+
+bool DissonanceCalc::isCellInMask (int xStep, int yStep) const
+{
+    if (cellMask == nullptr)
+        return true;
+    
+    return cellMask (*this, getFrequencyAtStep (xStep), getFrequencyAtStep (yStep));
+}
+
+bool DissonanceCalc::usingSparseMap() const noexcept
+{
+    return ! sparseMap3D.isEmpty();
+}
+
+DissonanceCalc::CellMask DissonanceCalc::orderedVoicesMask()
+{
+    return [] (const DissonanceCalc&, float xFreq, float yFreq)
+    {
+        return yFreq >= xFreq;
+    };
+}
+
+DissonanceCalc::CellMask DissonanceCalc::maxSpanMask (float maxRatio)
+{
+    jassert (maxRatio >= 1);
+    
+    return [maxRatio] (const DissonanceCalc& calc, float xFreq, float yFreq)
+    {
+        float lowest = jmin (xFreq, yFreq);
+        float highest = jmax (xFreq, yFreq);
+        
+        for (int d = 0; d < calc.distributions.size(); ++d)
+        {
+            const OvertoneDistribution* distribution = calc.distributions[d];
+            
+            if (d == calc.xDist || d == calc.yDist || distribution->isMuted())
+                continue;
+            
+            lowest = jmin (lowest, distribution->getFundamentalFreq());
+            highest = jmax (highest, distribution->getFundamentalFreq());
+        }
+        
+        return highest <= lowest * maxRatio;
+    };
+}
+
+DissonanceCalc::CellMask DissonanceCalc::pathMask (std::function<float (float xFreq)> path, float widthRatio)
+{
+    jassert (path != nullptr && widthRatio >= 1);
+    
+    return [path, widthRatio] (const DissonanceCalc&, float xFreq, float yFreq)
+    {
+        const float pathFreq = path (xFreq);
+        
+        return yFreq >= pathFreq / widthRatio && yFreq <= pathFreq * widthRatio;
+    };
+}
+
 //==============================================================================
 
 
@@ -316,16 +445,27 @@ int DissonanceCalc::getNumSteps() const noexcept
     return numSteps;
 }
 
-void DissonanceCalc::useLogarithmicSteps (bool useLogSteps) noexcept
+void DissonanceCalc::setStepType (StepType newStepType) noexcept
 {
-    logSteps = useLogSteps;
+    stepType = newStepType;
     
-    setStepSize();
+    if (numSteps > 0 && ! frequencyRange.isEmpty())
+        setStepSize();
+}
+
+DissonanceCalc::StepType DissonanceCalc::getStepType() const noexcept
+{
+    return stepType;
+}
+
+void DissonanceCalc::useLogarithmicSteps (bool useLogSteps) noexcept
+{
+    setStepType (useLogSteps ? StepType::logarithmicSteps : StepType::linearSteps);
 }
 
 bool DissonanceCalc::usingLogarithmicSteps() const noexcept
 {
-    return logSteps;
+    return stepType == StepType::logarithmicSteps;
 }
 
 float DissonanceCalc::getStepSize() const noexcept
@@ -403,16 +543,28 @@ bool DissonanceCalc::isReadyToProcess()
 
 void DissonanceCalc::calculateDissonanceMap()
 {
+    lastError.clear();
+    
+    // This map is over the memory budget, so it must be streamed with streamDissonanceMap or calculateDissonanceMapWithinBudget
+    if (! mapFitsInMemoryBudget())
+    {
+        lastError = "A dissonance map of " + String (numSteps) + " steps needs "
+                    + File::descriptionOfSizeInBytes ((int64) getEstimatedMapMemory())
+                    + ", which is over the memory budget. Stream it with calculateDissonanceMapWithinBudget or streamDissonanceMap instead.";
+        jassertfalse;
+        return;
+    }
+    
+    numCompressedRepairs = 0;
+    
     OwnedArray<OvertoneDistribution> tempDistributions;
     
     if (dimensionality == 2)
     {
-        float currentFreq = frequencyRange.getStart();
-        
-        distributions[varDist]->setFundamentalFreq (currentFreq);
-
         for (int i = 0; i < numSteps; ++i)
         {
+            distributions[varDist]->setFundamentalFreq (getFrequencyAtStep (i));
+            
             tempDistributions.clear();
             tempDistributions.addCopiesOf (distributions);
             
@@ -422,23 +574,30 @@ void DissonanceCalc::calculateDissonanceMap()
             }
             
             map2D.set (i, model->calculateDissonance (tempDistributions, false));
-            
-            currentFreq = incrementFrequency (currentFreq);
-            distributions[varDist]->setFundamentalFreq (currentFreq);
         }
     }
-    else if (dimensionality == 3)
+    else if (dimensionality == 3 && usingCompressedMap())
     {
-        float currentXFreq = frequencyRange.getStart();
-        float currentYFreq = frequencyRange.getStart();
-
-        distributions[xDist]->setFundamentalFreq (currentXFreq);
-        distributions[yDist]->setFundamentalFreq (currentYFreq);
+        // Rows are calculated a row of tiles at a time, and compressed as soon as each row of tiles is complete
+        const int tileSize = compressedMap3D.getTileSize();
+        HeapBlock<float> tileRows ((size_t) (tileSize * numSteps));
         
         for (int xStep = 0; xStep < numSteps; ++xStep)
         {
+            distributions[xDist]->setFundamentalFreq (getFrequencyAtStep (xStep));
+            
+            float* row = tileRows + (xStep % tileSize) * numSteps;
+            
             for (int yStep = 0; yStep < numSteps; ++yStep)
             {
+                if (! isCellInMask (xStep, yStep))
+                {
+                    row[yStep] = 0;
+                    continue;
+                }
+                
+                distributions[yDist]->setFundamentalFreq (getFrequencyAtStep (yStep));
+                
                 tempDistributions.clear();
                 tempDistributions.addCopiesOf (distributions);
                 
@@ -447,20 +606,370 @@ void DissonanceCalc::calculateDissonanceMap()
                     pre->process (tempDistributions);
                 }
                 
-                map3D[xStep].set (yStep, model->calculateDissonance (tempDistributions, false));
-                
-                currentYFreq = incrementFrequency (currentYFreq);
-                distributions[yDist]->setFundamentalFreq (currentYFreq);
+                row[yStep] = model->calculateDissonance (tempDistributions, false);
             }
             
-            currentXFreq = incrementFrequency (currentXFreq);
-            distributions[xDist]->setFundamentalFreq (currentXFreq);
+            if (xStep % tileSize == tileSize - 1 || xStep == numSteps - 1)
+                compressedMap3D.setTileRow (xStep / tileSize, tileRows);
+        }
+    }
+    else if (dimensionality == 3 && cellMask != nullptr && useSparseMapForMask())
+    {
+        for (int xStep = 0; xStep < numSteps; ++xStep)
+        {
+            distributions[xDist]->setFundamentalFreq (getFrequencyAtStep (xStep));
             
-            // Reset the Y-axis distribution's frequency to the starting frequency
-            currentYFreq = frequencyRange.getStart();
-            distributions[yDist]->setFundamentalFreq (currentYFreq);
+            for (int run = 0; run < sparseMap3D.getNumRuns (xStep); ++run)
+            {
+                const Range<int> columns = sparseMap3D.getRun (xStep, run);
+                float* values = sparseMap3D.getRunValues (xStep, run);
+                
+                for (int yStep = columns.getStart(); yStep < columns.getEnd(); ++yStep)
+                {
+                    distributions[yDist]->setFundamentalFreq (getFrequencyAtStep (yStep));
+                    
+                    tempDistributions.clear();
+                    tempDistributions.addCopiesOf (distributions);
+                    
+                    for (auto* pre : preprocessors)
+                    {
+                        pre->process (tempDistributions);
+                    }
+                    
+                    values[yStep - columns.getStart()] = model->calculateDissonance (tempDistributions, false);
+                }
+            }
         }
     }
+    else if (dimensionality == 3)
+    {
+        sparseMap3D.clear();
+        
+        if (map3D.size() != numSteps)
+            resizeMap();
+        
+        for (int xStep = 0; xStep < numSteps; ++xStep)
+        {
+            distributions[xDist]->setFundamentalFreq (getFrequencyAtStep (xStep));
+            
+            for (int yStep = 0; yStep < numSteps; ++yStep)
+            {
+                if (! isCellInMask (xStep, yStep))
+                {
+                    map3D.getReference (xStep).set (yStep, std::numeric_limits<float>::quiet_NaN());
+                    continue;
+                }
+                
+                distributions[yDist]->setFundamentalFreq (getFrequencyAtStep (yStep));
+                
+                tempDistributions.clear();
+                tempDistributions.addCopiesOf (distributions);
+                
+                for (auto* pre : preprocessors)
+                {
+                    pre->process (tempDistributions);
+                }
+                
+                map3D.getReference (xStep).set (yStep, model->calculateDissonance (tempDistributions, false));
+            }
+        }
+    }
+    
+    // Uncompressed maps are calculated with the exact path, so only compressed maps can differ from it
+    if (shadowVerifier != nullptr && usingCompressedMap() && dimensionality == 3)
+        shadowVerifier->submitMap (*this, "compressedMap");
+}
+
+Result DissonanceCalc::streamDissonanceMap (const MapRowCallback& rowCallback)
+{
+    jassert (rowCallback != nullptr);
+    
+    if (model == nullptr || numSteps <= 0 || rowCallback == nullptr)
+        return Result::fail ("The dissonance map needs a model, a number of steps and a callback");
+    
+    OwnedArray<OvertoneDistribution> tempDistributions;
+    HeapBlock<float> row ((size_t) numSteps);
+    const int numRows = dimensionality == 3 ? numSteps : 1;
+    
+    for (int xStep = 0; xStep < numRows; ++xStep)
+    {
+        calculateMapRow (xStep, row, tempDistributions);
+        
+        if (! rowCallback (xStep, row, numSteps))
+            break;
+    }
+    
+    return Result::ok();
+}
+
+Result DissonanceCalc::calculateDissonanceMapToFile (const File& file)
+{
+    FileOutputStream output (file);
+    
+    if (output.failedToOpen())
+        return Result::fail ("Couldn't open " + file.getFullPathName() + " for writing");
+    
+    output.truncate();
+    
+    const int mapFileMagic = 0x504d4d44;     // "DMMP"
+    const int mapFileVersion = 1;
+    
+    bool writeOk = output.writeInt (mapFileMagic)
+                   && output.writeInt (mapFileVersion)
+                   && output.writeInt ((int) dimensionality)
+                   && output.writeInt (numSteps)
+                   && output.writeFloat (frequencyRange.getStart())
+                   && output.writeFloat (frequencyRange.getEnd())
+                   && output.writeInt ((int) stepType);
+    
+    if (! writeOk)
+        return Result::fail ("Couldn't write to " + file.getFullPathName());
+    
+    const Result result = streamDissonanceMap ([&] (int, const float* values, int numValues)
+    {
+        writeOk = output.write (values, sizeof (float) * (size_t) numValues);
+        return writeOk;
+    });
+    
+    if (result.failed())
+        return result;
+    
+    if (! writeOk)
+        return Result::fail ("Couldn't write to " + file.getFullPathName());
+    
+    output.flush();
+    
+    return Result::ok();
+}
+
+Result DissonanceCalc::calculateDissonanceMapWithinBudget (const MapRowCallback& overflowCallback)
+{
+    if (mapFitsInMemoryBudget())
+    {
+        calculateDissonanceMap();
+        return Result::ok();
+    }
+    
+    if (overflowCallback != nullptr)
+        return streamDissonanceMap (overflowCallback);
+    
+    return Result::fail ("A dissonance map of " + String (numSteps) + " steps needs "
+                         + File::descriptionOfSizeInBytes ((int64) getEstimatedMapMemory())
+                         + ", which is over the memory budget");
+}
+
+DissonanceCalc::PartialState DissonanceCalc::getPartialState (int distributionIndex, int partialIndex) const
+{
+    const OvertoneDistribution* distribution = distributions[distributionIndex];
+
+    jassert (distribution != nullptr && isPositiveAndBelow (partialIndex, distribution->numPartials()));
+
+    if (distribution == nullptr)
+        return { 0, 0, true };
+
+    return { distribution->getFreqRatio (partialIndex), distribution->getAmpRatio (partialIndex), distribution->partialIsMuted (partialIndex) };
+}
+
+namespace
+{
+    // Each repair of a compressed map can move its cells by up to half a quantisation step, so this many repairs are allowed between full calculations
+    const int maxCompressedRepairs = 8;
+}
+
+bool DissonanceCalc::repairDissonanceMap (int distributionIndex, int partialIndex, const PartialState& oldState, bool exactResync)
+{
+    auto* pairwiseModel = dynamic_cast<SpectralInterferenceModel*> (model.get());
+    OvertoneDistribution* distribution = distributions[distributionIndex];
+
+    jassert (distribution != nullptr && isPositiveAndBelow (partialIndex, distribution->numPartials()));
+
+    if (exactResync || pairwiseModel == nullptr || ! preprocessors.isEmpty() || cellMask != nullptr
+        || distribution == nullptr || ! isPositiveAndBelow (partialIndex, distribution->numPartials())
+        || (dimensionality == 3 && usingCompressedMap() && numCompressedRepairs >= maxCompressedRepairs))
+    {
+        calculateDissonanceMap();
+        return false;
+    }
+
+    // Returns the change in dissonance at the distributions' current fundamentals
+    auto getChange = [&]
+    {
+        if (distribution->isMuted())
+            return 0.0f;
+
+        const float fundamentalFreq = distribution->getFundamentalFreq();
+        const float fundamentalAmp = distribution->getFundamentalAmp();
+        float change = 0;
+
+        if (! distribution->partialIsMuted (partialIndex))
+            change += calculatePartialContribution (*pairwiseModel, distributionIndex, partialIndex,
+                                                    distribution->getRealFreq (partialIndex),
+                                                    distribution->getRealAmp (partialIndex));
+
+        if (! oldState.muted)
+            change -= calculatePartialContribution (*pairwiseModel, distributionIndex, partialIndex,
+                                                    oldState.freqRatio * fundamentalFreq,
+                                                    oldState.ampRatio * fundamentalAmp);
+
+        return change;
+    };
+
+    if (dimensionality == 2)
+    {
+        jassert (map2D.size() == numSteps);     // calculateDissonanceMap must be called first
+
+        for (int i = 0; i < map2D.size(); ++i)
+        {
+            distributions[varDist]->setFundamentalFreq (getFrequencyAtStep (i));
+            map2D.getReference (i) += getChange();
+        }
+    }
+    else if (dimensionality == 3 && usingCompressedMap())
+    {
+        jassert (compressedMap3D.getNumRows() == numSteps);     // calculateDissonanceMap must be called first
+
+        ++numCompressedRepairs;
+
+        // Each row of tiles is decompressed, repaired and compressed again
+        const int tileSize = compressedMap3D.getTileSize();
+        HeapBlock<float> tileRows ((size_t) (tileSize * numSteps));
+
+        for (int xStep = 0; xStep < compressedMap3D.getNumRows(); ++xStep)
+        {
+            distributions[xDist]->setFundamentalFreq (getFrequencyAtStep (xStep));
+
+            float* row = tileRows + (xStep % tileSize) * numSteps;
+
+            for (int yStep = 0; yStep < numSteps; ++yStep)
+            {
+                distributions[yDist]->setFundamentalFreq (getFrequencyAtStep (yStep));
+                row[yStep] = compressedMap3D.get (xStep, yStep) + getChange();
+            }
+
+            if (xStep % tileSize == tileSize - 1 || xStep == numSteps - 1)
+                compressedMap3D.setTileRow (xStep / tileSize, tileRows);
+        }
+    }
+    else if (dimensionality == 3)
+    {
+        jassert (map3D.size() == numSteps);     // calculateDissonanceMap must be called first
+
+        for (int xStep = 0; xStep < map3D.size(); ++xStep)
+        {
+            distributions[xDist]->setFundamentalFreq (getFrequencyAtStep (xStep));
+
+            Array<float>& row = map3D.getReference (xStep);
+
+            for (int yStep = 0; yStep < row.size(); ++yStep)
+            {
+                distributions[yDist]->setFundamentalFreq (getFrequencyAtStep (yStep));
+                row.getReference (yStep) += getChange();
+            }
+        }
+    }
+
+    if (shadowVerifier != nullptr)
+        shadowVerifier->submitMap (*this, "repairedMap");
+
+    return true;
+}
+
+void DissonanceCalc::setShadowVerifier (ShadowVerifier* verifier) noexcept
+{
+    shadowVerifier = verifier;
+}
+
+//==============================================================================
+
+
+void DissonanceCalc::setMemoryBudget (size_t softLimitBytes, size_t hardLimitBytes)
+{
+    softMemoryLimit = softLimitBytes;
+    hardMemoryLimit = hardLimitBytes;
+    
+    // Free a stored map that no longer fits
+    if (! mapFitsInMemoryBudget())
+        resizeMap();
+}
+
+size_t DissonanceCalc::getSoftMemoryLimit() const noexcept
+{
+    return softMemoryLimit;
+}
+
+size_t DissonanceCalc::getHardMemoryLimit() const noexcept
+{
+    return hardMemoryLimit;
+}
+
+size_t DissonanceCalc::getEstimatedMapMemory() const noexcept
+{
+    const size_t steps = (size_t) jmax (0, numSteps);
+    
+    if (dimensionality == 2)
+        return steps * sizeof (float);
+    
+    if (usingCompressedMap())
+    {
+        const size_t bytesPerValue = getMapPrecision() == MapStorage::quantised8Bit ? 1 : 2;
+        const size_t tilesPerSide = (steps + (size_t) compressedMap3D.getTileSize() - 1) / (size_t) compressedMap3D.getTileSize();
+        
+        // Each tile also stores an offset and a scale
+        return steps * steps * bytesPerValue + tilesPerSide * tilesPerSide * 2 * sizeof (float);
+    }
+    
+    // Each row of map3D is a separate Array
+    return steps * (steps * sizeof (float) + sizeof (Array<float>));
+}
+
+size_t DissonanceCalc::getEstimatedChordMemory (int numChordsToStore) const noexcept
+{
+    const size_t bytesPerChord = sizeof (Array<FreqAmpPair>) + (size_t) distributions.size() * sizeof (FreqAmpPair) + sizeof (float);
+    
+    return (size_t) jmax (0, numChordsToStore) * bytesPerChord;
+}
+
+bool DissonanceCalc::mapFitsInMemoryBudget() const noexcept
+{
+    const size_t mapMemory = getEstimatedMapMemory();
+    
+    return (softMemoryLimit == 0 || mapMemory <= softMemoryLimit)
+           && (hardMemoryLimit == 0 || mapMemory <= hardMemoryLimit);
+}
+
+Result DissonanceCalc::checkMemoryBudget() const
+{
+    if (hardMemoryLimit == 0)
+        return Result::ok();
+    
+    const String limit = File::descriptionOfSizeInBytes ((int64) hardMemoryLimit);
+    
+    if (getEstimatedMapMemory() > hardMemoryLimit)
+        return Result::fail ("A dissonance map of " + String (numSteps) + " steps needs "
+                             + File::descriptionOfSizeInBytes ((int64) getEstimatedMapMemory())
+                             + ", which is over the hard limit of " + limit + ". Stream it with streamDissonanceMap instead.");
+    
+    const String chordError = getChordMemoryError (chords.size());
+    
+    if (chordError.isNotEmpty())
+        return Result::fail (chordError);
+    
+    return Result::ok();
+}
+
+Result DissonanceCalc::getLastError() const
+{
+    return lastError.isEmpty() ? Result::ok() : Result::fail (lastError);
+}
+
+String DissonanceCalc::getChordMemoryError (int numChordsToStore) const
+{
+    if (hardMemoryLimit == 0 || getEstimatedChordMemory (numChordsToStore) <= hardMemoryLimit)
+        return {};
+    
+    return String (numChordsToStore) + " chords need "
+           + File::descriptionOfSizeInBytes ((int64) getEstimatedChordMemory (numChordsToStore))
+           + ", which is over the hard limit of " + File::descriptionOfSizeInBytes ((int64) hardMemoryLimit);
 }
 
 //==============================================================================
@@ -547,6 +1056,12 @@ float DissonanceCalc::getDissonanceAtStep (int step) const
 
 float DissonanceCalc::getDissonanceAtStep (int xStep, int yStep) const
 {
+    if (usingCompressedMap())
+        return compressedMap3D.get (xStep, yStep);
+    
+    if (usingSparseMap())
+        return sparseMap3D.get (xStep, yStep);
+    
     return map3D[xStep][yStep];
 }
 
@@ -565,23 +1080,122 @@ float DissonanceCalc::getDissonanceAtFreq (float xFreq, float yFreq) const
     return calculateDissonance();
 }
 
-float DissonanceCalc::getFrequencyAtStep (float step)
+float DissonanceCalc::getInterpolatedDissonance (float freq) const
+{
+    jassert (dimensionality == 2 && map2D.size() == numSteps);     // calculateDissonanceMap must be called first
+    
+    if (map2D.isEmpty())
+        return 0;
+    
+    const float step = jlimit (0.0f, (float) (map2D.size() - 1), getStepOfFrequency (freq));
+    const int lower = jmin ((int) step, map2D.size() - 2);
+    
+    if (lower < 0)
+        return map2D[0];
+    
+    const float proportion = step - lower;
+    
+    return map2D[lower] + proportion * (map2D[lower + 1] - map2D[lower]);
+}
+
+float DissonanceCalc::getInterpolatedDissonance (float xFreq, float yFreq) const
 {
-    return logSteps
-           ? pow (stepSize, step) * frequencyRange.getStart()
-           : stepSize * step + frequencyRange.getStart();
+    if (usingCompressedMap())
+        return compressedMap3D.getInterpolated (getStepOfFrequency (xFreq), getStepOfFrequency (yFreq));
+    
+    if (usingSparseMap())
+    {
+        // Cells outside of the mask are NaN, so interpolating next to them gives NaN
+        const int lastStep = sparseMap3D.getNumRows() - 1;
+        const float xStep = jlimit (0.0f, (float) lastStep, getStepOfFrequency (xFreq));
+        const float yStep = jlimit (0.0f, (float) lastStep, getStepOfFrequency (yFreq));
+        const int x = jmax (0, jmin ((int) xStep, lastStep - 1));
+        const int y = jmax (0, jmin ((int) yStep, lastStep - 1));
+        const int nextX = jmin (x + 1, lastStep);
+        const int nextY = jmin (y + 1, lastStep);
+        const float xProportion = xStep - x;
+        const float yProportion = yStep - y;
+        
+        const float lower = sparseMap3D.get (x, y) + yProportion * (sparseMap3D.get (x, nextY) - sparseMap3D.get (x, y));
+        const float upper = sparseMap3D.get (nextX, y) + yProportion * (sparseMap3D.get (nextX, nextY) - sparseMap3D.get (nextX, y));
+        
+        return lower + xProportion * (upper - lower);
+    }
+    
+    jassert (dimensionality == 3 && map3D.size() == numSteps);     // calculateDissonanceMap must be called first
+    
+    if (map3D.isEmpty() || map3D[0].isEmpty())
+        return 0;
+    
+    if (map3D.size() < 2)
+        return map3D[0][0];
+    
+    const float lastStep = (float) (map3D.size() - 1);
+    const float xStep = jlimit (0.0f, lastStep, getStepOfFrequency (xFreq));
+    const float yStep = jlimit (0.0f, lastStep, getStepOfFrequency (yFreq));
+    const int x = jmin ((int) xStep, map3D.size() - 2);
+    const int y = jmin ((int) yStep, map3D.size() - 2);
+    const float xProportion = xStep - x;
+    const float yProportion = yStep - y;
+    
+    const float lower = map3D[x][y] + yProportion * (map3D[x][y + 1] - map3D[x][y]);
+    const float upper = map3D[x + 1][y] + yProportion * (map3D[x + 1][y + 1] - map3D[x + 1][y]);
+    
+    return lower + xProportion * (upper - lower);
 }
 
-float DissonanceCalc::getFreqRatioAtStep (float step)
+float DissonanceCalc::getFrequencyAtStep (float step) const
+{
+    switch (stepType)
+    {
+        case StepType::logarithmicSteps:
+            return pow (stepSize, step) * frequencyRange.getStart();
+        
+        case StepType::erbRateSteps:
+            return AuditoryScales::erbRateToHz (AuditoryScales::hzToErbRate (frequencyRange.getStart()) + stepSize * step);
+        
+        case StepType::barkSteps:
+            return AuditoryScales::barkToHz (AuditoryScales::hzToBark (frequencyRange.getStart()) + stepSize * step);
+        
+        case StepType::linearSteps:
+        default:
+            return stepSize * step + frequencyRange.getStart();
+    }
+}
+
+float DissonanceCalc::getFreqRatioAtStep (float step) const
 {
     return getFrequencyAtStep (step) / frequencyRange.getStart();
 }
 
-float DissonanceCalc::getStepOfFrequency (float freq)
+float DissonanceCalc::getStepOfFrequency (float freq) const
 {
-    return logSteps
-           ? log (freq / frequencyRange.getStart()) / log (stepSize)
-           : (freq - frequencyRange.getStart()) / stepSize;
+    switch (stepType)
+    {
+        case StepType::logarithmicSteps:
+            return log (freq / frequencyRange.getStart()) / log (stepSize);
+        
+        case StepType::erbRateSteps:
+            return (AuditoryScales::hzToErbRate (freq) - AuditoryScales::hzToErbRate (frequencyRange.getStart())) / stepSize;
+        
+        case StepType::barkSteps:
+            return (AuditoryScales::hzToBark (freq) - AuditoryScales::hzToBark (frequencyRange.getStart())) / stepSize;
+        
+        case StepType::linearSteps:
+        default:
+            return (freq - frequencyRange.getStart()) / stepSize;
+    }
+}
+
+Array<float> DissonanceCalc::getStepFrequencies() const
+{
+    Array<float> frequencies;
+    frequencies.ensureStorageAllocated (numSteps);
+    
+    for (int i = 0; i < numSteps; ++i)
+        frequencies.add (getFrequencyAtStep (i));
+    
+    return frequencies;
 }
 
 Array<float> DissonanceCalc::getOptimalFreqs (bool getMinima)
@@ -599,39 +1213,156 @@ float* DissonanceCalc::get2dRawDissonanceData()
 
 void DissonanceCalc::setStepSize() noexcept
 {
-    if (usingLogarithmicSteps())
+    switch (stepType)
     {
-        stepSize = pow (frequencyRange.getEnd() / frequencyRange.getStart(), 1.0 / numSteps);
-    }
-    else
-    {
-        stepSize = (frequencyRange.getEnd() - frequencyRange.getStart()) / numSteps;
+        case StepType::logarithmicSteps:
+            stepSize = pow (frequencyRange.getEnd() / frequencyRange.getStart(), 1.0 / numSteps);
+            break;
+        
+        case StepType::erbRateSteps:
+            stepSize = (AuditoryScales::hzToErbRate (frequencyRange.getEnd()) - AuditoryScales::hzToErbRate (frequencyRange.getStart())) / numSteps;
+            break;
+        
+        case StepType::barkSteps:
+            stepSize = (AuditoryScales::hzToBark (frequencyRange.getEnd()) - AuditoryScales::hzToBark (frequencyRange.getStart())) / numSteps;
+            break;
+        
+        case StepType::linearSteps:
+        default:
+            stepSize = (frequencyRange.getEnd() - frequencyRange.getStart()) / numSteps;
+            break;
     }
 }
 
 float DissonanceCalc::incrementFrequency (float frequency) noexcept
 {
-    if (usingLogarithmicSteps())
-        return frequency * stepSize;
-    
-    return frequency + stepSize;
+    switch (stepType)
+    {
+        case StepType::logarithmicSteps:
+            return frequency * stepSize;
+        
+        case StepType::erbRateSteps:
+            return AuditoryScales::erbRateToHz (AuditoryScales::hzToErbRate (frequency) + stepSize);
+        
+        case StepType::barkSteps:
+            return AuditoryScales::barkToHz (AuditoryScales::hzToBark (frequency) + stepSize);
+        
+        case StepType::linearSteps:
+        default:
+            return frequency + stepSize;
+    }
 }
 
 void DissonanceCalc::resizeMap() 
 {
+    // Maps over the memory budget are never stored, so nothing is allocated for them
+    if (! mapFitsInMemoryBudget())
+    {
+        map2D.clear();
+        map3D.clear();
+        compressedMap3D.clear();
+        sparseMap3D.clear();
+        return;
+    }
+    
     if (dimensionality == 2)
     {
         map2D.resize (numSteps);
     }
+    else if (dimensionality == 3 && usingCompressedMap())
+    {
+        map3D.clear();
+        sparseMap3D.clear();
+        compressedMap3D.setSize (numSteps, numSteps);
+    }
     else if (dimensionality == 3)
     {
+        compressedMap3D.clear();
+        sparseMap3D.clear();
         map3D.resize (numSteps);
         
         for (int i = 0; i < numSteps; ++i)
         {
-            map3D[i].resize (numSteps);
+            map3D.getReference (i).resize (numSteps);
         }
     }
 }
 
+bool DissonanceCalc::usingCompressedMap() const noexcept
+{
+    return compressedMap3D.getPrecision() != MapStorage::fullPrecision;
+}
+
+void DissonanceCalc::calculateMapRow (int xStep, float* row, OwnedArray<OvertoneDistribution>& tempDistributions)
+{
+    const int distributionIndex = dimensionality == 3 ? yDist : varDist;
+    
+    if (dimensionality == 3)
+        distributions[xDist]->setFundamentalFreq (getFrequencyAtStep (xStep));
+    
+    for (int step = 0; step < numSteps; ++step)
+    {
+        if (dimensionality == 3 && ! isCellInMask (xStep, step))
+        {
+            row[step] = std::numeric_limits<float>::quiet_NaN();
+            continue;
+        }
+        
+        distributions[distributionIndex]->setFundamentalFreq (getFrequencyAtStep (step));
+        
+        tempDistributions.clear();
+        tempDistributions.addCopiesOf (distributions);
+        
+        for (auto* pre : preprocessors)
+        {
+            pre->process (tempDistributions);
+        }
+        
+        row[step] = model->calculateDissonance (tempDistributions, false);
+    }
+}
+
+bool DissonanceCalc::useSparseMapForMask()
+{
+    sparseMap3D.setMask (numSteps, numSteps, [this] (int xStep, int yStep) { return isCellInMask (xStep, yStep); });
+    
+    const size_t denseSize = sizeof (float) * (size_t) numSteps * (size_t) numSteps;
+    
+    if (sparseMap3D.getMemorySize() < denseSize)
+    {
+        map3D.clear();
+        return true;
+    }
+    
+    sparseMap3D.clear();
+    return false;
+}
+
+float DissonanceCalc::calculatePartialContribution (SpectralInterferenceModel& pairwiseModel, int distributionIndex, int partialIndex, float freq, float amp) const
+{
+    float contribution = 0;
+
+    // The same pairs that SpectralInterferenceModel::calculateDissonance includes for a partial: every audible fundamental, including its own, and every other audible partial
+    for (int d = 0; d < distributions.size(); ++d)
+    {
+        const OvertoneDistribution* other = distributions.getUnchecked (d);
+
+        if (other->isMuted())
+            continue;
+
+        if (! other->fundamentalIsMuted())
+            contribution += pairwiseModel.calculateRoughness (freq, amp, other->getFundamentalFreq(), other->getFundamentalAmp());
+
+        for (int p = 0; p < other->numPartials(); ++p)
+        {
+            if ((d == distributionIndex && p == partialIndex) || other->partialIsMuted (p))
+                continue;
+
+            contribution += pairwiseModel.calculateRoughness (freq, amp, other->getRealFreq (p), other->getRealAmp (p));
+        }
+    }
+
+    return contribution;
+}
+
 
@@ -17,8 +17,13 @@
 #include "DissonanceModel.h"
 #include "OvertoneDistribution.h"
 #include "Preprocessor.h"
+#include "AuditoryScales.h"
+#include "MapStorage.h"
+#include "SparseMapStorage.h"
 #include <nlopt.hpp>
 
+class ShadowVerifier;
+
 /** A modular class for calculating dissonance.
  
     With this class, you can modularly use dissonance models and preprocessing algorithms to calculate the dissonance of timbres, intervals, and chords. Dissonance values can be calculated for a single chord or many, as well as for ranges of frequencies that result in dissonance curves and surfaces (collectively refered to in DisMAL as dissonance maps).
@@ -129,8 +134,10 @@ public:
     /** Adds a chord to the list of chords to include in dissonance calculations.
      
         This does not set frequency or amplitude values for any distribution objects for the new chord. setFreqInChord and setAmpInChord must be called for all distributions in the new chord before calling calculateDissonances.
+     
+        @return An error if the chord would take the chords over the hard memory limit, in which case it isn't added.
     */
-    void addChord();
+    Result addChord();
     
     /** Sets a distribution's frequency for a particular chord.
      
@@ -168,6 +175,8 @@ public:
     /** Calculates dissonance values for a list of chords.
      
         This function calculates dissonance values for a set of overtone distributions with a list of predefined chord structures (ie, sets of frequencies and amplitudes for each overtone distribution), yielding a dissonance value for each interval or chord.
+     
+        If the chords are over the hard memory limit, nothing is calculated and getLastError describes why.
     */
     void calculateDissonances();
     
@@ -209,6 +218,63 @@ public:
     /** Returns the dimensionality of the dissonance map. */
     Dimensionality getNumDimensions() const noexcept;
     
+    /** Sets the format in which 3D dissonance maps are stored.
+     
+        With the default, MapStorage::fullPrecision, maps are stored as floats. The other formats store maps as half floats or quantised values, which reduce the memory used by a map by 2 to 4 times. Values are decompressed when accessed with getDissonanceAtStep or getInterpolatedDissonance, and are accurate to within getMapStorage().getMaxError().
+     
+        Changing the format clears the map, so this should be called before calculateDissonanceMap.
+     
+        @see MapStorage
+    */
+    void setMapPrecision (MapStorage::Precision newPrecision);
+    
+    /** Returns the format in which 3D dissonance maps are stored. */
+    MapStorage::Precision getMapPrecision() const noexcept;
+    
+    /** Returns the compressed storage of a 3D dissonance map. This is empty when using MapStorage::fullPrecision. */
+    const MapStorage& getMapStorage() const noexcept;
+    
+    /** A predicate that selects the cells of a 3D dissonance map to calculate, given the fundamental frequencies of the x-axis and y-axis distributions at that cell. */
+    using CellMask = std::function<bool (const DissonanceCalc& calc, float xFreq, float yFreq)>;
+    
+    /** Sets a region of interest for 3D dissonance maps, so that calculateDissonanceMap only calculates the cells within it.
+     
+        When full precision maps are used, the cells within the mask are stored sparsely if that takes less memory than the full map, which is the case for most triangles and bands. Cells outside of the mask read as NaN from getDissonanceAtStep, and interpolating between them gives NaN. With the other precisions, maps are always stored in full and cells outside of the mask are stored as 0.
+     
+        Like the other settings of a map, this should be called before calculateDissonanceMap.
+     
+        @see orderedVoicesMask, maxSpanMask, pathMask
+    */
+    void setCellMask (CellMask newMask);
+    
+    /** Removes the region of interest, so that every cell of a 3D dissonance map is calculated. */
+    void clearCellMask();
+    
+    /** Returns true if a region of interest has been set. */
+    bool hasCellMask() const noexcept;
+    
+    /** Returns true if the cell at the (x, y) step of a 3D dissonance map is within the region of interest, or if there isn't one. */
+    bool isCellInMask (int xStep, int yStep) const;
+    
+    /** Returns true if the cells of the current 3D dissonance map are stored sparsely. */
+    bool usingSparseMap() const noexcept;
+    
+    /** Returns a mask of the cells where the y-axis distribution is at or above the x-axis distribution, which is the half of a map in which the voices are in order. */
+    static CellMask orderedVoicesMask();
+    
+    /** Returns a mask of the cells where the ratio between the highest and lowest fundamentals of every unmuted distribution, including those with fixed frequencies, is no more than maxRatio.
+     
+        @param maxRatio The widest span of the chord, such as 4 for two octaves.
+    */
+    static CellMask maxSpanMask (float maxRatio);
+    
+    /** Returns a mask of the cells within a band around a path through the map.
+     
+        @param path Returns the y-axis frequency of the path for an x-axis frequency.
+        @param widthRatio The largest ratio between a cell's y-axis frequency and the path's, in either direction, such as 1.06 for about a semitone.
+    */
+    static CellMask pathMask (std::function<float (float xFreq)> path, float widthRatio);
+    
     //==============================================================================
     /** Sets the range of frequencies to use when calculating dissonance maps.
      
@@ -229,6 +295,26 @@ public:
     /** Returns the number of data points to calculate in a dissonance map. */
     int getNumSteps() const noexcept;
     
+    /** Flags to indicate how the steps of a dissonance map are spaced across the frequency range. */
+    enum StepType
+    {
+        linearSteps,            /**< Steps of equal size in Hz. */
+        logarithmicSteps,       /**< Steps of equal frequency ratio. */
+        erbRateSteps,           /**< Steps of equal size on the ERB-rate scale. */
+        barkSteps               /**< Steps of equal size on the Bark scale. */
+    };
+    
+    /** Sets how the steps of a dissonance map are spaced across the frequency range.
+     
+        ERB-rate and Bark steps follow the frequency resolution of the auditory system, which is roughly linear below 500 Hz and logarithmic above it. Logarithmic steps oversample low frequencies relative to the ear's resolution, so a map with ERB-rate or Bark steps needs fewer steps to resolve the same perceptual detail.
+     
+        @see AuditoryScales
+    */
+    void setStepType (StepType newStepType) noexcept;
+    
+    /** Returns how the steps of a dissonance map are spaced. */
+    StepType getStepType() const noexcept;
+    
     /** Sets the type of step used.
      
         Setting this to true will cause dissonance calculations to use logarithmic step sizes that increase in size as frequencies increase. This ensures that the resolution of the dissonance map scales (approximately) with a number of pitch perception observations, including the perception of frequency distance and just noticeable difference.
@@ -242,9 +328,11 @@ public:
     
     /** Returns the step size between each data point in a dissonance map.
      
-        This could return a logarithmic step size or linear step size, each having their own operations. It is advised that this is called in tandem with usingLogarithmicSteps, if operations are to be done using this result. Different implementations are likely needed when switching between logarithmic and linear steps.
+        This could return a logarithmic step size or linear step size, each having their own operations. It is advised that this is called in tandem with getStepType, if operations are to be done using this result. Different implementations are likely needed for each type of step. For ERB-rate and Bark steps, the step size is in Cams and Bark, respectively.
+     
+        To convert between steps and frequencies, getFrequencyAtStep and getStepOfFrequency should be preferred, as they handle every type of step.
      
-        @see useLogarithmicSteps
+        @see setStepType
     */
     float getStepSize() const noexcept;
     
@@ -286,9 +374,111 @@ public:
     /** Checks if any data needs to be set in order to calculate a dissonance map. */
     bool isReadyToProcess();
     
-    /** Calculates dissonance values for a set of overtone distributions across a range of frequency intervals. */
+    /** Calculates dissonance values for a set of overtone distributions across a range of frequency intervals.
+     
+        If the map is larger than the memory budget, nothing is calculated and getLastError describes why. Use calculateDissonanceMapWithinBudget or streamDissonanceMap instead.
+     
+        @see setMemoryBudget, getLastError
+    */
     virtual void calculateDissonanceMap();
     
+    /** Returns the reason that the last call to calculateDissonanceMap or calculateDissonances calculated nothing, or Result::ok() if it succeeded. */
+    Result getLastError() const;
+    
+    /** Called with each row of a streamed dissonance map. A 2D map is passed as a single row with an xStep of 0.
+     
+        @return True to continue, or false to stop streaming.
+    */
+    using MapRowCallback = std::function<bool (int xStep, const float* values, int numValues)>;
+    
+    /** Calculates a dissonance map a row at a time and passes each row to a callback, without storing the map. Only one row is held in memory, so maps of any size can be calculated.
+     
+        @return An error if the map couldn't be calculated. Stopping early from the callback isn't an error.
+    */
+    Result streamDissonanceMap (const MapRowCallback& rowCallback);
+    
+    /** Streams a dissonance map to a file.
+     
+        The file starts with a header of 32-bit values: a magic number, a version, the dimensionality, the number of steps, the start and end of the frequency range and the step type. This is followed by each row of the map as native-endian floats.
+    */
+    Result calculateDissonanceMapToFile (const File& file);
+    
+    /** Stores the dissonance map if it fits within the memory budget, or otherwise streams it.
+     
+        @param overflowCallback Receives the rows of maps that are too large to store. If this is nullptr, those maps are rejected.
+        @return An error if the map was rejected or couldn't be calculated.
+    */
+    Result calculateDissonanceMapWithinBudget (const MapRowCallback& overflowCallback = nullptr);
+    
+    //==============================================================================
+    /** Sets limits on the memory used to store dissonance maps and chords.
+     
+        Maps that would use more memory than either limit aren't allocated by setNumSteps or calculated by calculateDissonanceMap, and calculateDissonanceMapWithinBudget streams them instead. Chords beyond the hard limit can't be added, and checkMemoryBudget reports which limit a job exceeds.
+     
+        @param softLimitBytes The largest map to store rather than stream, or 0 for no limit.
+        @param hardLimitBytes The most memory that a map or the chords may use, or 0 for no limit.
+    */
+    void setMemoryBudget (size_t softLimitBytes, size_t hardLimitBytes = 0);
+    
+    /** Returns the largest map that will be stored rather than streamed, or 0 if there is no limit. */
+    size_t getSoftMemoryLimit() const noexcept;
+    
+    /** Returns the most memory that a map or the chords may use, or 0 if there is no limit. */
+    size_t getHardMemoryLimit() const noexcept;
+    
+    /** Returns the memory needed to store a dissonance map with the current settings. Masked maps are estimated at their full size. */
+    size_t getEstimatedMapMemory() const noexcept;
+    
+    /** Returns the memory needed to store a number of chords and their dissonances. */
+    size_t getEstimatedChordMemory (int numChordsToStore) const noexcept;
+    
+    /** Returns true if a dissonance map with the current settings can be stored within both memory limits. */
+    bool mapFitsInMemoryBudget() const noexcept;
+    
+    /** Checks the stored map and chords against the hard memory limit.
+     
+        @return An error describing the job that exceeds the limit, or Result::ok().
+    */
+    Result checkMemoryBudget() const;
+
+    /** The frequency ratio, amplitude ratio and mute state of a partial, recorded before it is edited.
+
+        @see repairDissonanceMap
+    */
+    struct PartialState
+    {
+        float freqRatio;
+        float ampRatio;
+        bool muted;
+    };
+
+    /** Returns the current state of a partial, to pass to repairDissonanceMap after editing it. */
+    PartialState getPartialState (int distributionIndex, int partialIndex) const;
+
+    /** Updates a calculated dissonance map after a single partial has been edited.
+
+        Editing a partial with setFreqRatio, setAmpRatio or mutePartial only changes the roughness between that partial and every other partial. Rather than recalculating the whole map, this subtracts the partial's old contribution and adds its new one at every step, which takes time proportional to the number of partials rather than its square.
+
+        Repeated repairs accumulate floating-point error, so the map should occasionally be resynchronised by passing exactResync, which recalculates it in full. A compressed map is quantised again by every repair, which adds up to half a quantisation step of error to each cell, so after 8 repairs since it was last calculated in full, the next repair recalculates it instead.
+
+        Repairs are only possible when the model is a SpectralInterferenceModel and there are no preprocessors, as preprocessors can change any partial in response to an edit. Otherwise, the map is recalculated in full.
+
+        @param distributionIndex The index of the distribution containing the edited partial.
+        @param partialIndex The index of the edited partial after the edit. This can differ from its index before the edit, as setFreqRatio keeps partials sorted by frequency.
+        @param oldState The state of the partial before the edit, as returned by getPartialState.
+        @param exactResync Set to true to recalculate the whole map instead.
+        @return True if the map was repaired, or false if it was recalculated in full.
+    */
+    bool repairDissonanceMap (int distributionIndex, int partialIndex, const PartialState& oldState, bool exactResync = false);
+
+    /** Sets a ShadowVerifier to check the accuracy of dissonance maps against the exact calculation.
+
+        After each compressed map is calculated with calculateDissonanceMap, and after each call to repairDissonanceMap, the verifier is given a random sample of the map's cells, which it recalculates on its own thread. Compressed maps are recorded under the kernel name "compressedMap" and repaired maps under "repairedMap". Uncompressed maps are calculated exactly, so they aren't submitted.
+
+        @param verifier The verifier to use, which must outlive this DissonanceCalc, or nullptr to stop verifying. Copies of this DissonanceCalc don't use the verifier.
+    */
+    void setShadowVerifier (ShadowVerifier* verifier) noexcept;
+
     /** Attempts to locate all local dissonance minima or maxima for a 2D dissonance map.
      
         Using default values for all parameters will search for minima throughout the entire frequency range of map. By setting the parameters with different values, you can also search for maxima or search within a different frequency range.
@@ -307,7 +497,7 @@ public:
     /** Returns the dissonance value stored at the nth step in a 2D dissonance map. */
     float getDissonanceAtStep (int step) const;
     
-    /** Returns the dissonance value stored at the (x, y) step in a 3D dissonance map. */
+    /** Returns the dissonance value stored at the (x, y) step in a 3D dissonance map. Cells outside of the region of interest set with setCellMask read as NaN, or 0 for compressed maps. */
     float getDissonanceAtStep (int xStep, int yStep) const;
     
     /** Returns the dissonance value when the x-axis distribution has a frequency equal to the input. */
@@ -316,17 +506,35 @@ public:
     /** Returns the dissonance value when the x-axis and y-axis distributions have respective frequencies of the input parameters xFreq and yFreq. */
     float getDissonanceAtFreq (float xFreq, float yFreq) const;
 
+    /** Returns the dissonance at a frequency, interpolated from the values stored in a 2D dissonance map.
+     
+        Unlike getDissonanceAtFreq, this doesn't calculate the dissonance, so it is only valid after calculateDissonanceMap. Frequencies outside of the map's range are clipped to its first or last step.
+    */
+    float getInterpolatedDissonance (float freq) const;
+    
+    /** Returns the dissonance at a pair of frequencies, bilinearly interpolated from the values stored in a 3D dissonance map.
+     
+        @see getInterpolatedDissonance
+    */
+    float getInterpolatedDissonance (float xFreq, float yFreq) const;
+
     /** Returns the frequency in Hz of a given step. */
-    float getFrequencyAtStep (float step);
+    float getFrequencyAtStep (float step) const;
     
     /** Returns the frequency ratio of a given step to the start frequency. */
-    float getFreqRatioAtStep (float step);
+    float getFreqRatioAtStep (float step) const;
     
     /** Returns a step number for a given frequency.
      
         Being of type float, the return value can have decimal places indicating that the frequency lies between two steps.
     */
-    float getStepOfFrequency (float freq);
+    float getStepOfFrequency (float freq) const;
+    
+    /** Returns the frequency of every step in a dissonance map.
+     
+        This is the axis against which the values of get2dRawDissonanceData (or each row and column of a 3D map) should be plotted or exported.
+    */
+    Array<float> getStepFrequencies() const;
     
     /** Returns an array of frequencies representing the dissonance minima or maxima of a 2D dissonance map.
      
@@ -342,6 +550,15 @@ public:
     ///@}
     
 protected:
+    friend class SessionSnapshot;
+    friend class ResultCache;
+    friend class RegisterSweep;
+    friend class MapRenderer;
+    friend class ShadowVerifier;
+    
+    /** Creates a copy of another DissonanceCalc object, optionally without its list of chords. */
+    DissonanceCalc (const DissonanceCalc& otherCalc, bool copyChords);
+    
     /** Contains OvertoneDistribution objects to be used in dissonance calculations. */
     OwnedArray<OvertoneDistribution> distributions;
     
@@ -371,12 +588,19 @@ protected:
     //==============================================================================
     Array<float> map2D;
     Array<Array<float>> map3D;
+    MapStorage compressedMap3D;
+    SparseMapStorage sparseMap3D;
+    CellMask cellMask;
+    ShadowVerifier* shadowVerifier;
+    int numCompressedRepairs;
+    size_t softMemoryLimit, hardMemoryLimit;
+    String lastError;
     
     Range<float> frequencyRange;
     float stepSize;
     int numSteps, varDist, xDist, yDist;
     Dimensionality dimensionality;
-    bool logSteps;
+    StepType stepType;
     
     //==============================================================================
     //                               Optimization
@@ -391,17 +615,23 @@ protected:
      
         \f$$\frac{f_{max}-f_{min}}{n}$\f$
      
-        and logarithmic step sizes are found with
+        logarithmic step sizes are found with
      
         \f$$\sqrt[n]{\frac{f_{max}}{f_{min}}}$\f$
      
-        where \f$n\f$ is the number of steps.
+        and ERB-rate and Bark step sizes are found with
+     
+        \f$$\frac{s(f_{max})-s(f_{min})}{n}$\f$
+     
+        where \f$n\f$ is the number of steps and \f$s\f$ converts a frequency to the ERB-rate or Bark scale.
     */
     virtual void setStepSize() noexcept;
     
     /** Increments the frequency of an overtone distribution by the step size.
      
-        This is called after each dissonance calculation when creating a dissonance map, to increment the frequency of an overtone distribution. When using logarithmic steps, the frequency is multiplied by the step size.  When using linear steps, the step size is added to the frequency.
+        When using logarithmic steps, the frequency is multiplied by the step size. When using linear steps, the step size is added to the frequency. When using ERB-rate or Bark steps, the step size is added to the frequency on that scale.
+     
+        Dissonance maps find the frequency of each step with getFrequencyAtStep instead, so that rounding errors don't accumulate over many steps.
      
         @param frequency The frequency to increment.
         @return The incremented frequency.
@@ -410,4 +640,25 @@ protected:
     
     /** Resizes the array that will hold dissonance values when using calculateRange. */
     void resizeMap();
+    
+    /** Returns true if 3D dissonance maps are stored in compressedMap3D, rather than map3D. */
+    bool usingCompressedMap() const noexcept;
+
+    /** Returns an error message if a number of chords would be over the hard memory limit, or an empty string if they fit. */
+    String getChordMemoryError (int numChordsToStore) const;
+    
+    /** Calculates a row of a dissonance map into an array of numSteps values. Cells outside of the cell mask are set to NaN. */
+    void calculateMapRow (int xStep, float* row, OwnedArray<OvertoneDistribution>& tempDistributions);
+    
+    /** Finds the cells within the mask and decides how to store them. If storing them sparsely takes less memory than the full map, sparseMap3D is allocated and map3D is freed.
+
+        @return True if the map should be stored in sparseMap3D.
+    */
+    bool useSparseMapForMask();
+
+    /** Returns the roughness between a partial with the given real frequency and amplitude and every other audible partial and fundamental, at the distributions' current fundamentals.
+
+        @see repairDissonanceMap
+    */
+    float calculatePartialContribution (SpectralInterferenceModel& pairwiseModel, int distributionIndex, int partialIndex, float freq, float amp) const;
 };
@@ -0,0 +1,300 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "DissonanceEstimator.h"
+#include "AuditoryScales.h"
+
+DissonanceEstimator::DissonanceEstimator()
+{
+    numPartials = 0;
+    nearNormalisation = 0;
+    proximityWindow = 3;
+    uniformProportion = 0.1f;
+    confidenceLevel = 0.95f;
+
+    reset();
+}
+
+DissonanceEstimator::~DissonanceEstimator()
+{
+}
+
+//==============================================================================
+
+
+void DissonanceEstimator::setDistributions (const OwnedArray<OvertoneDistribution>& distributions)
+{
+    partials.setDistributions (distributions);
+
+    prepare();
+    reset();
+}
+
+void DissonanceEstimator::setProximityWindow (float numErbs)
+{
+    jassert (numErbs > 0);
+
+    proximityWindow = jmax (0.01f, numErbs);
+
+    prepare();
+    reset();
+}
+
+void DissonanceEstimator::setUniformProportion (float proportion)
+{
+    // Without any uniform samples, pairs outside of the window could never be sampled and the estimate would be biased
+    jassert (proportion > 0 && proportion <= 1);
+
+    uniformProportion = jlimit (0.001f, 1.0f, proportion);
+
+    reset();
+}
+
+void DissonanceEstimator::setConfidenceLevel (float level)
+{
+    jassert (level > 0 && level < 1);
+
+    confidenceLevel = jlimit (0.5f, 0.9999f, level);
+}
+
+void DissonanceEstimator::setSeed (int64 seed)
+{
+    random.setSeed (seed);
+
+    reset();
+}
+
+void DissonanceEstimator::reset()
+{
+    numSamples = 0;
+    mean = 0;
+    sumOfSquaredDeviations = 0;
+    isExact = false;
+}
+
+//==============================================================================
+
+
+DissonanceEstimator::Estimate DissonanceEstimator::refine (SpectralInterferenceModel& model, int numSamplesToAdd)
+{
+    if (isExact)
+        return getEstimate();
+
+    // When every pair can be summed in no more time than sampling would take, the exact sum is used instead
+    if (getNumPairs() <= (int64) numSamples + numSamplesToAdd)
+    {
+        mean = model.calculatePairwiseDissonance (sortedFreqs.getRawDataPointer(), sortedAmps.getRawDataPointer(), numPartials);
+        sumOfSquaredDeviations = 0;
+        numSamples = (int) getNumPairs();
+        isExact = true;
+
+        return getEstimate();
+    }
+
+    for (int s = 0; s < numSamplesToAdd; ++s)
+    {
+        int i, j;
+        samplePair (i, j);
+
+        const double value = model.calculateRoughness (sortedFreqs[i], sortedAmps[i], sortedFreqs[j], sortedAmps[j])
+                             / getPairProbability (i, j);
+
+        // Welford's running mean and variance
+        ++numSamples;
+        const double delta = value - mean;
+        mean += delta / numSamples;
+        sumOfSquaredDeviations += delta * (value - mean);
+    }
+
+    return getEstimate();
+}
+
+DissonanceEstimator::Estimate DissonanceEstimator::estimate (SpectralInterferenceModel& model, float tolerance, bool relativeTolerance, int maxSamples)
+{
+    jassert (tolerance > 0);
+
+    int batchSize = 1024;
+    Estimate currentEstimate = getEstimate();
+
+    while (! currentEstimate.exact && numSamples < maxSamples)
+    {
+        if (numSamples >= 2)
+        {
+            const float halfWidth = jmax (currentEstimate.upperBound - currentEstimate.dissonance,
+                                          currentEstimate.dissonance - currentEstimate.lowerBound);
+
+            if (halfWidth <= (relativeTolerance ? tolerance * std::abs (currentEstimate.dissonance) : tolerance))
+                break;
+        }
+
+        currentEstimate = refine (model, jmin (batchSize, maxSamples - numSamples));
+        batchSize = jmin (batchSize * 2, 65536);
+    }
+
+    return currentEstimate;
+}
+
+DissonanceEstimator::Estimate DissonanceEstimator::getEstimate() const
+{
+    Estimate result;
+    result.dissonance = (float) mean;
+    result.numSamples = numSamples;
+    result.exact = isExact;
+
+    if (isExact)
+    {
+        result.lowerBound = result.dissonance;
+        result.upperBound = result.dissonance;
+    }
+    else if (numSamples < 2)
+    {
+        // Nothing is known about the error of a single sample
+        result.lowerBound = 0;
+        result.upperBound = std::numeric_limits<float>::infinity();
+    }
+    else
+    {
+        const double standardError = std::sqrt (sumOfSquaredDeviations / (numSamples - 1) / numSamples);
+        const double halfWidth = getZScore() * standardError;
+
+        // Roughness is never negative
+        result.lowerBound = (float) jmax (0.0, mean - halfWidth);
+        result.upperBound = (float) (mean + halfWidth);
+    }
+
+    return result;
+}
+
+int64 DissonanceEstimator::getNumPairs() const noexcept
+{
+    return (int64) numPartials * (numPartials - 1) / 2;
+}
+
+//==============================================================================
+
+
+void DissonanceEstimator::prepare()
+{
+    numPartials = partials.size();
+
+    Array<int> order;
+
+    for (int i = 0; i < numPartials; ++i)
+        order.add (i);
+
+    std::sort (order.begin(), order.end(),
+               [this] (int a, int b) { return partials.getFreq (a) < partials.getFreq (b); });
+
+    sortedFreqs.clearQuick();
+    sortedAmps.clearQuick();
+    ampPrefixSums.clearQuick();
+    firstPartialWeights.clearQuick();
+    windowStarts.clearQuick();
+    windowEnds.clearQuick();
+
+    ampPrefixSums.add (0);
+    firstPartialWeights.add (0);
+
+    for (int index : order)
+    {
+        sortedFreqs.add (partials.getFreq (index));
+        sortedAmps.add (partials.getAmp (index));
+        ampPrefixSums.add (ampPrefixSums.getLast() + partials.getAmp (index));
+    }
+
+    // Near pairs are picked by choosing the first partial with probability proportional to its amplitude times the amplitude in its window, then the second in proportion to its amplitude. This makes the probability of a near pair proportional to the product of its amplitudes.
+    for (int i = 0; i < numPartials; ++i)
+    {
+        const float halfWidth = proximityWindow * AuditoryScales::getErb (sortedFreqs[i]);
+        const int start = (int) (std::lower_bound (sortedFreqs.begin(), sortedFreqs.end(), sortedFreqs[i] - halfWidth) - sortedFreqs.begin());
+        const int end = (int) (std::upper_bound (sortedFreqs.begin(), sortedFreqs.end(), sortedFreqs[i] + halfWidth) - sortedFreqs.begin());
+
+        windowStarts.add (start);
+        windowEnds.add (end);
+
+        const double ampInWindow = ampPrefixSums[end] - ampPrefixSums[start] - sortedAmps[i];
+        firstPartialWeights.add (firstPartialWeights.getLast() + sortedAmps[i] * jmax (0.0, ampInWindow));
+    }
+
+    nearNormalisation = firstPartialWeights.getLast();
+}
+
+double DissonanceEstimator::getPairProbability (int i, int j) const noexcept
+{
+    const double uniformWeight = nearNormalisation > 0 ? uniformProportion : 1.0;
+    double nearProbability = 0;
+
+    if (nearNormalisation > 0)
+    {
+        // Either partial can be the one whose window the pair was sampled from
+        const int numWays = (j >= windowStarts[i] && j < windowEnds[i] ? 1 : 0)
+                            + (i >= windowStarts[j] && i < windowEnds[j] ? 1 : 0);
+
+        nearProbability = (double) sortedAmps[i] * sortedAmps[j] * numWays / nearNormalisation;
+    }
+
+    return (1 - uniformWeight) * nearProbability + uniformWeight / (double) getNumPairs();
+}
+
+void DissonanceEstimator::samplePair (int& i, int& j)
+{
+    const double uniformWeight = nearNormalisation > 0 ? uniformProportion : 1.0;
+
+    if (random.nextDouble() < uniformWeight)
+    {
+        i = random.nextInt (numPartials);
+        j = random.nextInt (numPartials - 1);
+
+        if (j >= i)
+            ++j;
+
+        return;
+    }
+
+    const double* weights = firstPartialWeights.getRawDataPointer();
+    i = (int) (std::upper_bound (weights + 1, weights + numPartials + 1, random.nextDouble() * nearNormalisation) - weights) - 1;
+    i = jlimit (0, numPartials - 1, i);
+
+    // Skip over the first partial's own amplitude, so that it can't be paired with itself
+    const int start = windowStarts[i];
+    const int end = windowEnds[i];
+    const double ampInWindow = ampPrefixSums[end] - ampPrefixSums[start] - sortedAmps[i];
+    double position = ampPrefixSums[start] + random.nextDouble() * ampInWindow;
+
+    if (position >= ampPrefixSums[i])
+        position += sortedAmps[i];
+
+    j = findPartialByAmplitude (position, start, end);
+
+    if (j == i)
+        j = i + 1 < end ? i + 1 : i - 1;
+}
+
+int DissonanceEstimator::findPartialByAmplitude (double position, int start, int end) const noexcept
+{
+    const double* sums = ampPrefixSums.getRawDataPointer();
+    const int index = (int) (std::upper_bound (sums + start + 1, sums + end + 1, position) - sums) - 1;
+
+    return jlimit (start, end - 1, index);
+}
+
+float DissonanceEstimator::getZScore() const noexcept
+{
+    // The inverse error function, with Winitzki's approximation, which is accurate to better than 0.2%
+    const double a = 0.147;
+    const double logTerm = std::log (1.0 - (double) confidenceLevel * confidenceLevel);
+    const double firstTerm = 2 / (MathConstants<double>::pi * a) + logTerm / 2;
+    const double inverseErf = std::sqrt (std::sqrt (firstTerm * firstTerm - logTerm / a) - firstTerm);
+
+    return (float) (MathConstants<double>::sqrt2 * inverseErf);
+}
@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceModel.h"
+#include "OvertoneDistribution.h"
+#include "PartialList.h"
+
+/** Estimates the dissonance of very dense spectra by sampling pairs of partials.
+
+    SpectralInterferenceModel::calculateDissonance sums the roughness of every pair of partials, which takes time proportional to the square of the number of partials. For analysed noise or bells with thousands of partials, this class instead estimates the sum from a random sample of pairs, with a confidence interval that narrows as more pairs are sampled.
+
+    Pairs are importance-sampled: most samples pick two partials that lie within a few ERBs of each other, with probability proportional to the product of their amplitudes, as these pairs make up almost all of the roughness. The rest are picked uniformly from every pair, so that no pair has zero probability and the estimate is unbiased. Each sampled pair's roughness is divided by its probability, and the estimate is the mean of these values.
+
+    Sampling is progressive: refine adds samples to the current estimate, and estimate keeps refining until the confidence interval is within a tolerance. When there are fewer pairs than the samples that would be drawn, the exact sum is calculated instead.
+*/
+class DissonanceEstimator
+{
+public:
+    //==============================================================================
+    /** An estimate of the dissonance of a set of distributions. */
+    struct Estimate
+    {
+        float dissonance;       /**< The estimated dissonance. */
+        float lowerBound;       /**< The lower bound of the confidence interval. */
+        float upperBound;       /**< The upper bound of the confidence interval. */
+        int numSamples;         /**< The number of pairs sampled, or the number of pairs summed if the estimate is exact. */
+        bool exact;             /**< True if every pair was summed, so the estimate has no error. */
+    };
+
+    //==============================================================================
+    /** Creates a DissonanceEstimator with no partials. */
+    DissonanceEstimator();
+
+    /** Destructor. */
+    ~DissonanceEstimator();
+
+    //==============================================================================
+    /** Sets the distributions whose dissonance is estimated, at their current fundamentals. This discards the current estimate. */
+    void setDistributions (const OwnedArray<OvertoneDistribution>& distributions);
+
+    /** Sets the distance within which partials are sampled as near pairs, in ERBs. This discards the current estimate.
+
+        The window should cover the range over which the model's roughness curve is significant. The default of 3 ERBs covers the Plomp-Levelt curves used by SetharesModel and VassilakisModel.
+    */
+    void setProximityWindow (float numErbs);
+
+    /** Sets the proportion of samples picked uniformly from all pairs, between 0 and 1. This discards the current estimate. */
+    void setUniformProportion (float proportion);
+
+    /** Sets the confidence level of the interval, such as 0.95. */
+    void setConfidenceLevel (float level);
+
+    /** Seeds the random number generator, so that estimates can be repeated. This discards the current estimate. */
+    void setSeed (int64 seed);
+
+    /** Discards the current estimate. */
+    void reset();
+
+    //==============================================================================
+    /** Samples more pairs and returns the improved estimate.
+
+        @param model The model whose roughness curve is used.
+        @param numSamplesToAdd The number of pairs to sample.
+    */
+    Estimate refine (SpectralInterferenceModel& model, int numSamplesToAdd);
+
+    /** Samples pairs until the confidence interval is within a tolerance, or a maximum number of samples is reached.
+
+        @param model The model whose roughness curve is used.
+        @param tolerance The largest acceptable distance between the estimate and either bound of its confidence interval.
+        @param relativeTolerance If true, the tolerance is a proportion of the estimate. If false, it's in units of dissonance.
+        @param maxSamples The number of samples at which sampling stops, even if the tolerance isn't met.
+    */
+    Estimate estimate (SpectralInterferenceModel& model, float tolerance, bool relativeTolerance = true, int maxSamples = 1 << 20);
+
+    /** Returns the current estimate, without sampling any more pairs. */
+    Estimate getEstimate() const;
+
+    /** Returns the number of pairs of audible partials. */
+    int64 getNumPairs() const noexcept;
+
+private:
+    //==============================================================================
+    PartialList partials;
+    int numPartials;
+
+    // Partials sorted by frequency, with the running sum of their amplitudes and the range of partials in each partial's window
+    Array<float> sortedFreqs, sortedAmps;
+    Array<double> ampPrefixSums, firstPartialWeights;
+    Array<int> windowStarts, windowEnds;
+    double nearNormalisation;
+
+    float proximityWindow, uniformProportion, confidenceLevel;
+    Random random;
+
+    int numSamples;
+    double mean, sumOfSquaredDeviations;
+    bool isExact;
+
+    //==============================================================================
+    /** Sorts the partials and builds the tables used for sampling. */
+    void prepare();
+
+    /** Returns the probability of sampling the pair of sorted partials i and j. */
+    double getPairProbability (int i, int j) const noexcept;
+
+    /** Picks a random pair of sorted partials. */
+    void samplePair (int& i, int& j);
+
+    /** Returns the index of the partial at a position in the running sum of amplitudes. */
+    int findPartialByAmplitude (double position, int start, int end) const noexcept;
+
+    /** Returns the number of standard errors between the estimate and the bounds of its confidence interval. */
+    float getZScore() const noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DissonanceEstimator)
+};
@@ -130,6 +130,78 @@ float SpectralInterferenceModel::calculateDissonance (const OwnedArray<OvertoneD
     return dissonance;
 }
 
+float SpectralInterferenceModel::calculatePairwiseDissonance (const float* freqs, const float* amps, int numPartials)
+{
+    float dissonance = 0;
+    
+    for (int i = 0; i < numPartials; ++i)
+        for (int j = i + 1; j < numPartials; ++j)
+            dissonance += calculateRoughness (freqs[i], amps[i], freqs[j], amps[j]);
+    
+    return dissonance;
+}
+
+void SpectralInterferenceModel::AlignedPartials::copy (const float* sourceFreqs, const float* sourceAmps, int numPartials)
+{
+    const int laneWidth = (int) SIMDFloat::size();
+    paddedSize = ((numPartials + laneWidth - 1) / laneWidth) * laneWidth;
+    
+    if (paddedSize > capacity)
+    {
+        capacity = paddedSize;
+        
+        // Four arrays and room for alignment
+        storage.malloc ((size_t) (4 * capacity + laneWidth));
+        
+        freqs = SIMDFloat::getNextSIMDAlignedPtr (storage.get());
+        amps = freqs + capacity;
+        curveInterps = amps + capacity;
+        ampPowers = curveInterps + capacity;
+    }
+    
+    FloatVectorOperations::copy (freqs, sourceFreqs, numPartials);
+    FloatVectorOperations::copy (amps, sourceAmps, numPartials);
+    
+    // The padding is silent, so it adds nothing to any sum
+    const int numPadding = paddedSize - numPartials;
+    
+    if (numPadding > 0)
+    {
+        FloatVectorOperations::clear (freqs + numPartials, numPadding);
+        FloatVectorOperations::clear (amps + numPartials, numPadding);
+        FloatVectorOperations::clear (curveInterps + numPartials, numPadding);
+        FloatVectorOperations::clear (ampPowers + numPartials, numPadding);
+    }
+}
+
+namespace
+{
+    typedef dsp::SIMDRegister<float> SIMDFloat;
+    
+    /** Returns e to the power of each lane, for exponents of 0 or less.
+     
+        SIMDRegister has no exponential, so the exponent is divided by 256, its Taylor series is summed to the 7th power, and the sum is squared 8 times. Down to the point where a float underflows, this is within about 3e-5 of std::exp relative to its value.
+    */
+    SIMDFloat expOfNonPositive (SIMDFloat exponent) noexcept
+    {
+        const SIMDFloat x = SIMDFloat::max (exponent, SIMDFloat::expand (-87.0f)) * (1.0f / 256);
+        
+        SIMDFloat result = SIMDFloat::expand (1.0f / 5040);
+        result = result * x + (1.0f / 720);
+        result = result * x + (1.0f / 120);
+        result = result * x + (1.0f / 24);
+        result = result * x + (1.0f / 6);
+        result = result * x + 0.5f;
+        result = result * x + 1.0f;
+        result = result * x + 1.0f;
+        
+        for (int i = 0; i < 8; ++i)
+            result = result * result;
+        
+        return result;
+    }
+}
+
 
 
 //==============================================================================
@@ -161,11 +233,74 @@ float SetharesModel::calculateRoughness (float firstFreq, float firstAmp,
                                          + plcFit2 * std::exp (plCurveRate2 * curveInterp * freqDiff));
 }
 
+float SetharesModel::calculatePairwiseDissonance (const float* freqs, const float* amps, int numPartials)
+{
+    const int laneWidth = (int) SIMDFloat::size();
+    
+    // Too few partials to fill the registers
+    if (numPartials < 2 * laneWidth)
+        return SpectralInterferenceModel::calculatePairwiseDissonance (freqs, amps, numPartials);
+    
+    alignedPartials.copy (freqs, amps, numPartials);
+    
+    const float* alignedFreqs = alignedPartials.freqs;
+    const float* alignedAmps = alignedPartials.amps;
+    float* curveInterps = alignedPartials.curveInterps;
+    
+    // s falls as the frequency rises, so the s of a pair is the larger s of its partials
+    for (int i = 0; i < numPartials; ++i)
+        curveInterps[i] = maxDiss / (plcInterp1 * freqs[i] + plcInterp2);
+    
+    float dissonance = 0;
+    SIMDFloat sums = SIMDFloat::expand (0.0f);
+    
+    for (int i = 0; i < numPartials - 1; ++i)
+    {
+        if (amps[i] <= 0)
+            continue;
+        
+        const int firstBlock = ((i + laneWidth) / laneWidth) * laneWidth;
+        
+        // The partials before the first whole register are paired one at a time
+        for (int j = i + 1; j < jmin (firstBlock, numPartials); ++j)
+            dissonance += calculateRoughness (freqs[i], amps[i], freqs[j], amps[j]);
+        
+        const SIMDFloat freq = SIMDFloat::expand (freqs[i]);
+        const SIMDFloat amp = SIMDFloat::expand (amps[i]);
+        const SIMDFloat curveInterp = SIMDFloat::expand (curveInterps[i]);
+        
+        for (int j = firstBlock; j < alignedPartials.paddedSize; j += laneWidth)
+        {
+            const SIMDFloat scaledDiff = SIMDFloat::max (curveInterp, SIMDFloat::fromRawArray (curveInterps + j))
+                                         * SIMDFloat::abs (SIMDFloat::fromRawArray (alignedFreqs + j) - freq);
+            
+            sums += SIMDFloat::min (amp, SIMDFloat::fromRawArray (alignedAmps + j))
+                    * (expOfNonPositive (scaledDiff * plCurveRate1) * plcFit1 + expOfNonPositive (scaledDiff * plCurveRate2) * plcFit2);
+        }
+    }
+    
+    return dissonance + sums.sum();
+}
+
 std::unique_ptr<DissonanceModel> SetharesModel::cloneModel() const
 {
     return std::make_unique<SetharesModel> (*this);
 }
 
+NamedValueSet SetharesModel::getParameters() const
+{
+    NamedValueSet parameters;
+    parameters.set ("maxDiss", maxDiss);
+    parameters.set ("plcInterp1", plcInterp1);
+    parameters.set ("plcInterp2", plcInterp2);
+    parameters.set ("plCurveRate1", plCurveRate1);
+    parameters.set ("plCurveRate2", plCurveRate2);
+    parameters.set ("plcFit1", plcFit1);
+    parameters.set ("plcFit2", plcFit2);
+    
+    return parameters;
+}
+
 
 //==============================================================================
 //                              VassilakisModel
@@ -200,10 +335,309 @@ float VassilakisModel::calculateRoughness (float firstFreq, float firstAmp,
     return x * y * z;
 }
 
+float VassilakisModel::calculatePairwiseDissonance (const float* freqs, const float* amps, int numPartials)
+{
+    const int laneWidth = (int) SIMDFloat::size();
+    
+    // Too few partials to fill the registers
+    if (numPartials < 2 * laneWidth)
+        return SpectralInterferenceModel::calculatePairwiseDissonance (freqs, amps, numPartials);
+    
+    alignedPartials.copy (freqs, amps, numPartials);
+    
+    const float* alignedFreqs = alignedPartials.freqs;
+    const float* alignedAmps = alignedPartials.amps;
+    float* curveInterps = alignedPartials.curveInterps;
+    float* ampPowers = alignedPartials.ampPowers;
+    
+    // s falls as the frequency rises, so the s of a pair is the larger s of its partials, and (a1a2)^0.1 is the product of the partials' powers
+    for (int i = 0; i < numPartials; ++i)
+    {
+        curveInterps[i] = maxDiss / (plcInterp1 * freqs[i] + plcInterp2);
+        ampPowers[i] = std::pow (amps[i], 0.1f);
+    }
+    
+    float dissonance = 0;
+    SIMDFloat sums = SIMDFloat::expand (0.0f);
+    
+    for (int i = 0; i < numPartials - 1; ++i)
+    {
+        if (amps[i] <= 0)
+            continue;
+        
+        const int firstBlock = ((i + laneWidth) / laneWidth) * laneWidth;
+        
+        // The partials before the first whole register are paired one at a time
+        for (int j = i + 1; j < jmin (firstBlock, numPartials); ++j)
+            dissonance += calculateRoughness (freqs[i], amps[i], freqs[j], amps[j]);
+        
+        const SIMDFloat freq = SIMDFloat::expand (freqs[i]);
+        const SIMDFloat ampPower = SIMDFloat::expand (ampPowers[i]);
+        const SIMDFloat curveInterp = SIMDFloat::expand (curveInterps[i]);
+        
+        for (int j = firstBlock; j < alignedPartials.paddedSize; j += laneWidth)
+        {
+            const SIMDFloat scaledDiff = SIMDFloat::max (curveInterp, SIMDFloat::fromRawArray (curveInterps + j))
+                                         * SIMDFloat::abs (SIMDFloat::fromRawArray (alignedFreqs + j) - freq);
+            
+            // SIMDRegister can't divide or raise to a power, so the amplitude balance is found one lane at a time
+            SIMDFloat balance;
+            
+            for (int lane = 0; lane < laneWidth; ++lane)
+            {
+                const float otherAmp = alignedAmps[j + lane];
+                balance.set ((size_t) lane, 0.5f * std::pow (2 * jmin (amps[i], otherAmp) / (amps[i] + otherAmp), 3.11f));
+            }
+            
+            sums += ampPower * SIMDFloat::fromRawArray (ampPowers + j) * balance
+                    * (expOfNonPositive (scaledDiff * plCurveRate1) * plcFit1 + expOfNonPositive (scaledDiff * plCurveRate2) * plcFit2);
+        }
+    }
+    
+    return dissonance + sums.sum();
+}
+
 std::unique_ptr<DissonanceModel> VassilakisModel::cloneModel() const
 {
     return std::make_unique<VassilakisModel> (*this);
 }
 
+NamedValueSet VassilakisModel::getParameters() const
+{
+    NamedValueSet parameters;
+    parameters.set ("maxDiss", maxDiss);
+    parameters.set ("plcInterp1", plcInterp1);
+    parameters.set ("plcInterp2", plcInterp2);
+    parameters.set ("plCurveRate1", plCurveRate1);
+    parameters.set ("plCurveRate2", plCurveRate2);
+    parameters.set ("plcFit1", plcFit1);
+    parameters.set ("plcFit2", plcFit2);
+    
+    return parameters;
+}
+
+
+
+//==============================================================================
+//                          KameokaKuriyagawaModel
+//==============================================================================
+
+KameokaKuriyagawaModel::KameokaKuriyagawaModel() :   referenceLevel (60), pressureExponent (1),
+                                                     peakScale (2.27f), peakExponent (0.477f),
+                                                     lowerSlope (1), upperSlope (1)
+{
+    name = "Kameoka-Kuriyagawa";
+    prepareTables();
+}
+
+KameokaKuriyagawaModel::~KameokaKuriyagawaModel()
+{
+}
+
+//==============================================================================
+
+
+float KameokaKuriyagawaModel::calculateDissonance (const OwnedArray<OvertoneDistribution>& distributions,
+                                                   bool sumPartialDissonances)
+{
+    partials.setDistributions (distributions);
+    
+    return sumPairs (partials.getFreqs(), partials.getAmps(), partials.size(), sumPartialDissonances ? &distributions : nullptr);
+}
+
+float KameokaKuriyagawaModel::calculatePairwiseDissonance (const float* freqs, const float* amps, int numPartials)
+{
+    return sumPairs (freqs, amps, numPartials, nullptr);
+}
+
+float KameokaKuriyagawaModel::calculateRoughness (float firstFreq, float firstAmp,
+                                                  float secondFreq, float secondAmp)
+{
+    // w rises with amplitude, so the weaker tone's weight is the weight of the smaller amplitude
+    const float weight = getWeight (jmin (firstAmp, secondAmp));
+    
+    if (weight <= 0)
+        return 0;
+    
+    return weight * getCurve (std::abs (firstFreq - secondFreq) * getInversePeak (jmin (firstFreq, secondFreq)));
+}
+
+std::unique_ptr<DissonanceModel> KameokaKuriyagawaModel::cloneModel() const
+{
+    return std::make_unique<KameokaKuriyagawaModel> (*this);
+}
+
+NamedValueSet KameokaKuriyagawaModel::getParameters() const
+{
+    NamedValueSet parameters;
+    parameters.set ("referenceLevel", referenceLevel);
+    parameters.set ("pressureExponent", pressureExponent);
+    parameters.set ("peakScale", peakScale);
+    parameters.set ("peakExponent", peakExponent);
+    parameters.set ("lowerSlope", lowerSlope);
+    parameters.set ("upperSlope", upperSlope);
+    
+    return parameters;
+}
+
+void KameokaKuriyagawaModel::setParameters (const NamedValueSet& newParameters)
+{
+    if (newParameters.contains ("referenceLevel"))
+        referenceLevel = jmax (1.0f, (float) newParameters["referenceLevel"]);
+    
+    if (newParameters.contains ("pressureExponent"))
+        pressureExponent = jmax (0.0f, (float) newParameters["pressureExponent"]);
+    
+    if (newParameters.contains ("peakScale"))
+        peakScale = jmax (0.01f, (float) newParameters["peakScale"]);
+    
+    if (newParameters.contains ("peakExponent"))
+        peakExponent = (float) newParameters["peakExponent"];
+    
+    if (newParameters.contains ("lowerSlope"))
+        lowerSlope = jmax (0.01f, (float) newParameters["lowerSlope"]);
+    
+    if (newParameters.contains ("upperSlope"))
+        upperSlope = jmax (0.01f, (float) newParameters["upperSlope"]);
+    
+    prepareTables();
+}
+
+//==============================================================================
+
+
+namespace
+{
+    const int curveTableSize = 8192;
+    const float curveTableRange = 64.0f;        // V(x) is negligible beyond 64 times the peak difference
+    const int peakTableSize = 4801;
+    const float peakTableStep = 5.0f;           // Hz, covering 0 - 24 kHz
+    const float lowestPeakFreq = 10.0f;         // The peak difference vanishes at 0 Hz, so lower frequencies use this one
+    const int initialNumPartials = 256;         // The per-partial arrays only grow for chords with more partials than this
+}
+
+void KameokaKuriyagawaModel::prepareTables()
+{
+    curveTable.resize (curveTableSize);
+    
+    for (int i = 0; i < curveTableSize; ++i)
+    {
+        const double x = curveTableRange * i / (curveTableSize - 1);
+        curveTable.set (i, (float) (x <= 1 ? std::pow (x, (double) lowerSlope) : std::pow (x, (double) -upperSlope)));
+    }
+    
+    // The last entry is 0, so interpolating towards the end of the table fades out smoothly
+    curveTable.set (curveTableSize - 1, 0.0f);
+    
+    inversePeakTable.resize (peakTableSize);
+    
+    for (int i = 0; i < peakTableSize; ++i)
+    {
+        const double freq = jmax ((double) lowestPeakFreq, (double) peakTableStep * i);
+        inversePeakTable.set (i, (float) (1.0 / (peakScale * std::pow (freq, (double) peakExponent))));
+    }
+    
+    // Amplitudes at or below this are at or below 0 dB above the threshold of hearing
+    thresholdAmp = std::pow (10.0f, -referenceLevel / 20.0f);
+    
+    if (weights.size() < initialNumPartials)
+    {
+        weights.resize (initialNumPartials);
+        inversePeaks.resize (initialNumPartials);
+    }
+}
+
+float KameokaKuriyagawaModel::sumPairs (const float* freqs, const float* amps, int numPartials,
+                                        const OwnedArray<OvertoneDistribution>* distributions)
+{
+    if (weights.size() < numPartials)
+    {
+        weights.resize (numPartials);
+        inversePeaks.resize (numPartials);
+    }
+    
+    float* partialWeights = weights.getRawDataPointer();
+    float* partialInversePeaks = inversePeaks.getRawDataPointer();
+    
+    // Each partial's weight and peak difference are converted once, rather than once for every pair it belongs to
+    for (int i = 0; i < numPartials; ++i)
+    {
+        partialWeights[i] = getWeight (amps[i]);
+        partialInversePeaks[i] = getInversePeak (freqs[i]);
+    }
+    
+    auto addPartialDissonance = [&] (int index, float partialDissonance)
+    {
+        OvertoneDistribution* distribution = (*distributions)[partials.getDistributionIndex (index)];
+        const int partialIndex = partials.getPartialIndex (index);
+        
+        if (partialIndex < 0)
+            distribution->addDissonanceToFundamental (partialDissonance);
+        else
+            distribution->addPartialDissonance (partialIndex, partialDissonance);
+    };
+    
+    float dissonance = 0;
+    
+    for (int i = 0; i < numPartials; ++i)
+    {
+        if (partialWeights[i] <= 0)     // Partials below the threshold of hearing create no roughness
+            continue;
+        
+        for (int j = i + 1; j < numPartials; ++j)
+        {
+            const float weight = jmin (partialWeights[i], partialWeights[j]);
+            
+            if (weight <= 0)
+                continue;
+            
+            const float inversePeak = freqs[i] <= freqs[j] ? partialInversePeaks[i] : partialInversePeaks[j];
+            const float pairDissonance = weight * getCurve (std::abs (freqs[i] - freqs[j]) * inversePeak);
+            
+            dissonance += pairDissonance;
+            
+            if (distributions != nullptr)
+            {
+                addPartialDissonance (i, pairDissonance / 2);
+                addPartialDissonance (j, pairDissonance / 2);
+            }
+        }
+    }
+    
+    return dissonance;
+}
+
+float KameokaKuriyagawaModel::getWeight (float amp) const noexcept
+{
+    if (amp <= thresholdAmp)
+        return 0;
+    
+    return pressureExponent == 1.0f ? amp : std::pow (amp, pressureExponent);
+}
 
+float KameokaKuriyagawaModel::getInversePeak (float freq) const noexcept
+{
+    const float position = freq / peakTableStep;
+    
+    // Frequencies above the table are rare enough to calculate directly
+    if (position >= peakTableSize - 1)
+        return 1.0f / (peakScale * std::pow (freq, peakExponent));
+    
+    const int index = (int) position;
+    const float* table = inversePeakTable.getRawDataPointer();
+    
+    return table[index] + (position - index) * (table[index + 1] - table[index]);
+}
 
+float KameokaKuriyagawaModel::getCurve (float x) const noexcept
+{
+    const float position = x * ((curveTableSize - 1) / curveTableRange);
+    
+    if (position >= curveTableSize - 1)
+        return 0;
+    
+    const int index = (int) position;
+    const float* table = curveTable.getRawDataPointer();
+    
+    return table[index] + (position - index) * (table[index + 1] - table[index]);
+}
@@ -15,6 +15,7 @@
 
 #include "JuceHeader.h"
 #include "OvertoneDistribution.h"
+#include "PartialList.h"
 
 /** Base class for implementing dissonance models. */
 class DissonanceModel
@@ -39,6 +40,19 @@ public:
     /** Enables dynamic allocation of child objects via std::unique_ptr. */
     virtual std::unique_ptr<DissonanceModel> cloneModel() const = 0;
     
+    //==============================================================================
+    /** Returns the values of the model's parameters.
+     
+        Together with the model's name, these identify the exact configuration of a model, so that it can be saved with a session or used to identify cached results.
+    */
+    virtual NamedValueSet getParameters() const { return NamedValueSet(); }
+    
+    /** Sets the values of the model's parameters, as returned by getParameters.
+     
+        Models whose parameters are fixed ignore this.
+    */
+    virtual void setParameters (const NamedValueSet&) {}
+    
 protected:
     //==============================================================================
     String name = "";
@@ -76,6 +90,39 @@ public:
     */
     virtual float calculateRoughness (float firstFreq, float firstAmp,
                                       float secondFreq, float secondAmp) = 0;
+    
+    /** Calculates the sum of the roughness between every pair of partials in arrays of real frequencies and amplitudes.
+     
+        Given the audible partials of a set of distributions, as listed by a PartialList, this is the same sum that calculateDissonance makes. Models that convert each partial before pairing it can override this to convert each partial once.
+     
+        @see PartialList
+    */
+    virtual float calculatePairwiseDissonance (const float* freqs, const float* amps, int numPartials);
+    
+protected:
+    typedef dsp::SIMDRegister<float> SIMDFloat;
+    
+    /** SIMD-aligned copies of the partials passed to calculatePairwiseDissonance, padded with silent partials to a whole number of registers.
+     
+        Copies start out empty, since the arrays only hold the partials of the call being evaluated.
+    */
+    struct AlignedPartials
+    {
+        AlignedPartials() {}
+        AlignedPartials (const AlignedPartials&) {}
+        AlignedPartials& operator= (const AlignedPartials&) { return *this; }
+        
+        /** Copies a set of partials and zeroes the padding of every array, growing the storage if needed. */
+        void copy (const float* sourceFreqs, const float* sourceAmps, int numPartials);
+        
+        HeapBlock<float> storage;
+        int capacity = 0;                   /**< The number of partials each array can hold. */
+        int paddedSize = 0;                 /**< The number of partials copied, rounded up to a multiple of the register size. */
+        float* freqs = nullptr;
+        float* amps = nullptr;
+        float* curveInterps = nullptr;      /**< The curve interpolation \f$s\f$ of each partial, as the lower frequency of a pair, filled in by the model. */
+        float* ampPowers = nullptr;         /**< A power of each partial's amplitude, filled in by models that need one. */
+    };
 };
 
 //==================================================================================
@@ -105,9 +152,15 @@ public:
     float calculateRoughness (float firstFreq, float firstAmp,
                               float secondFreq, float secondAmp) override;
     
+    /** Sums the roughness between every pair of partials, evaluating several pairs at once with juce::dsp::SIMDRegister. This requires the juce_dsp module. */
+    float calculatePairwiseDissonance (const float* freqs, const float* amps, int numPartials) override;
+    
     /** For dynamic allocation via std::unique_ptr in DissonanceCalc. */
     std::unique_ptr<DissonanceModel> cloneModel() const override;
     
+    /** Returns the constants of the model's roughness curve. */
+    NamedValueSet getParameters() const override;
+    
 protected:
     /** This is the point of maximum dissonance. The value is derived from a model of the Plom Levelt dissonance curves for all frequencies. Denoted by \f$$x$\f$. */
     const float maxDiss;
@@ -123,6 +176,7 @@ protected:
     const float plcFit2;        /**< These parameters have values to fit the experimental data of Plomp and Levelt. */
     float curveInterp;          /**< This stores the result of \f$s = \frac{x}{s_1f_1 + s_2}\f$. */
     float freqDiff;             /**< This stores the difference in frequency between the partials. */
+    AlignedPartials alignedPartials;
 };
 
 //==================================================================================
@@ -152,9 +206,15 @@ public:
     float calculateRoughness (float firstFreq, float firstAmp,
                               float secondFreq, float secondAmp) override;
     
+    /** Sums the roughness between every pair of partials, evaluating several pairs at once with juce::dsp::SIMDRegister. This requires the juce_dsp module. */
+    float calculatePairwiseDissonance (const float* freqs, const float* amps, int numPartials) override;
+    
     /** For dynamic allocation via std::unique_ptr in DissonanceCalc. */
     std::unique_ptr<DissonanceModel> cloneModel() const override;
     
+    /** Returns the constants of the model's roughness curve. */
+    NamedValueSet getParameters() const override;
+    
 protected:
     /** This is the point of maximum dissonance. The value is derived from a model of the Plom Levelt dissonance curves for all frequencies. Denoted by \f$$x$\f$. */
     const float maxDiss;
@@ -171,6 +231,98 @@ protected:
     float curveInterp;          /**< This stores the result of \f$s = \frac{x}{s_1f_1 + s_2}\f$. */
     float freqDiff;             /**< This stores the difference in frequency between the partials. */
     float x, y, z;
+    AlignedPartials alignedPartials;
+    
+    
+};
+
+//==================================================================================
+
+/** Implementation of Kameoka & Kuriyagawa's model from "Consonance Theory Part I: Consonance of Dyads" and "Consonance Theory Part II: Consonance of Complex Tones and its Calculation Method" (1969).
+ 
+    The dissonance of a dyad of pure tones depends on the frequency difference relative to the difference of maximum dissonance,
+ 
+    \f$$\Delta f_m(f) = 2.27f^{0.477}$\f$
+ 
+    and follows Kameoka & Kuriyagawa's "V-curve", which rises and falls along straight lines on logarithmic axes of dissonance and frequency difference:
+ 
+    \f$$V(x) = \begin{cases} x^{\alpha} & x \le 1 \\ x^{-\beta} & x > 1 \end{cases}$\f$
+ 
+    The dissonance grows as a power of the sound pressure of the weaker tone, and vanishes below the threshold of hearing:
+ 
+    \f$$d(f_1,f_2,a_1,a_2) = w(min(a_1,a_2))\,V(\frac{f_2-f_1}{\Delta f_m(f_1)})$\f$
+ 
+    where
+ 
+    \f$$w(a) = \begin{cases} a^{\gamma} & 20log_{10}a + L_0 > 0 \\ 0 & otherwise \end{cases}$\f$
+ 
+    for
+ 
+    \f$$f_1 < f_2$\f$
+ 
+    An amplitude of 1 is played at the reference level \f$L_0\f$. As in Part II, the dissonance of complex tones is the sum of the dissonance of every pair of partials.
+ 
+    The powers that make this model slow when evaluated naively are avoided: calculateDissonance and calculatePairwiseDissonance convert each audible partial's amplitude and frequency once per call, and \f$V\f$ and \f$\Delta f_m\f$ are read from tables that are built whenever the parameters change. As a SpectralInterferenceModel, it runs through the same fast paths as the other pairwise models.
+*/
+class KameokaKuriyagawaModel :   public SpectralInterferenceModel
+{
+public:
+    /** Creates a KameokaKuriyagawaModel object. */
+    KameokaKuriyagawaModel();
+    
+    /** Destructor. */
+    ~KameokaKuriyagawaModel();
+    
+    /** Calculates the dissonance of a set of overtone distributions, converting each partial's level once. */
+    float calculateDissonance (const OwnedArray<OvertoneDistribution>& distributions,
+                               bool sumPartialDissonances) override;
+    
+    /** Calculates the roughness between two partials. */
+    float calculateRoughness (float firstFreq, float firstAmp,
+                              float secondFreq, float secondAmp) override;
+    
+    /** Calculates the roughness between every pair of partials, converting each partial's level once. */
+    float calculatePairwiseDissonance (const float* freqs, const float* amps, int numPartials) override;
+    
+    /** For dynamic allocation via std::unique_ptr in DissonanceCalc. */
+    std::unique_ptr<DissonanceModel> cloneModel() const override;
+    
+    /** Returns the constants of the model's level dependence and V-curve. */
+    NamedValueSet getParameters() const override;
+    
+    /** Sets the constants of the model's level dependence and V-curve, and rebuilds its tables. */
+    void setParameters (const NamedValueSet& newParameters) override;
+    
+protected:
+    float referenceLevel;       /**< The sound pressure level, in dB above the threshold of hearing, of a partial with an amplitude of 1. Denoted by \f$L_0\f$. */
+    float pressureExponent;     /**< The power of the weaker tone's sound pressure. Denoted by \f$\gamma\f$. */
+    float peakScale;            /**< The scale of the frequency difference of maximum dissonance, in Hz. */
+    float peakExponent;         /**< The power to which the lower frequency is raised in the frequency difference of maximum dissonance. */
+    float lowerSlope;           /**< The slope of the V-curve below the difference of maximum dissonance, on logarithmic axes. Denoted by \f$\alpha\f$. */
+    float upperSlope;           /**< The slope of the V-curve above the difference of maximum dissonance, on logarithmic axes. Denoted by \f$\beta\f$. */
+    
+    Array<float> curveTable;            /**< \f$V(x)\f$ at equal steps of \f$x\f$. */
+    Array<float> inversePeakTable;      /**< \f$1 / \Delta f_m(f)\f$ at equal steps of frequency. */
+    float thresholdAmp;                 /**< The amplitude at the threshold of hearing. */
+    
+    PartialList partials;               /**< The audible partials of the distributions being evaluated. */
+    Array<float> weights, inversePeaks; /**< The \f$w(a)\f$ and \f$1 / \Delta f_m\f$ of each partial being evaluated. */
+    
+    /** Rebuilds the curve and frequency tables from the parameters, and allocates the per-partial arrays. */
+    void prepareTables();
+    
+    /** Sums the roughness between every pair of partials.
+     
+        @param distributions If not nullptr, each pair's dissonance is shared between its two partials in these distributions, which the arrays must have been listed from by partials.
+    */
+    float sumPairs (const float* freqs, const float* amps, int numPartials, const OwnedArray<OvertoneDistribution>* distributions);
+    
+    /** Returns \f$w(a)\f$ for an amplitude. */
+    float getWeight (float amp) const noexcept;
     
+    /** Returns \f$1 / \Delta f_m(f)\f$ for a frequency, interpolated from the table. */
+    float getInversePeak (float freq) const noexcept;
     
+    /** Returns \f$V(x)\f$, interpolated from the table. */
+    float getCurve (float x) const noexcept;
 };
@@ -198,10 +198,7 @@ void FileIO::saveTreeToFile (const ValueTree &treeToSave,
 
 OvertoneDistribution FileIO::loadOvertonesFromFile()
 {
-    tree = ValueTree();
-    
-    file.loadFileAsData (memory);
-    tree.readFromData (&memory, memory.getSize());
+    tree = readTree (file);
     
     OvertoneDistribution distribution;
     
@@ -211,24 +208,14 @@ OvertoneDistribution FileIO::loadOvertonesFromFile()
         return distribution;        // Returns an empty OvertoneDistribution if tree is invalid. Soft fail.
     }
     
-    distribution.setDistributionName (tree.getPropertyAsValue (IDs::Name, nullptr).toString());
-    distribution.setMinInterval (tree.getPropertyAsValue (IDs::MinInterval, nullptr).getValue());
-    
-    for (int i = 0; i < tree.getNumChildren(); ++i)
-    {
-        distribution.addPartial (tree.getChild (i).getPropertyAsValue (IDs::Freq, nullptr).getValue(),
-                                 tree.getChild (i).getPropertyAsValue (IDs::Amp, nullptr).getValue());
-    }
+    overtonesFromTree (tree, distribution);
     
     return distribution;
 }
 
 TuningSystem FileIO::loadTuningFromFile()
 {
-    tree = ValueTree();
-    
-    file.loadFileAsData (memory);
-    tree.readFromData (&memory, memory.getSize());
+    tree = readTree (file);
     
     TuningSystem tuning;
     
@@ -238,15 +225,7 @@ TuningSystem FileIO::loadTuningFromFile()
         return tuning;          // Returns an empty TuningSystem if tree is invalid. Soft fail.
     }
     
-    tuning.setName (tree.getPropertyAsValue (IDs::Name, nullptr).toString());
-    tuning.setMinInterval (tree.getPropertyAsValue (IDs::MinInterval, nullptr).getValue());
-    tuning.setRepeatRatio (tree.getPropertyAsValue (IDs::RepeatRatio, nullptr).getValue());
-    tuning.setReferenceFrequency (tree.getPropertyAsValue (IDs::ReferenceFreq, nullptr).getValue());
-
-    for (int i = 0; i < tree.getPropertyAsValue (IDs::Notes, nullptr).getValue().getArray()->size(); ++i)
-    {
-        tuning.addInterval (tree.getPropertyAsValue (IDs::Notes, nullptr).getValue()[i]);
-    }
+    tuningFromTree (tree, tuning);
     
     return tuning;
 }
@@ -261,3 +240,61 @@ ValueTree& FileIO::loadTreeFromFile()
     return tree;
 }
 
+//==============================================================================
+
+
+ValueTree FileIO::readTree (const File& fileToRead)
+{
+    MemoryBlock data;
+    
+    if (! fileToRead.existsAsFile() || ! fileToRead.loadFileAsData (data))
+        return ValueTree();
+    
+    return ValueTree::readFromData (data.getData(), data.getSize());
+}
+
+bool FileIO::readOvertones (const File& fileToRead, OvertoneDistribution& result)
+{
+    return overtonesFromTree (readTree (fileToRead), result);
+}
+
+bool FileIO::readTuning (const File& fileToRead, TuningSystem& result)
+{
+    return tuningFromTree (readTree (fileToRead), result);
+}
+
+bool FileIO::overtonesFromTree (const ValueTree& sourceTree, OvertoneDistribution& result)
+{
+    if (! sourceTree.hasType (IDs::OvertoneDistribution))
+        return false;
+    
+    result.setDistributionName (sourceTree.getProperty (IDs::Name).toString());
+    result.setMinInterval (sourceTree.getProperty (IDs::MinInterval));
+    
+    for (int i = 0; i < sourceTree.getNumChildren(); ++i)
+    {
+        result.addPartial (sourceTree.getChild (i).getProperty (IDs::Freq),
+                           sourceTree.getChild (i).getProperty (IDs::Amp));
+    }
+    
+    return true;
+}
+
+bool FileIO::tuningFromTree (const ValueTree& sourceTree, TuningSystem& result)
+{
+    if (! sourceTree.hasType (IDs::Tuning))
+        return false;
+    
+    result.setName (sourceTree.getProperty (IDs::Name).toString());
+    result.setMinInterval (sourceTree.getProperty (IDs::MinInterval));
+    result.setRepeatRatio (sourceTree.getProperty (IDs::RepeatRatio));
+    result.setReferenceFrequency (sourceTree.getProperty (IDs::ReferenceFreq));
+    
+    if (auto* notes = sourceTree.getProperty (IDs::Notes).getArray())
+    {
+        for (auto& note : *notes)
+            result.addInterval (note);
+    }
+    
+    return true;
+}
@@ -21,6 +21,10 @@
 /** A class for reading from and writing to '.dismal' files.
  
     This class uses a juce::ValueTree, juce::File, and juce::MemoryBlock to serialize and deserialize OvertoneDistribution and TuningSystem objects into raw binary data. The files produced using this class should have an file extension of '.dismal', and can contain both overtone distributions and tuning systems. This is to enable the transfer of overtone distributions and tunings between users of DisMAL or apps derived from DisMAL.
+ 
+    The member functions keep the file, tree and data they work on in member variables, so a FileIO object must not be used by more than one thread at a time. The static reading functions don't keep any state, and can be called from any number of threads at once.
+ 
+    @see LibraryLoader
 */
 class FileIO
 {
@@ -85,6 +89,49 @@ public:
     /** Returns a juce::ValueTree of the OvertoneDistribution or TuningSystem data contained in a file. */
     ValueTree& loadTreeFromFile();
     
+    //==============================================================================
+    /** @name Stateless reading functions
+     
+        These functions only use their arguments and local variables, so they are safe to call from many threads at once.
+    */
+    ///@{
+    
+    /** Reads the ValueTree stored in a '.dismal' file.
+     
+        @return The tree, or an invalid tree if the file couldn't be read.
+    */
+    static ValueTree readTree (const File& fileToRead);
+    
+    /** Reads an overtone distribution from a '.dismal' file.
+     
+        @param fileToRead The file to read.
+        @param result The distribution to add the file's name, minimum interval and partials to. This should be empty.
+        @return True if the file contained an overtone distribution.
+    */
+    static bool readOvertones (const File& fileToRead, OvertoneDistribution& result);
+    
+    /** Reads a tuning system from a '.dismal' file.
+     
+        @param fileToRead The file to read.
+        @param result The tuning to add the file's settings and intervals to. This should be empty.
+        @return True if the file contained a tuning system.
+    */
+    static bool readTuning (const File& fileToRead, TuningSystem& result);
+    
+    /** Converts a ValueTree of type "OvertoneDistribution" into an overtone distribution.
+     
+        @return True if the tree was of the correct type.
+    */
+    static bool overtonesFromTree (const ValueTree& sourceTree, OvertoneDistribution& result);
+    
+    /** Converts a ValueTree of type "Tuning" into a tuning system.
+     
+        @return True if the tree was of the correct type.
+    */
+    static bool tuningFromTree (const ValueTree& sourceTree, TuningSystem& result);
+    
+    ///@}
+    
 private:
     String fileName;
     File file;
@@ -0,0 +1,195 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "LibraryLoader.h"
+
+LibraryLoader::LibraryLoader (WorkerPool& workerPool)   : pool (workerPool)
+{
+    watchRecursively = false;
+}
+
+LibraryLoader::~LibraryLoader()
+{
+    stopTimer();
+}
+
+//==============================================================================
+
+
+LibraryLoader::LoadedFile LibraryLoader::loadFile (const File& file)
+{
+    LoadedFile result;
+    result.file = file;
+    result.modificationTime = file.getLastModificationTime();
+
+    const ValueTree tree = FileIO::readTree (file);
+
+    if (tree.hasType (IDs::OvertoneDistribution))
+    {
+        auto overtones = std::make_shared<OvertoneDistribution>();
+        result.succeeded = FileIO::overtonesFromTree (tree, *overtones);
+        result.overtones = overtones;
+    }
+    else if (tree.hasType (IDs::Tuning))
+    {
+        // The tuning is read in place, as TuningSystem's copy constructor only copies the intervals
+        auto tuning = std::make_shared<TuningSystem>();
+        result.succeeded = FileIO::tuningFromTree (tree, *tuning);
+        result.tuning = tuning;
+    }
+
+    return result;
+}
+
+Array<File> LibraryLoader::findLibraryFiles (const File& folder, bool recursive)
+{
+    Array<File> files = folder.findChildFiles (File::findFiles | File::ignoreHiddenFiles, recursive, "*.dismal");
+
+    // Keep the order stable, so that libraries always load into the same indices
+    std::sort (files.begin(), files.end(),
+               [] (const File& a, const File& b) { return a.getFullPathName() < b.getFullPathName(); });
+
+    return files;
+}
+
+//==============================================================================
+
+
+std::shared_future<LibraryLoader::LoadedFile> LibraryLoader::loadFileAsync (const File& file)
+{
+    auto promise = std::make_shared<std::promise<LoadedFile>>();
+    std::shared_future<LoadedFile> future (promise->get_future());
+
+    WeakReference<LibraryLoader> loader (this);
+
+    pool.addJob ([file, promise, loader]
+    {
+        // Only the loader's weak reference is touched here, as the loader may be deleted while the file loads
+        const LoadedFile result = loadFile (file);
+        promise->set_value (result);
+
+        MessageManager::callAsync ([loader, result]
+        {
+            if (auto* owner = loader.get())
+                owner->listeners.call ([&] (Listener& l) { l.libraryFileLoaded (result); });
+        });
+    });
+
+    return future;
+}
+
+Array<std::shared_future<LibraryLoader::LoadedFile>> LibraryLoader::loadFolderAsync (const File& folder, bool recursive)
+{
+    Array<std::shared_future<LoadedFile>> futures;
+
+    for (auto& file : findLibraryFiles (folder, recursive))
+        futures.add (loadFileAsync (file));
+
+    return futures;
+}
+
+Array<LibraryLoader::LoadedFile> LibraryLoader::loadFolder (const File& folder, bool recursive)
+{
+    const Array<File> files = findLibraryFiles (folder, recursive);
+
+    Array<LoadedFile> results;
+    results.resize (files.size());
+
+    pool.parallelFor (files.size(), [&] (int item, int)
+    {
+        results.getReference (item) = loadFile (files.getReference (item));
+    });
+
+    return results;
+}
+
+//==============================================================================
+
+
+void LibraryLoader::addListener (Listener* listener)
+{
+    listeners.add (listener);
+}
+
+void LibraryLoader::removeListener (Listener* listener)
+{
+    listeners.remove (listener);
+}
+
+//==============================================================================
+
+
+void LibraryLoader::startWatching (const File& folder, bool recursive, int intervalMilliseconds)
+{
+    jassert (folder.isDirectory());
+    jassert (intervalMilliseconds > 0);
+
+    watchedFolder = folder;
+    watchRecursively = recursive;
+    modificationTimes = scanWatchedFolder();
+
+    startTimer (jmax (1, intervalMilliseconds));
+}
+
+void LibraryLoader::stopWatching()
+{
+    stopTimer();
+
+    watchedFolder = File();
+    modificationTimes.clear();
+}
+
+File LibraryLoader::getWatchedFolder() const
+{
+    return watchedFolder;
+}
+
+//==============================================================================
+
+
+std::map<String, int64> LibraryLoader::scanWatchedFolder() const
+{
+    std::map<String, int64> times;
+
+    for (auto& file : findLibraryFiles (watchedFolder, watchRecursively))
+        times[file.getFullPathName()] = file.getLastModificationTime().toMilliseconds();
+
+    return times;
+}
+
+void LibraryLoader::timerCallback()
+{
+    const std::map<String, int64> currentTimes = scanWatchedFolder();
+
+    for (auto& entry : currentTimes)
+    {
+        auto previous = modificationTimes.find (entry.first);
+
+        if (previous == modificationTimes.end() || previous->second != entry.second)
+            loadFileAsync (File (entry.first));
+    }
+
+    Array<File> removedFiles;
+
+    for (auto& entry : modificationTimes)
+    {
+        if (currentTimes.find (entry.first) == currentTimes.end())
+            removedFiles.add (File (entry.first));
+    }
+
+    // Listeners are called last, as they may stop watching
+    modificationTimes = currentTimes;
+
+    for (auto& removedFile : removedFiles)
+        listeners.call ([&] (Listener& l) { l.libraryFileRemoved (removedFile); });
+}
@@ -0,0 +1,136 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "FileIO.h"
+#include "OvertoneDistribution.h"
+#include "TuningSystem.h"
+#include "WorkerPool.h"
+#include <future>
+#include <map>
+
+/** Loads libraries of '.dismal' files in parallel, and optionally reloads them when they change.
+
+    Files are read with FileIO's stateless reading functions on the workers of a WorkerPool, so a folder of presets loads without blocking the message thread. Results are delivered in two ways:
+
+    - Every asynchronous load returns a std::shared_future, which can be waited on from any thread.
+    - Registered listeners are called on the message thread as each file finishes loading.
+
+    When watching a folder, the loader checks the folder with a timer and reloads any '.dismal' file that has been added or modified, so that listeners can update a library while it is being edited.
+*/
+class LibraryLoader   : private Timer
+{
+public:
+    //==============================================================================
+    /** The contents of a loaded '.dismal' file. */
+    struct LoadedFile
+    {
+        File file;                                                  /**< The file that was read. */
+        Time modificationTime;                                      /**< The file's modification time when it was read. */
+        bool succeeded = false;                                     /**< True if the file contained an overtone distribution or tuning system. */
+        std::shared_ptr<const OvertoneDistribution> overtones;     /**< The overtone distribution in the file, or nullptr if it held a tuning system. */
+        std::shared_ptr<const TuningSystem> tuning;                 /**< The tuning system in the file, or nullptr if it held an overtone distribution. */
+    };
+
+    //==============================================================================
+    /** Receives the files loaded by a LibraryLoader. Callbacks are made on the message thread. */
+    class Listener
+    {
+    public:
+        /** Destructor. */
+        virtual ~Listener() {}
+
+        /** Called when an asynchronous load has finished, whether or not it succeeded. */
+        virtual void libraryFileLoaded (const LoadedFile& loadedFile) = 0;
+
+        /** Called when a file in a watched folder has been deleted or moved. */
+        virtual void libraryFileRemoved (const File&) {}
+    };
+
+    //==============================================================================
+    /** Creates a LibraryLoader that reads files on the workers of a pool. The pool must outlive the loader. */
+    explicit LibraryLoader (WorkerPool& workerPool);
+
+    /** Destructor. Loads that are still running will complete their futures, but won't call any listeners. */
+    ~LibraryLoader() override;
+
+    //==============================================================================
+    /** Reads a '.dismal' file on the calling thread. This is safe to call from any thread. */
+    static LoadedFile loadFile (const File& file);
+
+    /** Returns the '.dismal' files in a folder. */
+    static Array<File> findLibraryFiles (const File& folder, bool recursive = false);
+
+    //==============================================================================
+    /** Reads a '.dismal' file on the worker pool.
+
+        @return A future holding the result. Listeners are also called when the file has loaded.
+    */
+    std::shared_future<LoadedFile> loadFileAsync (const File& file);
+
+    /** Reads all of the '.dismal' files in a folder on the worker pool.
+
+        @return A future for every file found, in the order returned by findLibraryFiles.
+    */
+    Array<std::shared_future<LoadedFile>> loadFolderAsync (const File& folder, bool recursive = false);
+
+    /** Reads all of the '.dismal' files in a folder in parallel, and waits for them to finish.
+
+        This doesn't call any listeners. It must not be called from a job running on the same worker pool.
+    */
+    Array<LoadedFile> loadFolder (const File& folder, bool recursive = false);
+
+    //==============================================================================
+    /** Registers a listener to receive the results of asynchronous loads. */
+    void addListener (Listener* listener);
+
+    /** Deregisters a listener. */
+    void removeListener (Listener* listener);
+
+    //==============================================================================
+    /** Starts watching a folder for new, modified and removed '.dismal' files.
+
+        The files already in the folder are treated as loaded, so this should be called just after loading the folder. Only one folder can be watched at a time. This must be called on the message thread.
+
+        @param folder The folder to watch.
+        @param recursive Set to true to also watch the folder's subfolders.
+        @param intervalMilliseconds How often to check the folder for changes.
+    */
+    void startWatching (const File& folder, bool recursive = false, int intervalMilliseconds = 1000);
+
+    /** Stops watching a folder. */
+    void stopWatching();
+
+    /** Returns the folder being watched, or a default File if none is being watched. */
+    File getWatchedFolder() const;
+
+private:
+    //==============================================================================
+    WorkerPool& pool;
+    ListenerList<Listener> listeners;
+
+    File watchedFolder;
+    bool watchRecursively;
+    std::map<String, int64> modificationTimes;
+
+    //==============================================================================
+    /** Records the modification times of the files in the watched folder. */
+    std::map<String, int64> scanWatchedFolder() const;
+
+    void timerCallback() override;
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE (LibraryLoader)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (LibraryLoader)
+};
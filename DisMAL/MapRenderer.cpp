@@ -0,0 +1,227 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "MapRenderer.h"
+
+MapRenderer::MapRenderer()
+{
+    lookupTable.malloc ((size_t) numLookupEntries);
+    nanPixel = Colour (0x00000000).getPixelARGB();
+    range = Range<float> (0, 1);
+
+    setColourGradient (createDefaultGradient());
+}
+
+MapRenderer::~MapRenderer()
+{
+}
+
+//==============================================================================
+
+
+void MapRenderer::setColourGradient (const ColourGradient& gradient)
+{
+    gradient.createLookupTable (lookupTable, numLookupEntries);
+}
+
+void MapRenderer::setNanColour (Colour colour)
+{
+    nanPixel = colour.getPixelARGB();
+}
+
+void MapRenderer::setRange (float minDissonance, float maxDissonance)
+{
+    jassert (maxDissonance >= minDissonance);
+
+    range = Range<float> (jmin (minDissonance, maxDissonance), jmax (minDissonance, maxDissonance));
+}
+
+void MapRenderer::setRangeFromMap (const DissonanceCalc& calc)
+{
+    const int numSteps = calc.getNumSteps();
+    const bool denseRows = ! calc.usingCompressedMap() && ! calc.usingSparseMap() && ! calc.hasCellMask();
+    float lowest = std::numeric_limits<float>::max();
+    float highest = std::numeric_limits<float>::lowest();
+
+    for (int xStep = 0; xStep < numSteps; ++xStep)
+    {
+        if (denseRows && xStep < calc.map3D.size())
+        {
+            const Range<float> rowRange = FloatVectorOperations::findMinAndMax (calc.map3D.getReference (xStep).getRawDataPointer(),
+                                                                                calc.map3D.getReference (xStep).size());
+
+            lowest = jmin (lowest, rowRange.getStart());
+            highest = jmax (highest, rowRange.getEnd());
+            continue;
+        }
+
+        for (int yStep = 0; yStep < numSteps; ++yStep)
+        {
+            const float value = calc.getDissonanceAtStep (xStep, yStep);
+
+            if (value != value)
+                continue;
+
+            lowest = jmin (lowest, value);
+            highest = jmax (highest, value);
+        }
+    }
+
+    jassert (lowest <= highest);     // calculateDissonanceMap must be called first
+
+    if (lowest <= highest)
+        range = Range<float> (lowest, highest);
+}
+
+Range<float> MapRenderer::getRange() const noexcept
+{
+    return range;
+}
+
+ColourGradient MapRenderer::createDefaultGradient()
+{
+    ColourGradient gradient (Colour (0xff0b1040), 0, 0, Colour (0xfffbe84a), 1, 0, false);
+    gradient.addColour (0.35, Colour (0xff6a2c8e));
+    gradient.addColour (0.7, Colour (0xffe8683a));
+
+    return gradient;
+}
+
+//==============================================================================
+
+
+void MapRenderer::renderBlock (const float* values, int numColumns, int numRows, int valuesPerRow,
+                               Image::BitmapData& destination, int destX, int destY) const
+{
+    jassert (destination.pixelFormat == Image::ARGB || destination.pixelFormat == Image::RGB);
+
+    if (destination.pixelFormat != Image::ARGB && destination.pixelFormat != Image::RGB)
+        return;
+
+    const int firstColumn = jmax (0, -destX);
+    const int endColumn = jmin (numColumns, destination.width - destX);
+    const int firstRow = jmax (0, -destY);
+    const int endRow = jmin (numRows, destination.height - destY);
+
+    if (firstColumn >= endColumn || firstRow >= endRow)
+        return;
+
+    HeapBlock<float> indices ((size_t) (endColumn - firstColumn));
+
+    for (int row = firstRow; row < endRow; ++row)
+    {
+        renderRow (values + row * valuesPerRow + firstColumn, endColumn - firstColumn,
+                   destination.getPixelPointer (destX + firstColumn, destY + row),
+                   destination.pixelStride, destination.pixelFormat, indices);
+    }
+}
+
+void MapRenderer::renderMap (const DissonanceCalc& calc, Image& image, WorkerPool* pool) const
+{
+    jassert (calc.getNumDimensions() == DissonanceCalc::threeDimensional);     // Only 3D maps can be rendered as images
+
+    if (calc.getNumDimensions() != DissonanceCalc::threeDimensional)
+        return;
+
+    const int numSteps = calc.getNumSteps();
+    const int numRows = jmin (numSteps, image.getHeight());
+    const int numColumns = jmin (numSteps, image.getWidth());
+    const bool denseRows = ! calc.usingCompressedMap() && ! calc.usingSparseMap() && calc.map3D.size() == numSteps;
+
+    if (numRows <= 0 || numColumns <= 0)
+        return;
+
+    // Creating a BitmapData isn't thread-safe, so the pixels are locked once here and each worker writes its rows through raw pointers
+    Image::BitmapData destination (image, 0, 0, numColumns, numRows, Image::BitmapData::writeOnly);
+
+    jassert (destination.pixelFormat == Image::ARGB || destination.pixelFormat == Image::RGB);
+
+    if (destination.pixelFormat != Image::ARGB && destination.pixelFormat != Image::RGB)
+        return;
+
+    uint8* const pixels = destination.data;
+    const int lineStride = destination.lineStride;
+    const int pixelStride = destination.pixelStride;
+    const Image::PixelFormat format = destination.pixelFormat;
+
+    const int rowsPerBand = 16;
+    const int numBands = (numRows + rowsPerBand - 1) / rowsPerBand;
+
+    auto renderBand = [&] (int band, int)
+    {
+        const int firstRow = band * rowsPerBand;
+        const int endRow = jmin (firstRow + rowsPerBand, numRows);
+
+        HeapBlock<float> rowValues ((size_t) numColumns);
+        HeapBlock<float> indices ((size_t) numColumns);
+
+        for (int xStep = firstRow; xStep < endRow; ++xStep)
+        {
+            const float* values = rowValues;
+
+            if (denseRows)
+            {
+                values = calc.map3D.getReference (xStep).getRawDataPointer();
+            }
+            else
+            {
+                // Compressed and sparse maps are decompressed a row at a time
+                for (int yStep = 0; yStep < numColumns; ++yStep)
+                    rowValues[yStep] = calc.getDissonanceAtStep (xStep, yStep);
+            }
+
+            renderRow (values, numColumns, pixels + xStep * lineStride, pixelStride, format, indices);
+        }
+    };
+
+    if (pool != nullptr)
+    {
+        pool->parallelFor (numBands, renderBand);
+    }
+    else
+    {
+        for (int band = 0; band < numBands; ++band)
+            renderBand (band, 0);
+    }
+}
+
+//==============================================================================
+
+
+void MapRenderer::renderRow (const float* values, int numValues, uint8* pixels, int pixelStride, Image::PixelFormat format, float* indices) const
+{
+    const float lastEntry = (float) (numLookupEntries - 1);
+    const float scale = range.getLength() > 0 ? lastEntry / range.getLength() : 0.0f;
+
+    // Map the row to rounded lookup table indices with vector operations. NaN values are handled when the pixels are written.
+    FloatVectorOperations::copyWithMultiply (indices, values, scale, numValues);
+    FloatVectorOperations::add (indices, 0.5f - range.getStart() * scale, numValues);
+    FloatVectorOperations::clip (indices, indices, 0.0f, lastEntry, numValues);
+
+    if (format == Image::ARGB)
+    {
+        for (int i = 0; i < numValues; ++i)
+        {
+            auto* pixel = reinterpret_cast<PixelARGB*> (pixels + i * pixelStride);
+            pixel->set (values[i] != values[i] ? nanPixel : lookupTable[(int) indices[i]]);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < numValues; ++i)
+        {
+            auto* pixel = reinterpret_cast<PixelRGB*> (pixels + i * pixelStride);
+            pixel->set (values[i] != values[i] ? nanPixel : lookupTable[(int) indices[i]]);
+        }
+    }
+}
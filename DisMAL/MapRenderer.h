@@ -0,0 +1,94 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceCalc.h"
+#include "WorkerPool.h"
+
+/** Renders dissonance values straight into the pixels of a juce::Image.
+
+    Values are normalised to a range, converted to indices into a colour lookup table with vectorised operations, and written a row at a time into an Image::BitmapData. This avoids the per-pixel overhead of calling getDissonanceAtStep and looking up a colour for every cell.
+
+    A MapRenderer is never changed by rendering, so one renderer can be shared by many threads. Creating an Image::BitmapData isn't thread-safe, so create a single one for the display image on one thread and pass it to every worker: the worker that calculates a tile of a map can then render it with renderBlock into the region that it covers, as long as no two workers write to the same region at once.
+*/
+class MapRenderer
+{
+public:
+    //==============================================================================
+    /** Creates a MapRenderer with the default colour gradient and a range of 0 to 1. */
+    MapRenderer();
+
+    /** Destructor. */
+    ~MapRenderer();
+
+    //==============================================================================
+    /** Sets the colours used for dissonance values, from the start of the range at position 0 to the end at position 1. */
+    void setColourGradient (const ColourGradient& gradient);
+
+    /** Sets the colour used for NaN values, such as cells outside of a map's region of interest. By default, this is transparent. */
+    void setNanColour (Colour colour);
+
+    /** Sets the dissonances at the ends of the colour gradient. Values outside of the range are given the colour at the nearest end. */
+    void setRange (float minDissonance, float maxDissonance);
+
+    /** Sets the range to the lowest and highest values in a DissonanceCalc's 3D dissonance map, ignoring NaN values. */
+    void setRangeFromMap (const DissonanceCalc& calc);
+
+    /** Returns the dissonances at the ends of the colour gradient. */
+    Range<float> getRange() const noexcept;
+
+    /** Returns a gradient from dark blue for consonance to yellow for dissonance, which is used by default. */
+    static ColourGradient createDefaultGradient();
+
+    //==============================================================================
+    /** Renders a block of values into an image.
+
+        Each row of values is written to a row of pixels. The image must use the ARGB or RGB pixel format.
+
+        @param values The values to render, stored row by row.
+        @param numColumns The number of values in each row.
+        @param numRows The number of rows.
+        @param valuesPerRow The distance between the start of each row in values, which is numColumns unless rendering part of a larger buffer.
+        @param destination The pixels to write to. Values that would fall outside of it are skipped.
+        @param destX The column of the first pixel to write.
+        @param destY The row of the first pixel to write.
+    */
+    void renderBlock (const float* values, int numColumns, int numRows, int valuesPerRow,
+                      Image::BitmapData& destination, int destX = 0, int destY = 0) const;
+
+    /** Renders a DissonanceCalc's 3D dissonance map into an image, with a pixel for each cell.
+
+        Each row of the image is a step of the x-axis distribution and each column a step of the y-axis distribution, as in the map itself. Maps larger than the image are cropped.
+
+        @param calc The DissonanceCalc, after calculateDissonanceMap has been called.
+        @param image The image to write to, which should be getNumSteps() pixels square.
+        @param pool If not nullptr, the rows of the image are rendered in parallel by the pool's workers. The image's pixels are locked once on the calling thread.
+    */
+    void renderMap (const DissonanceCalc& calc, Image& image, WorkerPool* pool = nullptr) const;
+
+private:
+    //==============================================================================
+    enum { numLookupEntries = 1024 };
+
+    HeapBlock<PixelARGB> lookupTable;
+    PixelARGB nanPixel;
+    Range<float> range;
+
+    //==============================================================================
+    /** Writes a row of values to a row of pixels, using a buffer of numValues floats to hold their lookup table indices. */
+    void renderRow (const float* values, int numValues, uint8* pixels, int pixelStride, Image::PixelFormat format, float* indices) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MapRenderer)
+};
@@ -0,0 +1,389 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "MapStorage.h"
+
+MapStorage::MapStorage (Precision newPrecision, int newTileSize)
+{
+    jassert (newTileSize > 0);
+
+    precision = newPrecision;
+    tileSize = jmax (1, newTileSize);
+    numRows = 0;
+    numColumns = 0;
+    numTileRows = 0;
+    numTileColumns = 0;
+    maxError = 0;
+}
+
+MapStorage::~MapStorage()
+{
+}
+
+//==============================================================================
+
+
+void MapStorage::setPrecision (Precision newPrecision)
+{
+    precision = newPrecision;
+
+    setSize (numRows, numColumns);
+}
+
+MapStorage::Precision MapStorage::getPrecision() const noexcept
+{
+    return precision;
+}
+
+int MapStorage::getTileSize() const noexcept
+{
+    return tileSize;
+}
+
+void MapStorage::setSize (int newNumRows, int newNumColumns)
+{
+    jassert (newNumRows >= 0 && newNumColumns >= 0);
+
+    numRows = jmax (0, newNumRows);
+    numColumns = jmax (0, newNumColumns);
+    numTileRows = (numRows + tileSize - 1) / tileSize;
+    numTileColumns = (numColumns + tileSize - 1) / tileSize;
+    maxError = 0;
+
+    // Edge tiles are padded to a full tile, which keeps the addressing of every tile the same
+    const size_t numTiles = (size_t) (numTileRows * numTileColumns);
+    data.calloc (numTiles * (size_t) (tileSize * tileSize * getBytesPerValue()));
+
+    tileOffsets.clearQuick();
+    tileScales.clearQuick();
+    tileOffsets.insertMultiple (0, 0, (int) numTiles);
+    tileScales.insertMultiple (0, 0, (int) numTiles);
+}
+
+void MapStorage::clear()
+{
+    setSize (0, 0);
+}
+
+int MapStorage::getNumRows() const noexcept
+{
+    return numRows;
+}
+
+int MapStorage::getNumColumns() const noexcept
+{
+    return numColumns;
+}
+
+size_t MapStorage::getMemorySize() const noexcept
+{
+    return (size_t) (numTileRows * numTileColumns) * (size_t) (tileSize * tileSize * getBytesPerValue() + 2 * sizeof (float));
+}
+
+//==============================================================================
+
+
+void MapStorage::setTileRow (int tileRow, const float* values)
+{
+    jassert (isPositiveAndBelow (tileRow, numTileRows));
+
+    if (! isPositiveAndBelow (tileRow, numTileRows))
+        return;
+
+    const int firstRow = tileRow * tileSize;
+    const int rowsInTile = jmin (tileSize, numRows - firstRow);
+    const int valuesPerTile = tileSize * tileSize;
+
+    for (int tileColumn = 0; tileColumn < numTileColumns; ++tileColumn)
+    {
+        const int tile = tileRow * numTileColumns + tileColumn;
+        const int firstColumn = tileColumn * tileSize;
+        const int columnsInTile = jmin (tileSize, numColumns - firstColumn);
+
+        // Quantised values are stored relative to the tile's range
+        Range<float> tileRange = FloatVectorOperations::findMinAndMax (values + firstColumn, columnsInTile);
+
+        for (int r = 1; r < rowsInTile; ++r)
+            tileRange = tileRange.getUnionWith (FloatVectorOperations::findMinAndMax (values + r * numColumns + firstColumn, columnsInTile));
+
+        const int maxLevel = precision == quantised8Bit ? 255 : 65535;
+        const float scale = tileRange.getLength() / maxLevel;
+
+        tileOffsets.set (tile, tileRange.getStart());
+        tileScales.set (tile, scale);
+
+        if (precision == quantised8Bit || precision == quantised16Bit)
+            maxError = jmax (maxError, scale / 2);
+        else if (precision == halfFloat)
+            maxError = jmax (maxError, jmax (std::abs (tileRange.getStart()), std::abs (tileRange.getEnd())) / 2048);
+
+        uint8* tileData = data.get() + (size_t) tile * (size_t) (valuesPerTile * getBytesPerValue());
+
+        for (int r = 0; r < rowsInTile; ++r)
+        {
+            const float* source = values + r * numColumns + firstColumn;
+
+            switch (precision)
+            {
+                case halfFloat:
+                {
+                    uint16* destination = reinterpret_cast<uint16*> (tileData) + r * tileSize;
+
+                    for (int c = 0; c < columnsInTile; ++c)
+                        destination[c] = floatToHalf (source[c]);
+
+                    break;
+                }
+
+                case quantised16Bit:
+                {
+                    uint16* destination = reinterpret_cast<uint16*> (tileData) + r * tileSize;
+
+                    for (int c = 0; c < columnsInTile; ++c)
+                        destination[c] = (uint16) (scale > 0 ? roundToInt ((source[c] - tileRange.getStart()) / scale) : 0);
+
+                    break;
+                }
+
+                case quantised8Bit:
+                {
+                    uint8* destination = tileData + r * tileSize;
+
+                    for (int c = 0; c < columnsInTile; ++c)
+                        destination[c] = (uint8) (scale > 0 ? roundToInt ((source[c] - tileRange.getStart()) / scale) : 0);
+
+                    break;
+                }
+
+                case fullPrecision:
+                default:
+                    FloatVectorOperations::copy (reinterpret_cast<float*> (tileData) + r * tileSize, source, columnsInTile);
+                    break;
+            }
+        }
+    }
+}
+
+void MapStorage::setAll (const float* values)
+{
+    for (int tileRow = 0; tileRow < numTileRows; ++tileRow)
+        setTileRow (tileRow, values + tileRow * tileSize * numColumns);
+}
+
+float MapStorage::get (int row, int column) const noexcept
+{
+    jassert (isPositiveAndBelow (row, numRows) && isPositiveAndBelow (column, numColumns));
+
+    const int tile = (row / tileSize) * numTileColumns + column / tileSize;
+    const int index = tile * tileSize * tileSize + (row % tileSize) * tileSize + column % tileSize;
+
+    switch (precision)
+    {
+        case halfFloat:
+            return halfToFloat (reinterpret_cast<const uint16*> (data.get())[index]);
+
+        case quantised16Bit:
+            return tileOffsets.getUnchecked (tile) + tileScales.getUnchecked (tile) * reinterpret_cast<const uint16*> (data.get())[index];
+
+        case quantised8Bit:
+            return tileOffsets.getUnchecked (tile) + tileScales.getUnchecked (tile) * data[(size_t) index];
+
+        case fullPrecision:
+        default:
+            return reinterpret_cast<const float*> (data.get())[index];
+    }
+}
+
+float MapStorage::getInterpolated (float row, float column) const noexcept
+{
+    if (numRows == 0 || numColumns == 0)
+        return 0;
+
+    row = jlimit (0.0f, (float) (numRows - 1), row);
+    column = jlimit (0.0f, (float) (numColumns - 1), column);
+
+    const int r = jmin ((int) row, jmax (0, numRows - 2));
+    const int c = jmin ((int) column, jmax (0, numColumns - 2));
+    const int nextR = jmin (r + 1, numRows - 1);
+    const int nextC = jmin (c + 1, numColumns - 1);
+    const float rowProportion = row - r;
+    const float columnProportion = column - c;
+
+    const float lower = get (r, c) + columnProportion * (get (r, nextC) - get (r, c));
+    const float upper = get (nextR, c) + columnProportion * (get (nextR, nextC) - get (nextR, c));
+
+    return lower + rowProportion * (upper - lower);
+}
+
+float MapStorage::getMaxError() const noexcept
+{
+    return maxError;
+}
+
+//==============================================================================
+
+
+void MapStorage::writeToStream (OutputStream& output) const
+{
+    output.writeInt ((int) precision);
+    output.writeInt (tileSize);
+    output.writeInt (numRows);
+    output.writeInt (numColumns);
+    output.writeFloat (maxError);
+
+    const int numTiles = numTileRows * numTileColumns;
+
+    if (numTiles > 0)
+    {
+        output.write (tileOffsets.getRawDataPointer(), sizeof (float) * (size_t) numTiles);
+        output.write (tileScales.getRawDataPointer(), sizeof (float) * (size_t) numTiles);
+        output.write (data.get(), (size_t) numTiles * (size_t) (tileSize * tileSize * getBytesPerValue()));
+    }
+}
+
+bool MapStorage::readFromStream (InputStream& input)
+{
+    const int newPrecision = input.readInt();
+    const int newTileSize = input.readInt();
+    const int newNumRows = input.readInt();
+    const int newNumColumns = input.readInt();
+    const float newMaxError = input.readFloat();
+
+    if (! isPositiveAndNotGreaterThan (newPrecision, (int) quantised8Bit)
+        || newTileSize <= 0 || newNumRows < 0 || newNumColumns < 0)
+    {
+        jassertfalse;       // Not data written by writeToStream
+        clear();
+        return false;
+    }
+
+    precision = (Precision) newPrecision;
+    tileSize = newTileSize;
+    setSize (newNumRows, newNumColumns);
+
+    const int numTiles = numTileRows * numTileColumns;
+    const int tableSize = (int) sizeof (float) * numTiles;
+    const int dataSize = numTiles * tileSize * tileSize * getBytesPerValue();
+
+    if (numTiles > 0
+        && (input.read (tileOffsets.getRawDataPointer(), tableSize) != tableSize
+            || input.read (tileScales.getRawDataPointer(), tableSize) != tableSize
+            || input.read (data.get(), dataSize) != dataSize))
+    {
+        clear();
+        return false;
+    }
+
+    maxError = newMaxError;
+
+    return true;
+}
+
+//==============================================================================
+
+
+int MapStorage::getBytesPerValue() const noexcept
+{
+    switch (precision)
+    {
+        case halfFloat:
+        case quantised16Bit:    return 2;
+        case quantised8Bit:     return 1;
+        case fullPrecision:
+        default:                return 4;
+    }
+}
+
+uint16 MapStorage::floatToHalf (float value) noexcept
+{
+    uint32 bits;
+    std::memcpy (&bits, &value, sizeof (bits));
+
+    const uint32 sign = (bits >> 16) & 0x8000;
+    const int exponent = (int) ((bits >> 23) & 0xff) - 127 + 15;
+    uint32 mantissa = bits & 0x7fffff;
+
+    // NaN and infinity
+    if (((bits >> 23) & 0xff) == 0xff)
+        return (uint16) (sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+
+    // Too large to represent, so clip to infinity
+    if (exponent >= 31)
+        return (uint16) (sign | 0x7c00);
+
+    // Subnormal halves, or too small to represent
+    if (exponent <= 0)
+    {
+        if (exponent < -10)
+            return (uint16) sign;
+
+        mantissa |= 0x800000;
+        const int shift = 14 - exponent;
+        const uint32 half = mantissa >> shift;
+        const uint32 remainder = mantissa & ((1u << shift) - 1);
+        const uint32 midpoint = 1u << (shift - 1);
+
+        return (uint16) (sign | (half + ((remainder > midpoint || (remainder == midpoint && (half & 1))) ? 1 : 0)));
+    }
+
+    // Round to nearest, with ties to even. A carry out of the mantissa correctly increments the exponent.
+    uint32 half = sign | ((uint32) exponent << 10) | (mantissa >> 13);
+    const uint32 remainder = mantissa & 0x1fff;
+
+    if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+        ++half;
+
+    return (uint16) half;
+}
+
+float MapStorage::halfToFloat (uint16 half) noexcept
+{
+    const uint32 sign = (uint32) (half & 0x8000) << 16;
+    int exponent = (half >> 10) & 0x1f;
+    uint32 mantissa = half & 0x3ff;
+    uint32 bits;
+
+    if (exponent == 0x1f)
+    {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    }
+    else if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            bits = sign;
+        }
+        else
+        {
+            // Normalise the subnormal half
+            exponent = 1;
+
+            while ((mantissa & 0x400) == 0)
+            {
+                mantissa <<= 1;
+                --exponent;
+            }
+
+            bits = sign | ((uint32) (exponent - 15 + 127) << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    }
+    else
+    {
+        bits = sign | ((uint32) (exponent - 15 + 127) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy (&value, &bits, sizeof (value));
+
+    return value;
+}
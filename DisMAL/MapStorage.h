@@ -0,0 +1,128 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Compact storage for a grid of dissonance values, such as a 3D dissonance map.
+
+    Values can be stored at full precision, as half-precision floats, or quantised to 16 or 8 bits. The grid is divided into square tiles, and quantised values are stored relative to the minimum of their tile and scaled by the tile's range, so a smooth surface keeps most of its precision even when its overall range is large. Values are decompressed on access.
+
+    Relative to full precision, half floats and 16-bit values halve the memory used by a map, and 8-bit values quarter it. The largest possible error of the stored values can be found with getMaxError.
+
+    Tiles are written a row of tiles at a time, so a map can be compressed as it is calculated without holding the whole map at full precision.
+*/
+class MapStorage
+{
+public:
+    //==============================================================================
+    /** The formats in which values can be stored. */
+    enum Precision
+    {
+        fullPrecision,      /**< 32-bit floats, stored without loss. */
+        halfFloat,          /**< 16-bit floats, with a relative error of at most 2^-11. */
+        quantised16Bit,     /**< 16-bit integers scaled to each tile's range. */
+        quantised8Bit       /**< 8-bit integers scaled to each tile's range. */
+    };
+
+    //==============================================================================
+    /** Creates an empty MapStorage object.
+
+        @param precision The format in which values are stored.
+        @param tileSize The width and height of each tile, in values.
+    */
+    explicit MapStorage (Precision precision = fullPrecision, int tileSize = 64);
+
+    /** Destructor. */
+    ~MapStorage();
+
+    //==============================================================================
+    /** Sets the format in which values are stored. This clears any stored values. */
+    void setPrecision (Precision newPrecision);
+
+    /** Returns the format in which values are stored. */
+    Precision getPrecision() const noexcept;
+
+    /** Returns the width and height of each tile. */
+    int getTileSize() const noexcept;
+
+    /** Allocates storage for a grid of values, all of which are zero until set. */
+    void setSize (int numRows, int numColumns);
+
+    /** Frees all storage. */
+    void clear();
+
+    /** Returns the number of rows in the grid. */
+    int getNumRows() const noexcept;
+
+    /** Returns the number of columns in the grid. */
+    int getNumColumns() const noexcept;
+
+    /** Returns the number of bytes used to store the grid. */
+    size_t getMemorySize() const noexcept;
+
+    //==============================================================================
+    /** Compresses and stores a row of tiles.
+
+        @param tileRow The index of the row of tiles, which covers grid rows from tileRow * getTileSize().
+        @param values The values of the rows covered by the tile row, stored row by row with getNumColumns() values in each. The last tile row may cover fewer than getTileSize() rows.
+    */
+    void setTileRow (int tileRow, const float* values);
+
+    /** Compresses and stores the whole grid.
+
+        @param values getNumRows() * getNumColumns() values, stored row by row.
+    */
+    void setAll (const float* values);
+
+    /** Returns the stored value at a row and column. */
+    float get (int row, int column) const noexcept;
+
+    /** Returns the value at a fractional row and column, bilinearly interpolated from the stored values. */
+    float getInterpolated (float row, float column) const noexcept;
+
+    /** Returns the largest difference between a stored value and the value that was set, over all tiles. */
+    float getMaxError() const noexcept;
+
+    //==============================================================================
+    /** Writes the stored grid to a stream, without decompressing it. */
+    void writeToStream (OutputStream& output) const;
+
+    /** Replaces the contents of the storage with data written by writeToStream.
+
+        @return True if the data was read successfully. Otherwise, the storage is left empty.
+    */
+    bool readFromStream (InputStream& input);
+
+private:
+    //==============================================================================
+    Precision precision;
+    int tileSize, numRows, numColumns, numTileRows, numTileColumns;
+
+    HeapBlock<uint8> data;
+    Array<float> tileOffsets, tileScales;
+    float maxError;
+
+    //==============================================================================
+    /** Returns the number of bytes used for each value. */
+    int getBytesPerValue() const noexcept;
+
+    /** Converts a float to the bits of a half-precision float, rounding to the nearest value. */
+    static uint16 floatToHalf (float value) noexcept;
+
+    /** Converts the bits of a half-precision float to a float. */
+    static float halfToFloat (uint16 half) noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MapStorage)
+};
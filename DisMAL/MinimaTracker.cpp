@@ -0,0 +1,385 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "MinimaTracker.h"
+
+namespace
+{
+    /** The number of windows a minimum can be followed through before it is treated as dead. */
+    const int maxFollowSteps = 8;
+
+    double centsToLogRatio (double cents) noexcept
+    {
+        return cents / 1200.0 * std::log (2.0);
+    }
+}
+
+MinimaTracker::MinimaTracker()
+{
+    varDist = 0;
+    numCoarsePoints = 96;
+    numCoarsePointsChecked = 0;
+    nextBirthPoint = 1;
+    coarseCheckNeeded = false;
+    tolerance = 0.5f;
+
+    coarseDissonances.resize (numCoarsePoints);
+}
+
+MinimaTracker::~MinimaTracker()
+{
+}
+
+//==============================================================================
+
+
+void MinimaTracker::setNumCoarsePoints (int numPoints)
+{
+    jassert (numPoints >= 3);       // At least three points are needed to find a dip
+
+    numCoarsePoints = jmax (3, numPoints);
+    numCoarsePointsChecked = 0;
+    nextBirthPoint = 1;
+    coarseDissonances.resize (numCoarsePoints);
+}
+
+int MinimaTracker::getNumCoarsePoints() const noexcept
+{
+    return numCoarsePoints;
+}
+
+void MinimaTracker::setTolerance (float cents)
+{
+    jassert (cents > 0);
+
+    tolerance = jmax (0.001f, cents);
+}
+
+float MinimaTracker::getTolerance() const noexcept
+{
+    return tolerance;
+}
+
+//==============================================================================
+
+
+void MinimaTracker::reset (const DissonanceCalc& newCalc)
+{
+    setCalc (newCalc);
+
+    minima.clearQuick();
+    numCoarsePointsChecked = 0;
+    nextBirthPoint = 1;
+    coarseCheckNeeded = true;
+
+    continueUpdate (std::numeric_limits<double>::max());
+}
+
+bool MinimaTracker::update (const DissonanceCalc& newCalc, double budgetMilliseconds)
+{
+    const double deadline = Time::getMillisecondCounterHiRes() + budgetMilliseconds;
+
+    setCalc (newCalc);
+
+    for (auto& minimum : minima)
+        minimum.refined = false;
+
+    // The samples of an interrupted coarse check were taken before the edit, so the check starts again
+    numCoarsePointsChecked = 0;
+    nextBirthPoint = 1;
+    coarseCheckNeeded = true;
+
+    return continueUpdate (deadline);
+}
+
+bool MinimaTracker::update (double budgetMilliseconds)
+{
+    jassert (calc != nullptr);      // reset must be called before updating
+
+    if (calc == nullptr)
+        return true;
+
+    return continueUpdate (Time::getMillisecondCounterHiRes() + budgetMilliseconds);
+}
+
+bool MinimaTracker::isUpToDate() const noexcept
+{
+    return ! coarseCheckNeeded;
+}
+
+//==============================================================================
+
+
+Array<float> MinimaTracker::getMinima() const
+{
+    Array<float> freqs;
+
+    for (auto& minimum : minima)
+        freqs.add (minimum.freq);
+
+    return freqs;
+}
+
+Array<float> MinimaTracker::getDissonances() const
+{
+    Array<float> dissonances;
+
+    for (auto& minimum : minima)
+        dissonances.add (minimum.dissonance);
+
+    return dissonances;
+}
+
+int MinimaTracker::getNumMinima() const noexcept
+{
+    return minima.size();
+}
+
+//==============================================================================
+
+
+void MinimaTracker::setCalc (const DissonanceCalc& newCalc)
+{
+    calc = std::make_unique<DissonanceCalc> (newCalc);
+    calc->setSumPartialDissonances (false);
+
+    frequencyRange = newCalc.getRange();
+    varDist = newCalc.get2dVariableDistributionIndex();
+
+    jassert (frequencyRange.getStart() > 0 && ! frequencyRange.isEmpty());      // setRange must be called on the DissonanceCalc
+    jassert (isPositiveAndBelow (varDist, newCalc.numOvertoneDistributions()));
+}
+
+bool MinimaTracker::continueUpdate (double deadline)
+{
+    // Known minima are refined first, as they are the ones being displayed
+    for (int i = 0; i < minima.size();)
+    {
+        TrackedMinimum& minimum = minima.getReference (i);
+
+        if (! minimum.refined)
+        {
+            if (Time::getMillisecondCounterHiRes() > deadline)
+                return false;
+
+            if (! refine (minimum))
+            {
+                minima.remove (i);
+                continue;
+            }
+        }
+
+        ++i;
+    }
+
+    sortAndMerge();
+
+    if (coarseCheckNeeded)
+    {
+        while (numCoarsePointsChecked < numCoarsePoints)
+        {
+            if (Time::getMillisecondCounterHiRes() > deadline)
+                return false;
+
+            coarseDissonances.set (numCoarsePointsChecked, evaluate (getCoarseFreq (numCoarsePointsChecked)));
+            ++numCoarsePointsChecked;
+        }
+
+        if (! updateFromCoarseCheck (deadline))
+            return false;
+
+        numCoarsePointsChecked = 0;
+        nextBirthPoint = 1;
+        coarseCheckNeeded = false;
+    }
+
+    return true;
+}
+
+float MinimaTracker::evaluate (float freq)
+{
+    calc->getDistributionReference (varDist)->setFundamentalFreq (freq);
+
+    return calc->calculateDissonance();
+}
+
+float MinimaTracker::getCoarseFreq (int point) const
+{
+    const float proportion = (float) point / (float) (numCoarsePoints - 1);
+
+    return frequencyRange.getStart() * std::pow (frequencyRange.getEnd() / frequencyRange.getStart(), proportion);
+}
+
+float MinimaTracker::goldenSectionSearch (float lower, float upper, float& dissonance)
+{
+    const double inverseGoldenRatio = (std::sqrt (5.0) - 1) / 2;
+    const double logTolerance = centsToLogRatio (tolerance);
+
+    // Minima are searched for on a log frequency axis, so the tolerance is the same at every frequency
+    double a = std::log ((double) lower);
+    double b = std::log ((double) upper);
+    double c = b - inverseGoldenRatio * (b - a);
+    double d = a + inverseGoldenRatio * (b - a);
+    float dissonanceC = evaluate ((float) std::exp (c));
+    float dissonanceD = evaluate ((float) std::exp (d));
+
+    while (b - a > logTolerance)
+    {
+        if (dissonanceC < dissonanceD)
+        {
+            b = d;
+            d = c;
+            dissonanceD = dissonanceC;
+            c = b - inverseGoldenRatio * (b - a);
+            dissonanceC = evaluate ((float) std::exp (c));
+        }
+        else
+        {
+            a = c;
+            c = d;
+            dissonanceC = dissonanceD;
+            d = a + inverseGoldenRatio * (b - a);
+            dissonanceD = evaluate ((float) std::exp (d));
+        }
+    }
+
+    if (dissonanceC < dissonanceD)
+    {
+        dissonance = dissonanceC;
+        return (float) std::exp (c);
+    }
+
+    dissonance = dissonanceD;
+    return (float) std::exp (d);
+}
+
+bool MinimaTracker::refine (TrackedMinimum& minimum)
+{
+    // Each window spans a coarse check step either side of the minimum's previous frequency
+    const float windowRatio = std::pow (frequencyRange.getEnd() / frequencyRange.getStart(), 1.0f / (float) (numCoarsePoints - 1));
+    float freq = minimum.freq;
+
+    for (int step = 0; step < maxFollowSteps; ++step)
+    {
+        const float lower = jmax (frequencyRange.getStart(), freq / windowRatio);
+        const float upper = jmin (frequencyRange.getEnd(), freq * windowRatio);
+
+        if (lower >= upper)
+            return false;
+
+        float dissonance;
+        const float newFreq = goldenSectionSearch (lower, upper, dissonance);
+
+        const bool atLowerEdge = isAtEdge (newFreq, lower);
+        const bool atUpperEdge = isAtEdge (newFreq, upper);
+
+        if (! atLowerEdge && ! atUpperEdge)
+        {
+            minimum.freq = newFreq;
+            minimum.dissonance = dissonance;
+            minimum.refined = true;
+            return true;
+        }
+
+        // The curve is still falling at the edge of the window, so the minimum has moved further. It can't be followed past the edge of the frequency range.
+        if ((atLowerEdge && lower <= frequencyRange.getStart())
+            || (atUpperEdge && upper >= frequencyRange.getEnd()))
+        {
+            return false;
+        }
+
+        freq = atLowerEdge ? lower : upper;
+    }
+
+    return false;
+}
+
+bool MinimaTracker::updateFromCoarseCheck (double deadline)
+{
+    // Births can be interrupted by the deadline, so the scan carries on from the next unchecked point
+    for (; nextBirthPoint < numCoarsePoints - 1; ++nextBirthPoint)
+    {
+        const int i = nextBirthPoint;
+
+        if (! (coarseDissonances[i] < coarseDissonances[i - 1] && coarseDissonances[i] <= coarseDissonances[i + 1]))
+            continue;
+
+        const float lower = getCoarseFreq (i - 1);
+        const float upper = getCoarseFreq (i + 1);
+        bool alreadyTracked = false;
+
+        for (auto& minimum : minima)
+        {
+            if (minimum.freq >= lower && minimum.freq <= upper)
+            {
+                alreadyTracked = true;
+                break;
+            }
+        }
+
+        if (alreadyTracked)
+            continue;
+
+        if (Time::getMillisecondCounterHiRes() > deadline)
+        {
+            sortAndMerge();
+            return false;
+        }
+
+        TrackedMinimum newMinimum;
+        newMinimum.freq = goldenSectionSearch (lower, upper, newMinimum.dissonance);
+        newMinimum.refined = true;
+
+        // A search that ends on the edge of its window has found a slope rather than a dip, as in refine
+        if (isAtEdge (newMinimum.freq, lower) || isAtEdge (newMinimum.freq, upper))
+            continue;
+
+        // A minimum is born
+        minima.add (newMinimum);
+    }
+
+    sortAndMerge();
+
+    return true;
+}
+
+bool MinimaTracker::isAtEdge (float freq, float edge) const noexcept
+{
+    return std::abs (std::log (freq / edge)) < 2 * centsToLogRatio (tolerance);
+}
+
+void MinimaTracker::sortAndMerge()
+{
+    std::sort (minima.begin(), minima.end(),
+               [] (const TrackedMinimum& a, const TrackedMinimum& b) { return a.freq < b.freq; });
+
+    const double mergeTolerance = 2 * centsToLogRatio (tolerance);
+
+    for (int i = 1; i < minima.size();)
+    {
+        TrackedMinimum& previous = minima.getReference (i - 1);
+        const TrackedMinimum& current = minima.getReference (i);
+
+        if (std::log (current.freq / previous.freq) < mergeTolerance)
+        {
+            // Keep the deeper of the two, which is the more accurate estimate of the merged minimum
+            if (current.dissonance < previous.dissonance || ! previous.refined)
+                previous = current;
+
+            minima.remove (i);
+            continue;
+        }
+
+        ++i;
+    }
+}
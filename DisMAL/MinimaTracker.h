@@ -0,0 +1,146 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceCalc.h"
+
+/** Keeps track of the dissonance minima of a 2D dissonance curve while its timbres are being edited.
+
+    Rather than searching the whole frequency range again after every edit, as DissonanceCalc::optimize2D does, each known minimum is refined from its previous location with a local golden-section search. A minimum that has moved beyond its search window is followed downhill, and one that has flattened out or reached the edge of the frequency range has died.
+
+    New minima are found by a coarse check: the curve is sampled at a small number of log-spaced frequencies, and any dip in the samples without a tracked minimum nearby is refined and added. Minima that converge onto each other are merged.
+
+    Updates are given a time budget, such as the length of a frame. Work that doesn't fit in the budget is continued by the next update, so the minima returned always reflect the latest edit as closely as the budget allows.
+
+    @see DissonanceCalc::optimize2D
+*/
+class MinimaTracker
+{
+public:
+    //==============================================================================
+    /** Creates a MinimaTracker with no minima. */
+    MinimaTracker();
+
+    /** Destructor. */
+    ~MinimaTracker();
+
+    //==============================================================================
+    /** Sets the number of frequencies sampled by the coarse check for new minima. More points find narrower minima, but take longer. */
+    void setNumCoarsePoints (int numPoints);
+
+    /** Returns the number of frequencies sampled by the coarse check. */
+    int getNumCoarsePoints() const noexcept;
+
+    /** Sets the precision, in cents, to which minima are refined. */
+    void setTolerance (float cents);
+
+    /** Returns the precision, in cents, to which minima are refined. */
+    float getTolerance() const noexcept;
+
+    //==============================================================================
+    /** Searches for all of the minima of a DissonanceCalc's 2D dissonance curve, without a time limit.
+
+        The DissonanceCalc's model, distributions, variable distribution and frequency range are copied, so it can be edited freely afterwards.
+    */
+    void reset (const DissonanceCalc& calc);
+
+    /** Updates the minima after an edit to a DissonanceCalc.
+
+        @param calc The edited DissonanceCalc, which must use the same variable distribution and frequency range as the one passed to reset.
+        @param budgetMilliseconds The time to spend on the update. Each minimum's refinement or birth is completed once started, so an update can overrun by the time of a single search. A coarse check interrupted by an earlier update is started again, as its samples are out of date.
+        @return True if every minimum was refined and the coarse check completed. Otherwise, call update again to continue.
+    */
+    bool update (const DissonanceCalc& calc, double budgetMilliseconds);
+
+    /** Continues an update that didn't complete within its budget.
+
+        @return True if the update has completed.
+    */
+    bool update (double budgetMilliseconds);
+
+    /** Returns true if the minima reflect the latest edit, with nothing left to update. */
+    bool isUpToDate() const noexcept;
+
+    //==============================================================================
+    /** Returns the frequencies of the tracked minima, in ascending order. */
+    Array<float> getMinima() const;
+
+    /** Returns the dissonance at each of the tracked minima, in the same order as getMinima. */
+    Array<float> getDissonances() const;
+
+    /** Returns the number of tracked minima. */
+    int getNumMinima() const noexcept;
+
+private:
+    //==============================================================================
+    struct TrackedMinimum
+    {
+        float freq;
+        float dissonance;
+        bool refined;
+    };
+
+    std::unique_ptr<DissonanceCalc> calc;
+    Range<float> frequencyRange;
+    int varDist;
+
+    Array<TrackedMinimum> minima;
+    Array<float> coarseDissonances;
+    int numCoarsePoints, numCoarsePointsChecked, nextBirthPoint;
+    bool coarseCheckNeeded;
+    float tolerance;
+
+    //==============================================================================
+    /** Copies the settings of a DissonanceCalc that affect its 2D dissonance curve. */
+    void setCalc (const DissonanceCalc& newCalc);
+
+    /** Refines minima and runs the coarse check until the work is complete or the deadline passes. */
+    bool continueUpdate (double deadline);
+
+    /** Returns the dissonance with the variable distribution at a frequency. */
+    float evaluate (float freq);
+
+    /** Returns the frequency of a coarse check point. */
+    float getCoarseFreq (int point) const;
+
+    /** Finds the minimum of the curve between two frequencies with a golden-section search.
+
+        @param lower The lower frequency of the search window.
+        @param upper The upper frequency of the search window.
+        @param dissonance Set to the dissonance at the minimum.
+        @return The frequency of the minimum.
+    */
+    float goldenSectionSearch (float lower, float upper, float& dissonance);
+
+    /** Refines a minimum from its previous frequency, following it if it has moved.
+
+        @return False if the minimum has died.
+    */
+    bool refine (TrackedMinimum& minimum);
+
+    /** Adds any minima found by the coarse check that aren't already tracked, and merges minima that have converged.
+
+        @return False if the deadline passed before every dip was searched. The next call carries on from the first dip that wasn't.
+    */
+    bool updateFromCoarseCheck (double deadline);
+
+    /** Returns true if a frequency found by a search is within the tolerance of the edge of its window. */
+    bool isAtEdge (float freq, float edge) const noexcept;
+
+    /** Sorts the minima by frequency and merges minima closer together than the tolerance. */
+    void sortAndMerge();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (MinimaTracker)
+};
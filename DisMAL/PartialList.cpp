@@ -0,0 +1,112 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "PartialList.h"
+
+PartialList::PartialList()
+{
+}
+
+PartialList::~PartialList()
+{
+}
+
+//==============================================================================
+
+
+void PartialList::ensureStorageAllocated (int numPartialsToAllocate)
+{
+    freqs.ensureStorageAllocated (numPartialsToAllocate);
+    amps.ensureStorageAllocated (numPartialsToAllocate);
+    distributionIndices.ensureStorageAllocated (numPartialsToAllocate);
+    partialIndices.ensureStorageAllocated (numPartialsToAllocate);
+}
+
+void PartialList::clear() noexcept
+{
+    freqs.clearQuick();
+    amps.clearQuick();
+    distributionIndices.clearQuick();
+    partialIndices.clearQuick();
+}
+
+void PartialList::setDistributions (const OwnedArray<OvertoneDistribution>& distributions)
+{
+    clear();
+
+    for (int d = 0; d < distributions.size(); ++d)
+        addDistribution (*distributions[d], d);
+}
+
+void PartialList::addDistribution (const OvertoneDistribution& distribution, int distributionIndex)
+{
+    if (distribution.isMuted())
+        return;
+
+    if (! distribution.fundamentalIsMuted())
+    {
+        freqs.add (distribution.getFundamentalFreq());
+        amps.add (distribution.getFundamentalAmp());
+        distributionIndices.add (distributionIndex);
+        partialIndices.add (-1);
+    }
+
+    for (int p = 0; p < distribution.numPartials(); ++p)
+    {
+        if (! distribution.partialIsMuted (p))
+        {
+            freqs.add (distribution.getRealFreq (p));
+            amps.add (distribution.getRealAmp (p));
+            distributionIndices.add (distributionIndex);
+            partialIndices.add (p);
+        }
+    }
+}
+
+//==============================================================================
+
+
+int PartialList::size() const noexcept
+{
+    return freqs.size();
+}
+
+const float* PartialList::getFreqs() const noexcept
+{
+    return freqs.getRawDataPointer();
+}
+
+const float* PartialList::getAmps() const noexcept
+{
+    return amps.getRawDataPointer();
+}
+
+float PartialList::getFreq (int index) const
+{
+    return freqs[index];
+}
+
+float PartialList::getAmp (int index) const
+{
+    return amps[index];
+}
+
+int PartialList::getDistributionIndex (int index) const
+{
+    return distributionIndices[index];
+}
+
+int PartialList::getPartialIndex (int index) const
+{
+    return partialIndices[index];
+}
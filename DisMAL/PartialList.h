@@ -0,0 +1,81 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "OvertoneDistribution.h"
+
+/** A flattened list of the audible partials in a set of overtone distributions.
+
+    The real frequencies and amplitudes of every fundamental and overtone are stored in contiguous arrays, which makes them suitable for vectorised processing. Muted distributions, muted fundamentals and muted partials are left out in the same way that SpectralInterferenceModel::calculateDissonance excludes them.
+
+    Each entry also remembers which distribution and partial it came from, so results can be mapped back onto the original OvertoneDistribution objects.
+*/
+class PartialList
+{
+public:
+    //==============================================================================
+    /** Creates an empty PartialList object. */
+    PartialList();
+
+    /** Destructor. */
+    ~PartialList();
+
+    //==============================================================================
+    /** Pre-allocates storage so that lists of up to this many partials can be built without allocating. */
+    void ensureStorageAllocated (int numPartialsToAllocate);
+
+    /** Removes all partials, keeping the allocated storage. */
+    void clear() noexcept;
+
+    /** Clears the list and adds the audible partials of a set of overtone distributions.
+
+        Entries are stored in distribution order, with each distribution's fundamental followed by its overtones.
+    */
+    void setDistributions (const OwnedArray<OvertoneDistribution>& distributions);
+
+    /** Adds the audible partials of a single overtone distribution.
+
+        @param distribution The distribution whose partials are added.
+        @param distributionIndex The value returned by getDistributionIndex for the added entries.
+    */
+    void addDistribution (const OvertoneDistribution& distribution, int distributionIndex);
+
+    //==============================================================================
+    /** Returns the number of audible partials in the list, including fundamentals. */
+    int size() const noexcept;
+
+    /** Returns a pointer to the contiguous array of real frequencies. */
+    const float* getFreqs() const noexcept;
+
+    /** Returns a pointer to the contiguous array of real amplitudes. */
+    const float* getAmps() const noexcept;
+
+    /** Returns the real frequency of an entry. */
+    float getFreq (int index) const;
+
+    /** Returns the real amplitude of an entry. */
+    float getAmp (int index) const;
+
+    /** Returns the index of the distribution that an entry belongs to. */
+    int getDistributionIndex (int index) const;
+
+    /** Returns the index of the partial that an entry belongs to, or -1 if the entry is a fundamental. */
+    int getPartialIndex (int index) const;
+
+private:
+    //==============================================================================
+    Array<float> freqs, amps;
+    Array<int> distributionIndices, partialIndices;
+};
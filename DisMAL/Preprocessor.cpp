@@ -27,7 +27,7 @@ HearingRangePreprocessor::~HearingRangePreprocessor()
 
 void HearingRangePreprocessor::setHearingRange (float lowerLimit, float upperLimit)
 {
-    hearingRange.withStartAndLength (lowerLimit, upperLimit - lowerLimit);
+    hearingRange = Range<float> (lowerLimit, upperLimit);
 }
 
 Range<float> HearingRangePreprocessor::getHearingRange()
@@ -54,3 +54,18 @@ std::unique_ptr<Preprocessor> HearingRangePreprocessor::clone() const
 {
     return std::make_unique<HearingRangePreprocessor> (*this);
 }
+
+NamedValueSet HearingRangePreprocessor::getParameters() const
+{
+    NamedValueSet parameters;
+    parameters.set ("lowerLimit", hearingRange.getStart());
+    parameters.set ("upperLimit", hearingRange.getEnd());
+    
+    return parameters;
+}
+
+void HearingRangePreprocessor::setParameters (const NamedValueSet& newParameters)
+{
+    if (newParameters.contains ("lowerLimit") && newParameters.contains ("upperLimit"))
+        setHearingRange (newParameters["lowerLimit"], newParameters["upperLimit"]);
+}
@@ -30,6 +30,12 @@ public:
     
     /** Enables dynamic allocation of child objects via std::unique_ptr. */
     virtual std::unique_ptr<Preprocessor> clone() const = 0;
+    
+    /** Returns the values of the preprocessor's settings, so that they can be saved and restored. */
+    virtual NamedValueSet getParameters() const { return NamedValueSet(); }
+    
+    /** Restores settings returned by getParameters. */
+    virtual void setParameters (const NamedValueSet&) {}
 
     
     String getName()
@@ -71,6 +77,12 @@ public:
     /** For dynamic allocation of unique pointers to generic preprocessor arrays in DissonanceCalc. */
     std::unique_ptr<Preprocessor> clone() const override;
     
+    /** Returns the limits of the hearing range, named "lowerLimit" and "upperLimit". */
+    NamedValueSet getParameters() const override;
+    
+    /** Sets the limits of the hearing range from values named "lowerLimit" and "upperLimit". */
+    void setParameters (const NamedValueSet& newParameters) override;
+    
 private:
     Range<float> hearingRange;
 };
@@ -0,0 +1,175 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "RegisterSweep.h"
+
+RegisterSweep::RegisterSweep()
+{
+    ratioRange = Range<float> (0.5f, 2.0f);
+    numSteps = 241;
+    numChords = 0;
+}
+
+RegisterSweep::~RegisterSweep()
+{
+}
+
+//==============================================================================
+
+
+void RegisterSweep::setRange (float lowestRatio, float highestRatio)
+{
+    jassert (lowestRatio > 0 && highestRatio > lowestRatio);
+
+    ratioRange = Range<float> (lowestRatio, highestRatio);
+}
+
+Range<float> RegisterSweep::getRange() const noexcept
+{
+    return ratioRange;
+}
+
+void RegisterSweep::setNumSteps (int newNumSteps)
+{
+    jassert (newNumSteps > 1);
+
+    numSteps = jmax (2, newNumSteps);
+}
+
+int RegisterSweep::getNumSteps() const noexcept
+{
+    return numSteps;
+}
+
+float RegisterSweep::getRatioAtStep (int step) const
+{
+    return ratioRange.getStart() * std::pow (ratioRange.getEnd() / ratioRange.getStart(),
+                                             (float) step / (float) (numSteps - 1));
+}
+
+//==============================================================================
+
+
+void RegisterSweep::calculate (const DissonanceCalc& calc, WorkerPool& pool)
+{
+    jassert (calc.model != nullptr);        // The DissonanceCalc needs a model
+
+    numChords = calc.model != nullptr ? calc.numChords() : 0;
+    curves.resize (numChords * numSteps);
+
+    pool.parallelFor (numChords, [&] (int chord, int)
+    {
+        // Each chord uses its own clone of the model, so chords can be calculated in parallel
+        std::unique_ptr<DissonanceModel> model (calc.model->cloneModel());
+        float* curve = curves.getRawDataPointer() + chord * numSteps;
+
+        OwnedArray<OvertoneDistribution> chordDistributions;
+        chordDistributions.addCopiesOf (calc.distributions);
+
+        for (int d = 0; d < chordDistributions.size(); ++d)
+            chordDistributions[d]->setFundamental (calc.getFreqInChord (chord, d), calc.getAmpInChord (chord, d));
+
+        auto* pairwiseModel = dynamic_cast<SpectralInterferenceModel*> (model.get());
+
+        if (pairwiseModel != nullptr && calc.preprocessors.isEmpty())
+        {
+            calculatePairwiseCurve (*pairwiseModel, chordDistributions, curve);
+        }
+        else
+        {
+            OwnedArray<Preprocessor> preprocessors;
+
+            for (auto* preprocessor : calc.preprocessors)
+                preprocessors.add (preprocessor->clone().release());
+
+            calculateFullCurve (*model, preprocessors, chordDistributions, curve);
+        }
+    });
+}
+
+int RegisterSweep::getNumChords() const noexcept
+{
+    return numChords;
+}
+
+const float* RegisterSweep::getCurve (int chordIndex) const
+{
+    jassert (isPositiveAndBelow (chordIndex, numChords));
+
+    return curves.getRawDataPointer() + jlimit (0, jmax (0, numChords - 1), chordIndex) * numSteps;
+}
+
+float RegisterSweep::getDissonance (int chordIndex, int step) const
+{
+    jassert (isPositiveAndBelow (step, numSteps));
+
+    return curves[chordIndex * numSteps + step];
+}
+
+int RegisterSweep::getLeastDissonantStep (int chordIndex) const
+{
+    if (! isPositiveAndBelow (chordIndex, numChords))
+    {
+        jassertfalse;
+        return -1;
+    }
+
+    const float* curve = getCurve (chordIndex);
+
+    return (int) (std::min_element (curve, curve + numSteps) - curve);
+}
+
+//==============================================================================
+
+
+void RegisterSweep::calculatePairwiseCurve (SpectralInterferenceModel& model, const OwnedArray<OvertoneDistribution>& chordDistributions, float* curve) const
+{
+    // SpectralInterferenceModel sums the roughness of every pair of audible partials and fundamentals once, so the chord is flattened into a list of those partials
+    PartialList partials;
+    partials.setDistributions (chordDistributions);
+
+    const int numPartials = partials.size();
+    HeapBlock<float> transposedFreqs ((size_t) jmax (1, numPartials));
+
+    // Transposing scales every frequency by the same ratio and leaves the amplitudes unchanged
+    for (int step = 0; step < numSteps; ++step)
+    {
+        FloatVectorOperations::copyWithMultiply (transposedFreqs, partials.getFreqs(), getRatioAtStep (step), numPartials);
+
+        curve[step] = model.calculatePairwiseDissonance (transposedFreqs, partials.getAmps(), numPartials);
+    }
+}
+
+void RegisterSweep::calculateFullCurve (DissonanceModel& model, const OwnedArray<Preprocessor>& preprocessors,
+                                        const OwnedArray<OvertoneDistribution>& chordDistributions, float* curve) const
+{
+    OwnedArray<OvertoneDistribution> tempDistributions;
+
+    for (int step = 0; step < numSteps; ++step)
+    {
+        const float ratio = getRatioAtStep (step);
+
+        tempDistributions.clear();
+        tempDistributions.addCopiesOf (chordDistributions);
+
+        for (int d = 0; d < tempDistributions.size(); ++d)
+            tempDistributions[d]->setFundamentalFreq (chordDistributions[d]->getFundamentalFreq() * ratio);
+
+        for (auto* pre : preprocessors)
+        {
+            pre->process (tempDistributions);
+        }
+
+        curve[step] = model.calculateDissonance (tempDistributions, false);
+    }
+}
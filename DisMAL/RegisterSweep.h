@@ -0,0 +1,93 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceCalc.h"
+#include "PartialList.h"
+#include "WorkerPool.h"
+
+/** Calculates how the dissonance of chords changes with register, as every voice is transposed together.
+
+    Each chord of a DissonanceCalc (as added with DissonanceCalc::addChord) is transposed by a range of log-spaced ratios, giving a register curve for each chord. As the ratios between the chord's partials never change, the chord's partials are flattened into a list once, and each step of the curve only scales their frequencies and sums the roughness of every pair with SpectralInterferenceModel::calculatePairwiseDissonance. No distributions are copied or preprocessed per step.
+
+    This applies to any SpectralInterferenceModel, provided that the DissonanceCalc has no preprocessors. Otherwise, each step is calculated with the chord's distributions transposed and preprocessed, as DissonanceCalc::calculateDissonances would.
+
+    Chords are calculated in parallel with a WorkerPool.
+*/
+class RegisterSweep
+{
+public:
+    //==============================================================================
+    /** Creates a RegisterSweep object, which sweeps from an octave below each chord to an octave above it in 241 steps. */
+    RegisterSweep();
+
+    /** Destructor. */
+    ~RegisterSweep();
+
+    //==============================================================================
+    /** Sets the range of ratios by which chords are transposed.
+
+        @param lowestRatio The ratio of the first step, such as 0.5 for an octave below the chord.
+        @param highestRatio The ratio of the last step.
+    */
+    void setRange (float lowestRatio, float highestRatio);
+
+    /** Returns the range of ratios by which chords are transposed. */
+    Range<float> getRange() const noexcept;
+
+    /** Sets the number of steps in each register curve. */
+    void setNumSteps (int newNumSteps);
+
+    /** Returns the number of steps in each register curve. */
+    int getNumSteps() const noexcept;
+
+    /** Returns the ratio by which chords are transposed at a step. Steps are spaced logarithmically. */
+    float getRatioAtStep (int step) const;
+
+    //==============================================================================
+    /** Calculates a register curve for every chord of a DissonanceCalc.
+
+        The DissonanceCalc's model, preprocessors, distributions and chords are used, but the DissonanceCalc isn't changed.
+    */
+    void calculate (const DissonanceCalc& calc, WorkerPool& pool);
+
+    /** Returns the number of chords with register curves. */
+    int getNumChords() const noexcept;
+
+    /** Returns a pointer to the getNumSteps() dissonance values of a chord's register curve. */
+    const float* getCurve (int chordIndex) const;
+
+    /** Returns the dissonance of a chord at a step of its register curve. */
+    float getDissonance (int chordIndex, int step) const;
+
+    /** Returns the step at which a chord's register curve is least dissonant. */
+    int getLeastDissonantStep (int chordIndex) const;
+
+private:
+    //==============================================================================
+    Range<float> ratioRange;
+    int numSteps, numChords;
+    Array<float> curves;
+
+    //==============================================================================
+    /** Fills a chord's curve from a list of its partials that is flattened once and transposed at every step. */
+    void calculatePairwiseCurve (SpectralInterferenceModel& model, const OwnedArray<OvertoneDistribution>& chordDistributions, float* curve) const;
+
+    /** Fills a chord's curve by transposing, preprocessing and calculating its distributions at every step. */
+    void calculateFullCurve (DissonanceModel& model, const OwnedArray<Preprocessor>& preprocessors,
+                             const OwnedArray<OvertoneDistribution>& chordDistributions, float* curve) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RegisterSweep)
+};
@@ -0,0 +1,738 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "ResultCache.h"
+
+namespace
+{
+    const int resultCacheMagic = 0x43524d44;     // "DMRC"
+    const int resultCacheVersion = 1;
+    const int recordMagic = 0x52435244;          // "DRCR"
+
+    // The magic number, version and generation
+    const int64 headerSize = 2 * sizeof (int) + sizeof (int64);
+
+    // The record magic number, key and number of values, followed by the values and a checksum
+    const int64 recordHeaderSize = 2 * sizeof (int) + 2 * sizeof (uint64);
+
+    int64 getRecordSize (int numValues) noexcept
+    {
+        return recordHeaderSize + (int64) sizeof (float) * numValues + (int64) sizeof (uint32);
+    }
+
+    /** Mixes the bits of a hash, so that similar inputs give unrelated keys. */
+    uint64 finalise (uint64 hash) noexcept
+    {
+        hash ^= hash >> 30;
+        hash *= 0xbf58476d1ce4e5b9ULL;
+        hash ^= hash >> 27;
+        hash *= 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+
+        return hash;
+    }
+
+    /** Caches that are opened through getShared, so that each file is only opened once per process. */
+    CriticalSection sharedCachesLock;
+    std::map<String, std::weak_ptr<ResultCache>> sharedCaches;
+}
+
+//==============================================================================
+
+
+ResultCache::KeyBuilder::KeyBuilder()
+{
+    // Two independent 64-bit hashes make up the 128-bit key
+    first = 0xcbf29ce484222325ULL;
+    second = 0x84222325cbf29ce4ULL;
+}
+
+ResultCache::KeyBuilder& ResultCache::KeyBuilder::add (const void* data, size_t numBytes)
+{
+    const uint8* bytes = static_cast<const uint8*> (data);
+
+    for (size_t i = 0; i < numBytes; ++i)
+    {
+        first = (first ^ bytes[i]) * 0x100000001b3ULL;
+        second = (second ^ bytes[i]) * 0x9e3779b97f4a7c15ULL;
+    }
+
+    return *this;
+}
+
+ResultCache::KeyBuilder& ResultCache::KeyBuilder::add (int value)
+{
+    return add (&value, sizeof (value));
+}
+
+ResultCache::KeyBuilder& ResultCache::KeyBuilder::add (float value)
+{
+    // Negative zero gives the same results as zero, so it shouldn't give a different key
+    if (value == 0)
+        value = 0;
+
+    uint32 bits;
+    std::memcpy (&bits, &value, sizeof (bits));
+
+    return add ((int) bits);
+}
+
+ResultCache::KeyBuilder& ResultCache::KeyBuilder::add (const String& text)
+{
+    add ((int) text.getNumBytesAsUTF8());
+
+    return add (text.toRawUTF8(), text.getNumBytesAsUTF8());
+}
+
+ResultCache::KeyBuilder& ResultCache::KeyBuilder::add (const NamedValueSet& parameters)
+{
+    add (parameters.size());
+
+    for (int i = 0; i < parameters.size(); ++i)
+    {
+        MemoryOutputStream value;
+        parameters.getValueAt (i).writeToStream (value);
+
+        add (parameters.getName (i).toString());
+        add (value.getData(), value.getDataSize());
+    }
+
+    return *this;
+}
+
+ResultCache::KeyBuilder& ResultCache::KeyBuilder::add (const OvertoneDistribution& distribution, bool includeFundamentalFreq)
+{
+    add (distribution.isMuted() ? 1 : 0);
+    add (distribution.fundamentalIsMuted() ? 1 : 0);
+    add (distribution.getMinInterval());
+    add (includeFundamentalFreq ? distribution.getFundamentalFreq() : 0.0f);
+    add (distribution.getFundamentalAmp());
+    add (distribution.numPartials());
+
+    for (int p = 0; p < distribution.numPartials(); ++p)
+    {
+        add (distribution.getFreqRatio (p));
+        add (distribution.getAmpRatio (p));
+        add (distribution.partialIsMuted (p) ? 1 : 0);
+    }
+
+    return *this;
+}
+
+ResultCache::Key ResultCache::KeyBuilder::getKey() const noexcept
+{
+    return { finalise (first), finalise (second) };
+}
+
+//==============================================================================
+
+
+ResultCache::ResultCache (const File& cacheFile, int64 maximumSizeInBytes)
+    : processLock ("DisMAL_ResultCache_" + String::toHexString (cacheFile.getFullPathName().hashCode64()))
+{
+    jassert (maximumSizeInBytes > headerSize);
+
+    file = cacheFile;
+    maximumSize = maximumSizeInBytes;
+    indexedLength = 0;
+    indexedGeneration = 0;
+}
+
+ResultCache::~ResultCache()
+{
+}
+
+std::shared_ptr<ResultCache> ResultCache::getShared (const File& cacheFile)
+{
+    const ScopedLock sl (sharedCachesLock);
+
+    const String path = cacheFile.getFullPathName();
+
+    if (auto existingCache = sharedCaches[path].lock())
+        return existingCache;
+
+    auto cache = std::make_shared<ResultCache> (cacheFile);
+    sharedCaches[path] = cache;
+
+    return cache;
+}
+
+//==============================================================================
+
+
+bool ResultCache::lookup (const Key& key, Array<float>& values)
+{
+    const ScopedLock sl (lock);
+    const InterProcessLock::ScopedLockType processScopedLock (processLock);
+
+    if (! processScopedLock.isLocked())
+        return false;
+
+    refreshIndex();
+
+    auto entry = index.find (key);
+
+    if (entry == index.end())
+        return false;
+
+    FileInputStream input (file);
+
+    if (! input.openedOk() || ! input.setPosition (entry->second.offset))
+        return false;
+
+    Array<float> cachedValues;
+    cachedValues.resize (entry->second.numValues);
+
+    const int numBytes = (int) sizeof (float) * entry->second.numValues;
+
+    if (input.read (cachedValues.getRawDataPointer(), numBytes) != numBytes
+        || (uint32) input.readInt() != getChecksum (cachedValues.getRawDataPointer(), cachedValues.size()))
+    {
+        // A damaged record is forgotten, so that it is recalculated and replaced
+        index.erase (entry);
+        return false;
+    }
+
+    values.swapWith (cachedValues);
+
+    return true;
+}
+
+bool ResultCache::store (const Key& key, const float* values, int numValues)
+{
+    jassert (numValues >= 0);
+
+    const ScopedLock sl (lock);
+    const InterProcessLock::ScopedLockType processScopedLock (processLock);
+
+    if (! processScopedLock.isLocked())
+        return false;
+
+    refreshIndex();
+
+    if (indexedGeneration == 0)
+        return false;
+
+    const int64 recordSize = getRecordSize (numValues);
+
+    if (recordSize > maximumSize - headerSize)
+    {
+        jassertfalse;       // This result can never fit in the cache
+        return false;
+    }
+
+    if (indexedLength + recordSize > maximumSize)
+        evictOldest ((maximumSize - headerSize) * 3 / 4 + headerSize - recordSize);
+
+    {
+        FileOutputStream output (file);
+
+        if (! output.openedOk())
+        {
+            jassertfalse;       // Couldn't write to the cache file
+            return false;
+        }
+
+        // Anything past the last complete record was left by an interrupted write, and is overwritten
+        output.setPosition (indexedLength);
+        output.truncate();
+
+        output.writeInt (recordMagic);
+        output.writeInt64 ((int64) key.high);
+        output.writeInt64 ((int64) key.low);
+        output.writeInt (numValues);
+        output.write (values, sizeof (float) * (size_t) numValues);
+        output.writeInt ((int) getChecksum (values, numValues));
+        output.flush();
+    }
+
+    index[key] = { indexedLength + recordHeaderSize, numValues };
+    indexedLength += recordSize;
+
+    return true;
+}
+
+bool ResultCache::store (const Key& key, const Array<float>& values)
+{
+    return store (key, values.getRawDataPointer(), values.size());
+}
+
+void ResultCache::clear()
+{
+    const ScopedLock sl (lock);
+    const InterProcessLock::ScopedLockType processScopedLock (processLock);
+
+    if (! processScopedLock.isLocked())
+        return;
+
+    int64 generation;
+
+    if (createEmptyFile (file, generation))
+    {
+        index.clear();
+        indexedLength = headerSize;
+        indexedGeneration = generation;
+    }
+}
+
+int ResultCache::getNumEntries()
+{
+    const ScopedLock sl (lock);
+    const InterProcessLock::ScopedLockType processScopedLock (processLock);
+
+    if (processScopedLock.isLocked())
+        refreshIndex();
+
+    return (int) index.size();
+}
+
+//==============================================================================
+
+
+void ResultCache::setMaximumSize (int64 maximumSizeInBytes)
+{
+    jassert (maximumSizeInBytes > headerSize);
+
+    const ScopedLock sl (lock);
+
+    maximumSize = maximumSizeInBytes;
+}
+
+int64 ResultCache::getMaximumSize() const noexcept
+{
+    return maximumSize;
+}
+
+int64 ResultCache::getFileSize() const
+{
+    return file.getSize();
+}
+
+//==============================================================================
+
+
+ResultCache::Key ResultCache::getKey (const DissonanceCalc& calc, ResultType type)
+{
+    jassert (calc.model != nullptr);     // A model must be set before calculating
+
+    KeyBuilder builder;
+    builder.add ((int) type);
+
+    builder.add (calc.model != nullptr ? calc.model->getName() : String());
+    builder.add (calc.model != nullptr ? calc.model->getParameters() : NamedValueSet());
+
+    // Preprocessing depends on the frequencies of each step or chord, so the chain of preprocessors is hashed rather than their output
+    builder.add (calc.preprocessors.size());
+
+    for (auto* preprocessor : calc.preprocessors)
+    {
+        builder.add (preprocessor->getName());
+        builder.add (preprocessor->getParameters());
+    }
+
+    builder.add (calc.distributions.size());
+
+    for (int i = 0; i < calc.distributions.size(); ++i)
+    {
+        bool fundamentalIsVariable;
+
+        switch (type)
+        {
+            case chordDissonances:
+                fundamentalIsVariable = true;
+                break;
+
+            case dissonanceMap:
+                fundamentalIsVariable = calc.dimensionality == DissonanceCalc::twoDimensional ? i == calc.varDist
+                                                                                              : i == calc.xDist || i == calc.yDist;
+                break;
+
+            case optimisedMinima:
+            case optimisedMaxima:
+                fundamentalIsVariable = i == calc.varDist;
+                break;
+
+            case pairwiseTable:
+            default:
+                fundamentalIsVariable = false;
+                break;
+        }
+
+        builder.add (*calc.distributions.getUnchecked (i), ! fundamentalIsVariable);
+    }
+
+    switch (type)
+    {
+        case chordDissonances:
+            builder.add (calc.chords.size());
+
+            for (auto& chord : calc.chords)
+            {
+                builder.add (chord.size());
+
+                for (auto& note : chord)
+                    builder.add (note.freq).add (note.amp);
+            }
+
+            break;
+
+        case dissonanceMap:
+            builder.add ((int) calc.dimensionality);
+            builder.add ((int) calc.stepType);
+            builder.add (calc.numSteps);
+            builder.add (calc.frequencyRange.getStart()).add (calc.frequencyRange.getEnd());
+
+            if (calc.dimensionality == DissonanceCalc::twoDimensional)
+                builder.add (calc.varDist);
+            else
+                builder.add (calc.xDist).add (calc.yDist).add ((int) calc.getMapPrecision());
+
+            break;
+
+        case optimisedMinima:
+        case optimisedMaxima:
+            builder.add (calc.varDist);
+            builder.add (calc.frequencyRange.getStart()).add (calc.frequencyRange.getEnd());
+            builder.add (calc.optimMinInterval).add (calc.optimStepSize).add (calc.optimTolerance);
+            break;
+
+        case pairwiseTable:
+        default:
+            break;
+    }
+
+    return builder.getKey();
+}
+
+bool ResultCache::calculateDissonanceMap (DissonanceCalc& calc)
+{
+    // This map is over the DissonanceCalc's memory budget, so it can't be stored
+    if (! calc.mapFitsInMemoryBudget())
+    {
+        jassertfalse;
+        return false;
+    }
+
+    // A cell mask is an arbitrary function, so it can't be part of the key
+    if (calc.dimensionality == DissonanceCalc::threeDimensional && calc.hasCellMask())
+    {
+        calc.calculateDissonanceMap();
+        return false;
+    }
+
+    const Key key = getKey (calc, dissonanceMap);
+    const bool threeDimensional = calc.dimensionality == DissonanceCalc::threeDimensional;
+    const int numValues = threeDimensional ? calc.numSteps * calc.numSteps : calc.numSteps;
+
+    Array<float> values;
+
+    if (lookup (key, values) && values.size() == numValues)
+    {
+        calc.resizeMap();
+
+        if (! threeDimensional)
+        {
+            calc.map2D.swapWith (values);
+            calc.distributions[calc.varDist]->setFundamentalFreq (calc.getFrequencyAtStep (calc.numSteps - 1));
+        }
+        else
+        {
+            if (calc.usingCompressedMap())
+            {
+                calc.compressedMap3D.setAll (values.getRawDataPointer());
+            }
+            else
+            {
+                for (int xStep = 0; xStep < calc.numSteps; ++xStep)
+                {
+                    FloatVectorOperations::copy (calc.map3D.getReference (xStep).getRawDataPointer(),
+                                                 values.getRawDataPointer() + xStep * calc.numSteps,
+                                                 calc.numSteps);
+                }
+            }
+
+            // Leave the distributions as a calculation would
+            calc.distributions[calc.xDist]->setFundamentalFreq (calc.getFrequencyAtStep (calc.numSteps - 1));
+            calc.distributions[calc.yDist]->setFundamentalFreq (calc.getFrequencyAtStep (calc.numSteps - 1));
+        }
+
+        return true;
+    }
+
+    calc.calculateDissonanceMap();
+
+    if (! threeDimensional)
+    {
+        store (key, calc.map2D);
+    }
+    else
+    {
+        values.resize (numValues);
+
+        for (int xStep = 0; xStep < calc.numSteps; ++xStep)
+        {
+            float* row = values.getRawDataPointer() + xStep * calc.numSteps;
+
+            if (calc.usingCompressedMap())
+            {
+                for (int yStep = 0; yStep < calc.numSteps; ++yStep)
+                    row[yStep] = calc.compressedMap3D.get (xStep, yStep);
+            }
+            else
+            {
+                FloatVectorOperations::copy (row, calc.map3D.getReference (xStep).getRawDataPointer(), calc.numSteps);
+            }
+        }
+
+        store (key, values);
+    }
+
+    return false;
+}
+
+bool ResultCache::calculateDissonances (DissonanceCalc& calc)
+{
+    const Key key = getKey (calc, chordDissonances);
+
+    Array<float> values;
+
+    if (lookup (key, values) && values.size() == calc.chords.size())
+    {
+        calc.dissonanceValues.swapWith (values);
+        return true;
+    }
+
+    calc.calculateDissonances();
+
+    // Chords over the memory budget aren't calculated, so there's nothing to store
+    if (calc.getLastError().failed())
+        return false;
+
+    store (key, calc.dissonanceValues);
+
+    return false;
+}
+
+bool ResultCache::optimize2D (DissonanceCalc& calc, bool minimize, float lowerBound, float upperBound)
+{
+    // optimize2D ignores bounds outside of the frequency range, so they give the same results as the default bounds
+    const bool useBounds = lowerBound >= calc.frequencyRange.getStart() && upperBound <= calc.frequencyRange.getEnd();
+
+    KeyBuilder builder;
+    const Key calcKey = getKey (calc, minimize ? optimisedMinima : optimisedMaxima);
+
+    builder.add (&calcKey, sizeof (calcKey));
+    builder.add (useBounds ? lowerBound : -1.0f).add (useBounds ? upperBound : -1.0f);
+
+    const Key key = builder.getKey();
+    Array<float>& optimisedValues = minimize ? calc.minima : calc.maxima;
+
+    Array<float> values;
+
+    if (lookup (key, values))
+    {
+        optimisedValues.swapWith (values);
+        return true;
+    }
+
+    calc.optimize2D (minimize, lowerBound, upperBound);
+    store (key, optimisedValues);
+
+    return false;
+}
+
+//==============================================================================
+
+
+bool ResultCache::createEmptyFile (const File& fileToCreate, int64& generation) const
+{
+    fileToCreate.getParentDirectory().createDirectory();
+
+    FileOutputStream output (fileToCreate);
+
+    if (! output.openedOk())
+    {
+        jassertfalse;       // Couldn't create the cache file
+        return false;
+    }
+
+    output.setPosition (0);
+    output.truncate();
+
+    // A new generation tells other processes that the file has been rewritten, so they must rebuild their indexes
+    do
+    {
+        generation = Random::getSystemRandom().nextInt64();
+    }
+    while (generation == 0 || generation == indexedGeneration);
+
+    output.writeInt (resultCacheMagic);
+    output.writeInt (resultCacheVersion);
+    output.writeInt64 (generation);
+    output.flush();
+
+    return true;
+}
+
+void ResultCache::refreshIndex()
+{
+    std::unique_ptr<FileInputStream> input;
+
+    if (file.existsAsFile())
+        input.reset (new FileInputStream (file));
+
+    int64 generation = 0;
+
+    if (input != nullptr && input->openedOk()
+        && input->getTotalLength() >= headerSize
+        && input->readInt() == resultCacheMagic
+        && input->readInt() == resultCacheVersion)
+    {
+        generation = input->readInt64();
+    }
+    else
+    {
+        // The file is missing, or isn't a cache of this version, so a new cache is started
+        input = nullptr;
+
+        if (! createEmptyFile (file, generation))
+        {
+            index.clear();
+            indexedLength = 0;
+            indexedGeneration = 0;
+            return;
+        }
+
+        input.reset (new FileInputStream (file));
+    }
+
+    if (generation != indexedGeneration)
+    {
+        index.clear();
+        indexedLength = headerSize;
+        indexedGeneration = generation;
+    }
+
+    const int64 fileLength = input->getTotalLength();
+
+    if (! input->openedOk() || ! input->setPosition (indexedLength))
+        return;
+
+    // Later records replace earlier records with the same key
+    while (indexedLength + getRecordSize (0) <= fileLength)
+    {
+        Key key;
+
+        if (input->readInt() != recordMagic)
+            break;
+
+        key.high = (uint64) input->readInt64();
+        key.low = (uint64) input->readInt64();
+        const int numValues = input->readInt();
+
+        if (numValues < 0 || indexedLength + getRecordSize (numValues) > fileLength)
+            break;
+
+        index[key] = { indexedLength + recordHeaderSize, numValues };
+        indexedLength += getRecordSize (numValues);
+
+        if (! input->setPosition (indexedLength))
+            break;
+    }
+}
+
+void ResultCache::evictOldest (int64 targetSize)
+{
+    struct Record
+    {
+        Key key;
+        Entry entry;
+    };
+
+    // Records that have been replaced are dropped, and the rest are kept in the order they were written
+    std::vector<Record> records;
+    int64 liveSize = headerSize;
+
+    for (auto& item : index)
+        records.push_back ({ item.first, item.second });
+
+    std::sort (records.begin(), records.end(),
+               [] (const Record& a, const Record& b) { return a.entry.offset < b.entry.offset; });
+
+    for (auto& record : records)
+        liveSize += getRecordSize (record.entry.numValues);
+
+    size_t firstKept = 0;
+
+    while (firstKept < records.size() && liveSize > targetSize)
+        liveSize -= getRecordSize (records[firstKept++].entry.numValues);
+
+    FileInputStream input (file);
+    TemporaryFile temp (file);
+    int64 generation;
+
+    if (! input.openedOk() || ! createEmptyFile (temp.getFile(), generation))
+        return;
+
+    std::map<Key, Entry> newIndex;
+    int64 newLength = headerSize;
+
+    {
+        FileOutputStream output (temp.getFile());
+
+        if (! output.openedOk())
+            return;
+
+        output.setPosition (headerSize);
+
+        for (size_t i = firstKept; i < records.size(); ++i)
+        {
+            const Record& record = records[i];
+            const int64 recordSize = getRecordSize (record.entry.numValues);
+            const int64 recordStart = record.entry.offset - recordHeaderSize;
+
+            MemoryBlock data;
+
+            if (! input.setPosition (recordStart)
+                || input.readIntoMemoryBlock (data, (ssize_t) recordSize) != (size_t) recordSize)
+            {
+                continue;
+            }
+
+            output.write (data.getData(), data.getSize());
+
+            newIndex[record.key] = { newLength + recordHeaderSize, record.entry.numValues };
+            newLength += recordSize;
+        }
+
+        output.flush();
+    }
+
+    if (temp.overwriteTargetFileWithTemporary())
+    {
+        index.swap (newIndex);
+        indexedLength = newLength;
+        indexedGeneration = generation;
+    }
+}
+
+uint32 ResultCache::getChecksum (const float* values, int numValues) noexcept
+{
+    const uint8* bytes = reinterpret_cast<const uint8*> (values);
+    uint32 checksum = 0x811c9dc5;
+
+    for (size_t i = 0; i < sizeof (float) * (size_t) numValues; ++i)
+        checksum = (checksum ^ bytes[i]) * 0x01000193;
+
+    return checksum;
+}
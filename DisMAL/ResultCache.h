@@ -0,0 +1,205 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceCalc.h"
+#include "DissonanceModel.h"
+#include "OvertoneDistribution.h"
+#include "Preprocessor.h"
+#include <map>
+
+/** A persistent cache of calculated dissonance values, shared between runs and processes.
+
+    Results are addressed by a 128-bit hash of everything that determines them: the overtone distributions, the preprocessor chain and its settings, the model and its parameters, and the chords, sweep or optimisation settings. Identical calculations made by different batch jobs (or different runs of the same job) are only ever calculated once.
+
+    Every result is an array of floats, so the cache can hold chord dissonances, 2D curves, 3D maps, tables of pairwise interactions and optimised minima. The helper functions such as calculateDissonanceMap look up a DissonanceCalc's result and only calculate it when it isn't cached.
+
+    The cache is a single file of records that are only ever appended. Each record starts with its key and length, which the cache scans to build an index in memory, and ends with a checksum. When the file grows beyond its maximum size, the oldest records are evicted by rewriting the file. All file access is protected by a juce::InterProcessLock, so any number of processes on one machine can share a cache file. On some platforms an InterProcessLock only excludes other processes, so within a process every thread must use the same ResultCache object for a file: getShared returns it.
+*/
+class ResultCache
+{
+public:
+    //==============================================================================
+    /** The 128-bit hash that identifies a result. */
+    struct Key
+    {
+        uint64 high;
+        uint64 low;
+
+        bool operator== (const Key& other) const noexcept     { return high == other.high && low == other.low; }
+        bool operator!= (const Key& other) const noexcept     { return ! operator== (other); }
+        bool operator< (const Key& other) const noexcept      { return high != other.high ? high < other.high : low < other.low; }
+    };
+
+    //==============================================================================
+    /** Builds a Key from the data that determines a result. */
+    class KeyBuilder
+    {
+    public:
+        /** Creates a KeyBuilder with nothing added. */
+        KeyBuilder();
+
+        /** Adds raw bytes to the hash. */
+        KeyBuilder& add (const void* data, size_t numBytes);
+
+        /** Adds an integer to the hash. */
+        KeyBuilder& add (int value);
+
+        /** Adds a float to the hash. */
+        KeyBuilder& add (float value);
+
+        /** Adds a string to the hash. */
+        KeyBuilder& add (const String& text);
+
+        /** Adds a set of named parameters to the hash. */
+        KeyBuilder& add (const NamedValueSet& parameters);
+
+        /** Adds the partials, fundamental and mutes of an overtone distribution to the hash.
+
+            @param distribution The distribution to add.
+            @param includeFundamentalFreq Set to false for distributions whose fundamental is swept, so that the frequency it happened to be left at doesn't change the key.
+        */
+        KeyBuilder& add (const OvertoneDistribution& distribution, bool includeFundamentalFreq = true);
+
+        /** Returns the key of everything added so far. */
+        Key getKey() const noexcept;
+
+    private:
+        uint64 first, second;
+    };
+
+    //==============================================================================
+    /** The kinds of result that can be cached for a DissonanceCalc. */
+    enum ResultType
+    {
+        chordDissonances = 1,       /**< The results of DissonanceCalc::calculateDissonances. */
+        dissonanceMap,              /**< A 2D curve or 3D map from DissonanceCalc::calculateDissonanceMap. */
+        optimisedMinima,            /**< The minima found by DissonanceCalc::optimize2D. */
+        optimisedMaxima,            /**< The maxima found by DissonanceCalc::optimize2D. */
+        pairwiseTable               /**< A table of dissonances between pairs of notes or partials. */
+    };
+
+    //==============================================================================
+    /** Creates a ResultCache that uses a file, creating the file if it doesn't exist.
+
+        @param cacheFile The file that holds the cache.
+        @param maximumSizeInBytes When the file grows beyond this size, the oldest results are evicted.
+    */
+    explicit ResultCache (const File& cacheFile, int64 maximumSizeInBytes = 256 * 1024 * 1024);
+
+    /** Destructor. */
+    ~ResultCache();
+
+    /** Returns the cache that uses a file, shared with every other caller in the process that asks for the same file.
+
+        Two ResultCache objects must never use the same file within one process, so this should be used instead of the constructor whenever a cache file may be opened more than once. The cache stays open until every caller has released it.
+    */
+    static std::shared_ptr<ResultCache> getShared (const File& cacheFile);
+
+    //==============================================================================
+    /** Finds a cached result.
+
+        @param key The key of the result.
+        @param values Set to the cached values if the result is found.
+        @return True if the result was found.
+    */
+    bool lookup (const Key& key, Array<float>& values);
+
+    /** Adds a result to the cache. If the key is already cached, the new values replace the old ones.
+
+        @return True if the result was written.
+    */
+    bool store (const Key& key, const float* values, int numValues);
+
+    /** Adds a result to the cache. */
+    bool store (const Key& key, const Array<float>& values);
+
+    /** Removes every result from the cache. */
+    void clear();
+
+    /** Returns the number of results in the cache. */
+    int getNumEntries();
+
+    //==============================================================================
+    /** Sets the size at which the oldest results are evicted. */
+    void setMaximumSize (int64 maximumSizeInBytes);
+
+    /** Returns the size at which the oldest results are evicted. */
+    int64 getMaximumSize() const noexcept;
+
+    /** Returns the size of the cache file. */
+    int64 getFileSize() const;
+
+    //==============================================================================
+    /** Returns the key of a result of a DissonanceCalc, given its current settings.
+
+        The key covers the distributions, preprocessors, model and the settings that affect the type of result. It doesn't cover the optimisation bounds, which are added by optimize2D.
+    */
+    static Key getKey (const DissonanceCalc& calc, ResultType type);
+
+    /** Fills a DissonanceCalc's dissonance map from the cache, or calculates and caches it.
+
+        3D maps with a cell mask are always calculated, as the mask can't be included in the key.
+
+        @return True if the map was found in the cache.
+    */
+    bool calculateDissonanceMap (DissonanceCalc& calc);
+
+    /** Fills a DissonanceCalc's chord dissonances from the cache, or calculates and caches them.
+
+        @return True if the dissonances were found in the cache.
+    */
+    bool calculateDissonances (DissonanceCalc& calc);
+
+    /** Fills a DissonanceCalc's optimised minima or maxima from the cache, or optimises and caches them.
+
+        The arguments are the same as DissonanceCalc::optimize2D.
+
+        @return True if the results were found in the cache.
+    */
+    bool optimize2D (DissonanceCalc& calc, bool minimize = true, float lowerBound = -1, float upperBound = -1);
+
+private:
+    //==============================================================================
+    struct Entry
+    {
+        int64 offset;       // The position of the record's values in the file
+        int numValues;
+    };
+
+    File file;
+    int64 maximumSize;
+
+    CriticalSection lock;
+    InterProcessLock processLock;
+
+    std::map<Key, Entry> index;
+    int64 indexedLength, indexedGeneration;
+
+    //==============================================================================
+    /** Creates an empty cache file with a new generation number. Must be called with the locks held. */
+    bool createEmptyFile (const File& fileToCreate, int64& generation) const;
+
+    /** Indexes any records appended since the last call, and rebuilds the index if the file has been rewritten. Must be called with the locks held. */
+    void refreshIndex();
+
+    /** Rewrites the file without its oldest records, until it is below the target size. Must be called with the locks held. */
+    void evictOldest (int64 targetSize);
+
+    /** Returns the checksum of a record's values. */
+    static uint32 getChecksum (const float* values, int numValues) noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ResultCache)
+};
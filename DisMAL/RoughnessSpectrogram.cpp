@@ -0,0 +1,259 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "RoughnessSpectrogram.h"
+
+RoughnessSpectrogram::RoughnessSpectrogram (int newFFTOrder, int newHopSize)
+{
+    jassert (newHopSize >= 0);
+
+    fftOrder = jlimit (8, 18, newFFTOrder);
+    frameSize = 1 << fftOrder;
+    hopSize = newHopSize > 0 ? newHopSize : frameSize / 2;
+    framesPerBlock = 64;
+    numBands = 48;
+    lowestFreq = 20;
+    highestFreq = 20000;
+    peakThreshold = -60;
+    maxNumPeaks = 64;
+}
+
+RoughnessSpectrogram::~RoughnessSpectrogram()
+{
+}
+
+//==============================================================================
+
+
+void RoughnessSpectrogram::setBands (int newNumBands, float newLowestFreq, float newHighestFreq)
+{
+    jassert (newNumBands > 0 && newLowestFreq > 0 && newHighestFreq > newLowestFreq);
+
+    numBands = jmax (1, newNumBands);
+    lowestFreq = jmax (1.0f, newLowestFreq);
+    highestFreq = jmax (lowestFreq * 1.01f, newHighestFreq);
+}
+
+int RoughnessSpectrogram::getNumBands() const noexcept
+{
+    return numBands;
+}
+
+Range<float> RoughnessSpectrogram::getBandRange (int band) const
+{
+    jassert (isPositiveAndBelow (band, numBands));      // The band doesn't exist
+
+    const float ratio = highestFreq / lowestFreq;
+
+    return Range<float> (lowestFreq * std::pow (ratio, (float) band / numBands),
+                         lowestFreq * std::pow (ratio, (float) (band + 1) / numBands));
+}
+
+int RoughnessSpectrogram::getBandIndex (float freq) const noexcept
+{
+    if (freq <= lowestFreq)
+        return 0;
+
+    const int band = (int) (numBands * std::log (freq / lowestFreq) / std::log (highestFreq / lowestFreq));
+
+    return jlimit (0, numBands - 1, band);
+}
+
+void RoughnessSpectrogram::setPeakSettings (float thresholdDb, int newMaxNumPeaks)
+{
+    jassert (thresholdDb <= 0 && newMaxNumPeaks > 0);
+
+    peakThreshold = jmin (0.0f, thresholdDb);
+    maxNumPeaks = jmax (1, newMaxNumPeaks);
+}
+
+void RoughnessSpectrogram::setFramesPerBlock (int numFrames)
+{
+    jassert (numFrames > 0);
+
+    framesPerBlock = jmax (1, numFrames);
+}
+
+//==============================================================================
+
+
+int RoughnessSpectrogram::getFrameSize() const noexcept
+{
+    return frameSize;
+}
+
+int RoughnessSpectrogram::getHopSize() const noexcept
+{
+    return hopSize;
+}
+
+int RoughnessSpectrogram::getNumFrames (int numSamples) const noexcept
+{
+    if (numSamples <= 0)
+        return 0;
+
+    if (numSamples <= frameSize)
+        return 1;
+
+    return 1 + (numSamples - frameSize + hopSize - 1) / hopSize;
+}
+
+//==============================================================================
+
+
+Result RoughnessSpectrogram::process (const float* samples, int numSamples, double sampleRate,
+                                      const SpectralInterferenceModel& model,
+                                      const BlockCallback& blockCallback,
+                                      WorkerPool* pool)
+{
+    jassert (sampleRate > 0 && blockCallback != nullptr);
+
+    const int numFrames = getNumFrames (numSamples);
+    const int numWorkers = pool != nullptr ? pool->getNumWorkers() : 1;
+
+    // Models keep intermediate values in member variables, so each worker needs its own
+    OwnedArray<Workspace> workspaces;
+
+    for (int w = 0; w < numWorkers; ++w)
+    {
+        auto* workspace = workspaces.add (new Workspace (fftOrder));
+        workspace->model = model.cloneModel();
+    }
+
+    HeapBlock<float> block ((size_t) (jmin (framesPerBlock, jmax (1, numFrames)) * numBands));
+
+    for (int firstFrame = 0; firstFrame < numFrames; firstFrame += framesPerBlock)
+    {
+        const int numBlockFrames = jmin (framesPerBlock, numFrames - firstFrame);
+
+        auto calculateFrame = [&] (int item, int worker)
+        {
+            processFrame (samples, numSamples, firstFrame + item, sampleRate, block + item * numBands, *workspaces[worker]);
+        };
+
+        if (pool != nullptr)
+        {
+            pool->parallelFor (numBlockFrames, calculateFrame);
+        }
+        else
+        {
+            for (int item = 0; item < numBlockFrames; ++item)
+                calculateFrame (item, 0);
+        }
+
+        if (! blockCallback (firstFrame, block, numBlockFrames))
+            return Result::fail ("The analysis was stopped after " + String (firstFrame + numBlockFrames) + " of " + String (numFrames) + " frames");
+    }
+
+    return Result::ok();
+}
+
+Result RoughnessSpectrogram::analyse (const float* samples, int numSamples, double sampleRate,
+                                      const SpectralInterferenceModel& model,
+                                      Array<float>& matrix,
+                                      WorkerPool* pool)
+{
+    matrix.resize (getNumFrames (numSamples) * numBands);
+
+    return process (samples, numSamples, sampleRate, model, [&] (int firstFrame, const float* values, int numFrames)
+    {
+        FloatVectorOperations::copy (matrix.getRawDataPointer() + firstFrame * numBands, values, numFrames * numBands);
+        return true;
+    }, pool);
+}
+
+Result RoughnessSpectrogram::analyseToNpyFile (const float* samples, int numSamples, double sampleRate,
+                                               const SpectralInterferenceModel& model,
+                                               const File& file,
+                                               WorkerPool* pool)
+{
+    FileOutputStream output (file);
+
+    if (output.failedToOpen())
+        return Result::fail ("Couldn't open " + file.getFullPathName() + " for writing");
+
+    output.truncate();
+
+    if (! writeNpyHeader (output, getNumFrames (numSamples), numBands))
+        return Result::fail ("Couldn't write to " + file.getFullPathName());
+
+    bool writeOk = true;
+
+    const Result result = process (samples, numSamples, sampleRate, model, [&] (int, const float* values, int numFrames)
+    {
+        writeOk = output.write (values, sizeof (float) * (size_t) (numFrames * numBands));
+        return writeOk;
+    }, pool);
+
+    if (! writeOk)
+        return Result::fail ("Couldn't write to " + file.getFullPathName());
+
+    if (result.failed())
+        return result;
+
+    output.flush();
+
+    return Result::ok();
+}
+
+//==============================================================================
+
+
+void RoughnessSpectrogram::processFrame (const float* samples, int numSamples, int frame, double sampleRate, float* bandRoughness, Workspace& workspace) const
+{
+    FloatVectorOperations::clear (bandRoughness, numBands);
+
+    const int start = frame * hopSize;
+
+    workspace.analyser.reset();
+    workspace.analyser.addFrame (samples + start, jmin (frameSize, numSamples - start));
+
+    Array<SpectrumAnalyser::Peak>& peaks = workspace.peaks;
+    workspace.analyser.findPeaks (sampleRate, peakThreshold, maxNumPeaks, peaks);
+
+    workspace.peakBands.clearQuick();
+
+    for (auto& peak : peaks)
+        workspace.peakBands.add (getBandIndex (peak.freq));
+
+    auto& pairwiseModel = static_cast<SpectralInterferenceModel&> (*workspace.model);
+
+    // Half of each pair's roughness is attributed to the band of each of its peaks
+    for (int i = 0; i < peaks.size(); ++i)
+    {
+        for (int j = i + 1; j < peaks.size(); ++j)
+        {
+            const float roughness = 0.5f * pairwiseModel.calculateRoughness (peaks.getReference (i).freq, peaks.getReference (i).amp,
+                                                                             peaks.getReference (j).freq, peaks.getReference (j).amp);
+
+            bandRoughness[workspace.peakBands.getUnchecked (i)] += roughness;
+            bandRoughness[workspace.peakBands.getUnchecked (j)] += roughness;
+        }
+    }
+}
+
+bool RoughnessSpectrogram::writeNpyHeader (OutputStream& output, int numRows, int numColumns)
+{
+    String header ("{'descr': '" + String (ByteOrder::isBigEndian() ? ">f4" : "<f4")
+                   + "', 'fortran_order': False, 'shape': (" + String (numRows) + ", " + String (numColumns) + "), }");
+
+    // The magic string, version and header length take 10 bytes, and the header is padded so that the data starts on a multiple of 64 bytes
+    const int headerLength = ((10 + header.length() + 1 + 63) / 64) * 64 - 10;
+    header = header.paddedRight (' ', headerLength - 1) + "\n";
+
+    const char magic[] = { (char) 0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0 };
+
+    return output.write (magic, sizeof (magic))
+           && output.writeShort ((short) headerLength)
+           && output.write (header.toRawUTF8(), (size_t) headerLength);
+}
@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceModel.h"
+#include "SpectrumAnalyser.h"
+#include "WorkerPool.h"
+
+/** Shows where in frequency the roughness of an audio signal comes from, over time.
+
+    The signal is split into overlapping frames, and the spectral peaks of each frame are found with a SpectrumAnalyser. The roughness of every pair of peaks is calculated with a SpectralInterferenceModel, and half of it is attributed to the band of each peak, so a frame's bands sum to its total roughness. The result is a matrix with a row for each frame and a column for each band, with bands spaced evenly on a logarithmic frequency scale.
+
+    Frames are calculated in blocks, and the frames of each block are split between the workers of a WorkerPool. Each block is passed on as soon as it's complete, so long signals can be written to a file without holding the whole matrix in memory.
+*/
+class RoughnessSpectrogram
+{
+public:
+    //==============================================================================
+    /** Called with each block of the matrix as it's completed.
+
+        @param firstFrame The index of the block's first frame.
+        @param values The roughness of each band of each frame in the block, with the bands of each frame stored consecutively.
+        @param numFrames The number of frames in the block.
+        @return False to stop the analysis.
+    */
+    using BlockCallback = std::function<bool (int firstFrame, const float* values, int numFrames)>;
+
+    //==============================================================================
+    /** Creates a RoughnessSpectrogram object.
+
+        @param fftOrder The base 2 logarithm of the frame size.
+        @param hopSize The number of samples between the starts of consecutive frames. If this is 0, frames overlap by half of their length.
+    */
+    explicit RoughnessSpectrogram (int fftOrder = 12, int hopSize = 0);
+
+    /** Destructor. */
+    ~RoughnessSpectrogram();
+
+    //==============================================================================
+    /** Sets the frequency bands that roughness is attributed to. Peaks outside of the bands are attributed to the nearest one.
+
+        @param numBands The number of bands.
+        @param lowestFreq The lower edge of the lowest band, in Hz.
+        @param highestFreq The upper edge of the highest band, in Hz.
+    */
+    void setBands (int numBands, float lowestFreq, float highestFreq);
+
+    /** Returns the number of frequency bands. */
+    int getNumBands() const noexcept;
+
+    /** Returns the lower and upper edges of a band, in Hz. */
+    Range<float> getBandRange (int band) const;
+
+    /** Returns the index of the band containing a frequency. */
+    int getBandIndex (float freq) const noexcept;
+
+    /** Sets which spectral peaks are included in each frame.
+
+        @param thresholdDb Peaks quieter than the frame's loudest peak by more than this many decibels are ignored.
+        @param maxNumPeaks The maximum number of peaks in each frame. When there are more, the loudest are kept.
+    */
+    void setPeakSettings (float thresholdDb, int maxNumPeaks);
+
+    /** Sets the number of frames calculated in each block. Larger blocks keep more workers busy, but use more memory. */
+    void setFramesPerBlock (int numFrames);
+
+    //==============================================================================
+    /** Returns the number of samples in each frame. */
+    int getFrameSize() const noexcept;
+
+    /** Returns the number of samples between the starts of consecutive frames. */
+    int getHopSize() const noexcept;
+
+    /** Returns the number of frames in a signal. The last frame is zero-padded if needed. */
+    int getNumFrames (int numSamples) const noexcept;
+
+    //==============================================================================
+    /** Calculates the matrix of a signal block by block.
+
+        @param samples The signal's samples.
+        @param numSamples The number of samples.
+        @param sampleRate The sample rate of the signal.
+        @param model The model used to calculate the roughness of each pair of peaks. It's cloned for each worker.
+        @param blockCallback Called on the calling thread with each block of the matrix, in order.
+        @param pool If not nullptr, the frames of each block are calculated in parallel by the pool's workers.
+        @return An error if the callback stopped the analysis.
+    */
+    Result process (const float* samples, int numSamples, double sampleRate,
+                    const SpectralInterferenceModel& model,
+                    const BlockCallback& blockCallback,
+                    WorkerPool* pool = nullptr);
+
+    /** Calculates the whole matrix of a signal.
+
+        @param matrix The array to fill with getNumFrames (numSamples) * getNumBands() values, with the bands of each frame stored consecutively.
+    */
+    Result analyse (const float* samples, int numSamples, double sampleRate,
+                    const SpectralInterferenceModel& model,
+                    Array<float>& matrix,
+                    WorkerPool* pool = nullptr);
+
+    /** Calculates the matrix of a signal and streams it to a NumPy .npy file, as a 2D array of 32-bit floats with a row for each frame. */
+    Result analyseToNpyFile (const float* samples, int numSamples, double sampleRate,
+                             const SpectralInterferenceModel& model,
+                             const File& file,
+                             WorkerPool* pool = nullptr);
+
+private:
+    //==============================================================================
+    /** Scratch memory for a single worker, reused for every frame the worker processes. */
+    struct Workspace
+    {
+        Workspace (int fftOrder)   : analyser (fftOrder) {}
+
+        SpectrumAnalyser analyser;
+        std::unique_ptr<DissonanceModel> model;
+        Array<SpectrumAnalyser::Peak> peaks;
+        Array<int> peakBands;
+    };
+
+    int fftOrder, frameSize, hopSize, framesPerBlock;
+    int numBands;
+    float lowestFreq, highestFreq;
+    float peakThreshold;
+    int maxNumPeaks;
+
+    //==============================================================================
+    /** Calculates the roughness of each band of a single frame. */
+    void processFrame (const float* samples, int numSamples, int frame, double sampleRate, float* bandRoughness, Workspace& workspace) const;
+
+    /** Writes the header of a .npy file holding a 2D array of floats. */
+    static bool writeNpyHeader (OutputStream& output, int numRows, int numColumns);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RoughnessSpectrogram)
+};
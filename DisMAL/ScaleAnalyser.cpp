@@ -0,0 +1,398 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "ScaleAnalyser.h"
+
+ScaleAnalyser::ScaleAnalyser (const DissonanceModel& model, const OvertoneDistribution& timbre, WorkerPool* workerPool)
+{
+    pool = workerPool;
+    referenceFrequency = 261.63f;
+    tuningReferenceFrequency = 0;
+    amplitude = 1;
+    lastUpdateTime = 0;
+
+    // Models keep intermediate values in member variables, so each worker needs its own
+    const int numWorkers = pool != nullptr ? pool->getNumWorkers() : 1;
+
+    for (int w = 0; w < numWorkers; ++w)
+    {
+        auto* workspace = workspaces.add (new Workspace());
+        workspace->model = model.cloneModel();
+        workspace->single.add (new OvertoneDistribution (timbre));
+        workspace->pair.add (new OvertoneDistribution (timbre));
+        workspace->pair.add (new OvertoneDistribution (timbre));
+    }
+
+    // The scale starts with just its tonic
+    noteRatios.add (1);
+    calculateAll();
+}
+
+ScaleAnalyser::~ScaleAnalyser()
+{
+}
+
+//==============================================================================
+
+
+void ScaleAnalyser::setReferenceFrequency (float newReferenceFreq)
+{
+    jassert (newReferenceFreq > 0);
+
+    if (newReferenceFreq > 0 && newReferenceFreq != referenceFrequency)
+    {
+        referenceFrequency = newReferenceFreq;
+        calculateAll();
+    }
+}
+
+float ScaleAnalyser::getReferenceFrequency() const noexcept
+{
+    return getTonicFrequency();
+}
+
+void ScaleAnalyser::setAmplitude (float newAmplitude)
+{
+    jassert (newAmplitude > 0);
+
+    if (newAmplitude > 0 && newAmplitude != amplitude)
+    {
+        amplitude = newAmplitude;
+        calculateAll();
+    }
+}
+
+//==============================================================================
+
+
+void ScaleAnalyser::setTuning (const TuningSystem& tuning)
+{
+    tuningReferenceFrequency = tuning.getReferenceFrequency();
+
+    noteRatios.clearQuick();
+    noteRatios.add (1);
+
+    for (int i = 0; i < tuning.numNotes() - 1; ++i)
+        noteRatios.add (tuning.getFreqRatio (i));
+
+    calculateAll();
+}
+
+void ScaleAnalyser::setNoteRatios (const Array<float>& newNoteRatios)
+{
+    jassert (! newNoteRatios.isEmpty());        // The scale needs a tonic
+
+    if (newNoteRatios.isEmpty())
+        return;
+
+    tuningReferenceFrequency = 0;
+    noteRatios = newNoteRatios;
+
+    calculateAll();
+}
+
+void ScaleAnalyser::intervalChanged (const TuningSystem& tuning, int intervalNum)
+{
+    jassert (tuning.numNotes() == getNumNotes());       // The tuning has been edited without updating the analyser
+    jassert (isPositiveAndBelow (intervalNum, tuning.numNotes() - 1));
+
+    const int note = intervalNum + 1;
+
+    if (tuning.numNotes() != getNumNotes() || tuning.getReferenceFrequency() != tuningReferenceFrequency)
+    {
+        setTuning (tuning);
+        return;
+    }
+
+    if (! isPositiveAndBelow (note, getNumNotes()) || tuning.getFreqRatio (intervalNum) == noteRatios[note])
+        return;
+
+    noteRatios.set (note, tuning.getFreqRatio (intervalNum));
+    calculateNote (note);
+}
+
+void ScaleAnalyser::intervalAdded (const TuningSystem& tuning)
+{
+    if (tuning.numNotes() == getNumNotes())
+        return;
+
+    jassert (tuning.numNotes() == getNumNotes() + 1);   // The tuning has been edited without updating the analyser
+
+    if (tuning.numNotes() != getNumNotes() + 1 || tuning.getReferenceFrequency() != tuningReferenceFrequency)
+    {
+        setTuning (tuning);
+        return;
+    }
+
+    // TuningSystem::addInterval appends the new interval, so the matrix grows by a row and column at the end
+    const int oldNumNotes = getNumNotes();
+    const int numNotes = oldNumNotes + 1;
+    Array<float> newDyads;
+    newDyads.resize (numNotes * numNotes);
+
+    for (int i = 0; i < oldNumNotes; ++i)
+        FloatVectorOperations::copy (newDyads.getRawDataPointer() + i * numNotes, dyads.getRawDataPointer() + i * oldNumNotes, oldNumNotes);
+
+    dyads.swapWith (newDyads);
+    noteRatios.add (tuning.getFreqRatio (tuning.numNotes() - 2));
+    noteDissonances.add (0);
+    calculateNote (oldNumNotes);
+}
+
+void ScaleAnalyser::intervalRemoved (const TuningSystem& tuning, int intervalNum)
+{
+    jassert (tuning.numNotes() == getNumNotes() - 1);   // The tuning has been edited without updating the analyser
+
+    const int removedNote = intervalNum + 1;
+
+    if (tuning.numNotes() != getNumNotes() - 1 || ! isPositiveAndBelow (removedNote, getNumNotes())
+        || tuning.getReferenceFrequency() != tuningReferenceFrequency)
+    {
+        setTuning (tuning);
+        return;
+    }
+
+    const double startTime = Time::getMillisecondCounterHiRes();
+    const int oldNumNotes = getNumNotes();
+    const int numNotes = oldNumNotes - 1;
+    Array<float> newDyads;
+    newDyads.resize (numNotes * numNotes);
+
+    for (int i = 0, row = 0; i < oldNumNotes; ++i)
+    {
+        if (i == removedNote)
+            continue;
+
+        for (int j = 0, column = 0; j < oldNumNotes; ++j)
+            if (j != removedNote)
+                newDyads.set (row * numNotes + column++, dyads.getUnchecked (i * oldNumNotes + j));
+
+        ++row;
+    }
+
+    dyads.swapWith (newDyads);
+    noteRatios.remove (removedNote);
+    noteDissonances.remove (removedNote);
+    updateScores();
+
+    lastUpdateTime = Time::getMillisecondCounterHiRes() - startTime;
+}
+
+//==============================================================================
+
+
+int ScaleAnalyser::getNumNotes() const noexcept
+{
+    return noteRatios.size();
+}
+
+float ScaleAnalyser::getNoteRatio (int note) const
+{
+    jassert (isPositiveAndBelow (note, getNumNotes()));     // The note doesn't exist
+
+    return noteRatios[note];
+}
+
+float ScaleAnalyser::getNoteDissonance (int note) const
+{
+    jassert (isPositiveAndBelow (note, getNumNotes()));     // The note doesn't exist
+
+    return noteDissonances[note];
+}
+
+float ScaleAnalyser::getDyadDissonance (int firstNote, int secondNote) const
+{
+    jassert (isPositiveAndBelow (firstNote, getNumNotes()) && isPositiveAndBelow (secondNote, getNumNotes()));
+
+    return dyads[firstNote * getNumNotes() + secondNote];
+}
+
+const float* ScaleAnalyser::getDyadRow (int note) const
+{
+    jassert (isPositiveAndBelow (note, getNumNotes()));     // The note doesn't exist
+
+    return dyads.getRawDataPointer() + note * getNumNotes();
+}
+
+float ScaleAnalyser::getTriadDissonance (int firstNote, int secondNote, int thirdNote) const
+{
+    jassert (firstNote != secondNote && firstNote != thirdNote && secondNote != thirdNote);
+
+    // Each note's own dissonance is counted in two of the three dyads, but belongs in the triad once
+    return getDyadDissonance (firstNote, secondNote) + getDyadDissonance (firstNote, thirdNote) + getDyadDissonance (secondNote, thirdNote)
+           - getNoteDissonance (firstNote) - getNoteDissonance (secondNote) - getNoteDissonance (thirdNote);
+}
+
+const ScaleAnalyser::Scores& ScaleAnalyser::getScores() const noexcept
+{
+    return scores;
+}
+
+double ScaleAnalyser::getLastUpdateTime() const noexcept
+{
+    return lastUpdateTime;
+}
+
+float ScaleAnalyser::getMeanTriadDissonance (double dyadSum, double noteSum, int numNotes) noexcept
+{
+    jassert (numNotes >= 3);
+
+    if (numNotes < 3)
+        return 0;
+
+    // Over every triad, each pair appears once for each of the other numNotes - 2 notes, and each note's own dissonance (counted twice by its dyads) is removed once for each pair of other notes
+    const double numTriads = numNotes * (numNotes - 1.0) * (numNotes - 2.0) / 6.0;
+    const double triadSum = (numNotes - 2) * dyadSum - (numNotes - 1.0) * (numNotes - 2.0) / 2.0 * noteSum;
+
+    return (float) (triadSum / numTriads);
+}
+
+//==============================================================================
+
+
+float ScaleAnalyser::getTonicFrequency() const noexcept
+{
+    return tuningReferenceFrequency > 0 ? tuningReferenceFrequency : referenceFrequency;
+}
+
+void ScaleAnalyser::calculateAll()
+{
+    const double startTime = Time::getMillisecondCounterHiRes();
+    const int numNotes = getNumNotes();
+
+    noteDissonances.resize (numNotes);
+    dyads.resize (numNotes * numNotes);
+
+    // The arrays are only written through raw pointers while the workers run, so they're never reallocated
+    float* singles = noteDissonances.getRawDataPointer();
+    float* matrix = dyads.getRawDataPointer();
+
+    forEach (numNotes, [this, singles] (int note, int worker)
+    {
+        singles[note] = calculateSingle (note, *workspaces[worker]);
+    });
+
+    // Each row only calculates the dyads on and above the diagonal, and mirrors them below it
+    forEach (numNotes, [this, matrix, numNotes] (int i, int worker)
+    {
+        for (int j = i; j < numNotes; ++j)
+        {
+            const float dissonance = calculatePair (i, j, *workspaces[worker]);
+            matrix[i * numNotes + j] = dissonance;
+            matrix[j * numNotes + i] = dissonance;
+        }
+    });
+
+    updateScores();
+
+    lastUpdateTime = Time::getMillisecondCounterHiRes() - startTime;
+}
+
+void ScaleAnalyser::calculateNote (int note)
+{
+    const double startTime = Time::getMillisecondCounterHiRes();
+    const int numNotes = getNumNotes();
+
+    float* matrix = dyads.getRawDataPointer();
+
+    noteDissonances.set (note, calculateSingle (note, *workspaces[0]));
+
+    forEach (numNotes, [this, matrix, note, numNotes] (int other, int worker)
+    {
+        const float dissonance = calculatePair (note, other, *workspaces[worker]);
+        matrix[note * numNotes + other] = dissonance;
+        matrix[other * numNotes + note] = dissonance;
+    });
+
+    updateScores();
+
+    lastUpdateTime = Time::getMillisecondCounterHiRes() - startTime;
+}
+
+float ScaleAnalyser::calculateSingle (int note, Workspace& workspace) const
+{
+    workspace.single[0]->setFundamental (getTonicFrequency() * noteRatios[note], amplitude);
+
+    return workspace.model->calculateDissonance (workspace.single, false);
+}
+
+float ScaleAnalyser::calculatePair (int firstNote, int secondNote, Workspace& workspace) const
+{
+    workspace.pair[0]->setFundamental (getTonicFrequency() * noteRatios[firstNote], amplitude);
+    workspace.pair[1]->setFundamental (getTonicFrequency() * noteRatios[secondNote], amplitude);
+
+    return workspace.model->calculateDissonance (workspace.pair, false);
+}
+
+void ScaleAnalyser::forEach (int numItems, const std::function<void (int item, int worker)>& function)
+{
+    if (pool != nullptr)
+    {
+        pool->parallelFor (numItems, function);
+    }
+    else
+    {
+        for (int item = 0; item < numItems; ++item)
+            function (item, 0);
+    }
+}
+
+void ScaleAnalyser::updateScores()
+{
+    const int numNotes = getNumNotes();
+    scores = Scores();
+
+    if (numNotes < 2)
+        return;
+
+    double dyadSum = 0;
+    float highestNoteSum = -1;
+
+    for (int i = 0; i < numNotes; ++i)
+    {
+        const float* row = getDyadRow (i);
+        float rowSum = 0;
+
+        for (int j = 0; j < numNotes; ++j)
+        {
+            if (j == i)
+                continue;
+
+            rowSum += row[j];
+            scores.maxDyadDissonance = jmax (scores.maxDyadDissonance, row[j]);
+        }
+
+        dyadSum += rowSum;
+
+        if (rowSum > highestNoteSum)
+        {
+            highestNoteSum = rowSum;
+            scores.mostDissonantNote = i;
+        }
+    }
+
+    // Every pair of different notes was counted twice
+    const double numPairs = numNotes * (numNotes - 1) / 2.0;
+    dyadSum /= 2;
+    scores.meanDyadDissonance = (float) (dyadSum / numPairs);
+
+    if (numNotes < 3)
+        return;
+
+    double noteSum = 0;
+
+    for (int i = 0; i < numNotes; ++i)
+        noteSum += noteDissonances.getUnchecked (i);
+
+    scores.meanTriadDissonance = getMeanTriadDissonance (dyadSum, noteSum, numNotes);
+}
@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceModel.h"
+#include "OvertoneDistribution.h"
+#include "TuningSystem.h"
+#include "WorkerPool.h"
+
+/** Keeps the dissonance of every dyad of a scale up to date while the scale is edited.
+
+    Every note of a TuningSystem (the tonic and each of its intervals) is played with the same timbre, and the dissonance of every pair of notes is kept in a matrix. When one interval is changed, added or removed, only the row and column of its note are recalculated, with the dyads split between the workers of a WorkerPool. Changing the reference frequency or calling setTuning recalculates the whole matrix.
+
+    Triads aren't stored. With a SpectralInterferenceModel, the dissonance of a chord is the sum of the dissonance within each note and the roughness between each pair of notes, so the dissonance of a triad follows exactly from its three dyads and the dissonance of each note alone. The same decomposition is used with other models, where it is only an approximation.
+
+    The aggregate scores of the scale are recalculated from the matrix after every edit, which takes far less time than recalculating a single dyad.
+*/
+class ScaleAnalyser
+{
+public:
+    //==============================================================================
+    /** Aggregate measures of the dissonance of a scale. */
+    struct Scores
+    {
+        float meanDyadDissonance = 0;       /**< The mean dissonance of every pair of different notes. */
+        float maxDyadDissonance = 0;        /**< The dissonance of the most dissonant pair of different notes. */
+        float meanTriadDissonance = 0;      /**< The mean dissonance of every combination of three different notes. */
+        int mostDissonantNote = -1;         /**< The note whose dyads with the other notes are the most dissonant on average. */
+    };
+
+    //==============================================================================
+    /** Creates a ScaleAnalyser object with no notes.
+
+        @param model The model used to calculate dissonance. It's cloned for each worker.
+        @param timbre The overtone distribution played by every note. Its fundamental is ignored.
+        @param pool If not nullptr, dyads are calculated in parallel by the pool's workers. The pool must outlive the analyser.
+    */
+    ScaleAnalyser (const DissonanceModel& model, const OvertoneDistribution& timbre, WorkerPool* pool = nullptr);
+
+    /** Destructor. */
+    ~ScaleAnalyser();
+
+    //==============================================================================
+    /** Sets the frequency of the tonic, used when a tuning has no reference frequency of its own. The whole matrix is recalculated. */
+    void setReferenceFrequency (float newReferenceFreq);
+
+    /** Returns the frequency of the tonic. */
+    float getReferenceFrequency() const noexcept;
+
+    /** Sets the amplitude of the fundamental of every note. The whole matrix is recalculated. */
+    void setAmplitude (float newAmplitude);
+
+    //==============================================================================
+    /** Replaces the scale with the notes of a tuning system, and recalculates the whole matrix. */
+    void setTuning (const TuningSystem& tuning);
+
+    /** Replaces the scale with notes at frequency ratios to the reference frequency, and recalculates the whole matrix.
+
+        Note 0 is the tonic, so its ratio should normally be 1. The notes don't need to be in order or within a repeat ratio, so any set of frequencies can be analysed, such as every step of a grid.
+    */
+    void setNoteRatios (const Array<float>& newNoteRatios);
+
+    /** Updates the row and column of an interval after it has been changed with TuningSystem::setFreqRatio.
+
+        If the tuning system rejected the change, nothing is recalculated.
+    */
+    void intervalChanged (const TuningSystem& tuning, int intervalNum);
+
+    /** Adds a row and column for an interval after it has been added with TuningSystem::addInterval.
+
+        If the tuning system rejected the interval, nothing is recalculated.
+    */
+    void intervalAdded (const TuningSystem& tuning);
+
+    /** Removes the row and column of an interval after it has been removed with TuningSystem::removeInterval. Nothing is recalculated. */
+    void intervalRemoved (const TuningSystem& tuning, int intervalNum);
+
+    //==============================================================================
+    /** Returns the number of notes, including the tonic. */
+    int getNumNotes() const noexcept;
+
+    /** Returns the frequency ratio of a note to the tonic. Note 0 is the tonic, and note n is interval n - 1 of the tuning system. */
+    float getNoteRatio (int note) const;
+
+    /** Returns the dissonance of a single note. */
+    float getNoteDissonance (int note) const;
+
+    /** Returns the dissonance of two notes played together. */
+    float getDyadDissonance (int firstNote, int secondNote) const;
+
+    /** Returns a pointer to the getNumNotes() dyad dissonances of a note with every note. */
+    const float* getDyadRow (int note) const;
+
+    /** Returns the dissonance of three different notes played together, from their dyads. */
+    float getTriadDissonance (int firstNote, int secondNote, int thirdNote) const;
+
+    /** Returns the aggregate scores of the scale. */
+    const Scores& getScores() const noexcept;
+
+    /** Returns the time taken by the last update, in milliseconds. */
+    double getLastUpdateTime() const noexcept;
+
+    /** Returns the mean dissonance of every triad of a scale, from the sum of its dyads and the sum of its notes alone.
+
+        @param dyadSum The sum of the dissonance of every pair of different notes, each counted once.
+        @param noteSum The sum of the dissonance of every note alone.
+        @param numNotes The number of notes, which must be at least 3.
+    */
+    static float getMeanTriadDissonance (double dyadSum, double noteSum, int numNotes) noexcept;
+
+private:
+    //==============================================================================
+    /** A model and distributions for a single worker. */
+    struct Workspace
+    {
+        std::unique_ptr<DissonanceModel> model;
+        OwnedArray<OvertoneDistribution> single, pair;
+    };
+
+    WorkerPool* pool;
+    OwnedArray<Workspace> workspaces;
+    float referenceFrequency, tuningReferenceFrequency, amplitude;
+
+    Array<float> noteRatios, noteDissonances;
+    Array<float> dyads;         // getNumNotes() * getNumNotes(), symmetric
+    Scores scores;
+    double lastUpdateTime;
+
+    //==============================================================================
+    /** Returns the frequency of the tonic, which is the tuning's reference frequency if it has one. */
+    float getTonicFrequency() const noexcept;
+
+    /** Recalculates the dissonance of every note and dyad. */
+    void calculateAll();
+
+    /** Recalculates the dissonance of a note and its dyads with every note. */
+    void calculateNote (int note);
+
+    /** Calculates the dissonance of a note with a worker's model. */
+    float calculateSingle (int note, Workspace& workspace) const;
+
+    /** Calculates the dissonance of two notes with a worker's model. */
+    float calculatePair (int firstNote, int secondNote, Workspace& workspace) const;
+
+    /** Calls a function for a range of items, in parallel if there is a pool. */
+    void forEach (int numItems, const std::function<void (int item, int worker)>& function);
+
+    /** Recalculates the aggregate scores from the matrix. */
+    void updateScores();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ScaleAnalyser)
+};
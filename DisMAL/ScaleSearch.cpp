@@ -0,0 +1,441 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "ScaleSearch.h"
+
+ScaleSearch::ScaleSearch (const DissonanceModel& dissonanceModel, const OvertoneDistribution& distribution)
+{
+    model = dissonanceModel.cloneModel();
+    timbre = distribution;
+
+    numNotes = 7;
+    repeatRatio = 2;
+    minInterval = 1;
+    stepCents = 5;
+    referenceFrequency = 261.63f;
+    objective = meanDyadDissonance;
+
+    populationSize = 200;
+    numElites = 4;
+    tournamentSize = 3;
+    mutationRate = 0.1f;
+    maxMutationSteps = 12;
+    seed = 0;
+
+    numGridSteps = 0;
+    minGapSteps = 1;
+    generation = 0;
+}
+
+ScaleSearch::~ScaleSearch()
+{
+}
+
+//==============================================================================
+
+
+void ScaleSearch::setScaleShape (int newNumNotes, float newRepeatRatio, float newMinInterval, float newStepCents)
+{
+    jassert (newNumNotes >= 2 && newRepeatRatio > 1 && newMinInterval >= 1 && newStepCents > 0);
+
+    numNotes = jmax (2, newNumNotes);
+    repeatRatio = jmax (1.001f, newRepeatRatio);
+    minInterval = jmax (1.0f, newMinInterval);
+    stepCents = jmax (0.01f, newStepCents);
+}
+
+void ScaleSearch::setReferenceFrequency (float newReferenceFreq)
+{
+    jassert (newReferenceFreq > 0);
+
+    if (newReferenceFreq > 0)
+        referenceFrequency = newReferenceFreq;
+}
+
+void ScaleSearch::setObjective (Objective newObjective)
+{
+    objective = newObjective;
+}
+
+void ScaleSearch::setGeneticParameters (int newPopulationSize, int newNumElites, int newTournamentSize,
+                                        float newMutationRate, int newMaxMutationSteps)
+{
+    jassert (newPopulationSize > 0 && newNumElites >= 0 && newTournamentSize > 0);
+    jassert (newMutationRate >= 0 && newMutationRate <= 1 && newMaxMutationSteps > 0);
+
+    populationSize = jmax (2, newPopulationSize);
+    numElites = jlimit (0, populationSize - 1, newNumElites);
+    tournamentSize = jmax (1, newTournamentSize);
+    mutationRate = jlimit (0.0f, 1.0f, newMutationRate);
+    maxMutationSteps = jmax (1, newMaxMutationSteps);
+}
+
+void ScaleSearch::setSeed (int64 newSeed)
+{
+    seed = newSeed;
+}
+
+//==============================================================================
+
+
+Result ScaleSearch::initialise (WorkerPool* pool)
+{
+    const Result result = prepareGrid (pool);
+
+    if (result.failed())
+        return result;
+
+    random.setSeed (seed);
+    generation = 0;
+    population.clear();
+
+    for (int i = 0; i < populationSize; ++i)
+        population.push_back (createRandomGenome());
+
+    evaluatePopulation (pool);
+
+    return Result::ok();
+}
+
+void ScaleSearch::run (int numGenerations, WorkerPool* pool, std::function<bool()> shouldStop)
+{
+    jassert (! population.empty());     // initialise must be called before running the search
+
+    if (population.empty())
+        return;
+
+    std::vector<Genome> nextPopulation;
+    nextPopulation.reserve ((size_t) populationSize);
+
+    for (int g = 0; g < numGenerations; ++g)
+    {
+        nextPopulation.clear();
+
+        // The population is sorted, so the elites are at the front
+        for (int e = 0; e < numElites && e < (int) population.size(); ++e)
+            nextPopulation.push_back (population[(size_t) e]);
+
+        while ((int) nextPopulation.size() < populationSize)
+        {
+            const Genome& firstParent = population[(size_t) selectParent()];
+            const Genome& secondParent = population[(size_t) selectParent()];
+            Genome child = firstParent;
+
+            for (size_t i = 0; i < child.steps.size(); ++i)
+            {
+                if (random.nextBool())
+                    child.steps[i] = secondParent.steps[i];
+
+                if (random.nextFloat() < mutationRate)
+                    child.steps[i] += random.nextInt (2 * maxMutationSteps + 1) - maxMutationSteps;
+            }
+
+            repair (child);
+            nextPopulation.push_back (std::move (child));
+        }
+
+        population.swap (nextPopulation);
+        evaluatePopulation (pool);
+        ++generation;
+
+        if (shouldStop != nullptr && shouldStop())
+            break;
+    }
+}
+
+int ScaleSearch::getGeneration() const noexcept
+{
+    return generation;
+}
+
+Array<ScaleSearch::Scale> ScaleSearch::getBestScales (int maxScales) const
+{
+    Array<Scale> scales;
+    std::vector<const Genome*> added;
+
+    for (auto& genome : population)
+    {
+        if (scales.size() >= maxScales)
+            break;
+
+        // Elites and their unmutated children are often identical
+        bool isDuplicate = false;
+
+        for (auto* other : added)
+            isDuplicate = isDuplicate || other->steps == genome.steps;
+
+        if (isDuplicate)
+            continue;
+
+        Scale scale;
+        scale.dissonance = genome.dissonance;
+
+        for (int step : genome.steps)
+            scale.intervals.add (getStepRatio (step));
+
+        scales.add (scale);
+        added.push_back (&genome);
+    }
+
+    return scales;
+}
+
+void ScaleSearch::createTuningSystems (OwnedArray<TuningSystem>& tuningSystems, int maxScales) const
+{
+    const Array<Scale> scales = getBestScales (maxScales);
+
+    for (int s = 0; s < scales.size(); ++s)
+    {
+        auto* tuning = tuningSystems.add (new TuningSystem());
+        tuning->setName ("Scale search " + String (s + 1));
+        tuning->setMinInterval (minInterval);
+
+        for (float interval : scales.getReference (s).intervals)
+            tuning->addInterval (interval);
+
+        // The repeat ratio has to be set after the intervals, as it must be larger than all of them
+        tuning->setRepeatRatio (repeatRatio);
+        tuning->setReferenceFrequency (referenceFrequency);
+    }
+}
+
+//==============================================================================
+
+
+bool ScaleSearch::writeCheckpoint (OutputStream& output) const
+{
+    const int checkpointMagic = 0x41475344;     // "DSGA"
+    const int checkpointVersion = 1;
+
+    bool writeOk = output.writeInt (checkpointMagic)
+                   && output.writeInt (checkpointVersion)
+                   && output.writeInt (numNotes)
+                   && output.writeFloat (repeatRatio)
+                   && output.writeFloat (minInterval)
+                   && output.writeFloat (stepCents)
+                   && output.writeFloat (referenceFrequency)
+                   && output.writeInt ((int) objective)
+                   && output.writeInt (populationSize)
+                   && output.writeInt (numElites)
+                   && output.writeInt (tournamentSize)
+                   && output.writeFloat (mutationRate)
+                   && output.writeInt (maxMutationSteps)
+                   && output.writeInt64 (seed)
+                   && output.writeInt64 (random.getSeed())
+                   && output.writeInt (generation)
+                   && output.writeInt ((int) population.size());
+
+    for (auto& genome : population)
+        for (int step : genome.steps)
+            writeOk = writeOk && output.writeInt (step);
+
+    return writeOk;
+}
+
+Result ScaleSearch::readCheckpoint (InputStream& input, WorkerPool* pool)
+{
+    if (input.readInt() != 0x41475344 || input.readInt() != 1)
+        return Result::fail ("The stream doesn't hold a scale search checkpoint");
+
+    const int newNumNotes = input.readInt();
+    const float newRepeatRatio = input.readFloat();
+    const float newMinInterval = input.readFloat();
+    const float newStepCents = input.readFloat();
+    const float newReferenceFreq = input.readFloat();
+    const int newObjective = input.readInt();
+    const int newPopulationSize = input.readInt();
+    const int newNumElites = input.readInt();
+    const int newTournamentSize = input.readInt();
+    const float newMutationRate = input.readFloat();
+    const int newMaxMutationSteps = input.readInt();
+    const int64 newSeed = input.readInt64();
+    const int64 randomState = input.readInt64();
+    const int newGeneration = input.readInt();
+    const int numGenomes = input.readInt();
+
+    if (newNumNotes < 2 || newPopulationSize <= 0 || numGenomes <= 0)
+        return Result::fail ("The scale search checkpoint is corrupt");
+
+    const int64 genomeBytes = (int64) numGenomes * (newNumNotes - 1) * (int64) sizeof (int);
+
+    if (input.getTotalLength() >= 0 && input.getTotalLength() - input.getPosition() < genomeBytes)
+        return Result::fail ("The scale search checkpoint is truncated");
+
+    setScaleShape (newNumNotes, newRepeatRatio, newMinInterval, newStepCents);
+    setReferenceFrequency (newReferenceFreq);
+    setObjective (newObjective == meanTriadDissonance ? meanTriadDissonance : meanDyadDissonance);
+    setGeneticParameters (newPopulationSize, newNumElites, newTournamentSize, newMutationRate, newMaxMutationSteps);
+    setSeed (newSeed);
+
+    const Result result = prepareGrid (pool);
+
+    if (result.failed())
+        return result;
+
+    population.assign ((size_t) numGenomes, Genome());
+
+    for (auto& genome : population)
+    {
+        genome.steps.resize ((size_t) (numNotes - 1));
+
+        for (auto& step : genome.steps)
+            step = input.readInt();
+
+        // Repairing a valid genome leaves it unchanged, and makes sure a damaged one stays on the grid
+        repair (genome);
+    }
+
+    random.setSeed (randomState);
+    generation = newGeneration;
+    evaluatePopulation (pool);
+
+    return Result::ok();
+}
+
+//==============================================================================
+
+
+Result ScaleSearch::prepareGrid (WorkerPool* pool)
+{
+    const float repeatCents = 1200.0f * std::log2 (repeatRatio);
+    const float minGapCents = 1200.0f * std::log2 (minInterval);
+
+    // The highest step still leaves the minimum interval below the repeat ratio
+    minGapSteps = jmax (1, (int) std::ceil (minGapCents / stepCents - 1.0e-4f));
+    const int maxStep = (int) std::floor ((repeatCents - minGapCents) / stepCents + 1.0e-4f);
+
+    if ((numNotes - 1) * minGapSteps > maxStep)
+        return Result::fail ("There is no room for " + String (numNotes) + " notes within a repeat ratio of "
+                             + String (repeatRatio) + " with a minimum interval of " + String (minInterval));
+
+    numGridSteps = maxStep + 1;
+
+    // Every step of the grid is analysed as a note of one large scale, so each pair of steps is a dyad of its matrix
+    Array<float> gridRatios;
+
+    for (int step = 0; step < numGridSteps; ++step)
+        gridRatios.add (getStepRatio (step));
+
+    ScaleAnalyser grid (*model, timbre, pool);
+    grid.setReferenceFrequency (referenceFrequency);
+    grid.setNoteRatios (gridRatios);
+
+    noteDissonances.resize (numGridSteps);
+    pairDissonances.resize (numGridSteps * numGridSteps);
+
+    for (int step = 0; step < numGridSteps; ++step)
+    {
+        noteDissonances.set (step, grid.getNoteDissonance (step));
+        FloatVectorOperations::copy (pairDissonances.getRawDataPointer() + step * numGridSteps, grid.getDyadRow (step), numGridSteps);
+    }
+
+    return Result::ok();
+}
+
+float ScaleSearch::getStepRatio (int step) const noexcept
+{
+    return std::pow (2.0f, step * stepCents / 1200.0f);
+}
+
+void ScaleSearch::repair (Genome& genome) const
+{
+    auto& steps = genome.steps;
+
+    if (steps.empty())
+        return;
+
+    std::sort (steps.begin(), steps.end());
+
+    // Push notes up until each is far enough above the one below it (the first is above the tonic)...
+    steps[0] = jmax (steps[0], minGapSteps);
+
+    for (size_t i = 1; i < steps.size(); ++i)
+        steps[i] = jmax (steps[i], steps[i - 1] + minGapSteps);
+
+    // ...then pull them down until each is far enough below the one above it (the last is below the repeat ratio)
+    steps.back() = jmin (steps.back(), numGridSteps - 1);
+
+    for (size_t i = steps.size() - 1; i > 0; --i)
+        steps[i - 1] = jmin (steps[i - 1], steps[i] - minGapSteps);
+}
+
+ScaleSearch::Genome ScaleSearch::createRandomGenome()
+{
+    Genome genome;
+    genome.dissonance = 0;
+
+    for (int i = 0; i < numNotes - 1; ++i)
+        genome.steps.push_back (minGapSteps + random.nextInt (numGridSteps - minGapSteps));
+
+    repair (genome);
+
+    return genome;
+}
+
+int ScaleSearch::selectParent()
+{
+    // The population is sorted, so the lowest index in the tournament wins
+    int winner = random.nextInt ((int) population.size());
+
+    for (int t = 1; t < tournamentSize; ++t)
+        winner = jmin (winner, random.nextInt ((int) population.size()));
+
+    return winner;
+}
+
+void ScaleSearch::evaluatePopulation (WorkerPool* pool)
+{
+    auto evaluateGenome = [this] (int item, int)
+    {
+        population[(size_t) item].dissonance = evaluate (population[(size_t) item]);
+    };
+
+    if (pool != nullptr)
+    {
+        pool->parallelFor ((int) population.size(), evaluateGenome);
+    }
+    else
+    {
+        for (int item = 0; item < (int) population.size(); ++item)
+            evaluateGenome (item, 0);
+    }
+
+    // A stable sort keeps the order of equally dissonant scales the same however they were evaluated
+    std::stable_sort (population.begin(), population.end(),
+                      [] (const Genome& a, const Genome& b) { return a.dissonance < b.dissonance; });
+}
+
+float ScaleSearch::evaluate (const Genome& genome) const noexcept
+{
+    const float* pairs = pairDissonances.getRawDataPointer();
+    double pairSum = 0;
+    double noteSum = noteDissonances.getUnchecked (0);
+
+    // The tonic is step 0
+    for (size_t i = 0; i < genome.steps.size(); ++i)
+    {
+        const int step = genome.steps[i];
+        const float* row = pairs + step * numGridSteps;
+
+        noteSum += noteDissonances.getUnchecked (step);
+        pairSum += row[0];
+
+        for (size_t j = i + 1; j < genome.steps.size(); ++j)
+            pairSum += row[genome.steps[j]];
+    }
+
+    if (objective == meanTriadDissonance && numNotes >= 3)
+        return ScaleAnalyser::getMeanTriadDissonance (pairSum, noteSum, numNotes);
+
+    return (float) (pairSum / (numNotes * (numNotes - 1) / 2.0));
+}
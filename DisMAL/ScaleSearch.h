@@ -0,0 +1,173 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceModel.h"
+#include "OvertoneDistribution.h"
+#include "ScaleAnalyser.h"
+#include "TuningSystem.h"
+#include "WorkerPool.h"
+
+/** Searches for the scales that are least dissonant with a timbre, with a genetic algorithm.
+
+    Each scale has a fixed number of notes within a repeat ratio, and is represented by a sorted vector of intervals above its tonic. Intervals lie on a grid of equal steps in cents, and neighbouring notes (including the tonic and its repetition) are always at least the minimum interval apart.
+
+    Before searching, the dissonance of every note of the grid alone and of every pair of notes is calculated once, in parallel, by a ScaleAnalyser that treats the whole grid as one scale. A scale's fitness only looks up the pairs of its notes, so whole populations are evaluated quickly, in parallel with a WorkerPool. With a SpectralInterferenceModel, the dissonance of a chord is the sum of the dissonance within each note and the roughness between each pair of notes, so the mean dissonance of a scale's triads is also found exactly from its pairs.
+
+    Each generation keeps the best scales unchanged, and fills the rest of the population with children of parents chosen by tournament, using uniform crossover and random steps of individual notes. All random choices are made by one seeded generator on the calling thread, so a search with the same seed and settings always gives the same results, however many workers evaluate it. The whole state of a search can be written to a checkpoint and resumed later.
+*/
+class ScaleSearch
+{
+public:
+    //==============================================================================
+    /** The measure of dissonance that the search minimises. */
+    enum Objective
+    {
+        meanDyadDissonance = 0,     /**< The mean dissonance of every pair of notes. */
+        meanTriadDissonance         /**< The mean dissonance of every combination of three notes. */
+    };
+
+    /** A scale found by the search. */
+    struct Scale
+    {
+        Array<float> intervals;     /**< The frequency ratios of the notes above the tonic, in ascending order. */
+        float dissonance;           /**< The value of the objective for the scale. */
+    };
+
+    //==============================================================================
+    /** Creates a ScaleSearch object.
+
+        @param model The model used to calculate dissonance. It's cloned for each worker.
+        @param timbre The overtone distribution played by every note. Its fundamental is ignored.
+    */
+    ScaleSearch (const DissonanceModel& model, const OvertoneDistribution& timbre);
+
+    /** Destructor. */
+    ~ScaleSearch();
+
+    //==============================================================================
+    /** Sets the shape of the scales to search for. This takes effect when the search is initialised.
+
+        @param numNotes The number of notes in each scale, including the tonic.
+        @param repeatRatio The ratio at which the scales repeat, such as 2 for an octave.
+        @param minInterval The smallest ratio allowed between neighbouring notes, as in TuningSystem::setMinInterval.
+        @param stepCents The size of the steps of the grid that notes lie on, in cents. Smaller steps take longer to prepare and use more memory.
+    */
+    void setScaleShape (int numNotes, float repeatRatio = 2.0f, float minInterval = 1.0f, float stepCents = 5.0f);
+
+    /** Sets the frequency of the tonic. This takes effect when the search is initialised. */
+    void setReferenceFrequency (float newReferenceFreq);
+
+    /** Sets the measure of dissonance that the search minimises. This takes effect when the search is initialised. */
+    void setObjective (Objective newObjective);
+
+    /** Sets the parameters of the genetic algorithm.
+
+        @param populationSize The number of scales in each generation.
+        @param numElites The number of best scales carried into the next generation unchanged.
+        @param tournamentSize The number of scales competing to be chosen as each parent.
+        @param mutationRate The probability that each note of a child is moved.
+        @param maxMutationSteps The largest number of grid steps by which a note is moved.
+    */
+    void setGeneticParameters (int populationSize = 200, int numElites = 4, int tournamentSize = 3,
+                               float mutationRate = 0.1f, int maxMutationSteps = 12);
+
+    /** Sets the seed of the random number generator. This takes effect when the search is initialised. */
+    void setSeed (int64 newSeed);
+
+    //==============================================================================
+    /** Prepares the dissonance of every note and pair of notes, and creates a random first generation.
+
+        @param pool If not nullptr, the preparation and evaluation are split between the pool's workers.
+        @return An error if no scale fits the shape that has been set.
+    */
+    Result initialise (WorkerPool* pool = nullptr);
+
+    /** Evolves the population for a number of generations.
+
+        @param shouldStop If not nullptr, this is called after every generation, and the search stops when it returns true.
+    */
+    void run (int numGenerations, WorkerPool* pool = nullptr, std::function<bool()> shouldStop = nullptr);
+
+    /** Returns the number of generations evolved since initialise. */
+    int getGeneration() const noexcept;
+
+    /** Returns the scales of the current generation from least to most dissonant, without duplicates.
+
+        @param maxScales The maximum number of scales to return.
+    */
+    Array<Scale> getBestScales (int maxScales = 10) const;
+
+    /** Creates TuningSystem objects for the best scales of the current generation, with the repeat ratio, minimum interval and reference frequency of the search. */
+    void createTuningSystems (OwnedArray<TuningSystem>& tuningSystems, int maxScales = 10) const;
+
+    //==============================================================================
+    /** Writes the settings, random state and population of the search, so that it can be resumed with readCheckpoint. */
+    bool writeCheckpoint (OutputStream& output) const;
+
+    /** Restores a search written by writeCheckpoint. The model and timbre must be the same as those of the search that was written.
+
+        @param pool If not nullptr, the preparation and evaluation are split between the pool's workers.
+    */
+    Result readCheckpoint (InputStream& input, WorkerPool* pool = nullptr);
+
+private:
+    //==============================================================================
+    /** A scale in the population: the grid steps of its notes above the tonic, in ascending order. */
+    struct Genome
+    {
+        std::vector<int> steps;
+        float dissonance;
+    };
+
+    std::unique_ptr<DissonanceModel> model;
+    OvertoneDistribution timbre;
+
+    int numNotes;
+    float repeatRatio, minInterval, stepCents, referenceFrequency;
+    Objective objective;
+    int populationSize, numElites, tournamentSize, maxMutationSteps;
+    float mutationRate;
+    int64 seed;
+
+    Random random;
+    int numGridSteps, minGapSteps, generation;
+    Array<float> noteDissonances, pairDissonances;      // numGridSteps, and numGridSteps * numGridSteps
+    std::vector<Genome> population;
+
+    //==============================================================================
+    /** Calculates the dissonance of every note of the grid and every pair of notes, with a ScaleAnalyser. */
+    Result prepareGrid (WorkerPool* pool);
+
+    /** Returns the frequency ratio of a grid step to the tonic. */
+    float getStepRatio (int step) const noexcept;
+
+    /** Sorts a genome's steps and moves them as little as possible to keep neighbouring notes at least the minimum gap apart. */
+    void repair (Genome& genome) const;
+
+    /** Returns a random valid genome. */
+    Genome createRandomGenome();
+
+    /** Returns the index of the winner of a tournament between random members of the population. */
+    int selectParent();
+
+    /** Calculates the objective for every genome of the population in parallel, and sorts it from least to most dissonant. */
+    void evaluatePopulation (WorkerPool* pool);
+
+    /** Returns the value of the objective for a genome. */
+    float evaluate (const Genome& genome) const noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ScaleSearch)
+};
@@ -0,0 +1,602 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "SessionSnapshot.h"
+
+namespace
+{
+    const int sessionSnapshotMagic = 0x53534d44;     // "DMSS"
+    const int sessionSnapshotVersion = 1;
+    const int64 sectionAlignment = 64;
+
+    /** Returns the size of a file's header, which holds the magic number, version and table of sections. */
+    int64 getHeaderSize (int numSections) noexcept
+    {
+        return 3 * sizeof (int) + numSections * (sizeof (int) + 2 * sizeof (int64));
+    }
+
+    int64 alignOffset (int64 offset) noexcept
+    {
+        return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+    }
+}
+
+SessionSnapshot::SessionSnapshot()
+{
+}
+
+SessionSnapshot::~SessionSnapshot()
+{
+}
+
+//==============================================================================
+
+
+bool SessionSnapshot::save (const DissonanceCalc& calc, const File& file, bool includeResults)
+{
+    struct PendingSection
+    {
+        int id;
+        int64 size;
+        std::function<void (OutputStream&)> write;
+    };
+
+    std::vector<PendingSection> pending;
+
+    MemoryOutputStream settings;
+    writeSettings (calc, settings);
+
+    pending.push_back ({ settingsSection, (int64) settings.getDataSize(),
+                         [&] (OutputStream& output) { output.write (settings.getData(), settings.getDataSize()); } });
+
+    MemoryOutputStream compressedMap;
+
+    if (includeResults)
+    {
+        if (calc.dimensionality == DissonanceCalc::twoDimensional && calc.map2D.size() > 0)
+        {
+            pending.push_back ({ map2dSection, (int64) sizeof (float) * calc.map2D.size(),
+                                 [&] (OutputStream& output) { output.write (calc.map2D.getRawDataPointer(), sizeof (float) * (size_t) calc.map2D.size()); } });
+        }
+        else if (calc.dimensionality == DissonanceCalc::threeDimensional && calc.usingCompressedMap())
+        {
+            calc.compressedMap3D.writeToStream (compressedMap);
+
+            pending.push_back ({ compressedMap3dSection, (int64) compressedMap.getDataSize(),
+                                 [&] (OutputStream& output) { output.write (compressedMap.getData(), compressedMap.getDataSize()); } });
+        }
+        else if (calc.dimensionality == DissonanceCalc::threeDimensional && calc.map3D.size() > 0)
+        {
+            // Rows are written back to back, so the map can be restored with a single copy per row
+            pending.push_back ({ map3dSection, (int64) sizeof (float) * calc.map3D.size() * calc.map3D.size(),
+                                 [&] (OutputStream& output)
+                                 {
+                                     for (auto& row : calc.map3D)
+                                         output.write (row.getRawDataPointer(), sizeof (float) * (size_t) row.size());
+                                 } });
+        }
+
+        const std::pair<int, const Array<float>*> floatArrays[] = { { chordDissonancesSection, &calc.dissonanceValues },
+                                                                     { minimaSection, &calc.minima },
+                                                                     { maximaSection, &calc.maxima } };
+
+        for (auto& array : floatArrays)
+        {
+            if (array.second->isEmpty())
+                continue;
+
+            const Array<float>* values = array.second;
+
+            pending.push_back ({ array.first, (int64) sizeof (float) * values->size(),
+                                 [values] (OutputStream& output) { output.write (values->getRawDataPointer(), sizeof (float) * (size_t) values->size()); } });
+        }
+    }
+
+    // The table of sections is written first, so every section's offset must be known up front
+    Array<Section> table;
+    int64 offset = getHeaderSize ((int) pending.size());
+
+    for (auto& section : pending)
+    {
+        offset = alignOffset (offset);
+        table.add ({ section.id, offset, section.size });
+        offset += section.size;
+    }
+
+    TemporaryFile temp (file);
+
+    {
+        FileOutputStream output (temp.getFile());
+
+        if (! output.openedOk())
+        {
+            jassertfalse;       // Couldn't write to the snapshot's folder
+            return false;
+        }
+
+        output.writeInt (sessionSnapshotMagic);
+        output.writeInt (sessionSnapshotVersion);
+        output.writeInt (table.size());
+
+        for (auto& section : table)
+        {
+            output.writeInt (section.id);
+            output.writeInt64 (section.offset);
+            output.writeInt64 (section.size);
+        }
+
+        for (size_t i = 0; i < pending.size(); ++i)
+        {
+            output.writeRepeatedByte (0, (size_t) (table.getReference ((int) i).offset - output.getPosition()));
+            pending[i].write (output);
+        }
+
+        output.flush();
+    }
+
+    return temp.overwriteTargetFileWithTemporary();
+}
+
+//==============================================================================
+
+
+bool SessionSnapshot::open (const File& file)
+{
+    close();
+
+    mappedFile = std::make_unique<MemoryMappedFile> (file, MemoryMappedFile::readOnly);
+
+    const size_t fileSize = mappedFile->getSize();
+
+    if (mappedFile->getData() == nullptr || fileSize < (size_t) getHeaderSize (0))
+    {
+        close();
+        return false;
+    }
+
+    MemoryInputStream input (mappedFile->getData(), fileSize, false);
+
+    const int magic = input.readInt();
+    const int version = input.readInt();
+    const int numSections = input.readInt();
+
+    if (magic != sessionSnapshotMagic || version != sessionSnapshotVersion
+        || numSections < 0 || getHeaderSize (numSections) > (int64) fileSize)
+    {
+        jassertfalse;       // Not a snapshot, or written by an incompatible version
+        close();
+        return false;
+    }
+
+    for (int i = 0; i < numSections; ++i)
+    {
+        Section section;
+        section.id = input.readInt();
+        section.offset = input.readInt64();
+        section.size = input.readInt64();
+
+        if (section.offset < 0 || section.size < 0 || section.offset + section.size > (int64) fileSize)
+        {
+            jassertfalse;   // The file has been truncated or damaged
+            close();
+            return false;
+        }
+
+        sections.add (section);
+    }
+
+    return true;
+}
+
+void SessionSnapshot::close()
+{
+    mappedFile.reset();
+    sections.clear();
+}
+
+bool SessionSnapshot::isOpen() const noexcept
+{
+    return mappedFile != nullptr;
+}
+
+bool SessionSnapshot::hasResults() const
+{
+    for (auto& section : sections)
+    {
+        if (section.id != settingsSection)
+            return true;
+    }
+
+    return false;
+}
+
+bool SessionSnapshot::restore (DissonanceCalc& calc,
+                               const OwnedArray<DissonanceModel>& availableModels,
+                               const OwnedArray<Preprocessor>& availablePreprocessors,
+                               bool restoreResults) const
+{
+    size_t settingsSize = 0;
+    const void* settingsData = getSection (settingsSection, settingsSize);
+
+    if (settingsData == nullptr)
+        return false;
+
+    MemoryInputStream settings (settingsData, settingsSize, false);
+
+    if (! readSettings (calc, settings, availableModels, availablePreprocessors))
+        return false;
+
+    calc.minima.clear();
+    calc.maxima.clear();
+    calc.dissonanceValues.clear();
+
+    if (! restoreResults)
+        return true;
+
+    size_t size = 0;
+    const int numSteps = calc.numSteps;
+
+    if (getSection (map2dSection, size) != nullptr && calc.dimensionality == DissonanceCalc::twoDimensional)
+    {
+        calc.map2D.resize (numSteps);
+
+        if (! readFloats (map2dSection, calc.map2D.getRawDataPointer(), numSteps))
+            return false;
+    }
+
+    if (getSection (map3dSection, size) != nullptr && calc.dimensionality == DissonanceCalc::threeDimensional)
+    {
+        // The map isn't allocated if it's over the DissonanceCalc's memory budget
+        if (size != sizeof (float) * (size_t) numSteps * (size_t) numSteps || calc.map3D.size() != numSteps)
+            return false;
+
+        const float* values = static_cast<const float*> (getSection (map3dSection, size));
+
+        for (int x = 0; x < numSteps; ++x)
+            FloatVectorOperations::copy (calc.map3D.getReference (x).getRawDataPointer(), values + x * numSteps, numSteps);
+    }
+
+    if (const void* compressed = getSection (compressedMap3dSection, size))
+    {
+        MemoryInputStream input (compressed, size, false);
+
+        if (! calc.compressedMap3D.readFromStream (input))
+            return false;
+    }
+
+    const std::pair<int, Array<float>*> floatArrays[] = { { chordDissonancesSection, &calc.dissonanceValues },
+                                                         { minimaSection, &calc.minima },
+                                                         { maximaSection, &calc.maxima } };
+
+    for (auto& array : floatArrays)
+    {
+        if (getSection (array.first, size) != nullptr)
+        {
+            array.second->resize ((int) (size / sizeof (float)));
+
+            if (! readFloats (array.first, array.second->getRawDataPointer(), array.second->size()))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+const float* SessionSnapshot::get2dMap (int& numValues) const
+{
+    size_t size = 0;
+    const void* data = getSection (map2dSection, size);
+
+    numValues = (int) (size / sizeof (float));
+
+    return static_cast<const float*> (data);
+}
+
+bool SessionSnapshot::load (const File& file,
+                            DissonanceCalc& calc,
+                            const OwnedArray<DissonanceModel>& availableModels,
+                            const OwnedArray<Preprocessor>& availablePreprocessors,
+                            bool restoreResults)
+{
+    SessionSnapshot snapshot;
+
+    return snapshot.open (file)
+        && snapshot.restore (calc, availableModels, availablePreprocessors, restoreResults);
+}
+
+//==============================================================================
+
+
+const void* SessionSnapshot::getSection (int sectionID, size_t& size) const
+{
+    for (auto& section : sections)
+    {
+        if (section.id == sectionID)
+        {
+            size = (size_t) section.size;
+            return static_cast<const char*> (mappedFile->getData()) + section.offset;
+        }
+    }
+
+    size = 0;
+    return nullptr;
+}
+
+void SessionSnapshot::writeSettings (const DissonanceCalc& calc, OutputStream& output)
+{
+    // Model and preprocessors
+    output.writeBool (calc.model != nullptr);
+
+    if (calc.model != nullptr)
+    {
+        output.writeString (calc.model->getName());
+        writeParameters (calc.model->getParameters(), output);
+    }
+
+    output.writeBool (calc.sumPartialDissonances);
+    output.writeInt (calc.preprocessors.size());
+
+    for (auto* preprocessor : calc.preprocessors)
+    {
+        output.writeString (preprocessor->getName());
+        writeParameters (preprocessor->getParameters(), output);
+    }
+
+    // Distributions
+    output.writeInt (calc.distributions.size());
+
+    for (auto* distribution : calc.distributions)
+    {
+        output.writeString (distribution->getName());
+        output.writeFloat (distribution->getMinInterval());
+        output.writeFloat (distribution->getFundamentalFreq());
+        output.writeFloat (distribution->getFundamentalAmp());
+        output.writeBool (distribution->isMuted());
+        output.writeBool (distribution->fundamentalIsMuted());
+        output.writeInt (distribution->numPartials());
+
+        for (int p = 0; p < distribution->numPartials(); ++p)
+        {
+            output.writeFloat (distribution->getFreqRatio (p));
+            output.writeFloat (distribution->getAmpRatio (p));
+            output.writeBool (distribution->partialIsMuted (p));
+        }
+    }
+
+    // Chords
+    output.writeInt (calc.chords.size());
+
+    for (auto& chord : calc.chords)
+    {
+        output.writeInt (chord.size());
+
+        for (auto& note : chord)
+        {
+            output.writeFloat (note.freq);
+            output.writeFloat (note.amp);
+        }
+    }
+
+    // Dissonance maps and optimisation
+    output.writeInt ((int) calc.dimensionality);
+    output.writeFloat (calc.frequencyRange.getStart());
+    output.writeFloat (calc.frequencyRange.getEnd());
+    output.writeInt (calc.numSteps);
+    output.writeInt ((int) calc.stepType);
+    output.writeInt (calc.varDist);
+    output.writeInt (calc.xDist);
+    output.writeInt (calc.yDist);
+    output.writeInt ((int) calc.getMapPrecision());
+
+    output.writeFloat (calc.optimMinInterval);
+    output.writeFloat (calc.optimStepSize);
+    output.writeFloat (calc.optimTolerance);
+}
+
+bool SessionSnapshot::readSettings (DissonanceCalc& calc, InputStream& input,
+                                    const OwnedArray<DissonanceModel>& availableModels,
+                                    const OwnedArray<Preprocessor>& availablePreprocessors)
+{
+    // Model and preprocessors
+    if (input.readBool())
+    {
+        const String modelName = input.readString();
+        const NamedValueSet parameters = readParameters (input);
+        DissonanceModel* matchingModel = nullptr;
+
+        for (auto* model : availableModels)
+        {
+            if (model->getName() == modelName)
+                matchingModel = model;
+        }
+
+        if (matchingModel == nullptr)
+        {
+            jassertfalse;       // The snapshot's model isn't one of the available models
+            return false;
+        }
+
+        calc.setModel (matchingModel);
+        calc.model->setParameters (parameters);
+    }
+
+    calc.setSumPartialDissonances (input.readBool());
+    calc.clearPreprocessors();
+
+    const int numPreprocessors = input.readInt();
+
+    for (int i = 0; i < numPreprocessors; ++i)
+    {
+        const String preprocessorName = input.readString();
+        const NamedValueSet parameters = readParameters (input);
+        Preprocessor* matchingPreprocessor = nullptr;
+
+        for (auto* preprocessor : availablePreprocessors)
+        {
+            if (preprocessor->getName() == preprocessorName)
+                matchingPreprocessor = preprocessor;
+        }
+
+        if (matchingPreprocessor == nullptr)
+        {
+            jassertfalse;       // The snapshot's preprocessor isn't one of the available preprocessors
+            return false;
+        }
+
+        std::unique_ptr<Preprocessor> preprocessor (matchingPreprocessor->clone());
+        preprocessor->setParameters (parameters);
+        calc.preprocessors.add (preprocessor.release());
+    }
+
+    // Distributions
+    calc.clearOvertoneDistributions();
+
+    const int numDistributions = input.readInt();
+
+    for (int i = 0; i < numDistributions && ! input.isExhausted(); ++i)
+    {
+        auto* distribution = new OvertoneDistribution();
+        calc.addOvertoneDistribution (distribution);
+
+        distribution->setDistributionName (input.readString());
+        const float minInterval = input.readFloat();
+        const float fundamentalFreq = input.readFloat();
+        const float fundamentalAmp = input.readFloat();
+        const bool muted = input.readBool();
+        const bool fundamentalMuted = input.readBool();
+        const int numPartials = input.readInt();
+
+        for (int p = 0; p < numPartials; ++p)
+        {
+            const float freqRatio = input.readFloat();
+            const float ampRatio = input.readFloat();
+            const bool partialMuted = input.readBool();
+
+            distribution->addPartial (freqRatio, ampRatio);
+
+            if (distribution->numPartials() == p + 1)
+                distribution->mutePartial (p, partialMuted);
+        }
+
+        // Set after adding partials, so that the saved partials are never rejected for being too close together
+        distribution->setMinInterval (minInterval);
+        distribution->setFundamental (fundamentalFreq, fundamentalAmp);
+        distribution->mute (muted);
+        distribution->muteFundamental (fundamentalMuted);
+    }
+
+    // Chords
+    calc.clearChords();
+
+    const int numChords = input.readInt();
+
+    for (int i = 0; i < numChords && ! input.isExhausted(); ++i)
+    {
+        Array<DissonanceCalc::FreqAmpPair> chord;
+        const int numNotes = input.readInt();
+
+        for (int n = 0; n < numNotes; ++n)
+        {
+            DissonanceCalc::FreqAmpPair note;
+            note.freq = input.readFloat();
+            note.amp = input.readFloat();
+            chord.add (note);
+        }
+
+        calc.chords.add (chord);
+    }
+
+    // Dissonance maps and optimisation
+    const int dimensionality = input.readInt();
+    const float startFreq = input.readFloat();
+    const float endFreq = input.readFloat();
+    const int numSteps = input.readInt();
+    const int stepType = input.readInt();
+
+    calc.varDist = input.readInt();
+    calc.xDist = input.readInt();
+    calc.yDist = input.readInt();
+
+    const int mapPrecision = input.readInt();
+
+    calc.optimMinInterval = input.readFloat();
+    calc.optimStepSize = input.readFloat();
+    calc.optimTolerance = input.readFloat();
+
+    if ((dimensionality != DissonanceCalc::twoDimensional && dimensionality != DissonanceCalc::threeDimensional)
+        || ! isPositiveAndNotGreaterThan (stepType, (int) DissonanceCalc::barkSteps)
+        || ! isPositiveAndNotGreaterThan (mapPrecision, (int) MapStorage::quantised8Bit)
+        || numSteps < 0)
+    {
+        jassertfalse;       // The settings are damaged
+        return false;
+    }
+
+    calc.dimensionality = (DissonanceCalc::Dimensionality) dimensionality;
+    calc.stepType = (DissonanceCalc::StepType) stepType;
+    calc.frequencyRange = Range<float> (startFreq, endFreq);
+    calc.numSteps = numSteps;
+    calc.compressedMap3D.setPrecision ((MapStorage::Precision) mapPrecision);
+
+    if (numSteps > 0)
+    {
+        calc.resizeMap();
+
+        if (! calc.frequencyRange.isEmpty())
+            calc.setStepSize();
+    }
+
+    return true;
+}
+
+void SessionSnapshot::writeParameters (const NamedValueSet& parameters, OutputStream& output)
+{
+    output.writeInt (parameters.size());
+
+    for (int i = 0; i < parameters.size(); ++i)
+    {
+        output.writeString (parameters.getName (i).toString());
+        parameters.getValueAt (i).writeToStream (output);
+    }
+}
+
+NamedValueSet SessionSnapshot::readParameters (InputStream& input)
+{
+    NamedValueSet parameters;
+    const int numParameters = input.readInt();
+
+    for (int i = 0; i < numParameters && ! input.isExhausted(); ++i)
+    {
+        const String name = input.readString();
+        parameters.set (name, var::readFromStream (input));
+    }
+
+    return parameters;
+}
+
+bool SessionSnapshot::readFloats (int sectionID, float* destination, int numValues) const
+{
+    size_t size = 0;
+    const void* data = getSection (sectionID, size);
+
+    if (data == nullptr || size != sizeof (float) * (size_t) numValues)
+    {
+        jassertfalse;       // The section doesn't match the restored settings
+        return false;
+    }
+
+    if (numValues > 0)
+        std::memcpy (destination, data, size);
+
+    return true;
+}
@@ -0,0 +1,152 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceCalc.h"
+#include "DissonanceModel.h"
+#include "Preprocessor.h"
+
+/** A binary snapshot of the complete state of a DissonanceCalc object.
+
+    A snapshot captures everything needed to restore an analysis session in one step:
+
+    - The dissonance model, by name, and its parameters.
+    - The chain of preprocessors, in order, with their parameters.
+    - Every overtone distribution, including fundamentals and muted partials.
+    - Chords and their calculated dissonances.
+    - Dissonance map and optimisation settings.
+    - Optionally, the calculated dissonance maps and optimised minima and maxima.
+
+    The file starts with a table of sections, each aligned to 64 bytes. Snapshots are opened with a juce::MemoryMappedFile, so opening a snapshot doesn't read the file. Restoring it copies each map into the DissonanceCalc with a single block copy. The 2D map can also be read directly from the mapped file with get2dMap. This means a session with large precomputed maps opens almost instantly.
+
+    Cell masks are functions, so they aren't saved, and neither are sparsely stored 3D maps.
+
+    Models and preprocessors are stored by name and recreated by cloning a matching object from the arrays passed to restore, such as DisMAL::DissonanceModels and DisMAL::Preprocessors.
+*/
+class SessionSnapshot
+{
+public:
+    //==============================================================================
+    /** Creates a SessionSnapshot object with no file open. */
+    SessionSnapshot();
+
+    /** Destructor. */
+    ~SessionSnapshot();
+
+    //==============================================================================
+    /** Saves the state of a DissonanceCalc to a file, replacing the file if it exists.
+
+        @param calc The DissonanceCalc to save.
+        @param file The file to write.
+        @param includeResults Set to true to also save calculated maps, chord dissonances and optimisation results.
+        @return True if the file was written.
+    */
+    static bool save (const DissonanceCalc& calc, const File& file, bool includeResults = true);
+
+    //==============================================================================
+    /** Memory-maps a snapshot file and checks its header.
+
+        @return True if the file is a valid snapshot.
+    */
+    bool open (const File& file);
+
+    /** Unmaps the open snapshot file. */
+    void close();
+
+    /** Returns true if a snapshot file is open. */
+    bool isOpen() const noexcept;
+
+    /** Returns true if the open snapshot contains calculated results. */
+    bool hasResults() const;
+
+    /** Restores a DissonanceCalc from the open snapshot, replacing all of its distributions, preprocessors, chords and settings.
+
+        @param calc The DissonanceCalc to restore.
+        @param availableModels Models that can be cloned to recreate the snapshot's model, such as DisMAL::DissonanceModels.
+        @param availablePreprocessors Preprocessors that can be cloned to recreate the snapshot's preprocessors, such as DisMAL::Preprocessors.
+        @param restoreResults Set to false to skip restoring any calculated results in the snapshot.
+        @return True if the snapshot was restored. False if it is damaged, or uses a model or preprocessor that wasn't available.
+    */
+    bool restore (DissonanceCalc& calc,
+                  const OwnedArray<DissonanceModel>& availableModels,
+                  const OwnedArray<Preprocessor>& availablePreprocessors,
+                  bool restoreResults = true) const;
+
+    /** Returns a pointer to the 2D dissonance map stored in the open snapshot, or nullptr if it doesn't contain one.
+
+        The pointer refers directly to the mapped file, and is valid until the snapshot is closed.
+
+        @param numValues Set to the number of values in the map.
+    */
+    const float* get2dMap (int& numValues) const;
+
+    //==============================================================================
+    /** Opens a snapshot file and restores a DissonanceCalc from it.
+
+        @see open, restore
+    */
+    static bool load (const File& file,
+                      DissonanceCalc& calc,
+                      const OwnedArray<DissonanceModel>& availableModels,
+                      const OwnedArray<Preprocessor>& availablePreprocessors,
+                      bool restoreResults = true);
+
+private:
+    //==============================================================================
+    /** Identifies a section of a snapshot file. */
+    enum SectionID
+    {
+        settingsSection = 1,
+        map2dSection,
+        map3dSection,
+        compressedMap3dSection,
+        chordDissonancesSection,
+        minimaSection,
+        maximaSection
+    };
+
+    struct Section
+    {
+        int id;
+        int64 offset;
+        int64 size;
+    };
+
+    std::unique_ptr<MemoryMappedFile> mappedFile;
+    Array<Section> sections;
+
+    //==============================================================================
+    /** Returns the address of a section in the mapped file, or nullptr if the section doesn't exist. */
+    const void* getSection (int sectionID, size_t& size) const;
+
+    /** Writes everything but the calculated results of a DissonanceCalc to a stream. */
+    static void writeSettings (const DissonanceCalc& calc, OutputStream& output);
+
+    /** Restores the settings written by writeSettings. */
+    static bool readSettings (DissonanceCalc& calc, InputStream& input,
+                              const OwnedArray<DissonanceModel>& availableModels,
+                              const OwnedArray<Preprocessor>& availablePreprocessors);
+
+    /** Writes a set of named parameters to a stream. */
+    static void writeParameters (const NamedValueSet& parameters, OutputStream& output);
+
+    /** Reads a set of named parameters written by writeParameters. */
+    static NamedValueSet readParameters (InputStream& input);
+
+    /** Copies an array of floats out of a section, returning false if the section doesn't hold exactly the expected number of values. */
+    bool readFloats (int sectionID, float* destination, int numValues) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SessionSnapshot)
+};
@@ -0,0 +1,344 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "ShadowVerifier.h"
+
+double ShadowVerifier::Statistics::getMeanAbsoluteError() const noexcept
+{
+    return numSamples > 0 ? sumAbsoluteError / numSamples : 0.0;
+}
+
+double ShadowVerifier::Statistics::getRmsError() const noexcept
+{
+    return numSamples > 0 ? std::sqrt (sumSquaredError / numSamples) : 0.0;
+}
+
+//==============================================================================
+
+
+ShadowVerifier::ShadowVerifier (float fraction, int maxWorstCasesToKeep, int maxResultsToQueue)   : Thread ("DisMAL shadow verifier")
+{
+    jassert (maxWorstCasesToKeep >= 0 && maxResultsToQueue > 0);
+
+    setSampledFraction (fraction);
+    maxWorstCases = jmax (0, maxWorstCasesToKeep);
+    maxQueuedResults = jmax (1, maxResultsToQueue);
+    isVerifying = false;
+
+    // Verification runs at a low priority, so that it only uses time the calculations it checks leave spare
+    startThread (1);
+}
+
+ShadowVerifier::~ShadowVerifier()
+{
+    signalThreadShouldExit();
+    resultQueued.signal();
+    stopThread (5000);
+}
+
+//==============================================================================
+
+
+void ShadowVerifier::setSampledFraction (float newFraction)
+{
+    jassert (newFraction >= 0 && newFraction <= 1);
+
+    const ScopedLock sl (lock);
+    sampledFraction = jlimit (0.0f, 1.0f, newFraction);
+}
+
+float ShadowVerifier::getSampledFraction() const noexcept
+{
+    return sampledFraction;
+}
+
+void ShadowVerifier::setSeed (int64 seed)
+{
+    const ScopedLock sl (lock);
+    random.setSeed (seed);
+}
+
+//==============================================================================
+
+
+bool ShadowVerifier::shouldSample()
+{
+    const ScopedLock sl (lock);
+
+    return sampledFraction > 0 && random.nextFloat() < sampledFraction;
+}
+
+void ShadowVerifier::submit (const String& kernel, float fastValue, const NamedValueSet& inputs, std::function<float()> calculateExactValue)
+{
+    jassert (calculateExactValue != nullptr);
+
+    {
+        const ScopedLock sl (lock);
+
+        if ((int) queue.size() >= maxQueuedResults)
+        {
+            ++statistics[kernel].numDropped;
+            return;
+        }
+
+        queue.push_back ({ kernel, fastValue, inputs, calculateExactValue });
+    }
+
+    resultQueued.signal();
+}
+
+void ShadowVerifier::submitMap (const DissonanceCalc& calc, const String& kernel)
+{
+    jassert (calc.model != nullptr);        // The DissonanceCalc needs a model
+
+    const int numSteps = calc.getNumSteps();
+
+    if (calc.model == nullptr || numSteps <= 0)
+        return;
+
+    const bool threeDimensional = calc.getNumDimensions() == DissonanceCalc::threeDimensional;
+    const double numCells = threeDimensional ? (double) numSteps * numSteps : (double) numSteps;
+    Array<int> xSteps, ySteps;
+
+    {
+        const ScopedLock sl (lock);
+
+        // The number of cells is rounded randomly, so that small maps are still sampled in the right proportion on average
+        const double expectedSamples = numCells * sampledFraction;
+        const int numSamples = (int) expectedSamples + (random.nextDouble() < expectedSamples - std::floor (expectedSamples) ? 1 : 0);
+
+        for (int s = 0; s < numSamples; ++s)
+        {
+            xSteps.add (random.nextInt (numSteps));
+            ySteps.add (threeDimensional ? random.nextInt (numSteps) : 0);
+        }
+    }
+
+    if (xSteps.isEmpty())
+        return;
+
+    // The copy doesn't share a model or distributions with calc, so it can be used on the verification thread. Its cells are calculated from the distributions alone, so the chords aren't copied.
+    std::shared_ptr<DissonanceCalc> reference (new DissonanceCalc (calc, false));
+    reference->setSumPartialDissonances (false);
+
+    for (int s = 0; s < xSteps.size(); ++s)
+    {
+        const int xStep = xSteps[s];
+        const int yStep = ySteps[s];
+        const float xFreq = calc.getFrequencyAtStep (xStep);
+        const float yFreq = calc.getFrequencyAtStep (yStep);
+        const float fastValue = threeDimensional ? calc.getDissonanceAtStep (xStep, yStep) : calc.getDissonanceAtStep (xStep);
+
+        // Cells outside of a cell mask weren't calculated. The compressed map stores them as 0 rather than NaN, so the mask itself is tested.
+        if (threeDimensional && ! calc.isCellInMask (xStep, yStep))
+            continue;
+
+        NamedValueSet inputs;
+
+        if (threeDimensional)
+        {
+            inputs.set ("xStep", xStep);
+            inputs.set ("yStep", yStep);
+            inputs.set ("xFreq", xFreq);
+            inputs.set ("yFreq", yFreq);
+
+            submit (kernel, fastValue, inputs, [reference, xFreq, yFreq] { return reference->getDissonanceAtFreq (xFreq, yFreq); });
+        }
+        else
+        {
+            inputs.set ("step", xStep);
+            inputs.set ("freq", xFreq);
+
+            submit (kernel, fastValue, inputs, [reference, xFreq] { return reference->getDissonanceAtFreq (xFreq); });
+        }
+    }
+}
+
+bool ShadowVerifier::waitUntilIdle (int timeoutMilliseconds)
+{
+    const double endTime = Time::getMillisecondCounterHiRes() + timeoutMilliseconds;
+
+    for (;;)
+    {
+        {
+            const ScopedLock sl (lock);
+
+            if (queue.empty() && ! isVerifying)
+                return true;
+        }
+
+        if (timeoutMilliseconds >= 0 && Time::getMillisecondCounterHiRes() >= endTime)
+            return false;
+
+        queueEmptied.wait (10);
+    }
+}
+
+//==============================================================================
+
+
+StringArray ShadowVerifier::getKernels() const
+{
+    const ScopedLock sl (lock);
+    StringArray kernels;
+
+    for (auto& entry : statistics)
+        kernels.add (entry.first);
+
+    return kernels;
+}
+
+ShadowVerifier::Statistics ShadowVerifier::getStatistics (const String& kernel) const
+{
+    const ScopedLock sl (lock);
+    auto entry = statistics.find (kernel);
+
+    return entry != statistics.end() ? entry->second : Statistics();
+}
+
+Array<ShadowVerifier::WorstCase> ShadowVerifier::getWorstCases() const
+{
+    const ScopedLock sl (lock);
+
+    return worstCases;
+}
+
+void ShadowVerifier::reset()
+{
+    const ScopedLock sl (lock);
+
+    queue.clear();
+    statistics.clear();
+    worstCases.clear();
+}
+
+//==============================================================================
+
+
+void ShadowVerifier::addListener (Listener* listener)
+{
+    listeners.add (listener);
+}
+
+void ShadowVerifier::removeListener (Listener* listener)
+{
+    listeners.remove (listener);
+}
+
+//==============================================================================
+
+
+void ShadowVerifier::run()
+{
+    const int batchSize = 64;
+
+    while (! threadShouldExit())
+    {
+        std::vector<PendingResult> batch;
+
+        {
+            const ScopedLock sl (lock);
+
+            while (! queue.empty() && (int) batch.size() < batchSize)
+            {
+                batch.push_back (std::move (queue.front()));
+                queue.pop_front();
+            }
+
+            isVerifying = ! batch.empty();
+        }
+
+        if (batch.empty())
+        {
+            queueEmptied.signal();
+            resultQueued.wait (100);
+            continue;
+        }
+
+        StringArray changedKernels;
+        Array<WorstCase> newWorstCases;
+
+        for (auto& result : batch)
+        {
+            if (threadShouldExit())
+                return;
+
+            const float exactValue = result.calculateExactValue();
+            const ScopedLock sl (lock);
+
+            if (record (result, exactValue))
+                newWorstCases.add ({ result.kernel, result.fastValue, exactValue, std::abs (result.fastValue - exactValue), result.inputs });
+
+            changedKernels.addIfNotAlreadyThere (result.kernel);
+        }
+
+        std::vector<std::pair<String, Statistics>> changedStatistics;
+
+        {
+            const ScopedLock sl (lock);
+            isVerifying = false;
+
+            for (auto& kernel : changedKernels)
+                changedStatistics.push_back ({ kernel, statistics[kernel] });
+        }
+
+        WeakReference<ShadowVerifier> verifier (this);
+
+        MessageManager::callAsync ([verifier, changedStatistics, newWorstCases]
+        {
+            if (auto* owner = verifier.get())
+            {
+                for (auto& entry : changedStatistics)
+                    owner->listeners.call ([&] (Listener& l) { l.shadowStatisticsChanged (entry.first, entry.second); });
+
+                for (auto& worstCase : newWorstCases)
+                    owner->listeners.call ([&] (Listener& l) { l.shadowWorstCaseFound (worstCase); });
+            }
+        });
+    }
+}
+
+bool ShadowVerifier::record (const PendingResult& result, float exactValue)
+{
+    const float absoluteError = std::abs (result.fastValue - exactValue);
+    const float relativeError = absoluteError / jmax (std::abs (exactValue), 1.0e-9f);
+
+    Statistics& kernelStatistics = statistics[result.kernel];
+    ++kernelStatistics.numSamples;
+    kernelStatistics.sumAbsoluteError += absoluteError;
+    kernelStatistics.sumSquaredError += (double) absoluteError * absoluteError;
+    kernelStatistics.maxAbsoluteError = jmax (kernelStatistics.maxAbsoluteError, absoluteError);
+    kernelStatistics.maxRelativeError = jmax (kernelStatistics.maxRelativeError, relativeError);
+
+    const int bin = relativeError > 0 ? (int) std::floor (std::log10 (relativeError)) + numHistogramBins : 0;
+    ++kernelStatistics.relativeErrorHistogram[jlimit (0, numHistogramBins - 1, bin)];
+
+    // Worst cases are kept sorted from the largest error down
+    if (maxWorstCases == 0 || absoluteError <= 0
+        || (worstCases.size() == maxWorstCases && absoluteError <= worstCases.getLast().absoluteError))
+    {
+        return false;
+    }
+
+    int index = 0;
+
+    while (index < worstCases.size() && worstCases.getReference (index).absoluteError >= absoluteError)
+        ++index;
+
+    worstCases.insert (index, { result.kernel, result.fastValue, exactValue, absoluteError, result.inputs });
+
+    if (worstCases.size() > maxWorstCases)
+        worstCases.removeLast();
+
+    return true;
+}
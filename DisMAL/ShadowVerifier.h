@@ -0,0 +1,185 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "DissonanceCalc.h"
+#include <deque>
+#include <map>
+
+/** Checks the accuracy of fast calculations against an exact reference while they are in use.
+
+    Compressed maps, repaired maps and other fast paths trade accuracy for speed. To make sure they stay accurate on real timbres, a ShadowVerifier recalculates a random sample of their results with the exact reference calculation on a low-priority background thread, and records the errors for each kernel:
+
+    - The mean, RMS and largest absolute errors, and the largest relative error.
+    - A histogram of relative errors, with a bin for each power of ten.
+    - The worst cases over all kernels, with the inputs that produced them.
+
+    A DissonanceCalc given a verifier with DissonanceCalc::setShadowVerifier submits a sample of each compressed map it calculates, and of each map it repairs. Other fast paths can submit their results with submit, along with a function that calculates the exact result.
+
+    Statistics can be polled with getStatistics and getWorstCases, or received by listeners, which are called on the message thread.
+*/
+class ShadowVerifier   : private Thread
+{
+public:
+    //==============================================================================
+    enum { numHistogramBins = 8 };
+
+    /** The errors recorded for one kernel. */
+    struct Statistics
+    {
+        int numSamples = 0;                 /**< The number of results that have been verified. */
+        int numDropped = 0;                 /**< The number of sampled results that were discarded because the queue was full. */
+        double sumAbsoluteError = 0;        /**< The sum of the absolute errors. */
+        double sumSquaredError = 0;         /**< The sum of the squared errors. */
+        float maxAbsoluteError = 0;         /**< The largest absolute error. */
+        float maxRelativeError = 0;         /**< The largest error relative to the exact result. */
+
+        /** The number of results in each bin of relative error. Bin 0 counts errors below 1e-7, and each following bin counts errors up to ten times larger, so the last bin counts errors of 0.1 and above. */
+        int relativeErrorHistogram[numHistogramBins] = {};
+
+        /** Returns the mean absolute error. */
+        double getMeanAbsoluteError() const noexcept;
+
+        /** Returns the root mean square error. */
+        double getRmsError() const noexcept;
+    };
+
+    /** A result with a large error, and the inputs that produced it. */
+    struct WorstCase
+    {
+        String kernel;              /**< The name of the kernel that produced the result. */
+        float fastValue;            /**< The result of the kernel. */
+        float exactValue;           /**< The result of the exact reference calculation. */
+        float absoluteError;        /**< The absolute difference between the two results. */
+        NamedValueSet inputs;       /**< The inputs of the calculation, such as its frequencies. */
+    };
+
+    //==============================================================================
+    /** Receives the errors recorded by a ShadowVerifier. Callbacks are made on the message thread. */
+    class Listener
+    {
+    public:
+        /** Destructor. */
+        virtual ~Listener() {}
+
+        /** Called after a batch of results from a kernel has been verified. */
+        virtual void shadowStatisticsChanged (const String& /*kernel*/, const Statistics& /*statistics*/) {}
+
+        /** Called when a result is among the worst cases recorded so far. */
+        virtual void shadowWorstCaseFound (const WorstCase&) {}
+    };
+
+    //==============================================================================
+    /** Creates a ShadowVerifier and starts its background thread.
+
+        @param sampledFraction The proportion of results to verify, between 0 and 1.
+        @param maxWorstCases The number of worst cases to keep.
+        @param maxQueuedResults The number of results that can wait to be verified. Results sampled while the queue is full are dropped and counted, so verification never holds up the calculations it checks.
+    */
+    explicit ShadowVerifier (float sampledFraction = 0.01f, int maxWorstCases = 16, int maxQueuedResults = 4096);
+
+    /** Destructor. Results that haven't been verified are discarded. */
+    ~ShadowVerifier() override;
+
+    //==============================================================================
+    /** Sets the proportion of results to verify, between 0 and 1. */
+    void setSampledFraction (float newFraction);
+
+    /** Returns the proportion of results to verify. */
+    float getSampledFraction() const noexcept;
+
+    /** Seeds the random number generator that picks the results to verify. */
+    void setSeed (int64 seed);
+
+    //==============================================================================
+    /** Randomly decides whether a result should be verified, with a probability of the sampled fraction. This is safe to call from any thread. */
+    bool shouldSample();
+
+    /** Queues a result to be verified, whether or not shouldSample would pick it. This is safe to call from any thread.
+
+        @param kernel The name of the kernel that produced the result, under which its errors are recorded.
+        @param fastValue The result of the kernel.
+        @param inputs The inputs of the calculation, which are kept with the worst cases.
+        @param calculateExactValue Calculates the result with the exact reference path. This is called on the background thread, so it must not share any objects with other threads.
+    */
+    void submit (const String& kernel, float fastValue, const NamedValueSet& inputs, std::function<float()> calculateExactValue);
+
+    /** Queues a random sample of the cells of a DissonanceCalc's dissonance map to be verified against DissonanceCalc::getDissonanceAtFreq. Cells outside of a cell mask are skipped.
+
+        The exact values are calculated with a copy of the DissonanceCalc, so it can go on being used while they are verified.
+
+        @param calc The DissonanceCalc, after its map has been calculated.
+        @param kernel The name under which the errors are recorded.
+    */
+    void submitMap (const DissonanceCalc& calc, const String& kernel);
+
+    /** Waits until every queued result has been verified.
+
+        @return True if the queue was emptied before the timeout.
+    */
+    bool waitUntilIdle (int timeoutMilliseconds = -1);
+
+    //==============================================================================
+    /** Returns the names of the kernels whose results have been sampled. */
+    StringArray getKernels() const;
+
+    /** Returns the errors recorded for a kernel. */
+    Statistics getStatistics (const String& kernel) const;
+
+    /** Returns the worst cases recorded over all kernels, from the largest error down. */
+    Array<WorstCase> getWorstCases() const;
+
+    /** Discards all recorded errors and queued results. */
+    void reset();
+
+    //==============================================================================
+    /** Registers a listener to receive recorded errors. */
+    void addListener (Listener* listener);
+
+    /** Deregisters a listener. */
+    void removeListener (Listener* listener);
+
+private:
+    //==============================================================================
+    struct PendingResult
+    {
+        String kernel;
+        float fastValue;
+        NamedValueSet inputs;
+        std::function<float()> calculateExactValue;
+    };
+
+    float sampledFraction;
+    int maxWorstCases, maxQueuedResults;
+    Random random;
+
+    std::deque<PendingResult> queue;
+    std::map<String, Statistics> statistics;
+    Array<WorstCase> worstCases;
+    bool isVerifying;
+
+    CriticalSection lock;
+    WaitableEvent resultQueued, queueEmptied;
+    ListenerList<Listener> listeners;
+
+    //==============================================================================
+    void run() override;
+
+    /** Records the error of a verified result, and returns true if it is one of the worst cases. */
+    bool record (const PendingResult& result, float exactValue);
+
+    JUCE_DECLARE_WEAK_REFERENCEABLE (ShadowVerifier)
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ShadowVerifier)
+};
@@ -0,0 +1,167 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "SparseMapStorage.h"
+
+SparseMapStorage::SparseMapStorage()
+{
+    numRows = 0;
+    numColumns = 0;
+}
+
+SparseMapStorage::~SparseMapStorage()
+{
+}
+
+//==============================================================================
+
+
+void SparseMapStorage::setMask (int newNumRows, int newNumColumns, const std::function<bool (int row, int column)>& isInMask)
+{
+    jassert (newNumRows >= 0 && newNumColumns >= 0);
+
+    clear();
+
+    numRows = jmax (0, newNumRows);
+    numColumns = jmax (0, newNumColumns);
+
+    int numValues = 0;
+
+    for (int row = 0; row < numRows; ++row)
+    {
+        firstRunOfRow.add (runStartColumns.size());
+
+        bool inRun = false;
+
+        for (int column = 0; column < numColumns; ++column)
+        {
+            const bool inMask = isInMask (row, column);
+
+            if (inMask && ! inRun)
+            {
+                runStartColumns.add (column);
+                runValueOffsets.add (numValues);
+            }
+
+            if (inMask)
+                ++numValues;
+
+            inRun = inMask;
+        }
+    }
+
+    // Sentinels, so that the end of the last row and run can be found in the same way as the others
+    firstRunOfRow.add (runStartColumns.size());
+    runValueOffsets.add (numValues);
+
+    values.insertMultiple (0, 0, numValues);
+}
+
+void SparseMapStorage::clear()
+{
+    numRows = 0;
+    numColumns = 0;
+
+    firstRunOfRow.clear();
+    runStartColumns.clear();
+    runValueOffsets.clear();
+    values.clear();
+}
+
+bool SparseMapStorage::isEmpty() const noexcept
+{
+    return numRows == 0 || numColumns == 0;
+}
+
+int SparseMapStorage::getNumRows() const noexcept
+{
+    return numRows;
+}
+
+int SparseMapStorage::getNumColumns() const noexcept
+{
+    return numColumns;
+}
+
+int SparseMapStorage::getNumStoredValues() const noexcept
+{
+    return values.size();
+}
+
+size_t SparseMapStorage::getMemorySize() const noexcept
+{
+    return sizeof (float) * (size_t) values.size()
+           + sizeof (int) * (size_t) (firstRunOfRow.size() + runStartColumns.size() + runValueOffsets.size());
+}
+
+//==============================================================================
+
+
+int SparseMapStorage::getNumRuns (int row) const
+{
+    jassert (isPositiveAndBelow (row, numRows));
+
+    return firstRunOfRow[row + 1] - firstRunOfRow[row];
+}
+
+Range<int> SparseMapStorage::getRun (int row, int run) const
+{
+    jassert (isPositiveAndBelow (run, getNumRuns (row)));
+
+    const int index = firstRunOfRow[row] + run;
+    const int start = runStartColumns[index];
+
+    return Range<int> (start, start + runValueOffsets[index + 1] - runValueOffsets[index]);
+}
+
+float* SparseMapStorage::getRunValues (int row, int run)
+{
+    jassert (isPositiveAndBelow (run, getNumRuns (row)));
+
+    return values.getRawDataPointer() + runValueOffsets[firstRunOfRow[row] + run];
+}
+
+//==============================================================================
+
+
+bool SparseMapStorage::contains (int row, int column) const noexcept
+{
+    return getValueIndex (row, column) >= 0;
+}
+
+float SparseMapStorage::get (int row, int column) const noexcept
+{
+    const int index = getValueIndex (row, column);
+
+    return index >= 0 ? values.getUnchecked (index) : std::numeric_limits<float>::quiet_NaN();
+}
+
+int SparseMapStorage::getValueIndex (int row, int column) const noexcept
+{
+    if (! isPositiveAndBelow (row, numRows) || ! isPositiveAndBelow (column, numColumns))
+        return -1;
+
+    // Find the last run of the row that starts at or before the column
+    const int* starts = runStartColumns.getRawDataPointer();
+    const int firstRun = firstRunOfRow.getUnchecked (row);
+    const int endRun = firstRunOfRow.getUnchecked (row + 1);
+    const int run = (int) (std::upper_bound (starts + firstRun, starts + endRun, column) - starts) - 1;
+
+    if (run < firstRun)
+        return -1;
+
+    const int offset = column - starts[run];
+    const int runLength = runValueOffsets.getUnchecked (run + 1) - runValueOffsets.getUnchecked (run);
+
+    return offset < runLength ? runValueOffsets.getUnchecked (run) + offset : -1;
+}
@@ -0,0 +1,89 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Storage for the cells of a grid that lie within a mask, such as a region of interest in a 3D dissonance map.
+
+    The cells of each row that are within the mask are stored as runs of consecutive columns. Masks such as a triangle or a band around a path have a single run per row, so the storage takes little more than four bytes per masked cell. Cells outside of the mask aren't stored, and read as NaN.
+*/
+class SparseMapStorage
+{
+public:
+    //==============================================================================
+    /** Creates an empty SparseMapStorage object. */
+    SparseMapStorage();
+
+    /** Destructor. */
+    ~SparseMapStorage();
+
+    //==============================================================================
+    /** Finds the runs of masked cells in a grid and allocates storage for them. Every stored value is zero until set.
+
+        @param numRows The number of rows in the grid.
+        @param numColumns The number of columns in the grid.
+        @param isInMask Returns true for the cells that should be stored.
+    */
+    void setMask (int numRows, int numColumns, const std::function<bool (int row, int column)>& isInMask);
+
+    /** Frees all storage. */
+    void clear();
+
+    /** Returns true if there is no storage. */
+    bool isEmpty() const noexcept;
+
+    /** Returns the number of rows in the grid. */
+    int getNumRows() const noexcept;
+
+    /** Returns the number of columns in the grid. */
+    int getNumColumns() const noexcept;
+
+    /** Returns the number of cells within the mask. */
+    int getNumStoredValues() const noexcept;
+
+    /** Returns the number of bytes used to store the grid. */
+    size_t getMemorySize() const noexcept;
+
+    //==============================================================================
+    /** Returns the number of runs of masked cells in a row. */
+    int getNumRuns (int row) const;
+
+    /** Returns the columns covered by a run of masked cells. */
+    Range<int> getRun (int row, int run) const;
+
+    /** Returns a pointer to the values of a run of masked cells, one for each column of the run. */
+    float* getRunValues (int row, int run);
+
+    //==============================================================================
+    /** Returns true if a cell is within the mask. */
+    bool contains (int row, int column) const noexcept;
+
+    /** Returns the value of a cell, or NaN if the cell is outside of the mask. */
+    float get (int row, int column) const noexcept;
+
+private:
+    //==============================================================================
+    int numRows, numColumns;
+
+    // The runs of row r are firstRunOfRow[r] to firstRunOfRow[r + 1]. The values of run k are at runValueOffsets[k].
+    Array<int> firstRunOfRow, runStartColumns, runValueOffsets;
+    Array<float> values;
+
+    //==============================================================================
+    /** Returns the index of the stored value of a cell, or -1 if the cell is outside of the mask. */
+    int getValueIndex (int row, int column) const noexcept;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SparseMapStorage)
+};
@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "SpectrumAnalyser.h"
+
+SpectrumAnalyser::SpectrumAnalyser (int fftOrder)   : fft (fftOrder),
+                                                      frameSize (1 << fftOrder),
+                                                      numBins ((1 << fftOrder) / 2 + 1),
+                                                      numFrames (0)
+{
+    window.malloc ((size_t) frameSize);
+    fftBuffer.calloc ((size_t) frameSize * 2);
+    magnitudes.calloc ((size_t) numBins);
+
+    dsp::WindowingFunction<float>::fillWindowingTables (window, (size_t) frameSize,
+                                                        dsp::WindowingFunction<float>::hann, false);
+}
+
+SpectrumAnalyser::~SpectrumAnalyser()
+{
+}
+
+//==============================================================================
+
+
+int SpectrumAnalyser::getFrameSize() const noexcept
+{
+    return frameSize;
+}
+
+int SpectrumAnalyser::getNumBins() const noexcept
+{
+    return numBins;
+}
+
+void SpectrumAnalyser::reset()
+{
+    FloatVectorOperations::clear (magnitudes, numBins);
+    numFrames = 0;
+}
+
+void SpectrumAnalyser::addFrame (const float* samples, int numSamples)
+{
+    const int numToCopy = jmin (numSamples, frameSize);
+
+    FloatVectorOperations::clear (fftBuffer, frameSize * 2);
+    FloatVectorOperations::multiply (fftBuffer, samples, window, numToCopy);
+
+    fft.performFrequencyOnlyForwardTransform (fftBuffer);
+
+    FloatVectorOperations::add (magnitudes, fftBuffer, numBins);
+    ++numFrames;
+}
+
+void SpectrumAnalyser::addSignal (const float* samples, int numSamples)
+{
+    if (numSamples <= frameSize)
+    {
+        addFrame (samples, numSamples);
+        return;
+    }
+
+    const int hopSize = frameSize / 2;
+
+    for (int start = 0; start + frameSize <= numSamples; start += hopSize)
+        addFrame (samples + start, frameSize);
+}
+
+int SpectrumAnalyser::getNumFrames() const noexcept
+{
+    return numFrames;
+}
+
+float SpectrumAnalyser::getMagnitude (int bin) const
+{
+    if (numFrames == 0 || ! isPositiveAndBelow (bin, numBins))
+        return 0;
+
+    // A Hann window halves the amplitude of a sinusoid, and a real FFT splits it between two bins
+    return magnitudes[bin] * 4.0f / (float) (frameSize * numFrames);
+}
+
+//==============================================================================
+
+
+void SpectrumAnalyser::findPeaks (double sampleRate, float thresholdDb, int maxNumPeaks, Array<Peak>& peaks) const
+{
+    peaks.clearQuick();
+
+    if (numFrames == 0 || maxNumPeaks <= 0)
+        return;
+
+    const float floor = 1.0e-9f;
+    const float binWidth = (float) (sampleRate / frameSize);
+
+    for (int bin = 2; bin < numBins - 1; ++bin)
+    {
+        const float centre = getMagnitude (bin);
+
+        if (centre > getMagnitude (bin - 1) && centre >= getMagnitude (bin + 1))
+        {
+            // Fit a parabola through the log magnitudes of the maximum and its neighbours
+            const float below = std::log (jmax (floor, getMagnitude (bin - 1)));
+            const float peak = std::log (jmax (floor, centre));
+            const float above = std::log (jmax (floor, getMagnitude (bin + 1)));
+            const float curvature = below - 2 * peak + above;
+            const float offset = curvature < 0 ? 0.5f * (below - above) / curvature : 0;
+
+            peaks.add ({ ((float) bin + offset) * binWidth,
+                         std::exp (peak - 0.25f * (below - above) * offset) });
+        }
+    }
+
+    float loudest = 0;
+
+    for (auto& p : peaks)
+        loudest = jmax (loudest, p.amp);
+
+    const float threshold = loudest * std::pow (10.0f, jmin (0.0f, thresholdDb) / 20);
+
+    for (int i = peaks.size(); --i >= 0;)
+    {
+        if (peaks.getReference (i).amp < threshold)
+            peaks.remove (i);
+    }
+
+    if (peaks.size() > maxNumPeaks)
+    {
+        std::sort (peaks.begin(), peaks.end(),
+                   [] (const Peak& a, const Peak& b) { return a.amp > b.amp; });
+
+        peaks.resize (maxNumPeaks);
+
+        std::sort (peaks.begin(), peaks.end(),
+                   [] (const Peak& a, const Peak& b) { return a.freq < b.freq; });
+    }
+}
@@ -0,0 +1,92 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** Estimates the sinusoidal peaks in the spectrum of an audio signal.
+
+    Frames of audio are Hann-windowed and transformed with juce::dsp::FFT, and their magnitude spectra are averaged. Peaks of the averaged spectrum are then located with sub-bin accuracy by fitting a parabola to the log magnitudes around each local maximum. Peak amplitudes are scaled to estimate the amplitude of the sinusoid that produced them.
+
+    All buffers are allocated on construction, so an analyser can be reused for many signals without allocating. This requires the juce_dsp module.
+*/
+class SpectrumAnalyser
+{
+public:
+    //==============================================================================
+    /** A sinusoidal peak with a frequency in Hz and a linear amplitude. */
+    struct Peak
+    {
+        float freq;
+        float amp;
+    };
+
+    //==============================================================================
+    /** Creates a SpectrumAnalyser object.
+
+        @param fftOrder The base 2 logarithm of the frame size. For example, an order of 14 analyses frames of 16384 samples.
+    */
+    explicit SpectrumAnalyser (int fftOrder);
+
+    /** Destructor. */
+    ~SpectrumAnalyser();
+
+    //==============================================================================
+    /** Returns the number of samples in each frame. */
+    int getFrameSize() const noexcept;
+
+    /** Returns the number of magnitude bins in the averaged spectrum, from 0 Hz up to the Nyquist frequency. */
+    int getNumBins() const noexcept;
+
+    /** Clears the averaged spectrum. */
+    void reset();
+
+    /** Adds the magnitude spectrum of a frame to the averaged spectrum.
+
+        @param samples The frame's samples.
+        @param numSamples The number of samples. Frames shorter than getFrameSize() are zero-padded.
+    */
+    void addFrame (const float* samples, int numSamples);
+
+    /** Adds the magnitude spectra of overlapping frames covering a whole signal to the averaged spectrum.
+
+        Frames overlap by half of their length. Signals shorter than a frame are analysed as a single zero-padded frame.
+    */
+    void addSignal (const float* samples, int numSamples);
+
+    /** Returns the number of frames that have been added since the last call to reset. */
+    int getNumFrames() const noexcept;
+
+    /** Returns the averaged magnitude of a bin, scaled so that a sinusoid centred on the bin has its own amplitude. */
+    float getMagnitude (int bin) const;
+
+    //==============================================================================
+    /** Finds the peaks of the averaged spectrum.
+
+        @param sampleRate The sample rate of the analysed audio.
+        @param thresholdDb Peaks quieter than the loudest peak by more than this many decibels are ignored. This should be negative.
+        @param maxNumPeaks The maximum number of peaks to return. When there are more, the loudest are kept.
+        @param peaks The array to fill with peaks, in order of ascending frequency.
+    */
+    void findPeaks (double sampleRate, float thresholdDb, int maxNumPeaks, Array<Peak>& peaks) const;
+
+private:
+    //==============================================================================
+    dsp::FFT fft;
+    int frameSize, numBins, numFrames;
+
+    HeapBlock<float> window, fftBuffer, magnitudes;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumAnalyser)
+};
@@ -0,0 +1,366 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "SpectrumStore.h"
+#include <map>
+
+namespace
+{
+    const int spectrumStoreMagic = 0x50534d44;       // "DMSP"
+    const int spectrumStoreVersion = 1;
+    const int64 arrayAlignment = 64;
+
+    /** The header at the start of a store file. Every array in the file starts at a multiple of arrayAlignment. */
+    struct StoreHeader
+    {
+        int magic;
+        int version;
+        int numSpectra;
+        int numPartials;
+        int64 entriesOffset;
+        int64 freqRatiosOffset;
+        int64 ampRatiosOffset;
+        int64 mutesOffset;
+        int64 namesOffset;
+        int64 namesSize;
+    };
+
+    int64 alignOffset (int64 offset) noexcept
+    {
+        return (offset + arrayAlignment - 1) / arrayAlignment * arrayAlignment;
+    }
+
+    /** Stores that are attached through getShared, so that each file is only mapped once per process. */
+    CriticalSection sharedStoresLock;
+    std::map<String, std::weak_ptr<const SpectrumStore>> sharedStores;
+}
+
+SpectrumStore::SpectrumStore()
+{
+    entries = nullptr;
+    freqRatios = nullptr;
+    ampRatios = nullptr;
+    partialMutes = nullptr;
+    names = nullptr;
+    numSpectra = 0;
+}
+
+SpectrumStore::~SpectrumStore()
+{
+}
+
+//==============================================================================
+
+
+bool SpectrumStore::write (const OwnedArray<OvertoneDistribution>& distributions, const File& file)
+{
+    Array<Entry> table;
+    Array<float> allFreqRatios, allAmpRatios;
+    Array<uint8> allMutes;
+    MemoryOutputStream allNames;
+
+    for (auto* distribution : distributions)
+    {
+        const String name = distribution->getName();
+
+        Entry entry;
+        entry.firstPartial = allFreqRatios.size();
+        entry.numPartials = distribution->numPartials();
+        entry.fundamentalFreq = distribution->getFundamentalFreq();
+        entry.fundamentalAmp = distribution->getFundamentalAmp();
+        entry.minInterval = distribution->getMinInterval();
+        entry.flags = (distribution->isMuted() ? mutedFlag : 0) | (distribution->fundamentalIsMuted() ? fundamentalMutedFlag : 0);
+        entry.nameOffset = (int) allNames.getDataSize();
+        entry.nameLength = (int) name.getNumBytesAsUTF8();
+
+        table.add (entry);
+        allNames.write (name.toRawUTF8(), name.getNumBytesAsUTF8());
+
+        for (int p = 0; p < distribution->numPartials(); ++p)
+        {
+            allFreqRatios.add (distribution->getFreqRatio (p));
+            allAmpRatios.add (distribution->getAmpRatio (p));
+            allMutes.add (distribution->partialIsMuted (p) ? 1 : 0);
+        }
+    }
+
+    StoreHeader header;
+    header.magic = spectrumStoreMagic;
+    header.version = spectrumStoreVersion;
+    header.numSpectra = table.size();
+    header.numPartials = allFreqRatios.size();
+    header.entriesOffset = alignOffset (sizeof (StoreHeader));
+    header.freqRatiosOffset = alignOffset (header.entriesOffset + (int64) sizeof (Entry) * table.size());
+    header.ampRatiosOffset = alignOffset (header.freqRatiosOffset + (int64) sizeof (float) * allFreqRatios.size());
+    header.mutesOffset = alignOffset (header.ampRatiosOffset + (int64) sizeof (float) * allAmpRatios.size());
+    header.namesOffset = alignOffset (header.mutesOffset + allMutes.size());
+    header.namesSize = (int64) allNames.getDataSize();
+
+    TemporaryFile temp (file);
+
+    {
+        FileOutputStream output (temp.getFile());
+
+        if (! output.openedOk())
+        {
+            jassertfalse;       // Couldn't write to the store's folder
+            return false;
+        }
+
+        const std::pair<int64, MemoryBlock> blocks[] =
+        {
+            { header.entriesOffset, MemoryBlock (table.getRawDataPointer(), sizeof (Entry) * (size_t) table.size()) },
+            { header.freqRatiosOffset, MemoryBlock (allFreqRatios.getRawDataPointer(), sizeof (float) * (size_t) allFreqRatios.size()) },
+            { header.ampRatiosOffset, MemoryBlock (allAmpRatios.getRawDataPointer(), sizeof (float) * (size_t) allAmpRatios.size()) },
+            { header.mutesOffset, MemoryBlock (allMutes.getRawDataPointer(), (size_t) allMutes.size()) },
+            { header.namesOffset, MemoryBlock (allNames.getData(), allNames.getDataSize()) }
+        };
+
+        output.write (&header, sizeof (header));
+
+        for (auto& block : blocks)
+        {
+            output.writeRepeatedByte (0, (size_t) (block.first - output.getPosition()));
+            output.write (block.second.getData(), block.second.getSize());
+        }
+
+        output.flush();
+    }
+
+    return temp.overwriteTargetFileWithTemporary();
+}
+
+bool SpectrumStore::attach (const File& file)
+{
+    detach();
+
+    mappedFile = std::make_unique<MemoryMappedFile> (file, MemoryMappedFile::readOnly);
+
+    const int64 fileSize = (int64) mappedFile->getSize();
+    const char* data = static_cast<const char*> (mappedFile->getData());
+
+    if (data == nullptr || fileSize < (int64) sizeof (StoreHeader))
+    {
+        detach();
+        return false;
+    }
+
+    StoreHeader header;
+    std::memcpy (&header, data, sizeof (header));
+
+    // Every array must lie within the file, and be aligned so that it can be read in place
+    auto arrayIsValid = [fileSize] (int64 offset, int64 size)
+    {
+        return offset >= (int64) sizeof (StoreHeader) && offset % arrayAlignment == 0
+               && size >= 0 && offset + size <= fileSize;
+    };
+
+    if (header.magic != spectrumStoreMagic || header.version != spectrumStoreVersion
+        || header.numSpectra < 0 || header.numPartials < 0
+        || ! arrayIsValid (header.entriesOffset, (int64) sizeof (Entry) * header.numSpectra)
+        || ! arrayIsValid (header.freqRatiosOffset, (int64) sizeof (float) * header.numPartials)
+        || ! arrayIsValid (header.ampRatiosOffset, (int64) sizeof (float) * header.numPartials)
+        || ! arrayIsValid (header.mutesOffset, header.numPartials)
+        || ! arrayIsValid (header.namesOffset, header.namesSize))
+    {
+        jassertfalse;       // Not a store, or written by an incompatible version
+        detach();
+        return false;
+    }
+
+    entries = reinterpret_cast<const Entry*> (data + header.entriesOffset);
+
+    for (int i = 0; i < header.numSpectra; ++i)
+    {
+        const Entry& entry = entries[i];
+
+        if (entry.firstPartial < 0 || entry.numPartials < 0 || entry.firstPartial + (int64) entry.numPartials > header.numPartials
+            || entry.nameOffset < 0 || entry.nameLength < 0 || entry.nameOffset + (int64) entry.nameLength > header.namesSize)
+        {
+            jassertfalse;   // The file has been damaged
+            detach();
+            return false;
+        }
+    }
+
+    freqRatios = reinterpret_cast<const float*> (data + header.freqRatiosOffset);
+    ampRatios = reinterpret_cast<const float*> (data + header.ampRatiosOffset);
+    partialMutes = reinterpret_cast<const uint8*> (data + header.mutesOffset);
+    names = data + header.namesOffset;
+    numSpectra = header.numSpectra;
+
+    return true;
+}
+
+void SpectrumStore::detach()
+{
+    entries = nullptr;
+    freqRatios = nullptr;
+    ampRatios = nullptr;
+    partialMutes = nullptr;
+    names = nullptr;
+    numSpectra = 0;
+
+    mappedFile.reset();
+}
+
+bool SpectrumStore::isAttached() const noexcept
+{
+    return entries != nullptr;
+}
+
+std::shared_ptr<const SpectrumStore> SpectrumStore::getShared (const File& file)
+{
+    const ScopedLock sl (sharedStoresLock);
+
+    const String path = file.getFullPathName();
+
+    if (auto existingStore = sharedStores[path].lock())
+        return existingStore;
+
+    auto store = std::make_shared<SpectrumStore>();
+
+    if (! store->attach (file))
+    {
+        sharedStores.erase (path);
+        return nullptr;
+    }
+
+    sharedStores[path] = store;
+
+    return store;
+}
+
+//==============================================================================
+
+
+int SpectrumStore::size() const noexcept
+{
+    return numSpectra;
+}
+
+String SpectrumStore::getName (int index) const
+{
+    const Entry& entry = getEntry (index);
+
+    return String::fromUTF8 (names + entry.nameOffset, entry.nameLength);
+}
+
+int SpectrumStore::indexOf (const String& name) const
+{
+    const char* nameToFind = name.toRawUTF8();
+    const size_t length = name.getNumBytesAsUTF8();
+
+    for (int i = 0; i < numSpectra; ++i)
+    {
+        if ((size_t) entries[i].nameLength == length
+            && std::memcmp (names + entries[i].nameOffset, nameToFind, length) == 0)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int SpectrumStore::getNumPartials (int index) const
+{
+    return getEntry (index).numPartials;
+}
+
+const float* SpectrumStore::getFreqRatios (int index) const
+{
+    return freqRatios + getEntry (index).firstPartial;
+}
+
+const float* SpectrumStore::getAmpRatios (int index) const
+{
+    return ampRatios + getEntry (index).firstPartial;
+}
+
+bool SpectrumStore::isPartialMuted (int index, int partialNum) const
+{
+    const Entry& entry = getEntry (index);
+
+    jassert (isPositiveAndBelow (partialNum, entry.numPartials));
+
+    return partialMutes[entry.firstPartial + partialNum] != 0;
+}
+
+float SpectrumStore::getFundamentalFreq (int index) const
+{
+    return getEntry (index).fundamentalFreq;
+}
+
+float SpectrumStore::getFundamentalAmp (int index) const
+{
+    return getEntry (index).fundamentalAmp;
+}
+
+float SpectrumStore::getMinInterval (int index) const
+{
+    return getEntry (index).minInterval;
+}
+
+bool SpectrumStore::isMuted (int index) const
+{
+    return (getEntry (index).flags & mutedFlag) != 0;
+}
+
+bool SpectrumStore::isFundamentalMuted (int index) const
+{
+    return (getEntry (index).flags & fundamentalMutedFlag) != 0;
+}
+
+//==============================================================================
+
+
+OvertoneDistribution* SpectrumStore::createDistribution (int index) const
+{
+    const Entry& entry = getEntry (index);
+    auto* distribution = new OvertoneDistribution();
+
+    distribution->setDistributionName (getName (index));
+
+    for (int p = 0; p < entry.numPartials; ++p)
+    {
+        distribution->addPartial (freqRatios[entry.firstPartial + p], ampRatios[entry.firstPartial + p]);
+
+        if (distribution->numPartials() == p + 1)
+            distribution->mutePartial (p, partialMutes[entry.firstPartial + p] != 0);
+    }
+
+    // Set after adding partials, so that the stored partials are never rejected for being too close together
+    distribution->setMinInterval (entry.minInterval);
+    distribution->setFundamental (entry.fundamentalFreq, entry.fundamentalAmp);
+    distribution->mute ((entry.flags & mutedFlag) != 0);
+    distribution->muteFundamental ((entry.flags & fundamentalMutedFlag) != 0);
+
+    return distribution;
+}
+
+//==============================================================================
+
+
+const SpectrumStore::Entry& SpectrumStore::getEntry (int index) const
+{
+    static const Entry emptyEntry = {};
+
+    if (! isPositiveAndBelow (index, numSpectra))
+    {
+        jassertfalse;       // The index is out of range, or the store isn't attached
+        return emptyEntry;
+    }
+
+    return entries[index];
+}
@@ -0,0 +1,148 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "OvertoneDistribution.h"
+
+/** A read-only library of overtone distributions that is shared by every process on a machine.
+
+    A library is flattened into a single file with write: the frequency ratios, amplitude ratios and mute states of every partial are stored in contiguous, SIMD-aligned arrays, after a table describing each spectrum. Attaching to the file memory-maps it read-only, so the operating system keeps a single copy of the library in memory, no matter how many processes or plugin instances attach to it. Within a process, getShared returns the same attached store to every caller.
+
+    Spectra are read directly from the mapped file, without being loaded into OvertoneDistribution objects. Only the spectra that are actually used in calculations need to be turned into distributions with createDistribution, for use with DissonanceCalc::addOvertoneDistribution.
+
+    Values are stored in the byte order of the machine that wrote the file.
+*/
+class SpectrumStore
+{
+public:
+    //==============================================================================
+    /** Creates a SpectrumStore that isn't attached to a file. */
+    SpectrumStore();
+
+    /** Destructor. */
+    ~SpectrumStore();
+
+    //==============================================================================
+    /** Flattens a library of overtone distributions into a store file, replacing the file if it exists.
+
+        @return True if the file was written.
+    */
+    static bool write (const OwnedArray<OvertoneDistribution>& distributions, const File& file);
+
+    /** Memory-maps a store file and checks its contents.
+
+        @return True if the file is a valid store.
+    */
+    bool attach (const File& file);
+
+    /** Unmaps the attached file. Any pointers returned by getFreqRatios or getAmpRatios become invalid. */
+    void detach();
+
+    /** Returns true if a store file is attached. */
+    bool isAttached() const noexcept;
+
+    /** Returns a store attached to a file, shared with every other caller in the process that asks for the same file.
+
+        The store stays attached until every caller has released it.
+
+        @return The shared store, or nullptr if the file isn't a valid store.
+    */
+    static std::shared_ptr<const SpectrumStore> getShared (const File& file);
+
+    //==============================================================================
+    /** Returns the number of spectra in the store. */
+    int size() const noexcept;
+
+    /** Returns the name of a spectrum. */
+    String getName (int index) const;
+
+    /** Returns the index of the first spectrum with a name, or -1 if there isn't one. */
+    int indexOf (const String& name) const;
+
+    /** Returns the number of partials in a spectrum, not including its fundamental. */
+    int getNumPartials (int index) const;
+
+    /** Returns a pointer to the frequency ratios of a spectrum's partials, in ascending order.
+
+        The pointer refers directly to the mapped file, and is valid until the store is detached.
+    */
+    const float* getFreqRatios (int index) const;
+
+    /** Returns a pointer to the amplitude ratios of a spectrum's partials.
+
+        @see getFreqRatios
+    */
+    const float* getAmpRatios (int index) const;
+
+    /** Returns true if a partial of a spectrum is muted. */
+    bool isPartialMuted (int index, int partialNum) const;
+
+    /** Returns the fundamental frequency that a spectrum was stored with. */
+    float getFundamentalFreq (int index) const;
+
+    /** Returns the fundamental amplitude that a spectrum was stored with. */
+    float getFundamentalAmp (int index) const;
+
+    /** Returns the minimum interval between a spectrum's partials. */
+    float getMinInterval (int index) const;
+
+    /** Returns true if the whole of a spectrum is muted. */
+    bool isMuted (int index) const;
+
+    /** Returns true if a spectrum's fundamental is muted. */
+    bool isFundamentalMuted (int index) const;
+
+    //==============================================================================
+    /** Creates an OvertoneDistribution from a stored spectrum.
+
+        The caller takes ownership of the distribution, which can be passed to DissonanceCalc::addOvertoneDistribution.
+    */
+    OvertoneDistribution* createDistribution (int index) const;
+
+private:
+    //==============================================================================
+    /** The description of a spectrum in the store's table. */
+    struct Entry
+    {
+        int firstPartial;
+        int numPartials;
+        float fundamentalFreq;
+        float fundamentalAmp;
+        float minInterval;
+        int flags;
+        int nameOffset;
+        int nameLength;
+    };
+
+    enum EntryFlags
+    {
+        mutedFlag = 1,
+        fundamentalMutedFlag = 2
+    };
+
+    std::unique_ptr<MemoryMappedFile> mappedFile;
+    const Entry* entries;
+    const float* freqRatios;
+    const float* ampRatios;
+    const uint8* partialMutes;
+    const char* names;
+    int numSpectra;
+
+    //==============================================================================
+    /** Returns the table entry of a spectrum. */
+    const Entry& getEntry (int index) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SpectrumStore)
+};
@@ -0,0 +1,444 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "TimbreExtractor.h"
+
+TimbreExtractor::TimbreExtractor()
+{
+    fftOrder = 14;
+    maxNumPartials = 64;
+    analysisSegment = Range<double> (0.1, 1.1);
+    peakThreshold = -60;
+    harmonicTolerance = 30;
+    fundamentalRange = Range<float> (20, 5000);
+    partialModel = harmonic;
+}
+
+TimbreExtractor::~TimbreExtractor()
+{
+}
+
+//==============================================================================
+
+
+void TimbreExtractor::setFFTOrder (int newFFTOrder)
+{
+    jassert (newFFTOrder >= 8 && newFFTOrder <= 18);    // Frames should have between 256 and 262144 samples
+
+    fftOrder = jlimit (8, 18, newFFTOrder);
+}
+
+int TimbreExtractor::getFFTOrder() const noexcept
+{
+    return fftOrder;
+}
+
+void TimbreExtractor::setAnalysisSegment (double startSeconds, double lengthSeconds)
+{
+    jassert (startSeconds >= 0);            // The segment can't start before the file does
+    jassert (lengthSeconds > 0);            // The segment must have a length
+
+    if (startSeconds >= 0 && lengthSeconds > 0)
+        analysisSegment = Range<double> (startSeconds, startSeconds + lengthSeconds);
+}
+
+Range<double> TimbreExtractor::getAnalysisSegment() const noexcept
+{
+    return analysisSegment;
+}
+
+void TimbreExtractor::setPeakThreshold (float newThresholdDb)
+{
+    jassert (newThresholdDb < 0);           // The threshold is relative to the loudest peak
+
+    peakThreshold = jmin (0.0f, newThresholdDb);
+}
+
+float TimbreExtractor::getPeakThreshold() const noexcept
+{
+    return peakThreshold;
+}
+
+void TimbreExtractor::setMaxNumPartials (int newMaxNumPartials)
+{
+    jassert (newMaxNumPartials > 0);
+
+    maxNumPartials = jmax (1, newMaxNumPartials);
+}
+
+int TimbreExtractor::getMaxNumPartials() const noexcept
+{
+    return maxNumPartials;
+}
+
+void TimbreExtractor::setPartialModel (PartialModel newPartialModel) noexcept
+{
+    partialModel = newPartialModel;
+}
+
+TimbreExtractor::PartialModel TimbreExtractor::getPartialModel() const noexcept
+{
+    return partialModel;
+}
+
+void TimbreExtractor::setHarmonicTolerance (float newToleranceCents)
+{
+    jassert (newToleranceCents > 0);
+
+    harmonicTolerance = jmax (0.1f, newToleranceCents);
+}
+
+float TimbreExtractor::getHarmonicTolerance() const noexcept
+{
+    return harmonicTolerance;
+}
+
+void TimbreExtractor::setFundamentalRange (float lowestFreq, float highestFreq)
+{
+    jassert (lowestFreq > 0);               // Frequencies must be positive
+    jassert (highestFreq > lowestFreq);     // highestFreq must be greater than lowestFreq
+
+    if (lowestFreq > 0 && highestFreq > lowestFreq)
+        fundamentalRange = Range<float> (lowestFreq, highestFreq);
+}
+
+Range<float> TimbreExtractor::getFundamentalRange() const noexcept
+{
+    return fundamentalRange;
+}
+
+//==============================================================================
+
+
+TimbreExtractor::Summary TimbreExtractor::extract (const File& audioFile,
+                                                   AudioFormatManager& formatManager,
+                                                   OvertoneDistribution& distribution) const
+{
+    Workspace workspace (fftOrder);
+
+    return extract (audioFile, formatManager, distribution, workspace);
+}
+
+Array<TimbreExtractor::Summary> TimbreExtractor::processFiles (const Array<File>& audioFiles,
+                                                               const File& outputFolder,
+                                                               WorkerPool& pool,
+                                                               bool overwrite,
+                                                               std::function<void (const Summary&)> onFileProcessed) const
+{
+    Array<Summary> summaries;
+    summaries.resize (audioFiles.size());
+
+    if (! outputFolder.isDirectory() && outputFolder.createDirectory().failed())
+    {
+        jassertfalse;                       // Couldn't create the output folder
+
+        for (int i = 0; i < audioFiles.size(); ++i)
+        {
+            summaries.getReference (i).sourceFile = audioFiles[i];
+            summaries.getReference (i).errorMessage = "Couldn't create the output folder";
+        }
+
+        return summaries;
+    }
+
+    AudioFormatManager formatManager;
+    formatManager.registerBasicFormats();
+
+    OwnedArray<Workspace> workspaces;
+
+    for (int i = 0; i < jmin (pool.getNumWorkers(), audioFiles.size()); ++i)
+        workspaces.add (new Workspace (fftOrder));
+
+    pool.parallelFor (audioFiles.size(), [&] (int item, int worker)
+    {
+        OvertoneDistribution distribution;
+        Summary summary = extract (audioFiles[item], formatManager, distribution, *workspaces[worker]);
+
+        if (summary.succeeded)
+        {
+            const File outputFile = outputFolder.getChildFile (audioFiles[item].getFileNameWithoutExtension() + ".dismal");
+
+            if (outputFile.existsAsFile() && ! overwrite)
+            {
+                summary.succeeded = false;
+                summary.errorMessage = "The output file already exists";
+            }
+            else
+            {
+                FileIO fileIO (outputFile);
+                fileIO.saveToFile (distribution, overwrite);
+
+                summary.outputFile = outputFile;
+                summary.succeeded = outputFile.existsAsFile();
+
+                if (! summary.succeeded)
+                    summary.errorMessage = "Failed to write the output file";
+            }
+        }
+
+        summaries.getReference (item) = summary;
+
+        if (onFileProcessed != nullptr)
+            onFileProcessed (summary);
+    });
+
+    return summaries;
+}
+
+//==============================================================================
+
+
+TimbreExtractor::Summary TimbreExtractor::extract (const File& audioFile,
+                                                   AudioFormatManager& formatManager,
+                                                   OvertoneDistribution& distribution,
+                                                   Workspace& workspace) const
+{
+    Summary summary;
+    summary.sourceFile = audioFile;
+
+    std::unique_ptr<AudioFormatReader> reader (formatManager.createReaderFor (audioFile));
+
+    if (reader == nullptr)
+    {
+        summary.errorMessage = "The file couldn't be read as audio";
+        return summary;
+    }
+
+    const double sampleRate = reader->sampleRate;
+    int64 startSample = (int64) (analysisSegment.getStart() * sampleRate);
+
+    // Recordings shorter than the attack offset are analysed from the start
+    if (startSample >= reader->lengthInSamples)
+        startSample = 0;
+
+    const int numSamples = (int) jmin ((int64) (analysisSegment.getLength() * sampleRate),
+                                       reader->lengthInSamples - startSample);
+
+    if (numSamples <= 0 || reader->numChannels == 0)
+    {
+        summary.errorMessage = "The file contains no audio";
+        return summary;
+    }
+
+    const int numChannels = (int) reader->numChannels;
+
+    workspace.audio.setSize (numChannels, numSamples, false, false, true);
+    reader->read (&workspace.audio, 0, numSamples, startSample, true, true);
+
+    // Mix down to mono
+    for (int channel = 1; channel < numChannels; ++channel)
+        workspace.audio.addFrom (0, 0, workspace.audio, channel, 0, numSamples);
+
+    if (numChannels > 1)
+        FloatVectorOperations::multiply (workspace.audio.getWritePointer (0), 1.0f / numChannels, numSamples);
+
+    workspace.analyser.reset();
+    workspace.analyser.addSignal (workspace.audio.getReadPointer (0), numSamples);
+
+    // Keep more peaks than partials, as some won't belong to the harmonic series
+    Array<SpectrumAnalyser::Peak>& peaks = workspace.peaks;
+    workspace.analyser.findPeaks (sampleRate, peakThreshold, maxNumPartials * 4, peaks);
+
+    const float baseFreq = estimateFundamental (peaks);
+
+    if (baseFreq <= 0)
+    {
+        summary.errorMessage = "No fundamental was found in the fundamental range";
+        return summary;
+    }
+
+    const float inharmonicity = partialModel == harmonic ? estimateInharmonicity (peaks, baseFreq) : 0;
+
+    // Use the measured first partial as the fundamental, if there is one.
+    // Otherwise, amplitudes are relative to the loudest peak.
+    int fundamentalPeak = -1;
+    int loudestPeak = 0;
+
+    for (int i = 0; i < peaks.size(); ++i)
+    {
+        if (peaks[i].amp > peaks[loudestPeak].amp)
+            loudestPeak = i;
+
+        if (findHarmonicNumber (peaks[i].freq, baseFreq, inharmonicity) == 1
+            && (fundamentalPeak < 0 || peaks[i].amp > peaks[fundamentalPeak].amp))
+            fundamentalPeak = i;
+    }
+
+    const float fundamentalFreq = fundamentalPeak >= 0 ? peaks[fundamentalPeak].freq
+                                                       : baseFreq * std::sqrt (1 + inharmonicity);
+    const float fundamentalAmp = fundamentalPeak >= 0 ? peaks[fundamentalPeak].amp
+                                                      : peaks[loudestPeak].amp;
+
+    // Collect candidate overtones. For the harmonic model, only the loudest peak on each harmonic is kept.
+    Array<SpectrumAnalyser::Peak> overtones;
+    Array<int> harmonicNumbers;
+
+    for (int i = 0; i < peaks.size(); ++i)
+    {
+        if (i == fundamentalPeak)
+            continue;
+
+        if (partialModel == harmonic)
+        {
+            const int n = findHarmonicNumber (peaks[i].freq, baseFreq, inharmonicity);
+
+            if (n < 2)
+                continue;
+
+            const int existing = harmonicNumbers.indexOf (n);
+
+            if (existing >= 0)
+            {
+                if (peaks[i].amp > overtones[existing].amp)
+                    overtones.set (existing, peaks[i]);
+
+                continue;
+            }
+
+            harmonicNumbers.add (n);
+        }
+
+        overtones.add (peaks[i]);
+    }
+
+    std::sort (overtones.begin(), overtones.end(),
+               [] (const SpectrumAnalyser::Peak& a, const SpectrumAnalyser::Peak& b) { return a.amp > b.amp; });
+
+    distribution.clearPartials();
+    distribution.setDistributionName (audioFile.getFileNameWithoutExtension());
+    distribution.setMinInterval (1);
+    distribution.setFundamental (fundamentalFreq, fundamentalAmp);
+
+    for (int i = 0; i < overtones.size() && distribution.numPartials() < maxNumPartials; ++i)
+    {
+        const float freqRatio = overtones[i].freq / fundamentalFreq;
+        const float ampRatio = overtones[i].amp / fundamentalAmp;
+
+        if (std::abs (freqRatio - 1) > 1.0e-4f && ampRatio > 0)
+            distribution.addPartial (freqRatio, ampRatio);
+    }
+
+    if (distribution.numPartials() == 0)
+    {
+        summary.errorMessage = "No overtones were found above the peak threshold";
+        return summary;
+    }
+
+    summary.succeeded = true;
+    summary.fundamentalFreq = fundamentalFreq;
+    summary.inharmonicity = inharmonicity;
+    summary.numPartials = distribution.numPartials();
+
+    return summary;
+}
+
+//==============================================================================
+
+
+float TimbreExtractor::estimateFundamental (const Array<SpectrumAnalyser::Peak>& peaks) const
+{
+    // Candidates are the loudest peaks and their first few subharmonics, which allows for missing fundamentals
+    Array<SpectrumAnalyser::Peak> loudest (peaks);
+
+    std::sort (loudest.begin(), loudest.end(),
+               [] (const SpectrumAnalyser::Peak& a, const SpectrumAnalyser::Peak& b) { return a.amp > b.amp; });
+
+    float bestFreq = 0;
+    float bestScore = 0;
+
+    for (int i = 0; i < jmin (10, loudest.size()); ++i)
+    {
+        for (int divisor = 1; divisor <= 4; ++divisor)
+        {
+            const float candidate = loudest[i].freq / divisor;
+
+            if (! fundamentalRange.contains (candidate))
+                continue;
+
+            // Weighting matches by 1 / sqrt (n) favours the true fundamental over its subharmonics
+            float score = 0;
+
+            for (auto& peak : peaks)
+            {
+                const int n = findHarmonicNumber (peak.freq, candidate, 0);
+
+                if (n > 0)
+                    score += peak.amp / std::sqrt ((float) n);
+            }
+
+            if (score > bestScore)
+            {
+                bestScore = score;
+                bestFreq = candidate;
+            }
+        }
+    }
+
+    return bestFreq;
+}
+
+int TimbreExtractor::findHarmonicNumber (float freq, float fundamentalFreq, float inharmonicity) const
+{
+    // Stretched partials lie above their harmonic positions, so only a few lower harmonic numbers need checking
+    const int nearest = jmax (1, roundToInt (freq / fundamentalFreq));
+    int bestHarmonic = 0;
+    float bestDistance = harmonicTolerance;
+
+    for (int n = jmax (1, nearest - 3); n <= nearest + 1; ++n)
+    {
+        const float harmonicFreq = n * fundamentalFreq * std::sqrt (1 + inharmonicity * n * n);
+        const float distance = std::abs (1200 * std::log2 (freq / harmonicFreq));
+
+        if (distance <= bestDistance)
+        {
+            bestDistance = distance;
+            bestHarmonic = n;
+        }
+    }
+
+    return bestHarmonic;
+}
+
+float TimbreExtractor::estimateInharmonicity (const Array<SpectrumAnalyser::Peak>& peaks, float fundamentalFreq) const
+{
+    // Least-squares fit of (f_n / nf_0)^2 - 1 = Bn^2, repeated so that the fitted series can pick up
+    // higher partials that lie outside the tolerance of an unstretched series
+    float inharmonicity = 0;
+
+    for (int iteration = 0; iteration < 3; ++iteration)
+    {
+        double sumXY = 0;
+        double sumXX = 0;
+
+        for (auto& peak : peaks)
+        {
+            const int n = findHarmonicNumber (peak.freq, fundamentalFreq, inharmonicity);
+
+            if (n < 2)
+                continue;
+
+            const double x = (double) n * n;
+            const double y = square (peak.freq / (n * fundamentalFreq)) - 1.0;
+
+            sumXY += x * y;
+            sumXX += x * x;
+        }
+
+        if (sumXX <= 0)
+            break;
+
+        inharmonicity = (float) jmax (0.0, sumXY / sumXX);
+    }
+
+    return inharmonicity;
+}
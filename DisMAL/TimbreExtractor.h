@@ -0,0 +1,175 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "OvertoneDistribution.h"
+#include "SpectrumAnalyser.h"
+#include "WorkerPool.h"
+#include "FileIO.h"
+
+/** Extracts overtone distributions from recordings of single notes.
+
+    For each audio file, a segment of the recording is read (skipping the attack, by default), its averaged spectrum is analysed with a SpectrumAnalyser, and the fundamental is estimated from the spectral peaks. The peaks are then converted into an OvertoneDistribution whose partials have frequency and amplitude ratios relative to the fundamental.
+
+    Two partial models are available:
+
+    - harmonic: a stiff-string harmonic series \f$f_n = nf_0\sqrt{1+Bn^2}\f$ is fitted to the peaks, and only peaks that lie on the fitted series are kept. This suits strings, winds and voices.
+    - inharmonic: every peak above the threshold is kept. This suits bells, bars and other inharmonic sounds.
+
+    Many files can be processed in parallel with processFiles. Memory use is bounded by the number of workers in the WorkerPool, as each worker reads at most the analysis segment of one file at a time, and extracted distributions are written to '.dismal' files through FileIO rather than being kept in memory.
+*/
+class TimbreExtractor
+{
+public:
+    //==============================================================================
+    /** Flags for choosing how peaks are turned into partials. */
+    enum PartialModel
+    {
+        harmonic = 0,
+        inharmonic
+    };
+
+    /** A summary of the extraction of a single file. */
+    struct Summary
+    {
+        File sourceFile;            /**< The audio file that was analysed. */
+        File outputFile;            /**< The '.dismal' file that was written, if any. */
+        bool succeeded = false;     /**< True if a distribution was extracted (and, for processFiles, written). */
+        String errorMessage;        /**< Describes why the extraction failed. */
+        float fundamentalFreq = 0;  /**< The estimated fundamental frequency in Hz. */
+        float inharmonicity = 0;    /**< The estimated inharmonicity coefficient, \f$B\f$. This is 0 for the inharmonic model. */
+        int numPartials = 0;        /**< The number of overtones in the extracted distribution. */
+    };
+
+    //==============================================================================
+    /** Creates a TimbreExtractor object with default analysis settings. */
+    TimbreExtractor();
+
+    /** Destructor. */
+    ~TimbreExtractor();
+
+    //==============================================================================
+    /** Sets the base 2 logarithm of the FFT frame size. The default of 14 gives frames of 16384 samples. */
+    void setFFTOrder (int newFFTOrder);
+
+    /** Returns the base 2 logarithm of the FFT frame size. */
+    int getFFTOrder() const noexcept;
+
+    /** Sets the segment of each recording to analyse.
+
+        @param startSeconds The time from the start of the file at which analysis begins. This is used to skip the attack of a note.
+        @param lengthSeconds The length of the analysed segment. This bounds the amount of audio held in memory per file.
+    */
+    void setAnalysisSegment (double startSeconds, double lengthSeconds);
+
+    /** Returns the start time and length of the analysed segment, in seconds. */
+    Range<double> getAnalysisSegment() const noexcept;
+
+    /** Sets how far below the loudest peak (in decibels) a peak can be and still become a partial. */
+    void setPeakThreshold (float newThresholdDb);
+
+    /** Returns the peak threshold in decibels. */
+    float getPeakThreshold() const noexcept;
+
+    /** Sets the maximum number of overtones in an extracted distribution. */
+    void setMaxNumPartials (int newMaxNumPartials);
+
+    /** Returns the maximum number of overtones in an extracted distribution. */
+    int getMaxNumPartials() const noexcept;
+
+    /** Sets how peaks are turned into partials.
+
+        @see PartialModel
+    */
+    void setPartialModel (PartialModel newPartialModel) noexcept;
+
+    /** Returns the partial model. */
+    PartialModel getPartialModel() const noexcept;
+
+    /** Sets how far (in cents) a peak can lie from a harmonic and still be considered part of the harmonic series. */
+    void setHarmonicTolerance (float newToleranceCents);
+
+    /** Returns the harmonic tolerance in cents. */
+    float getHarmonicTolerance() const noexcept;
+
+    /** Sets the range of frequencies in which the fundamental is searched for. */
+    void setFundamentalRange (float lowestFreq, float highestFreq);
+
+    /** Returns the range of frequencies in which the fundamental is searched for. */
+    Range<float> getFundamentalRange() const noexcept;
+
+    //==============================================================================
+    /** Extracts an overtone distribution from an audio file.
+
+        The distribution's fundamental is set to the estimated fundamental frequency and amplitude, and its name is set to the file name.
+
+        @param audioFile The recording of a single note.
+        @param formatManager The format manager used to read the file. Its formats must be registered.
+        @param distribution The distribution to fill. Existing partials are cleared.
+        @return A summary of the extraction. No output file is written.
+    */
+    Summary extract (const File& audioFile,
+                     AudioFormatManager& formatManager,
+                     OvertoneDistribution& distribution) const;
+
+    /** Extracts overtone distributions from many audio files in parallel, saving each one to a '.dismal' file.
+
+        @param audioFiles The recordings to analyse.
+        @param outputFolder The folder in which to save the distributions. Each file is named after its recording.
+        @param pool The worker pool used to process files in parallel.
+        @param overwrite Set to true to overwrite existing '.dismal' files.
+        @param onFileProcessed If set, this is called after each file is processed. It is called from the worker threads.
+        @return A summary for each file, in the same order as audioFiles.
+    */
+    Array<Summary> processFiles (const Array<File>& audioFiles,
+                                 const File& outputFolder,
+                                 WorkerPool& pool,
+                                 bool overwrite = false,
+                                 std::function<void (const Summary&)> onFileProcessed = nullptr) const;
+
+private:
+    //==============================================================================
+    int fftOrder, maxNumPartials;
+    Range<double> analysisSegment;
+    float peakThreshold, harmonicTolerance;
+    Range<float> fundamentalRange;
+    PartialModel partialModel;
+
+    /** Scratch memory for a single worker, reused for every file the worker processes. */
+    struct Workspace
+    {
+        Workspace (int fftOrder)   : analyser (fftOrder) {}
+
+        SpectrumAnalyser analyser;
+        AudioBuffer<float> audio;
+        Array<SpectrumAnalyser::Peak> peaks;
+    };
+
+    //==============================================================================
+    /** Reads, analyses and converts a single file using a worker's scratch memory. */
+    Summary extract (const File& audioFile,
+                     AudioFormatManager& formatManager,
+                     OvertoneDistribution& distribution,
+                     Workspace& workspace) const;
+
+    /** Returns the fundamental frequency that best explains a set of peaks as a harmonic series, or 0 if none is found. */
+    float estimateFundamental (const Array<SpectrumAnalyser::Peak>& peaks) const;
+
+    /** Returns the harmonic number of a frequency in a stretched harmonic series, or 0 if it is not within the harmonic tolerance of one. */
+    int findHarmonicNumber (float freq, float fundamentalFreq, float inharmonicity) const;
+
+    /** Fits the inharmonicity coefficient of a stretched harmonic series to a set of peaks. */
+    float estimateInharmonicity (const Array<SpectrumAnalyser::Peak>& peaks, float fundamentalFreq) const;
+};
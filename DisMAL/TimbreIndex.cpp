@@ -0,0 +1,311 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "TimbreIndex.h"
+
+namespace
+{
+    const int timbreIndexMagic = 0x49544d44;     // "DMTI"
+    const int timbreIndexVersion = 1;
+
+    /** Orders matches so that std::push_heap and std::pop_heap keep the furthest match at the front. */
+    bool isCloser (const TimbreIndex::Match& first, const TimbreIndex::Match& second) noexcept
+    {
+        return first.distance < second.distance;
+    }
+}
+
+TimbreIndex::TimbreIndex()
+{
+    static_assert (numFeatures >= numBands + 2, "Feature vectors must hold all bands, the inharmonicity and the centroid");
+    static_assert (numFeatures % 8 == 0, "Feature vectors must be a multiple of the largest SIMD register size");
+
+    numVectors = 0;
+    capacity = 0;
+}
+
+TimbreIndex::~TimbreIndex()
+{
+}
+
+//==============================================================================
+
+
+void TimbreIndex::computeFeatures (const OvertoneDistribution& distribution, float* output)
+{
+    FloatVectorOperations::clear (output, numFeatures);
+
+    const float bandsPerOctave = numBands / 6.0f;
+
+    // The fundamental has ratios of 1, and lies at the bottom of the first band
+    float* bands = output;
+    float totalEnergy = 1;
+    float totalAmp = 1;
+    float weightedDeviation = 0;
+    float weightedLogRatio = 0;
+
+    bands[0] = 1;
+
+    for (int p = 0; p < distribution.numPartials(); ++p)
+    {
+        if (distribution.partialIsMuted (p))
+            continue;
+
+        const float ratio = distribution.getFreqRatio (p);
+        const float amp = distribution.getAmpRatio (p);
+
+        if (ratio <= 0 || amp <= 0)
+            continue;
+
+        const float octaves = std::log2 (ratio);
+        const int band = (int) std::floor (octaves * bandsPerOctave);
+
+        if (isPositiveAndBelow (band, numBands))
+        {
+            bands[band] += amp * amp;
+            totalEnergy += amp * amp;
+        }
+
+        // Relative distance from the nearest harmonic, |r - n| / n, divided by its largest possible value of 0.5 / n, so a partial halfway between two harmonics scores 1 whatever its harmonic number.
+        // Partials below the fundamental are measured against it and count as at most halfway.
+        const float harmonic = jmax (1.0f, std::round (ratio));
+
+        weightedDeviation += amp * jmin (1.0f, 2 * std::abs (ratio - harmonic));
+        weightedLogRatio += amp * octaves;
+        totalAmp += amp;
+    }
+
+    for (int b = 0; b < numBands; ++b)
+        bands[b] = std::sqrt (bands[b] / totalEnergy);
+
+    output[numBands] = weightedDeviation / totalAmp;
+    output[numBands + 1] = weightedLogRatio / (totalAmp * 6);
+}
+
+//==============================================================================
+
+
+int TimbreIndex::add (const OvertoneDistribution& distribution)
+{
+    ensureCapacity (numVectors + 1);
+
+    computeFeatures (distribution, features + numVectors * numFeatures);
+    names.add (distribution.getName());
+
+    return numVectors++;
+}
+
+void TimbreIndex::addAll (const OwnedArray<OvertoneDistribution>& distributions, WorkerPool& pool)
+{
+    const int firstIndex = numVectors;
+
+    ensureCapacity (numVectors + distributions.size());
+
+    for (auto* distribution : distributions)
+        names.add (distribution->getName());
+
+    pool.parallelFor (distributions.size(), [&] (int item, int)
+    {
+        computeFeatures (*distributions[item], features + (firstIndex + item) * numFeatures);
+    });
+
+    numVectors += distributions.size();
+}
+
+void TimbreIndex::clear()
+{
+    storage.free();
+    features = nullptr;
+    numVectors = 0;
+    capacity = 0;
+    names.clear();
+}
+
+int TimbreIndex::size() const noexcept
+{
+    return numVectors;
+}
+
+String TimbreIndex::getName (int index) const
+{
+    return names[index];
+}
+
+const float* TimbreIndex::getFeatures (int index) const
+{
+    jassert (isPositiveAndBelow (index, numVectors));
+
+    return features + index * numFeatures;
+}
+
+//==============================================================================
+
+
+Array<TimbreIndex::Match> TimbreIndex::findNearest (const OvertoneDistribution& target, int numResults, WorkerPool* pool) const
+{
+    float targetFeatures[numFeatures];
+    computeFeatures (target, targetFeatures);
+
+    return findNearest (targetFeatures, numResults, pool);
+}
+
+Array<TimbreIndex::Match> TimbreIndex::findNearest (const float* targetFeatures, int numResults, WorkerPool* pool) const
+{
+    Array<Match> matches;
+
+    if (numResults <= 0 || numVectors == 0)
+        return matches;
+
+    // SIMD loads need an aligned copy of the target
+    alignas (32) float target[numFeatures];
+    FloatVectorOperations::copy (target, targetFeatures, numFeatures);
+
+    const int chunkSize = 4096;
+    const int numChunks = (numVectors + chunkSize - 1) / chunkSize;
+    std::vector<Match> closest;
+
+    if (pool == nullptr || numChunks == 1)
+    {
+        closest.reserve ((size_t) numResults);
+        scan (target, 0, numVectors, numResults, closest);
+    }
+    else
+    {
+        // Each worker keeps its own heap, and the heaps are merged once the scan is done
+        std::vector<std::vector<Match>> heaps ((size_t) pool->getNumWorkers());
+
+        for (auto& heap : heaps)
+            heap.reserve ((size_t) numResults);
+
+        pool->parallelFor (numChunks, [&] (int chunk, int worker)
+        {
+            scan (target, chunk * chunkSize, jmin (numVectors, (chunk + 1) * chunkSize), numResults, heaps[(size_t) worker]);
+        });
+
+        for (auto& heap : heaps)
+            closest.insert (closest.end(), heap.begin(), heap.end());
+    }
+
+    std::sort (closest.begin(), closest.end(), isCloser);
+
+    for (size_t i = 0; i < closest.size() && i < (size_t) numResults; ++i)
+        matches.add (closest[i]);
+
+    return matches;
+}
+
+//==============================================================================
+
+
+void TimbreIndex::writeToStream (OutputStream& output) const
+{
+    output.writeInt (timbreIndexMagic);
+    output.writeInt (timbreIndexVersion);
+    output.writeInt (numFeatures);
+    output.writeInt (numVectors);
+
+    for (int i = 0; i < numVectors; ++i)
+        output.writeString (names[i]);
+
+    if (numVectors > 0)
+        output.write (features, sizeof (float) * (size_t) (numVectors * numFeatures));
+}
+
+bool TimbreIndex::readFromStream (InputStream& input)
+{
+    clear();
+
+    if (input.readInt() != timbreIndexMagic
+        || input.readInt() != timbreIndexVersion
+        || input.readInt() != numFeatures)
+    {
+        jassertfalse;       // Not a TimbreIndex, or written by an incompatible version
+        return false;
+    }
+
+    const int numToRead = input.readInt();
+
+    if (numToRead < 0)
+        return false;
+
+    ensureCapacity (numToRead);
+
+    for (int i = 0; i < numToRead; ++i)
+        names.add (input.readString());
+
+    const int numBytes = (int) sizeof (float) * numToRead * numFeatures;
+
+    if (numToRead > 0 && input.read (features, numBytes) != numBytes)
+    {
+        clear();
+        return false;
+    }
+
+    numVectors = numToRead;
+
+    return true;
+}
+
+//==============================================================================
+
+
+void TimbreIndex::ensureCapacity (int numVectorsNeeded)
+{
+    if (numVectorsNeeded <= capacity)
+        return;
+
+    const int newCapacity = jmax (numVectorsNeeded, capacity * 2, 64);
+
+    HeapBlock<float> newStorage;
+    newStorage.calloc ((size_t) (newCapacity * numFeatures) + SIMDFloat::size());
+
+    float* newFeatures = SIMDFloat::getNextSIMDAlignedPtr (newStorage.get());
+
+    if (numVectors > 0)
+        FloatVectorOperations::copy (newFeatures, features, numVectors * numFeatures);
+
+    storage = std::move (newStorage);
+    features = newFeatures;
+    capacity = newCapacity;
+}
+
+void TimbreIndex::scan (const float* target, int startIndex, int endIndex, int numResults, std::vector<Match>& heap) const
+{
+    const int laneWidth = (int) SIMDFloat::size();
+
+    for (int i = startIndex; i < endIndex; ++i)
+    {
+        const float* vector = features + i * numFeatures;
+        SIMDFloat sum = SIMDFloat::expand (0);
+
+        for (int f = 0; f < numFeatures; f += laneWidth)
+        {
+            const SIMDFloat difference = SIMDFloat::fromRawArray (vector + f) - SIMDFloat::fromRawArray (target + f);
+            sum += difference * difference;
+        }
+
+        const float distance = sum.sum();
+
+        if ((int) heap.size() < numResults)
+        {
+            heap.push_back ({ i, distance });
+            std::push_heap (heap.begin(), heap.end(), isCloser);
+        }
+        else if (distance < heap.front().distance)
+        {
+            std::pop_heap (heap.begin(), heap.end(), isCloser);
+            heap.back() = { i, distance };
+            std::push_heap (heap.begin(), heap.end(), isCloser);
+        }
+    }
+}
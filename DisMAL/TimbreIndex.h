@@ -0,0 +1,129 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "OvertoneDistribution.h"
+#include "WorkerPool.h"
+
+/** A similarity index over a library of overtone distributions.
+
+    Each distribution is summarised by a fixed-length feature vector, which makes it possible to find the timbres in a large library that most resemble a target without loading or comparing the distributions themselves. The features are:
+
+    - The energy of the partials in numBands log-frequency bands spanning six octaves above the fundamental, normalised so that the bands have unit length.
+    - The inharmonicity of the distribution: the amplitude-weighted mean distance of its partials from the nearest harmonic, relative to the spacing of the harmonics around them.
+    - The spectral centroid: the amplitude-weighted mean of the partials' log frequency ratios.
+
+    The vectors of all indexed distributions are stored contiguously in SIMD-aligned memory, and queries are answered with an exhaustive SIMD scan of squared Euclidean distances. Scans over large libraries can be split between the workers of a WorkerPool.
+*/
+class TimbreIndex
+{
+public:
+    //==============================================================================
+    /** The number of log-frequency energy bands (four per octave). */
+    static constexpr int numBands = 24;
+
+    /** The number of floats in each stored feature vector. Bands are followed by the inharmonicity and centroid, then zeros that pad the vector to a multiple of the SIMD register size. */
+    static constexpr int numFeatures = 32;
+
+    /** A distribution found by a query. */
+    struct Match
+    {
+        int index;          /**< The index of the distribution in the TimbreIndex. */
+        float distance;     /**< The squared Euclidean distance between the distribution's features and the target's. */
+    };
+
+    //==============================================================================
+    /** Creates an empty TimbreIndex object. */
+    TimbreIndex();
+
+    /** Destructor. */
+    ~TimbreIndex();
+
+    //==============================================================================
+    /** Computes the feature vector of an overtone distribution.
+
+        Only the distribution's frequency and amplitude ratios are used, so the result doesn't depend on its fundamental.
+
+        @param distribution The distribution to summarise.
+        @param features An array of numFeatures floats to fill.
+    */
+    static void computeFeatures (const OvertoneDistribution& distribution, float* features);
+
+    //==============================================================================
+    /** Adds a distribution to the index and returns its index. */
+    int add (const OvertoneDistribution& distribution);
+
+    /** Adds many distributions to the index, computing their features in parallel. */
+    void addAll (const OwnedArray<OvertoneDistribution>& distributions, WorkerPool& pool);
+
+    /** Removes all distributions from the index. */
+    void clear();
+
+    /** Returns the number of indexed distributions. */
+    int size() const noexcept;
+
+    /** Returns the name of an indexed distribution. */
+    String getName (int index) const;
+
+    /** Returns a pointer to the stored feature vector of an indexed distribution. */
+    const float* getFeatures (int index) const;
+
+    //==============================================================================
+    /** Returns the indexed distributions that most resemble a target distribution.
+
+        @param target The distribution to compare against.
+        @param numResults The maximum number of matches to return.
+        @param pool If set, the scan is split between the pool's workers.
+        @return Matches in order of increasing distance.
+    */
+    Array<Match> findNearest (const OvertoneDistribution& target, int numResults, WorkerPool* pool = nullptr) const;
+
+    /** Returns the indexed distributions whose features are closest to a feature vector.
+
+        @param targetFeatures An array of numFeatures floats, as produced by computeFeatures.
+        @param numResults The maximum number of matches to return.
+        @param pool If set, the scan is split between the pool's workers.
+        @return Matches in order of increasing distance.
+    */
+    Array<Match> findNearest (const float* targetFeatures, int numResults, WorkerPool* pool = nullptr) const;
+
+    //==============================================================================
+    /** Writes the names and feature vectors of the index to a stream. */
+    void writeToStream (OutputStream& output) const;
+
+    /** Replaces the contents of the index with data written by writeToStream.
+
+        @return True if the data was read successfully. Otherwise, the index is left empty.
+    */
+    bool readFromStream (InputStream& input);
+
+private:
+    //==============================================================================
+    typedef dsp::SIMDRegister<float> SIMDFloat;
+
+    HeapBlock<float> storage;
+    float* features = nullptr;
+    int numVectors, capacity;
+    StringArray names;
+
+    //==============================================================================
+    /** Grows the aligned feature storage so that it can hold at least this many vectors. */
+    void ensureCapacity (int numVectorsNeeded);
+
+    /** Scans a range of vectors, keeping the closest numResults of them in a max-heap ordered by distance. */
+    void scan (const float* targetFeatures, int startIndex, int endIndex, int numResults, std::vector<Match>& heap) const;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TimbreIndex)
+};
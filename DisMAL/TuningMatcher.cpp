@@ -0,0 +1,277 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "TuningMatcher.h"
+
+TuningMatcher::TuningMatcher()
+{
+    totalWeight = 0;
+    toleranceCents = 10;
+}
+
+TuningMatcher::~TuningMatcher()
+{
+}
+
+//==============================================================================
+
+
+void TuningMatcher::setTunings (const OwnedArray<TuningSystem>& tunings, float maximumRatio)
+{
+    jassert (maximumRatio > 1);         // Ratios must be above the tonic
+
+    tuningCents.clearQuick();
+    firstNoteOfTuning.clearQuick();
+    tuningNames.clear();
+
+    const float maximumCents = ratioToCents (jmax (1.0f, maximumRatio));
+    Array<float> scale;
+
+    for (auto* tuning : tunings)
+    {
+        firstNoteOfTuning.add (tuningCents.size());
+        tuningNames.add (tuning->getName());
+
+        // numNotes includes the tonic, which isn't stored as an interval
+        scale.clearQuick();
+        scale.add (0);
+
+        for (int i = 0; i < tuning->numNotes() - 1; ++i)
+        {
+            if (tuning->getFreqRatio (i) > 0)
+                scale.add (ratioToCents (tuning->getFreqRatio (i)));
+        }
+
+        const float repeatCents = tuning->getRepeatRatio() > 1 ? ratioToCents (tuning->getRepeatRatio()) : 0;
+        const int firstNote = tuningCents.size();
+
+        for (float offset = 0; offset <= maximumCents; offset += repeatCents)
+        {
+            for (auto cents : scale)
+            {
+                if (offset + cents <= maximumCents)
+                    tuningCents.add (offset + cents);
+            }
+
+            if (repeatCents <= 0)
+                break;
+        }
+
+        std::sort (tuningCents.begin() + firstNote, tuningCents.end());
+    }
+
+    firstNoteOfTuning.add (tuningCents.size());
+}
+
+int TuningMatcher::numTunings() const noexcept
+{
+    return tuningNames.size();
+}
+
+String TuningMatcher::getTuningName (int tuningIndex) const
+{
+    return tuningNames[tuningIndex];
+}
+
+//==============================================================================
+
+
+void TuningMatcher::setMinima (const Array<float>& ratios, const Array<float>& weights)
+{
+    jassert (weights.isEmpty() || weights.size() == ratios.size());     // There must be a weight for every minimum
+
+    minimaCents.clearQuick();
+    minimaWeights.clearQuick();
+
+    for (int i = 0; i < ratios.size(); ++i)
+    {
+        if (ratios[i] > 0)
+        {
+            minimaCents.add (ratioToCents (ratios[i]));
+            minimaWeights.add (weights.isEmpty() ? 1.0f : jmax (0.0f, weights[i]));
+        }
+    }
+
+    sortMinima();
+}
+
+void TuningMatcher::setMinimaFromFrequencies (const Array<float>& minimaFreqs, float referenceFreq)
+{
+    jassert (referenceFreq > 0);        // Frequencies must be positive
+
+    Array<float> ratios;
+
+    for (auto freq : minimaFreqs)
+        ratios.add (freq / referenceFreq);
+
+    setMinima (ratios);
+}
+
+void TuningMatcher::setMinima (const Array<ConsonanceIndex::Minimum>& minima)
+{
+    Array<float> ratios, weights;
+
+    for (auto& minimum : minima)
+    {
+        ratios.add (minimum.ratio);
+        weights.add (minimum.relativeDepth);
+    }
+
+    setMinima (ratios, weights);
+}
+
+int TuningMatcher::numMinima() const noexcept
+{
+    return minimaCents.size();
+}
+
+void TuningMatcher::setTolerance (float newToleranceCents)
+{
+    jassert (newToleranceCents > 0);
+
+    toleranceCents = jmax (0.01f, newToleranceCents);
+}
+
+float TuningMatcher::getTolerance() const noexcept
+{
+    return toleranceCents;
+}
+
+//==============================================================================
+
+
+Array<TuningMatcher::Match> TuningMatcher::findBestTunings (WorkerPool& pool, int maxResults) const
+{
+    Array<Match> matches;
+    matches.resize (numTunings());
+
+    // Tunings are cheap to score, so they're handed to workers in chunks
+    const int chunkSize = 256;
+    const int numChunks = (numTunings() + chunkSize - 1) / chunkSize;
+
+    pool.parallelFor (numChunks, [&] (int chunk, int)
+    {
+        for (int t = chunk * chunkSize; t < jmin (numTunings(), (chunk + 1) * chunkSize); ++t)
+            matches.getReference (t) = scoreTuning (t);
+    });
+
+    std::sort (matches.begin(), matches.end(),
+               [] (const Match& a, const Match& b) { return a.score > b.score; });
+
+    if (matches.size() > maxResults)
+        matches.resize (jmax (0, maxResults));
+
+    return matches;
+}
+
+TuningMatcher::Match TuningMatcher::scoreTuning (int tuningIndex) const
+{
+    Match match;
+    match.tuningIndex = tuningIndex;
+    match.score = 0;
+    match.coverage = 0;
+    match.precision = 0;
+    match.numMatchedMinima = 0;
+    match.meanErrorCents = 0;
+
+    if (! isPositiveAndBelow (tuningIndex, numTunings()) || minimaCents.isEmpty() || totalWeight <= 0)
+        return match;
+
+    const float* notes = tuningCents.getRawDataPointer() + firstNoteOfTuning[tuningIndex];
+    const int numNotes = firstNoteOfTuning[tuningIndex + 1] - firstNoteOfTuning[tuningIndex];
+    const float* minima = minimaCents.getRawDataPointer();
+    const int numMinimaToMatch = minimaCents.size();
+
+    // Coverage: merge the minima into the notes, checking the notes within the tolerance window of each minimum
+    float matchedWeight = 0;
+    float totalError = 0;
+
+    for (int m = 0, n = 0; m < numMinimaToMatch; ++m)
+    {
+        while (n < numNotes && notes[n] < minima[m] - toleranceCents)
+            ++n;
+
+        float nearest = toleranceCents;
+
+        for (int i = n; i < numNotes && notes[i] <= minima[m] + toleranceCents; ++i)
+            nearest = jmin (nearest, std::abs (notes[i] - minima[m]));
+
+        if (nearest < toleranceCents)
+        {
+            matchedWeight += minimaWeights[m] * (1 - nearest / toleranceCents);
+            totalError += nearest;
+            ++match.numMatchedMinima;
+        }
+    }
+
+    // Precision: merge the notes within the range of the minima into the minima
+    const float lowest = minima[0] - toleranceCents;
+    const float highest = minima[numMinimaToMatch - 1] + toleranceCents;
+    int notesInRange = 0;
+    int notesMatched = 0;
+
+    for (int n = 0, m = 0; n < numNotes && notes[n] <= highest; ++n)
+    {
+        if (notes[n] < lowest)
+            continue;
+
+        ++notesInRange;
+
+        while (m < numMinimaToMatch && minima[m] < notes[n] - toleranceCents)
+            ++m;
+
+        if (m < numMinimaToMatch && minima[m] <= notes[n] + toleranceCents)
+            ++notesMatched;
+    }
+
+    match.coverage = matchedWeight / totalWeight;
+    match.precision = notesInRange > 0 ? (float) notesMatched / notesInRange : 0;
+    match.meanErrorCents = match.numMatchedMinima > 0 ? totalError / match.numMatchedMinima : 0;
+
+    if (match.coverage + match.precision > 0)
+        match.score = 2 * match.coverage * match.precision / (match.coverage + match.precision);
+
+    return match;
+}
+
+//==============================================================================
+
+
+float TuningMatcher::ratioToCents (float ratio)
+{
+    return 1200 * std::log2 (ratio);
+}
+
+void TuningMatcher::sortMinima()
+{
+    Array<int> order;
+
+    for (int i = 0; i < minimaCents.size(); ++i)
+        order.add (i);
+
+    std::sort (order.begin(), order.end(),
+               [this] (int a, int b) { return minimaCents[a] < minimaCents[b]; });
+
+    Array<float> sortedCents, sortedWeights;
+    totalWeight = 0;
+
+    for (auto i : order)
+    {
+        sortedCents.add (minimaCents[i]);
+        sortedWeights.add (minimaWeights[i]);
+        totalWeight += minimaWeights[i];
+    }
+
+    minimaCents.swapWith (sortedCents);
+    minimaWeights.swapWith (sortedWeights);
+}
@@ -0,0 +1,126 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+#include "TuningSystem.h"
+#include "ConsonanceIndex.h"
+#include "WorkerPool.h"
+
+/** Ranks a library of tuning systems by how well their intervals coincide with a timbre's dissonance minima.
+
+    Every tuning is stored as a sorted vector of cents above its tonic, including the tonic itself and the repetitions of its intervals at the repeat ratio, up to a maximum ratio. The timbre's minima are stored the same way, so a tuning can be scored with a single tolerance-windowed merge of the two vectors. No dissonance is recalculated per tuning.
+
+    A tuning's score combines two measures:
+
+    - Coverage: the weighted fraction of minima with a note of the tuning within the tolerance, where closer notes count for more.
+    - Precision: the fraction of the tuning's notes (within the range of the minima) that lie within the tolerance of a minimum.
+
+    The score is their harmonic mean, so a tuning needs to both cover the minima and avoid dissonant notes to rank highly. Tunings are scored in parallel with a WorkerPool.
+*/
+class TuningMatcher
+{
+public:
+    //==============================================================================
+    /** The result of scoring a tuning. */
+    struct Match
+    {
+        int tuningIndex;            /**< The index of the tuning in the array passed to setTunings. */
+        float score;                /**< The harmonic mean of coverage and precision, between 0 and 1. */
+        float coverage;             /**< The weighted, closeness-scaled fraction of minima matched by a note. */
+        float precision;            /**< The fraction of notes that lie near a minimum. */
+        int numMatchedMinima;       /**< The number of minima with a note within the tolerance. */
+        float meanErrorCents;       /**< The mean distance in cents between matched minima and their nearest notes. */
+    };
+
+    //==============================================================================
+    /** Creates an empty TuningMatcher object. */
+    TuningMatcher();
+
+    /** Destructor. */
+    ~TuningMatcher();
+
+    //==============================================================================
+    /** Sets the library of tunings to match against.
+
+        Each tuning's intervals are converted into sorted cents. If a tuning has a repeat ratio, its intervals are repeated at that ratio up to the maximum ratio.
+
+        @param tunings The tuning library.
+        @param maximumRatio The largest frequency ratio above the tonic at which notes are kept. This should cover the range of the minima.
+    */
+    void setTunings (const OwnedArray<TuningSystem>& tunings, float maximumRatio = 2.1f);
+
+    /** Returns the number of tunings in the library. */
+    int numTunings() const noexcept;
+
+    /** Returns the name of a tuning in the library. */
+    String getTuningName (int tuningIndex) const;
+
+    //==============================================================================
+    /** Sets the timbre's dissonance minima as frequency ratios.
+
+        @param ratios The frequency ratios of the minima.
+        @param weights The importance of each minimum, such as its depth. If empty, every minimum has a weight of 1.
+    */
+    void setMinima (const Array<float>& ratios, const Array<float>& weights = Array<float>());
+
+    /** Sets the timbre's dissonance minima from frequencies found by DissonanceCalc::optimize2D.
+
+        @param minimaFreqs The minima, as returned by DissonanceCalc::getOptimalFreqs.
+        @param referenceFreq The frequency of the fixed distribution in the 2D dissonance map, which becomes the tonic.
+    */
+    void setMinimaFromFrequencies (const Array<float>& minimaFreqs, float referenceFreq);
+
+    /** Sets the timbre's dissonance minima from a ConsonanceIndex, weighting each minimum by its relative depth. */
+    void setMinima (const Array<ConsonanceIndex::Minimum>& minima);
+
+    /** Returns the number of minima being matched. */
+    int numMinima() const noexcept;
+
+    /** Sets how far (in cents) a note can be from a minimum and still match it. */
+    void setTolerance (float newToleranceCents);
+
+    /** Returns the matching tolerance in cents. */
+    float getTolerance() const noexcept;
+
+    //==============================================================================
+    /** Scores every tuning against the minima.
+
+        @param pool The worker pool used to score tunings in parallel.
+        @param maxResults The maximum number of matches to return.
+        @return The best matches, ranked from highest to lowest score.
+    */
+    Array<Match> findBestTunings (WorkerPool& pool, int maxResults = 20) const;
+
+    /** Scores a single tuning against the minima. */
+    Match scoreTuning (int tuningIndex) const;
+
+private:
+    //==============================================================================
+    Array<float> tuningCents;
+    Array<int> firstNoteOfTuning;
+    StringArray tuningNames;
+
+    Array<float> minimaCents, minimaWeights;
+    float totalWeight, toleranceCents;
+
+    //==============================================================================
+    /** Converts a frequency ratio into cents. */
+    static float ratioToCents (float ratio);
+
+    /** Sorts the minima (and their weights) by cents. */
+    void sortMinima();
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (TuningMatcher)
+};
@@ -0,0 +1,77 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool (int numWorkersToUse)   : pool (jmax (1, numWorkersToUse)),
+                                                 numWorkers (jmax (1, numWorkersToUse))
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    pool.removeAllJobs (false, -1);
+}
+
+//==============================================================================
+
+
+int WorkerPool::getNumWorkers() const noexcept
+{
+    return numWorkers;
+}
+
+void WorkerPool::parallelFor (int numItems, const std::function<void (int item, int worker)>& function)
+{
+    if (numItems <= 0)
+        return;
+
+    const int numJobs = jmin (numWorkers, numItems);
+
+    // Nothing to gain from a thread hop
+    if (numJobs == 1)
+    {
+        for (int item = 0; item < numItems; ++item)
+            function (item, 0);
+
+        return;
+    }
+
+    std::atomic<int> nextItem (0);
+    std::atomic<int> jobsRemaining (numJobs);
+    WaitableEvent finished;
+
+    for (int worker = 0; worker < numJobs; ++worker)
+    {
+        pool.addJob ([&, worker]
+        {
+            for (int item = nextItem++; item < numItems; item = nextItem++)
+                function (item, worker);
+
+            if (--jobsRemaining == 0)
+                finished.signal();
+        });
+    }
+
+    finished.wait();
+}
+
+void WorkerPool::addJob (std::function<void()> job)
+{
+    pool.addJob (std::move (job));
+}
+
+int WorkerPool::getNumJobs() const noexcept
+{
+    return pool.getNumJobs();
+}
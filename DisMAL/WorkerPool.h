@@ -0,0 +1,60 @@
+/*
+  ==============================================================================
+
+    This file is part of DisMAL (Dissonance Modeling and Analysis Library)
+    Copyright (c) 2019 - Spectral Discord
+    http://spectraldiscord.com
+
+    This program is provided under the terms of GPL v3
+    https://opensource.org/licenses/GPL-3.0
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include "JuceHeader.h"
+
+/** A pool of worker threads for running DisMAL calculations in parallel.
+
+    This wraps a juce::ThreadPool and adds a blocking parallelFor, which splits a range of items between the workers. Each call is told which worker is running it, so that callers can give every worker its own scratch memory or its own clone of a DissonanceModel (models keep intermediate values in member variables, so a model object must never be shared between threads).
+
+    A single pool can be shared by many objects, but parallelFor must not be called from inside a job that is running on the same pool.
+*/
+class WorkerPool
+{
+public:
+    //==============================================================================
+    /** Creates a pool with a number of worker threads.
+
+        @param numWorkers The number of threads to run. By default, this is the number of CPU cores.
+    */
+    explicit WorkerPool (int numWorkers = SystemStats::getNumCpus());
+
+    /** Destructor. Waits for any running jobs to finish. */
+    ~WorkerPool();
+
+    //==============================================================================
+    /** Returns the number of worker threads in the pool. */
+    int getNumWorkers() const noexcept;
+
+    /** Calls a function once for every item in a range, using all workers, and waits until every call has returned.
+
+        @param numItems The number of items. The function is called with every item index in [0, numItems).
+        @param function The function to call. Its second argument is the index of the worker making the call, in [0, getNumWorkers()). No two calls with the same worker index ever run at the same time.
+    */
+    void parallelFor (int numItems, const std::function<void (int item, int worker)>& function);
+
+    /** Runs a function asynchronously on one of the worker threads. */
+    void addJob (std::function<void()> job);
+
+    /** Returns the number of jobs that are running or waiting to run. */
+    int getNumJobs() const noexcept;
+
+private:
+    //==============================================================================
+    ThreadPool pool;
+    int numWorkers;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WorkerPool)
+};